@@ -20,6 +20,8 @@
 #  include "config_win.h"
 #endif
 #include "log.h"
+#include "mutex.h"
+#include "util.h"
 #include "util_linux.h"
 
 typedef struct g_proxy_config_s {
@@ -27,6 +29,11 @@ typedef struct g_proxy_config_s {
     int32_t ref_count;
     // Proxy config interface
     proxy_config_i_s *proxy_config_i;
+    // Config interface is initialized on first use
+    bool is_lazy;
+    // Set once initialization on first use has finished, read without the lock
+    int32_t is_lazy_init_done;
+    void *lazy_init_mutex;
     // Overrides
     bool auto_discover_disable;
     char *auto_config_url;
@@ -36,9 +43,24 @@ typedef struct g_proxy_config_s {
 
 g_proxy_config_s g_proxy_config;
 
+static bool proxy_config_init_interface(void);
+
+// Initialize config interface once, on the first call that needs it
+static void proxy_config_lazy_init(void) {
+    if (!g_proxy_config.is_lazy || ATOMIC_LOAD_ACQUIRE(&g_proxy_config.is_lazy_init_done))
+        return;
+    mutex_lock(g_proxy_config.lazy_init_mutex);
+    if (!g_proxy_config.is_lazy_init_done) {
+        proxy_config_init_interface();
+        ATOMIC_STORE_RELEASE(&g_proxy_config.is_lazy_init_done, 1);
+    }
+    mutex_unlock(g_proxy_config.lazy_init_mutex);
+}
+
 bool proxy_config_get_auto_discover(void) {
     if (g_proxy_config.auto_discover_disable)
         return false;
+    proxy_config_lazy_init();
     if (g_proxy_config.proxy_config_i)
         return g_proxy_config.proxy_config_i->auto_discover();
     return false;
@@ -47,6 +69,7 @@ bool proxy_config_get_auto_discover(void) {
 char *proxy_config_get_auto_config_url(void) {
     if (g_proxy_config.auto_config_url)
         return strdup(g_proxy_config.auto_config_url);
+    proxy_config_lazy_init();
     if (!g_proxy_config.proxy_config_i)
         return NULL;
     return g_proxy_config.proxy_config_i->get_auto_config_url();
@@ -55,6 +78,7 @@ char *proxy_config_get_auto_config_url(void) {
 char *proxy_config_get_proxy(const char *scheme) {
     if (g_proxy_config.proxy)
         return strdup(g_proxy_config.proxy);
+    proxy_config_lazy_init();
     if (!g_proxy_config.proxy_config_i)
         return NULL;
     return g_proxy_config.proxy_config_i->get_proxy(scheme);
@@ -63,6 +87,7 @@ char *proxy_config_get_proxy(const char *scheme) {
 char *proxy_config_get_bypass_list(void) {
     if (g_proxy_config.bypass_list)
         return strdup(g_proxy_config.bypass_list);
+    proxy_config_lazy_init();
     if (!g_proxy_config.proxy_config_i)
         return NULL;
     return g_proxy_config.proxy_config_i->get_bypass_list();
@@ -87,12 +112,7 @@ void proxy_config_set_bypass_list_override(const char *bypass_list) {
     g_proxy_config.bypass_list = bypass_list ? strdup(bypass_list) : NULL;
 }
 
-bool proxy_config_global_init(void) {
-    if (g_proxy_config.ref_count > 0) {
-        g_proxy_config.ref_count++;
-        return true;
-    }
-    memset(&g_proxy_config, 0, sizeof(g_proxy_config));
+static bool proxy_config_init_interface(void) {
 #if defined(__APPLE__)
     if (proxy_config_mac_global_init())
         g_proxy_config.proxy_config_i = proxy_config_mac_get_interface();
@@ -128,6 +148,31 @@ bool proxy_config_global_init(void) {
         log_error("No config interface found");
         return false;
     }
+    return true;
+}
+
+bool proxy_config_global_init(void) {
+    if (g_proxy_config.ref_count > 0) {
+        g_proxy_config.ref_count++;
+        return true;
+    }
+    memset(&g_proxy_config, 0, sizeof(g_proxy_config));
+    if (!proxy_config_init_interface())
+        return false;
+    g_proxy_config.ref_count++;
+    return true;
+}
+
+bool proxy_config_global_init_lazy(void) {
+    if (g_proxy_config.ref_count > 0) {
+        g_proxy_config.ref_count++;
+        return true;
+    }
+    memset(&g_proxy_config, 0, sizeof(g_proxy_config));
+    g_proxy_config.lazy_init_mutex = mutex_create();
+    if (!g_proxy_config.lazy_init_mutex)
+        return false;
+    g_proxy_config.is_lazy = true;
     g_proxy_config.ref_count++;
     return true;
 }
@@ -142,6 +187,8 @@ bool proxy_config_global_cleanup(void) {
 
     if (g_proxy_config.proxy_config_i)
         g_proxy_config.proxy_config_i->global_cleanup();
+    if (g_proxy_config.lazy_init_mutex)
+        mutex_delete(&g_proxy_config.lazy_init_mutex);
 
     memset(&g_proxy_config, 0, sizeof(g_proxy_config));
     return false;
@@ -166,6 +166,19 @@ char *proxy_config_gnome2_get_bypass_list(void) {
 }
 
 bool proxy_config_gnome2_global_init(void) {
+    // Glib functions
+    const dl_symbol_s glib_symbols[] = {
+        {"g_free", (void **)&g_proxy_config_gnome2.g_free},
+        {"g_slist_free_full", (void **)&g_proxy_config_gnome2.g_slist_free_full},
+        {"g_slist_foreach", (void **)&g_proxy_config_gnome2.g_slist_foreach}};
+    // Gconf functions
+    const dl_symbol_s gconf_symbols[] = {
+        {"gconf_engine_get_default", (void **)&g_proxy_config_gnome2.gconf_engine_get_default},
+        {"gconf_engine_get_string", (void **)&g_proxy_config_gnome2.gconf_engine_get_string},
+        {"gconf_engine_get_int", (void **)&g_proxy_config_gnome2.gconf_engine_get_int},
+        {"gconf_engine_get_bool", (void **)&g_proxy_config_gnome2.gconf_engine_get_bool},
+        {"gconf_engine_get_list", (void **)&g_proxy_config_gnome2.gconf_engine_get_list}};
+
     g_proxy_config_gnome2.glib_module = dlopen("libglib-2.0.so.0", RTLD_LAZY | RTLD_LOCAL);
     if (!g_proxy_config_gnome2.glib_module)
         goto gnome2_init_error;
@@ -173,40 +186,11 @@ bool proxy_config_gnome2_global_init(void) {
     if (!g_proxy_config_gnome2.gconf_module)
         goto gnome2_init_error;
 
-    // Glib functions
-    g_proxy_config_gnome2.g_free = (void (*)(gpointer))dlsym(g_proxy_config_gnome2.glib_module, "g_free");
-    if (!g_proxy_config_gnome2.g_free)
-        goto gnome2_init_error;
-    g_proxy_config_gnome2.g_slist_free_full =
-        (void (*)(GSList *, GDestroyNotify))dlsym(g_proxy_config_gnome2.glib_module, "g_slist_free_full");
-    if (!g_proxy_config_gnome2.g_slist_free_full)
-        goto gnome2_init_error;
-    g_proxy_config_gnome2.g_slist_foreach =
-        (void (*)(GSList *, GFunc, gpointer))dlsym(g_proxy_config_gnome2.glib_module, "g_slist_foreach");
-    if (!g_proxy_config_gnome2.g_slist_foreach)
-        goto gnome2_init_error;
-
-    // Gconf functions
-    g_proxy_config_gnome2.gconf_engine_get_default =
-        (GConfEngine * (*)()) dlsym(g_proxy_config_gnome2.gconf_module, "gconf_engine_get_default");
-    if (!g_proxy_config_gnome2.gconf_engine_get_default)
-        goto gnome2_init_error;
-    g_proxy_config_gnome2.gconf_engine_get_string = (gchar * (*)(GConfEngine *, const gchar *, GError **))
-        dlsym(g_proxy_config_gnome2.gconf_module, "gconf_engine_get_string");
-    if (!g_proxy_config_gnome2.gconf_engine_get_string)
-        goto gnome2_init_error;
-    g_proxy_config_gnome2.gconf_engine_get_int = (gint(*)(GConfEngine *, const gchar *, GError **))dlsym(
-        g_proxy_config_gnome2.gconf_module, "gconf_engine_get_int");
-    if (!g_proxy_config_gnome2.gconf_engine_get_int)
-        goto gnome2_init_error;
-    g_proxy_config_gnome2.gconf_engine_get_bool = (gboolean(*)(GConfEngine *, const gchar *, GError **))dlsym(
-        g_proxy_config_gnome2.gconf_module, "gconf_engine_get_bool");
-    if (!g_proxy_config_gnome2.gconf_engine_get_bool)
+    if (!dl_load_symbols(g_proxy_config_gnome2.glib_module, glib_symbols,
+                         sizeof(glib_symbols) / sizeof(glib_symbols[0])))
         goto gnome2_init_error;
-    g_proxy_config_gnome2.gconf_engine_get_list =
-        (GSList * (*)(GConfEngine *, const gchar *, GConfValueType, GError **))
-            dlsym(g_proxy_config_gnome2.gconf_module, "gconf_engine_get_list");
-    if (!g_proxy_config_gnome2.gconf_engine_get_list)
+    if (!dl_load_symbols(g_proxy_config_gnome2.gconf_module, gconf_symbols,
+                         sizeof(gconf_symbols) / sizeof(gconf_symbols[0])))
         goto gnome2_init_error;
 
     // Get default config instance
@@ -154,6 +154,18 @@ char *proxy_config_gnome3_get_bypass_list(void) {
 }
 
 bool proxy_config_gnome3_global_init(void) {
+    // Glib functions
+    const dl_symbol_s glib_symbols[] = {{"g_free", (void **)&g_proxy_config_gnome3.g_free},
+                                        {"g_strfreev", (void **)&g_proxy_config_gnome3.g_strfreev}};
+    // GIO functions
+    const dl_symbol_s gio_symbols[] = {
+        {"g_object_unref", (void **)&g_proxy_config_gnome3.g_object_unref},
+        {"g_settings_new", (void **)&g_proxy_config_gnome3.g_settings_new},
+        {"g_settings_get_string", (void **)&g_proxy_config_gnome3.g_settings_get_string},
+        {"g_settings_get_int", (void **)&g_proxy_config_gnome3.g_settings_get_int},
+        {"g_settings_get_strv", (void **)&g_proxy_config_gnome3.g_settings_get_strv},
+        {"g_settings_get_boolean", (void **)&g_proxy_config_gnome3.g_settings_get_boolean}};
+
     g_proxy_config_gnome3.glib_module = dlopen("libglib-2.0.so.0", RTLD_LAZY | RTLD_LOCAL);
     if (!g_proxy_config_gnome3.glib_module)
         goto gnome3_init_error;
@@ -161,38 +173,10 @@ bool proxy_config_gnome3_global_init(void) {
     if (!g_proxy_config_gnome3.gio_module)
         goto gnome3_init_error;
 
-    // Glib functions
-    g_proxy_config_gnome3.g_free = (void (*)(gpointer))dlsym(g_proxy_config_gnome3.glib_module, "g_free");
-    if (!g_proxy_config_gnome3.g_free)
-        goto gnome3_init_error;
-    g_proxy_config_gnome3.g_strfreev = (void (*)(gchar **))dlsym(g_proxy_config_gnome3.glib_module, "g_strfreev");
-    if (!g_proxy_config_gnome3.g_strfreev)
-        goto gnome3_init_error;
-
-    // GIO functions
-    g_proxy_config_gnome3.g_object_unref =
-        (void (*)(gpointer))dlsym(g_proxy_config_gnome3.gio_module, "g_object_unref");
-    if (!g_proxy_config_gnome3.g_object_unref)
-        goto gnome3_init_error;
-    g_proxy_config_gnome3.g_settings_new =
-        (GSettings * (*)(const gchar *)) dlsym(g_proxy_config_gnome3.gio_module, "g_settings_new");
-    if (!g_proxy_config_gnome3.g_settings_new)
-        goto gnome3_init_error;
-    g_proxy_config_gnome3.g_settings_get_string =
-        (gchar * (*)(GSettings *, const gchar *)) dlsym(g_proxy_config_gnome3.gio_module, "g_settings_get_string");
-    if (!g_proxy_config_gnome3.g_settings_get_string)
-        goto gnome3_init_error;
-    g_proxy_config_gnome3.g_settings_get_int =
-        (gint(*)(GSettings *, const gchar *))dlsym(g_proxy_config_gnome3.gio_module, "g_settings_get_int");
-    if (!g_proxy_config_gnome3.g_settings_get_int)
-        goto gnome3_init_error;
-    g_proxy_config_gnome3.g_settings_get_strv =
-        (gchar * *(*)(GSettings *, const gchar *)) dlsym(g_proxy_config_gnome3.gio_module, "g_settings_get_strv");
-    if (!g_proxy_config_gnome3.g_settings_get_strv)
+    if (!dl_load_symbols(g_proxy_config_gnome3.glib_module, glib_symbols,
+                         sizeof(glib_symbols) / sizeof(glib_symbols[0])))
         goto gnome3_init_error;
-    g_proxy_config_gnome3.g_settings_get_boolean =
-        (gboolean(*)(GSettings *, const gchar *))dlsym(g_proxy_config_gnome3.gio_module, "g_settings_get_boolean");
-    if (!g_proxy_config_gnome3.g_settings_get_boolean)
+    if (!dl_load_symbols(g_proxy_config_gnome3.gio_module, gio_symbols, sizeof(gio_symbols) / sizeof(gio_symbols[0])))
         goto gnome3_init_error;
     return true;
 
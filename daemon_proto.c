@@ -0,0 +1,149 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sys/socket.h>
+
+#include "daemon_proto.h"
+
+#define DAEMON_PROTO_RECV_MIN (4096)
+
+#ifndef MSG_NOSIGNAL
+#  define MSG_NOSIGNAL 0
+#endif
+
+static void daemon_proto_put_u32(uint8_t *buffer, uint32_t value) {
+    buffer[0] = (uint8_t)(value);
+    buffer[1] = (uint8_t)(value >> 8);
+    buffer[2] = (uint8_t)(value >> 16);
+    buffer[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t daemon_proto_get_u32(const uint8_t *buffer) {
+    return (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) | ((uint32_t)buffer[2] << 16) |
+           ((uint32_t)buffer[3] << 24);
+}
+
+// Encode frame into buffer, returns encoded length or zero if it does not fit
+size_t daemon_proto_encode(const daemon_proto_frame_s *frame, uint8_t *buffer, size_t buffer_len) {
+    if (!frame || !buffer || frame->payload_len > DAEMON_PROTO_PAYLOAD_MAX)
+        return 0;
+    const size_t frame_len = DAEMON_PROTO_HEADER_LEN + frame->payload_len;
+    if (frame_len > buffer_len)
+        return 0;
+
+    daemon_proto_put_u32(buffer, frame->payload_len);
+    daemon_proto_put_u32(buffer + 4, frame->id);
+    buffer[8] = (uint8_t)(frame->type);
+    buffer[9] = (uint8_t)(frame->type >> 8);
+    buffer[10] = 0;
+    buffer[11] = 0;
+    daemon_proto_put_u32(buffer + 12, (uint32_t)frame->error);
+    if (frame->payload_len)
+        memcpy(buffer + DAEMON_PROTO_HEADER_LEN, frame->payload, frame->payload_len);
+    return frame_len;
+}
+
+// Decode the next complete frame, returns consumed length, zero if more data is needed or -1 if invalid
+int32_t daemon_proto_decode(const uint8_t *buffer, size_t buffer_len, daemon_proto_frame_s *frame) {
+    if (!buffer || !frame)
+        return -1;
+    if (buffer_len < DAEMON_PROTO_HEADER_LEN)
+        return 0;
+
+    const uint32_t payload_len = daemon_proto_get_u32(buffer);
+    if (payload_len > DAEMON_PROTO_PAYLOAD_MAX)
+        return -1;
+
+    const uint16_t type = (uint16_t)(buffer[8] | (buffer[9] << 8));
+    if (type != DAEMON_PROTO_TYPE_RESOLVE && type != DAEMON_PROTO_TYPE_RESULT)
+        return -1;
+
+    if (buffer_len < DAEMON_PROTO_HEADER_LEN + payload_len)
+        return 0;
+
+    frame->payload_len = payload_len;
+    frame->id = daemon_proto_get_u32(buffer + 4);
+    frame->type = type;
+    frame->error = (int32_t)daemon_proto_get_u32(buffer + 12);
+    frame->payload = (const char *)buffer + DAEMON_PROTO_HEADER_LEN;
+    return (int32_t)(DAEMON_PROTO_HEADER_LEN + payload_len);
+}
+
+// Encode and send a frame on a connected socket
+bool daemon_proto_send(int sfd, const daemon_proto_frame_s *frame) {
+    const size_t buffer_len = DAEMON_PROTO_HEADER_LEN + (frame ? frame->payload_len : 0);
+    uint8_t *buffer = (uint8_t *)malloc(buffer_len);
+    if (!buffer)
+        return false;
+
+    size_t sent = 0;
+    const size_t frame_len = daemon_proto_encode(frame, buffer, buffer_len);
+    while (frame_len && sent < frame_len) {
+        // Peer may disconnect at any time, so do not raise SIGPIPE
+        const ssize_t count = send(sfd, buffer + sent, frame_len - sent, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            break;
+        sent += (size_t)count;
+    }
+
+    free(buffer);
+    return frame_len && sent == frame_len;
+}
+
+// Receive more data from a connected socket, returns false if the connection was closed
+bool daemon_proto_reader_recv(daemon_proto_reader_s *reader, int sfd) {
+    // Move partial frame to the start of the buffer
+    if (reader->offset) {
+        memmove(reader->buffer, reader->buffer + reader->offset, reader->len - reader->offset);
+        reader->len -= reader->offset;
+        reader->offset = 0;
+    }
+
+    // Grow buffer up to the size of the largest frame
+    if (reader->max - reader->len < DAEMON_PROTO_RECV_MIN) {
+        const size_t frame_max = DAEMON_PROTO_HEADER_LEN + DAEMON_PROTO_PAYLOAD_MAX;
+        size_t max = reader->max ? reader->max * 2 : DAEMON_PROTO_RECV_MIN * 2;
+        if (max > frame_max)
+            max = frame_max;
+        if (max > reader->max) {
+            uint8_t *buffer = (uint8_t *)realloc(reader->buffer, max);
+            if (!buffer)
+                return false;
+            reader->buffer = buffer;
+            reader->max = max;
+        }
+    }
+    if (reader->len == reader->max)
+        return false;
+
+    for (;;) {
+        const ssize_t count = recv(sfd, reader->buffer + reader->len, reader->max - reader->len, 0);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        reader->len += (size_t)count;
+        return true;
+    }
+}
+
+// Get the next received frame, valid until the next receive, returns zero if more data is needed or -1 if invalid
+int32_t daemon_proto_reader_next(daemon_proto_reader_s *reader, daemon_proto_frame_s *frame) {
+    if (!reader->buffer)
+        return 0;
+    const int32_t frame_len = daemon_proto_decode(reader->buffer + reader->offset, reader->len - reader->offset, frame);
+    if (frame_len > 0)
+        reader->offset += (size_t)frame_len;
+    return frame_len;
+}
+
+// Free data held by reader
+void daemon_proto_reader_free(daemon_proto_reader_s *reader) {
+    free(reader->buffer);
+    memset(reader, 0, sizeof(daemon_proto_reader_s));
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+// Frames are a fixed size little-endian header followed by the payload:
+//   uint32_t payload length
+//   uint32_t request id chosen by the client and echoed in the result
+//   uint16_t frame type
+//   uint16_t reserved
+//   int32_t  error, zero for requests and successful results
+#define DAEMON_PROTO_HEADER_LEN  (16)
+#define DAEMON_PROTO_PAYLOAD_MAX (65536)
+
+typedef enum daemon_proto_type_enum {
+    // Resolve proxies for the url in the payload
+    DAEMON_PROTO_TYPE_RESOLVE = 1,
+    // Proxy list for a previous request in the payload
+    DAEMON_PROTO_TYPE_RESULT = 2
+} daemon_proto_type_enum;
+
+typedef struct daemon_proto_frame_s {
+    uint32_t id;
+    uint16_t type;
+    int32_t error;
+    // Payload is not null-terminated and points into the decoded buffer
+    const char *payload;
+    uint32_t payload_len;
+} daemon_proto_frame_s;
+
+typedef struct daemon_proto_reader_s {
+    // Received data, frames before offset have already been decoded
+    uint8_t *buffer;
+    size_t offset;
+    size_t len;
+    size_t max;
+} daemon_proto_reader_s;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Encode frame into buffer, returns encoded length or zero if it does not fit
+size_t daemon_proto_encode(const daemon_proto_frame_s *frame, uint8_t *buffer, size_t buffer_len);
+
+// Decode the next complete frame, returns consumed length, zero if more data is needed or -1 if invalid
+int32_t daemon_proto_decode(const uint8_t *buffer, size_t buffer_len, daemon_proto_frame_s *frame);
+
+// Encode and send a frame on a connected socket
+bool daemon_proto_send(int sfd, const daemon_proto_frame_s *frame);
+
+// Receive more data from a connected socket, returns false if the connection was closed
+bool daemon_proto_reader_recv(daemon_proto_reader_s *reader, int sfd);
+
+// Get the next received frame, valid until the next receive, returns zero if more data is needed or -1 if invalid
+int32_t daemon_proto_reader_next(daemon_proto_reader_s *reader, daemon_proto_frame_s *frame);
+
+// Free data held by reader
+void daemon_proto_reader_free(daemon_proto_reader_s *reader);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,343 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <errno.h>
+
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "daemon_proto.h"
+#include "daemon_server.h"
+#include "log.h"
+#include "mutex.h"
+#include "resolver.h"
+#include "threadpool.h"
+#include "util.h"
+
+#define DAEMON_SERVER_BACKLOG         (64)
+#define DAEMON_SERVER_POLL_MS         (250)
+#define DAEMON_SERVER_IDLE_WAIT_MS    (10)
+#define DAEMON_SERVER_MIN_THREADS     (2)
+#define DAEMON_SERVER_MAX_THREADS     (16)
+
+typedef struct daemon_connection_s {
+    struct daemon_server_s *server;
+    int sfd;
+    // Results for pipelined requests are written by many lookups
+    void *write_mutex;
+    // Connection thread and each lookup hold a reference
+    int32_t ref_count;
+    struct daemon_connection_s *next;
+} daemon_connection_s;
+
+typedef struct daemon_server_s {
+    char *socket_path;
+    int listen_sfd;
+    volatile bool stop;
+    // Thread pool running lookups
+    void *threadpool;
+    // Connection list lock
+    void *mutex;
+    daemon_connection_s *connections;
+} daemon_server_s;
+
+typedef struct daemon_lookup_s {
+    daemon_connection_s *connection;
+    uint32_t id;
+    char *url;
+} daemon_lookup_s;
+
+static void daemon_connection_free(daemon_connection_s *connection) {
+    close(connection->sfd);
+    mutex_delete(&connection->write_mutex);
+    free(connection);
+}
+
+static void daemon_connection_release(daemon_connection_s *connection) {
+    daemon_server_s *server = connection->server;
+
+    mutex_lock(server->mutex);
+    const int32_t ref_count = --connection->ref_count;
+    mutex_unlock(server->mutex);
+    if (ref_count == 0)
+        daemon_connection_free(connection);
+}
+
+static void daemon_server_lookup(void *arg) {
+    daemon_lookup_s *lookup = (daemon_lookup_s *)arg;
+    daemon_connection_s *connection = lookup->connection;
+    daemon_proto_frame_s frame = {0};
+
+    frame.id = lookup->id;
+    frame.type = DAEMON_PROTO_TYPE_RESULT;
+
+    // Use the in-process resolver so lookups share its discovery state and caches
+    void *proxy_resolver = proxy_resolver_create();
+    if (!proxy_resolver) {
+        frame.error = ENOMEM;
+    } else if (!proxy_resolver_get_proxies_for_url(proxy_resolver, lookup->url)) {
+        frame.error = proxy_resolver_get_error(proxy_resolver);
+    } else {
+        proxy_resolver_wait(proxy_resolver, -1);
+        const char *list = proxy_resolver_get_list(proxy_resolver);
+        frame.error = proxy_resolver_get_error(proxy_resolver);
+        if (list) {
+            frame.payload = list;
+            frame.payload_len = (uint32_t)strlen(list);
+        }
+    }
+    if (!frame.payload && !frame.error)
+        frame.error = EIO;
+    if (frame.payload_len > DAEMON_PROTO_PAYLOAD_MAX) {
+        frame.error = EMSGSIZE;
+        frame.payload = NULL;
+        frame.payload_len = 0;
+    }
+
+    mutex_lock(connection->write_mutex);
+    if (!daemon_proto_send(connection->sfd, &frame))
+        log_debug("Unable to send result to proxy resolver daemon client (%" PRId32 ")", (int32_t)errno);
+    mutex_unlock(connection->write_mutex);
+
+    proxy_resolver_delete(&proxy_resolver);
+    daemon_connection_release(connection);
+    free(lookup->url);
+    free(lookup);
+}
+
+static bool daemon_server_enqueue_lookup(daemon_connection_s *connection, const daemon_proto_frame_s *frame) {
+    daemon_server_s *server = connection->server;
+
+    daemon_lookup_s *lookup = (daemon_lookup_s *)calloc(1, sizeof(daemon_lookup_s));
+    if (!lookup)
+        return false;
+    lookup->connection = connection;
+    lookup->id = frame->id;
+    lookup->url = (char *)calloc(frame->payload_len + 1, sizeof(char));
+    if (!lookup->url) {
+        free(lookup);
+        return false;
+    }
+    memcpy(lookup->url, frame->payload, frame->payload_len);
+
+    mutex_lock(server->mutex);
+    connection->ref_count++;
+    mutex_unlock(server->mutex);
+
+    if (!threadpool_enqueue(server->threadpool, lookup, daemon_server_lookup)) {
+        daemon_connection_release(connection);
+        free(lookup->url);
+        free(lookup);
+        return false;
+    }
+    return true;
+}
+
+static void *daemon_server_read_requests(void *arg) {
+    daemon_connection_s *connection = (daemon_connection_s *)arg;
+    daemon_server_s *server = connection->server;
+    daemon_proto_reader_s reader = {0};
+    daemon_proto_frame_s frame = {0};
+    bool is_ok = true;
+
+    // Requests are answered as soon as each lookup finishes, without waiting for earlier ones
+    while (is_ok && daemon_proto_reader_recv(&reader, connection->sfd)) {
+        int32_t frame_len = 0;
+        while (is_ok && (frame_len = daemon_proto_reader_next(&reader, &frame)) > 0) {
+            if (frame.type == DAEMON_PROTO_TYPE_RESOLVE)
+                is_ok = daemon_server_enqueue_lookup(connection, &frame);
+        }
+        if (frame_len < 0) {
+            log_warn("Invalid request from proxy resolver daemon client");
+            is_ok = false;
+        }
+    }
+
+    daemon_proto_reader_free(&reader);
+    shutdown(connection->sfd, SHUT_RD);
+
+    // Server may be deleted as soon as the connection is removed from the list
+    mutex_lock(server->mutex);
+    daemon_connection_s **link = &server->connections;
+    while (*link && *link != connection)
+        link = &(*link)->next;
+    if (*link)
+        *link = connection->next;
+    const int32_t ref_count = --connection->ref_count;
+    mutex_unlock(server->mutex);
+
+    if (ref_count == 0)
+        daemon_connection_free(connection);
+    return NULL;
+}
+
+static bool daemon_server_accept(daemon_server_s *server) {
+    int sfd = accept(server->listen_sfd, NULL, NULL);
+    if (sfd < 0)
+        return errno == EINTR || errno == EAGAIN || errno == ECONNABORTED;
+
+    daemon_connection_s *connection = (daemon_connection_s *)calloc(1, sizeof(daemon_connection_s));
+    if (!connection) {
+        close(sfd);
+        return true;
+    }
+    connection->server = server;
+    connection->sfd = sfd;
+    connection->ref_count = 1;
+    connection->write_mutex = mutex_create();
+
+    mutex_lock(server->mutex);
+    connection->next = server->connections;
+    server->connections = connection;
+    mutex_unlock(server->mutex);
+
+    // Each connection is read on its own thread since it stays open for the life of the client
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (!connection->write_mutex || pthread_create(&thread, &attr, daemon_server_read_requests, connection) != 0) {
+        log_error("Unable to create proxy resolver daemon connection thread");
+        mutex_lock(server->mutex);
+        server->connections = connection->next;
+        mutex_unlock(server->mutex);
+        daemon_connection_free(connection);
+    }
+    pthread_attr_destroy(&attr);
+    return true;
+}
+
+// Accept connections and answer lookups until stopped
+bool daemon_server_run(void *ctx) {
+    daemon_server_s *server = (daemon_server_s *)ctx;
+    if (!server)
+        return false;
+
+    log_info("Proxy resolver daemon listening on %s", server->socket_path);
+
+    while (!server->stop) {
+        struct pollfd pfd = {server->listen_sfd, POLLIN, 0};
+        const int count = poll(&pfd, 1, DAEMON_SERVER_POLL_MS);
+        if (count < 0 && errno != EINTR) {
+            log_error("Unable to wait for proxy resolver daemon connections (%" PRId32 ")", (int32_t)errno);
+            return false;
+        }
+        if (count > 0 && !daemon_server_accept(server)) {
+            log_error("Unable to accept proxy resolver daemon connection (%" PRId32 ")", (int32_t)errno);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Stop accepting connections, safe to call from a signal handler
+void daemon_server_stop(void *ctx) {
+    daemon_server_s *server = (daemon_server_s *)ctx;
+    if (server)
+        server->stop = true;
+}
+
+// Listen for lookups from proxy resolver daemon clients on a unix domain socket
+void *daemon_server_create(const char *socket_path) {
+    struct sockaddr_un address = {0};
+
+    if (!socket_path || strlen(socket_path) >= sizeof(address.sun_path)) {
+        log_error("Invalid proxy resolver daemon socket path");
+        return NULL;
+    }
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+
+    daemon_server_s *server = (daemon_server_s *)calloc(1, sizeof(daemon_server_s));
+    if (!server)
+        return NULL;
+    server->listen_sfd = -1;
+    server->socket_path = strdup(socket_path);
+    server->mutex = mutex_create();
+    server->threadpool = threadpool_create(DAEMON_SERVER_MIN_THREADS, DAEMON_SERVER_MAX_THREADS);
+    if (!server->socket_path || !server->mutex || !server->threadpool)
+        goto create_error;
+
+    server->listen_sfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server->listen_sfd < 0) {
+        log_error("Unable to create socket (%" PRId32 ")", (int32_t)errno);
+        goto create_error;
+    }
+
+    // Replace socket left behind by a daemon that is no longer running
+    struct stat st;
+    if (lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        int probe_sfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const bool in_use = probe_sfd >= 0 && connect(probe_sfd, (struct sockaddr *)&address, sizeof(address)) == 0;
+        if (probe_sfd >= 0)
+            close(probe_sfd);
+        if (in_use) {
+            log_error("Proxy resolver daemon already running on %s", socket_path);
+            goto create_error;
+        }
+        unlink(socket_path);
+    }
+
+    if (bind(server->listen_sfd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(server->listen_sfd, DAEMON_SERVER_BACKLOG) != 0) {
+        log_error("Unable to listen on %s (%" PRId32 ")", socket_path, (int32_t)errno);
+        goto create_error;
+    }
+    return server;
+
+create_error:
+    if (server->listen_sfd >= 0)
+        close(server->listen_sfd);
+    server->listen_sfd = -1;
+    daemon_server_delete((void **)&server);
+    return NULL;
+}
+
+// Close all connections and delete server instance
+bool daemon_server_delete(void **ctx) {
+    if (!ctx)
+        return false;
+    daemon_server_s *server = (daemon_server_s *)*ctx;
+    if (!server)
+        return false;
+
+    if (server->listen_sfd >= 0) {
+        close(server->listen_sfd);
+        unlink(server->socket_path);
+    }
+
+    if (server->mutex) {
+        // Wake connection threads and let lookups that are in progress finish
+        mutex_lock(server->mutex);
+        for (daemon_connection_s *connection = server->connections; connection; connection = connection->next)
+            shutdown(connection->sfd, SHUT_RDWR);
+        mutex_unlock(server->mutex);
+
+        // Connection threads are detached, so wait for them to stop queuing lookups
+        for (;;) {
+            mutex_lock(server->mutex);
+            const bool is_idle = server->connections == NULL;
+            mutex_unlock(server->mutex);
+            if (is_idle)
+                break;
+            usleep(DAEMON_SERVER_IDLE_WAIT_MS * 1000);
+        }
+    }
+
+    if (server->threadpool) {
+        threadpool_wait(server->threadpool);
+        threadpool_delete(&server->threadpool);
+    }
+    mutex_delete(&server->mutex);
+    free(server->socket_path);
+    free(server);
+    *ctx = NULL;
+    return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Listen for lookups from proxy resolver daemon clients on a unix domain socket
+void *daemon_server_create(const char *socket_path);
+
+// Accept connections and answer lookups until stopped
+bool daemon_server_run(void *ctx);
+
+// Stop accepting connections, safe to call from a signal handler
+void daemon_server_stop(void *ctx);
+
+// Close all connections and delete server instance
+bool daemon_server_delete(void **ctx);
+
+#ifdef __cplusplus
+}
+#endif
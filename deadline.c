@@ -0,0 +1,38 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "deadline.h"
+#include "util.h"
+
+static THREAD_LOCAL int64_t thread_deadline_ms;
+
+void deadline_set(int64_t deadline_ms) {
+    thread_deadline_ms = deadline_ms;
+}
+
+int64_t deadline_get(void) {
+    return thread_deadline_ms;
+}
+
+bool deadline_is_expired(void) {
+    return thread_deadline_ms && get_monotonic_time_ms() >= thread_deadline_ms;
+}
+
+int64_t deadline_clamp(int64_t deadline_ms) {
+    if (!thread_deadline_ms || thread_deadline_ms > deadline_ms)
+        return deadline_ms;
+    return thread_deadline_ms;
+}
+
+int32_t deadline_clamp_timeout(int32_t timeout_ms) {
+    if (!thread_deadline_ms)
+        return timeout_ms;
+
+    int64_t remaining_ms = thread_deadline_ms - get_monotonic_time_ms();
+    if (remaining_ms < 0)
+        remaining_ms = 0;
+    if (timeout_ms < 0 || remaining_ms < timeout_ms)
+        return (int32_t)(remaining_ms < INT32_MAX ? remaining_ms : INT32_MAX);
+    return timeout_ms;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Set the monotonic time in milliseconds by which work on the calling thread must finish, zero for none
+void deadline_set(int64_t deadline_ms);
+
+// Get the deadline for the calling thread, zero if there is none
+int64_t deadline_get(void);
+
+// Whether the deadline for the calling thread has passed
+bool deadline_is_expired(void);
+
+// Get the earlier of the deadline and the calling thread's deadline
+int64_t deadline_clamp(int64_t deadline_ms);
+
+// Shorten a timeout in milliseconds to the time left before the calling thread's deadline, negative waits forever
+int32_t deadline_clamp_timeout(int32_t timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
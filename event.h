@@ -7,7 +7,10 @@ extern "C" {
 // Sets an event to signalled state.
 bool event_set(void *ctx);
 
-// Waits for an event to be signalled.
+// Sets an event to non-signalled state so it can be reused.
+bool event_reset(void *ctx);
+
+// Waits for an event to be signalled, a negative timeout waits forever.
 bool event_wait(void *ctx, int32_t timeout_ms);
 
 // Creates an event.
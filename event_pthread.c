@@ -2,11 +2,20 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <time.h>
 
 #include <pthread.h>
 
 #include "event.h"
 
+// Clock used for timed waits, macOS condition variables only support the realtime clock
+#ifdef __APPLE__
+#  define EVENT_CLOCK CLOCK_REALTIME
+#else
+#  define EVENT_CLOCK CLOCK_MONOTONIC
+#endif
+
 typedef struct event_s {
     pthread_cond_t cond;
     pthread_mutex_t mutex;
@@ -18,44 +27,74 @@ bool event_set(void *ctx) {
     if (!event)
         return false;
     pthread_mutex_lock(&event->mutex);
-    int32_t err = pthread_cond_signal(&event->cond);
+    // Wake every waiter, more than one thread may be waiting on the same event
+    int32_t err = pthread_cond_broadcast(&event->cond);
     if (err == 0)
         event->signalled = true;
     pthread_mutex_unlock(&event->mutex);
     return err == 0;
 }
 
+bool event_reset(void *ctx) {
+    event_s *event = (event_s *)ctx;
+    if (!event)
+        return false;
+    pthread_mutex_lock(&event->mutex);
+    event->signalled = false;
+    pthread_mutex_unlock(&event->mutex);
+    return true;
+}
+
 bool event_wait(void *ctx, int32_t timeout_ms) {
     event_s *event = (event_s *)ctx;
+    struct timespec deadline = {0};
     int32_t err = 0;
 
     if (!event)
         return false;
 
+    // Timed waits expect an absolute deadline, computed once so wake ups do not extend it
+    if (timeout_ms > 0) {
+        clock_gettime(EVENT_CLOCK, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
     pthread_mutex_lock(&event->mutex);
-    if (!event->signalled) {
-        if (timeout_ms < 0) {
+    // Condition variable may wake up without the event being signalled
+    while (!event->signalled && err == 0) {
+        if (timeout_ms < 0)
             err = pthread_cond_wait(&event->cond, &event->mutex);
-        } else {
-            struct timespec ts;
-
-            ts.tv_sec = timeout_ms / 1000;
-            ts.tv_nsec = (timeout_ms % 1000) * 1000000;
-
-            err = pthread_cond_timedwait(&event->cond, &event->mutex, &ts);
-        }
-        if (err == 0)
-            event->signalled = true;
+        else if (timeout_ms == 0)
+            err = ETIMEDOUT;
+        else
+            err = pthread_cond_timedwait(&event->cond, &event->mutex, &deadline);
     }
+    const bool signalled = event->signalled;
     pthread_mutex_unlock(&event->mutex);
-    return err == 0;
+    return signalled;
 }
 
 void *event_create(void) {
     event_s *event = (event_s *)calloc(1, sizeof(event_s));
     if (!event)
         return NULL;
-    if (pthread_cond_init(&event->cond, NULL)) {
+    pthread_condattr_t attr;
+    if (pthread_condattr_init(&attr)) {
+        free(event);
+        return NULL;
+    }
+#ifndef __APPLE__
+    // Timed waits are not affected by changes to the system time
+    pthread_condattr_setclock(&attr, EVENT_CLOCK);
+#endif
+    const int32_t err = pthread_cond_init(&event->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (err) {
         free(event);
         return NULL;
     }
@@ -15,7 +15,8 @@ bool event_wait(void *ctx, int32_t timeout_ms) {
     event_s *event = (event_s *)ctx;
     if (!event)
         return false;
-    if (WaitForSingleObject(event->handle, timeout_ms ? timeout_ms : INFINITE) != WAIT_OBJECT_0)
+    // Negative timeout waits forever and zero only checks the current state
+    if (WaitForSingleObject(event->handle, timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms) != WAIT_OBJECT_0)
         return false;
     return true;
 }
@@ -27,6 +28,13 @@ bool event_set(void *ctx) {
     return true;
 }
 
+bool event_reset(void *ctx) {
+    event_s *event = (event_s *)ctx;
+    if (!event || !ResetEvent(event->handle))
+        return false;
+    return true;
+}
+
 void *event_create(void) {
     event_s *event = (event_s *)calloc(1, sizeof(event_s));
     if (!event)
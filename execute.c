@@ -5,6 +5,9 @@
 
 #include "execute.h"
 #include "execute_i.h"
+#include "mutex.h"
+#include "trace.h"
+#include "util.h"
 
 #ifdef HAVE_DUKTAPE
 #  include "execute_duktape.h"
@@ -30,14 +33,44 @@ typedef struct g_proxy_execute_s {
     int32_t ref_count;
     // Proxy execute interface
     proxy_execute_i_s *proxy_execute_i;
+    // Execute interface is initialized on first use
+    bool is_lazy;
+    // Set once initialization on first use has finished, read without the lock
+    int32_t is_lazy_init_done;
+    void *lazy_init_mutex;
 } g_proxy_execute_s;
 
 g_proxy_execute_s g_proxy_execute;
 
+static bool proxy_execute_init_interface(void);
+
+// Initialize execute interface once, on the first call that needs it
+static void proxy_execute_lazy_init(void) {
+    if (!g_proxy_execute.is_lazy || ATOMIC_LOAD_ACQUIRE(&g_proxy_execute.is_lazy_init_done))
+        return;
+    mutex_lock(g_proxy_execute.lazy_init_mutex);
+    if (!g_proxy_execute.is_lazy_init_done) {
+        proxy_execute_init_interface();
+        ATOMIC_STORE_RELEASE(&g_proxy_execute.is_lazy_init_done, 1);
+    }
+    mutex_unlock(g_proxy_execute.lazy_init_mutex);
+}
+
+bool proxy_execute_get_proxies_for_script(void *ctx, const pac_script_s *script, const char *url) {
+    if (!g_proxy_execute.proxy_execute_i || !script)
+        return false;
+    trace_begin(TRACE_EVENT_EXECUTE);
+    const bool is_ok = g_proxy_execute.proxy_execute_i->get_proxies_for_url(ctx, script, url);
+    trace_end(TRACE_EVENT_EXECUTE);
+    return is_ok;
+}
+
 bool proxy_execute_get_proxies_for_url(void *ctx, const char *script, const char *url) {
-    if (!g_proxy_execute.proxy_execute_i)
+    pac_script_s pac_script;
+    if (!script)
         return false;
-    return g_proxy_execute.proxy_execute_i->get_proxies_for_url(ctx, script, url);
+    pac_script_init(&pac_script, script);
+    return proxy_execute_get_proxies_for_script(ctx, &pac_script, url);
 }
 
 const char *proxy_execute_get_list(void *ctx) {
@@ -53,6 +86,7 @@ int32_t proxy_execute_get_error(void *ctx) {
 }
 
 void *proxy_execute_create(void) {
+    proxy_execute_lazy_init();
     if (!g_proxy_execute.proxy_execute_i)
         return NULL;
     return g_proxy_execute.proxy_execute_i->create();
@@ -64,12 +98,7 @@ bool proxy_execute_delete(void **ctx) {
     return g_proxy_execute.proxy_execute_i->delete(ctx);
 }
 
-bool proxy_execute_global_init(void) {
-    if (g_proxy_execute.ref_count > 0) {
-        g_proxy_execute.ref_count++;
-        return true;
-    }
-    memset(&g_proxy_execute, 0, sizeof(g_proxy_execute));
+static bool proxy_execute_init_interface(void) {
 #ifdef HAVE_DUKTAPE
     if (proxy_execute_duktape_global_init())
         g_proxy_execute.proxy_execute_i = proxy_execute_duktape_get_interface();
@@ -88,8 +117,31 @@ bool proxy_execute_global_init(void) {
         g_proxy_execute.proxy_execute_i = proxy_execute_jscore_get_interface();
 #  endif
 #endif
-    if (!g_proxy_execute.proxy_execute_i)
+    return g_proxy_execute.proxy_execute_i != NULL;
+}
+
+bool proxy_execute_global_init(void) {
+    if (g_proxy_execute.ref_count > 0) {
+        g_proxy_execute.ref_count++;
+        return true;
+    }
+    memset(&g_proxy_execute, 0, sizeof(g_proxy_execute));
+    if (!proxy_execute_init_interface())
+        return false;
+    g_proxy_execute.ref_count++;
+    return true;
+}
+
+bool proxy_execute_global_init_lazy(void) {
+    if (g_proxy_execute.ref_count > 0) {
+        g_proxy_execute.ref_count++;
+        return true;
+    }
+    memset(&g_proxy_execute, 0, sizeof(g_proxy_execute));
+    g_proxy_execute.lazy_init_mutex = mutex_create();
+    if (!g_proxy_execute.lazy_init_mutex)
         return false;
+    g_proxy_execute.is_lazy = true;
     g_proxy_execute.ref_count++;
     return true;
 }
@@ -99,6 +151,8 @@ bool proxy_execute_global_cleanup(void) {
         return true;
     if (g_proxy_execute.proxy_execute_i)
         g_proxy_execute.proxy_execute_i->global_cleanup();
+    if (g_proxy_execute.lazy_init_mutex)
+        mutex_delete(&g_proxy_execute.lazy_init_mutex);
 
     memset(&g_proxy_execute, 0, sizeof(g_proxy_execute));
     return true;
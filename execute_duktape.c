@@ -1,16 +1,50 @@
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
 
 #include <duktape.h>
 
+#include "deadline.h"
 #include "execute.h"
 #include "execute_i.h"
 #include "execute_duktape.h"
 #include "log.h"
 #include "mozilla_js.h"
+#include "mutex.h"
 #include "net_util.h"
+#include "trace.h"
 #include "util.h"
 
+#ifdef __linux__
+#  include "util_linux.h"
+#endif
+
+// Bytecode caches, one per NUMA node so workers load bytecode from memory local to them
+#define PROXY_EXECUTE_DUKTAPE_CACHE_COUNT (8)
+
+typedef struct proxy_execute_duktape_cache_s {
+    // Bytecode cache lock
+    void *mutex;
+    // Compiled Mozilla PAC utilities
+    uint8_t *mozilla_bytecode;
+    size_t mozilla_bytecode_len;
+    // Compiled PAC script
+    uint8_t *script_bytecode;
+    size_t script_bytecode_len;
+    // Hash and length of the compiled PAC script source
+    uint64_t script_hash;
+    size_t script_len;
+} proxy_execute_duktape_cache_s;
+
+typedef struct g_proxy_execute_duktape_s {
+    proxy_execute_duktape_cache_s caches[PROXY_EXECUTE_DUKTAPE_CACHE_COUNT];
+} g_proxy_execute_duktape_s;
+
+g_proxy_execute_duktape_s g_proxy_execute_duktape;
+
 typedef struct proxy_execute_duktape_s {
     // Execute error
     int32_t error;
@@ -29,6 +63,9 @@ static duk_ret_t proxy_execute_duktape_dns_resolve(duk_context *ctx) {
         return DUK_RET_ERROR;
 
     char *address = dns_resolve(host, NULL);
+    // Abort the script instead of evaluating it with failed host lookups once the deadline passes
+    if (!address && deadline_is_expired())
+        return DUK_RET_RANGE_ERROR;
     duk_push_string(ctx, address ? address : "");
     free(address);
     return 1;
@@ -43,6 +80,9 @@ static duk_ret_t proxy_execute_duktape_dns_resolve_ex(duk_context *ctx) {
         return DUK_RET_ERROR;
 
     char *address = dns_resolve_ex(host, NULL);
+    // Abort the script instead of evaluating it with failed host lookups once the deadline passes
+    if (!address && deadline_is_expired())
+        return DUK_RET_RANGE_ERROR;
     duk_push_string(ctx, address ? address : "");
     free(address);
     return 1;
@@ -62,7 +102,87 @@ static duk_ret_t proxy_execute_duktape_my_ip_address_ex(duk_context *ctx) {
     return 1;
 }
 
-bool proxy_execute_duktape_get_proxies_for_url(void *ctx, const char *script, const char *url) {
+// Compile global code and dump it to a bytecode buffer that can be loaded into any heap, name is used for logging
+static bool proxy_execute_duktape_compile(duk_context *duk_ctx, const char *name, const char *source,
+                                          size_t source_len, uint8_t **bytecode, size_t *bytecode_len) {
+    trace_begin(TRACE_EVENT_COMPILE);
+    const duk_int_t result = duk_pcompile_lstring(duk_ctx, 0, source, source_len);
+    trace_end(TRACE_EVENT_COMPILE);
+    if (result != 0) {
+        log_error("Error compiling %s: %s", name, duk_safe_to_string(duk_ctx, -1));
+        duk_pop(duk_ctx);
+        return false;
+    }
+
+    duk_dump_function(duk_ctx);
+
+    duk_size_t dump_len = 0;
+    const void *dump = duk_get_buffer_data(duk_ctx, -1, &dump_len);
+
+    *bytecode = (uint8_t *)malloc(dump_len);
+    if (*bytecode) {
+        memcpy(*bytecode, dump, dump_len);
+        *bytecode_len = dump_len;
+    } else {
+        log_error("Unable to allocate memory for %s (%" PRId32 ")", "bytecode", ENOMEM);
+    }
+
+    duk_pop(duk_ctx);
+    return *bytecode != NULL;
+}
+
+// Load bytecode buffer into the heap as a function without parsing any source
+static void proxy_execute_duktape_load(duk_context *duk_ctx, const uint8_t *bytecode, size_t bytecode_len) {
+    void *buffer = duk_push_fixed_buffer(duk_ctx, bytecode_len);
+    memcpy(buffer, bytecode, bytecode_len);
+    duk_load_function(duk_ctx);
+}
+
+// Push functions for Mozilla PAC utilities and PAC script, compiling them only if not already cached
+static bool proxy_execute_duktape_push_compiled(duk_context *duk_ctx, const pac_script_s *script) {
+    bool is_ok = false;
+
+#ifdef __linux__
+    proxy_execute_duktape_cache_s *cache =
+        &g_proxy_execute_duktape.caches[get_current_numa_node() % PROXY_EXECUTE_DUKTAPE_CACHE_COUNT];
+#else
+    proxy_execute_duktape_cache_s *cache = &g_proxy_execute_duktape.caches[0];
+#endif
+
+    mutex_lock(cache->mutex);
+
+    // Compile Mozilla's JavaScript PAC utilities once
+    if (!cache->mozilla_bytecode) {
+        if (!proxy_execute_duktape_compile(duk_ctx, "Mozilla PAC JavaScript", MOZILLA_PAC_JAVASCRIPT,
+                                           strlen(MOZILLA_PAC_JAVASCRIPT), &cache->mozilla_bytecode,
+                                           &cache->mozilla_bytecode_len))
+            goto push_done;
+    }
+
+    // Compile PAC script only when it has changed
+    if (!cache->script_bytecode || cache->script_len != script->len || cache->script_hash != script->hash) {
+        free(cache->script_bytecode);
+        cache->script_bytecode = NULL;
+        cache->script_bytecode_len = 0;
+
+        if (!proxy_execute_duktape_compile(duk_ctx, "PAC script", script->text, script->len,
+                                           &cache->script_bytecode, &cache->script_bytecode_len))
+            goto push_done;
+
+        cache->script_hash = script->hash;
+        cache->script_len = script->len;
+    }
+
+    proxy_execute_duktape_load(duk_ctx, cache->mozilla_bytecode, cache->mozilla_bytecode_len);
+    proxy_execute_duktape_load(duk_ctx, cache->script_bytecode, cache->script_bytecode_len);
+    is_ok = true;
+
+push_done:
+    mutex_unlock(cache->mutex);
+    return is_ok;
+}
+
+bool proxy_execute_duktape_get_proxies_for_url(void *ctx, const pac_script_s *script, const char *url) {
     proxy_execute_duktape_s *proxy_execute = (proxy_execute_duktape_s *)ctx;
     if (!proxy_execute || !proxy_execute->ctx)
         return false;
@@ -86,15 +206,21 @@ bool proxy_execute_duktape_get_proxies_for_url(void *ctx, const char *script, co
         duk_put_global_string(duk_ctx, functions[i].name);
     }
 
-    // Load Mozilla's JavaScript PAC utilities to help process PAC files
-    if (duk_peval_string(duk_ctx, MOZILLA_PAC_JAVASCRIPT) != 0) {
+    // Load compiled Mozilla PAC utilities and PAC script
+    if (!proxy_execute_duktape_push_compiled(duk_ctx, script))
+        return false;
+
+    // Run Mozilla's JavaScript PAC utilities to help process PAC files
+    duk_insert(duk_ctx, -2);
+    if (duk_pcall(duk_ctx, 0) != 0) {
         log_error("Failed to parse Mozilla PAC JavaScript");
-        duk_pop(duk_ctx);
+        duk_pop_2(duk_ctx);
         return false;
     }
+    duk_pop(duk_ctx);
 
     // Evaluate the PAC script
-    if (duk_peval_string(duk_ctx, script) != 0) {
+    if (duk_pcall(duk_ctx, 0) != 0) {
         log_error("Error evaluating PAC script: %s", duk_safe_to_string(duk_ctx, -1));
         duk_pop(duk_ctx);
         return false;
@@ -171,10 +297,27 @@ bool proxy_execute_duktape_delete(void **ctx) {
 }
 
 bool proxy_execute_duktape_global_init(void) {
+    memset(&g_proxy_execute_duktape, 0, sizeof(g_proxy_execute_duktape));
+    for (int32_t i = 0; i < PROXY_EXECUTE_DUKTAPE_CACHE_COUNT; i++) {
+        g_proxy_execute_duktape.caches[i].mutex = mutex_create();
+        if (!g_proxy_execute_duktape.caches[i].mutex) {
+            // Delete mutexes that were already created
+            proxy_execute_duktape_global_cleanup();
+            return false;
+        }
+    }
     return true;
 }
 
 bool proxy_execute_duktape_global_cleanup(void) {
+    for (int32_t i = 0; i < PROXY_EXECUTE_DUKTAPE_CACHE_COUNT; i++) {
+        proxy_execute_duktape_cache_s *cache = &g_proxy_execute_duktape.caches[i];
+        free(cache->mozilla_bytecode);
+        free(cache->script_bytecode);
+        mutex_delete(&cache->mutex);
+    }
+
+    memset(&g_proxy_execute_duktape, 0, sizeof(g_proxy_execute_duktape));
     return true;
 }
 
@@ -1,7 +1,9 @@
 #pragma once
 
+#include "pac_script.h"
+
 typedef struct proxy_execute_i_s {
-    bool (*get_proxies_for_url)(void *ctx, const char *script, const char *url);
+    bool (*get_proxies_for_url)(void *ctx, const pac_script_s *script, const char *url);
 
     const char *(*get_list)(void *ctx);
     int32_t (*get_error)(void *ctx);
@@ -16,3 +18,14 @@ typedef struct proxy_execute_i_s {
     bool (*global_init)(void);
     bool (*global_cleanup)(void);
 } proxy_execute_i_s;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Executes a PAC script shared between lookups, without measuring or hashing its text again
+bool proxy_execute_get_proxies_for_script(void *ctx, const pac_script_s *script, const char *url);
+
+#ifdef __cplusplus
+}
+#endif
@@ -17,6 +17,7 @@
 #include "log.h"
 #include "mozilla_js.h"
 #include "net_util.h"
+#include "trace.h"
 #include "util.h"
 
 typedef struct g_proxy_execute_jsc_s {
@@ -91,7 +92,7 @@ static char *proxy_execute_jsc_my_ip_address_ex(void) {
     return my_ip_address_ex();
 }
 
-bool proxy_execute_jsc_get_proxies_for_url(void *ctx, const char *script, const char *url) {
+bool proxy_execute_jsc_get_proxies_for_url(void *ctx, const pac_script_s *script, const char *url) {
     proxy_execute_jsc_s *proxy_execute = (proxy_execute_jsc_s *)ctx;
     JSCContext *global = NULL;
     JSCException *exception = NULL;
@@ -147,7 +148,9 @@ bool proxy_execute_jsc_get_proxies_for_url(void *ctx, const char *script, const
     // Load PAC script
     if (result)
         g_proxy_execute_jsc.g_object_unref(result);
-    result = g_proxy_execute_jsc.jsc_context_evaluate(global, script, -1);
+    trace_begin(TRACE_EVENT_COMPILE);
+    result = g_proxy_execute_jsc.jsc_context_evaluate(global, script->text, -1);
+    trace_end(TRACE_EVENT_COMPILE);
     exception = g_proxy_execute_jsc.jsc_context_get_exception(global);
     if (exception) {
         log_error("Unable to execute PAC script");
@@ -218,6 +221,26 @@ void proxy_execute_jsc_delayed_init(void) {
     const char *library_names[] = {"libjavascriptcoregtk-6.0.so.1", "libjavascriptcoregtk-4.1.so.0",
                                    "libjavascriptcoregtk-4.0.so.18"};
     const size_t library_names_size = sizeof(library_names) / sizeof(library_names[0]);
+    const dl_symbol_s symbols[] = {
+        // GObject functions (loaded as a dependency of the module)
+        {"g_object_unref", (void **)&g_proxy_execute_jsc.g_object_unref},
+        // Context functions
+        {"jsc_context_new", (void **)&g_proxy_execute_jsc.jsc_context_new},
+        {"jsc_context_get_global_object", (void **)&g_proxy_execute_jsc.jsc_context_get_global_object},
+        {"jsc_context_evaluate", (void **)&g_proxy_execute_jsc.jsc_context_evaluate},
+        {"jsc_context_get_exception", (void **)&g_proxy_execute_jsc.jsc_context_get_exception},
+        {"jsc_context_set_value", (void **)&g_proxy_execute_jsc.jsc_context_set_value},
+        // Value functions
+        {"jsc_value_is_string", (void **)&g_proxy_execute_jsc.jsc_value_is_string},
+        {"jsc_value_is_number", (void **)&g_proxy_execute_jsc.jsc_value_is_number},
+        {"jsc_value_is_object", (void **)&g_proxy_execute_jsc.jsc_value_is_object},
+        {"jsc_value_to_double", (void **)&g_proxy_execute_jsc.jsc_value_to_double},
+        {"jsc_value_new_string", (void **)&g_proxy_execute_jsc.jsc_value_new_string},
+        {"jsc_value_to_string", (void **)&g_proxy_execute_jsc.jsc_value_to_string},
+        {"jsc_value_new_function", (void **)&g_proxy_execute_jsc.jsc_value_new_function},
+        {"jsc_value_object_get_property", (void **)&g_proxy_execute_jsc.jsc_value_object_get_property},
+        // Exception functions
+        {"jsc_exception_report", (void **)&g_proxy_execute_jsc.jsc_exception_report}};
 
     // Use existing JavaScriptCoreGTK if already loaded
     struct link_map *map = NULL;
@@ -245,74 +268,13 @@ void proxy_execute_jsc_delayed_init(void) {
     if (!g_proxy_execute_jsc.module)
         return;
 
-    // GObject functions (loaded as a dependency of the module)
-    g_proxy_execute_jsc.g_object_unref = (void (*)(gpointer))dlsym(g_proxy_execute_jsc.module, "g_object_unref");
-    if (!g_proxy_execute_jsc.g_object_unref)
+    if (!dl_load_symbols(g_proxy_execute_jsc.module, symbols, sizeof(symbols) / sizeof(symbols[0])))
         goto jsc_init_error;
 
-    // Context functions
-    g_proxy_execute_jsc.jsc_context_new = (JSCContext * (*)()) dlsym(g_proxy_execute_jsc.module, "jsc_context_new");
-    if (!g_proxy_execute_jsc.jsc_context_new)
-        goto jsc_init_error;
-    g_proxy_execute_jsc.jsc_context_get_global_object =
-        (JSCValue * (*)(JSCContext *)) dlsym(g_proxy_execute_jsc.module, "jsc_context_get_global_object");
-    if (!g_proxy_execute_jsc.jsc_context_get_global_object)
-        goto jsc_init_error;
-    g_proxy_execute_jsc.jsc_context_evaluate =
-        (JSCValue * (*)(JSCContext *, const char *, gssize)) dlsym(g_proxy_execute_jsc.module, "jsc_context_evaluate");
-    if (!g_proxy_execute_jsc.jsc_context_evaluate)
-        goto jsc_init_error;
-    g_proxy_execute_jsc.jsc_context_get_exception =
-        (JSCException * (*)(JSCContext *)) dlsym(g_proxy_execute_jsc.module, "jsc_context_get_exception");
-    if (!g_proxy_execute_jsc.jsc_context_get_exception)
-        goto jsc_init_error;
-    g_proxy_execute_jsc.jsc_context_set_value =
-        (void (*)(JSCContext *, const char *, JSCValue *))dlsym(g_proxy_execute_jsc.module, "jsc_context_set_value");
-    if (!g_proxy_execute_jsc.jsc_context_set_value)
-        goto jsc_init_error;
     // JS_EXPORT_PRIVATE void jscContextGarbageCollect(JSCContext*, bool sanitizeStack = false) is undocumented, may be
     // unavailable, and is not declared with C language linkage.
     g_proxy_execute_jsc.jsc_context_garbage_collect =
         (void (*)(JSCContext *, bool))dlsym(g_proxy_execute_jsc.module, "_Z24jscContextGarbageCollectP11_JSCContextb");
-    // Value functions
-    g_proxy_execute_jsc.jsc_value_is_string =
-        (gboolean(*)(JSCValue *))dlsym(g_proxy_execute_jsc.module, "jsc_value_is_string");
-    if (!g_proxy_execute_jsc.jsc_value_is_string)
-        goto jsc_init_error;
-    g_proxy_execute_jsc.jsc_value_is_number =
-        (gboolean(*)(JSCValue *))dlsym(g_proxy_execute_jsc.module, "jsc_value_is_number");
-    if (!g_proxy_execute_jsc.jsc_value_is_number)
-        goto jsc_init_error;
-    g_proxy_execute_jsc.jsc_value_is_object =
-        (gboolean(*)(JSCValue *))dlsym(g_proxy_execute_jsc.module, "jsc_value_is_object");
-    if (!g_proxy_execute_jsc.jsc_value_is_object)
-        goto jsc_init_error;
-    g_proxy_execute_jsc.jsc_value_to_double =
-        (double (*)(JSCValue *))dlsym(g_proxy_execute_jsc.module, "jsc_value_to_double");
-    if (!g_proxy_execute_jsc.jsc_value_to_double)
-        goto jsc_init_error;
-    g_proxy_execute_jsc.jsc_value_new_string =
-        (JSCValue * (*)(JSCContext *, const char *)) dlsym(g_proxy_execute_jsc.module, "jsc_value_new_string");
-    if (!g_proxy_execute_jsc.jsc_value_new_string)
-        goto jsc_init_error;
-    g_proxy_execute_jsc.jsc_value_to_string =
-        (char *(*)(JSCValue *))dlsym(g_proxy_execute_jsc.module, "jsc_value_to_string");
-    if (!g_proxy_execute_jsc.jsc_value_to_string)
-        goto jsc_init_error;
-    g_proxy_execute_jsc.jsc_value_new_function =
-        (JSCValue * (*)(JSCContext *, const char *, GCallback, gpointer, GDestroyNotify, GType, guint, ...))
-            dlsym(g_proxy_execute_jsc.module, "jsc_value_new_function");
-    if (!g_proxy_execute_jsc.jsc_value_new_function)
-        goto jsc_init_error;
-    g_proxy_execute_jsc.jsc_value_object_get_property =
-        (JSCValue * (*)(JSCValue *, const char *)) dlsym(g_proxy_execute_jsc.module, "jsc_value_object_get_property");
-    if (!g_proxy_execute_jsc.jsc_value_object_get_property)
-        goto jsc_init_error;
-    // Exception functions
-    g_proxy_execute_jsc.jsc_exception_report =
-        (char *(*)(JSCException *))dlsym(g_proxy_execute_jsc.module, "jsc_exception_report");
-    if (!g_proxy_execute_jsc.jsc_exception_report)
-        goto jsc_init_error;
 
     return;
 
@@ -15,6 +15,7 @@
 #include "log.h"
 #include "mozilla_js.h"
 #include "net_util.h"
+#include "trace.h"
 #include "util.h"
 
 typedef struct g_proxy_execute_jscore_s {
@@ -245,7 +246,7 @@ bool proxy_execute_register_function(void *ctx, JSGlobalContextRef global, const
     return true;
 }
 
-bool proxy_execute_jscore_get_proxies_for_url(void *ctx, const char *script, const char *url) {
+bool proxy_execute_jscore_get_proxies_for_url(void *ctx, const pac_script_s *script, const char *url) {
     proxy_execute_jscore_s *proxy_execute = (proxy_execute_jscore_s *)ctx;
     JSGlobalContextRef global = NULL;
     JSValueRef exception = NULL;
@@ -292,8 +293,10 @@ bool proxy_execute_jscore_get_proxies_for_url(void *ctx, const char *script, con
     }
 
     // Load PAC script
-    script_string = g_proxy_execute_jscore.JSStringCreateWithUTF8CString(script);
+    script_string = g_proxy_execute_jscore.JSStringCreateWithUTF8CString(script->text);
+    trace_begin(TRACE_EVENT_COMPILE);
     g_proxy_execute_jscore.JSEvaluateScript(global, script_string, NULL, NULL, 1, &exception);
+    trace_end(TRACE_EVENT_COMPILE);
     g_proxy_execute_jscore.JSStringRelease(script_string);
     if (exception) {
         log_error("Unable to execute PAC script");
@@ -352,6 +355,33 @@ int32_t proxy_execute_jscore_get_error(void *ctx) {
 }
 
 void proxy_execute_jscore_delayed_init(void) {
+    const dl_symbol_s symbols[] = {
+        // Object functions
+        {"JSObjectMakeFunctionWithCallback", (void **)&g_proxy_execute_jscore.JSObjectMakeFunctionWithCallback},
+        {"JSObjectGetProperty", (void **)&g_proxy_execute_jscore.JSObjectGetProperty},
+        {"JSObjectSetProperty", (void **)&g_proxy_execute_jscore.JSObjectSetProperty},
+        // Context functions
+        {"JSContextGetGlobalObject", (void **)&g_proxy_execute_jscore.JSContextGetGlobalObject},
+        // Value functions
+        {"JSValueIsString", (void **)&g_proxy_execute_jscore.JSValueIsString},
+        {"JSValueIsNumber", (void **)&g_proxy_execute_jscore.JSValueIsNumber},
+        {"JSValueToObject", (void **)&g_proxy_execute_jscore.JSValueToObject},
+        {"JSValueToStringCopy", (void **)&g_proxy_execute_jscore.JSValueToStringCopy},
+        {"JSValueToNumber", (void **)&g_proxy_execute_jscore.JSValueToNumber},
+        {"JSValueMakeString", (void **)&g_proxy_execute_jscore.JSValueMakeString},
+        // String functions
+        {"JSStringCreateWithUTF8CString", (void **)&g_proxy_execute_jscore.JSStringCreateWithUTF8CString},
+        {"JSStringGetUTF8CString", (void **)&g_proxy_execute_jscore.JSStringGetUTF8CString},
+        {"JSStringGetMaximumUTF8CStringSize", (void **)&g_proxy_execute_jscore.JSStringGetMaximumUTF8CStringSize},
+        {"JSStringRelease", (void **)&g_proxy_execute_jscore.JSStringRelease},
+        // Global context functions
+        {"JSGlobalContextCreate", (void **)&g_proxy_execute_jscore.JSGlobalContextCreate},
+        {"JSGlobalContextRelease", (void **)&g_proxy_execute_jscore.JSGlobalContextRelease},
+        // Execute functions
+        {"JSEvaluateScript", (void **)&g_proxy_execute_jscore.JSEvaluateScript},
+        // Garbage collection functions
+        {"JSGarbageCollect", (void **)&g_proxy_execute_jscore.JSGarbageCollect}};
+
 #ifdef __APPLE__
     g_proxy_execute_jscore.module = dlopen(
         "/System/Library/Frameworks/JavaScriptCore.framework/Versions/Current/JavaScriptCore", RTLD_LAZY | RTLD_LOCAL);
@@ -387,92 +417,7 @@ void proxy_execute_jscore_delayed_init(void) {
     if (!g_proxy_execute_jscore.module)
         return;
 
-    // Object functions
-    g_proxy_execute_jscore.JSObjectMakeFunctionWithCallback =
-        (JSObjectRef(*)(JSContextRef, JSStringRef, JSObjectCallAsFunctionCallback))dlsym(
-            g_proxy_execute_jscore.module, "JSObjectMakeFunctionWithCallback");
-    if (!g_proxy_execute_jscore.JSObjectMakeFunctionWithCallback)
-        goto jscore_init_error;
-    g_proxy_execute_jscore.JSObjectGetProperty =
-        (JSValueRef(*)(JSContextRef, JSObjectRef, JSStringRef, JSValueRef *))dlsym(g_proxy_execute_jscore.module,
-                                                                                   "JSObjectGetProperty");
-    if (!g_proxy_execute_jscore.JSObjectGetProperty)
-        goto jscore_init_error;
-    g_proxy_execute_jscore.JSObjectSetProperty =
-        (void (*)(JSContextRef, JSObjectRef, JSStringRef, JSValueRef, JSPropertyAttributes, JSValueRef *))dlsym(
-            g_proxy_execute_jscore.module, "JSObjectSetProperty");
-    if (!g_proxy_execute_jscore.JSObjectSetProperty)
-        goto jscore_init_error;
-    // Context functions
-    g_proxy_execute_jscore.JSContextGetGlobalObject =
-        (JSObjectRef(*)(JSContextRef))dlsym(g_proxy_execute_jscore.module, "JSContextGetGlobalObject");
-    if (!g_proxy_execute_jscore.JSContextGetGlobalObject)
-        goto jscore_init_error;
-    // Value functions
-    g_proxy_execute_jscore.JSValueIsString =
-        (bool (*)(JSContextRef, JSValueRef))dlsym(g_proxy_execute_jscore.module, "JSValueIsString");
-    if (!g_proxy_execute_jscore.JSValueIsString)
-        goto jscore_init_error;
-    g_proxy_execute_jscore.JSValueIsNumber =
-        (double (*)(JSContextRef, JSValueRef))dlsym(g_proxy_execute_jscore.module, "JSValueIsNumber");
-    if (!g_proxy_execute_jscore.JSValueIsNumber)
-        goto jscore_init_error;
-    g_proxy_execute_jscore.JSValueToObject =
-        (JSObjectRef(*)(JSContextRef, JSValueRef, JSValueRef *))dlsym(g_proxy_execute_jscore.module, "JSValueToObject");
-    if (!g_proxy_execute_jscore.JSValueToObject)
-        goto jscore_init_error;
-    g_proxy_execute_jscore.JSValueToStringCopy = (JSStringRef(*)(JSContextRef, JSValueRef, JSValueRef *))dlsym(
-        g_proxy_execute_jscore.module, "JSValueToStringCopy");
-    if (!g_proxy_execute_jscore.JSValueToStringCopy)
-        goto jscore_init_error;
-    g_proxy_execute_jscore.JSValueToNumber =
-        (double (*)(JSContextRef, JSValueRef, JSValueRef *))dlsym(g_proxy_execute_jscore.module, "JSValueToNumber");
-    if (!g_proxy_execute_jscore.JSValueToNumber)
-        goto jscore_init_error;
-    g_proxy_execute_jscore.JSValueMakeString =
-        (JSValueRef(*)(JSContextRef, JSStringRef))dlsym(g_proxy_execute_jscore.module, "JSValueMakeString");
-    if (!g_proxy_execute_jscore.JSValueMakeString)
-        goto jscore_init_error;
-    // String functions
-    g_proxy_execute_jscore.JSStringCreateWithUTF8CString =
-        (JSStringRef(*)(const char *))dlsym(g_proxy_execute_jscore.module, "JSStringCreateWithUTF8CString");
-    if (!g_proxy_execute_jscore.JSStringCreateWithUTF8CString)
-        goto jscore_init_error;
-    g_proxy_execute_jscore.JSStringGetUTF8CString =
-        (size_t (*)(JSStringRef, char *, size_t))dlsym(g_proxy_execute_jscore.module, "JSStringGetUTF8CString");
-    if (!g_proxy_execute_jscore.JSStringGetUTF8CString)
-        goto jscore_init_error;
-    g_proxy_execute_jscore.JSStringGetMaximumUTF8CStringSize =
-        (size_t (*)(JSStringRef))dlsym(g_proxy_execute_jscore.module, "JSStringGetMaximumUTF8CStringSize");
-    if (!g_proxy_execute_jscore.JSStringGetMaximumUTF8CStringSize)
-        goto jscore_init_error;
-    g_proxy_execute_jscore.JSStringGetMaximumUTF8CStringSize =
-        (size_t (*)(JSStringRef))dlsym(g_proxy_execute_jscore.module, "JSStringGetMaximumUTF8CStringSize");
-    if (!g_proxy_execute_jscore.JSStringGetMaximumUTF8CStringSize)
-        goto jscore_init_error;
-    g_proxy_execute_jscore.JSStringRelease =
-        (void (*)(JSStringRef))dlsym(g_proxy_execute_jscore.module, "JSStringRelease");
-    if (!g_proxy_execute_jscore.JSStringRelease)
-        goto jscore_init_error;
-    // Global context functions
-    g_proxy_execute_jscore.JSGlobalContextCreate =
-        (JSGlobalContextRef(*)(JSClassRef))dlsym(g_proxy_execute_jscore.module, "JSGlobalContextCreate");
-    if (!g_proxy_execute_jscore.JSGlobalContextCreate)
-        goto jscore_init_error;
-    g_proxy_execute_jscore.JSGlobalContextRelease =
-        (void (*)(JSGlobalContextRef))dlsym(g_proxy_execute_jscore.module, "JSGlobalContextRelease");
-    if (!g_proxy_execute_jscore.JSGlobalContextRelease)
-        goto jscore_init_error;
-    // Execute functions
-    g_proxy_execute_jscore.JSEvaluateScript =
-        (JSValueRef(*)(JSContextRef, JSStringRef, JSObjectRef, JSStringRef, int, JSValueRef *))dlsym(
-            g_proxy_execute_jscore.module, "JSEvaluateScript");
-    if (!g_proxy_execute_jscore.JSEvaluateScript)
-        goto jscore_init_error;
-    // Garbage collection functions
-    g_proxy_execute_jscore.JSGarbageCollect =
-        (void (*)(JSContextRef))dlsym(g_proxy_execute_jscore.module, "JSGarbageCollect");
-    if (!g_proxy_execute_jscore.JSGarbageCollect)
+    if (!dl_load_symbols(g_proxy_execute_jscore.module, symbols, sizeof(symbols) / sizeof(symbols[0])))
         goto jscore_init_error;
 
     return;
@@ -234,7 +234,7 @@ static bool script_engine_delete(proxy_execute_wsh_s *proxy_execute_wsh) {
     return true;
 }
 
-bool proxy_execute_wsh_get_proxies_for_url(void *ctx, const char *script, const char *url) {
+bool proxy_execute_wsh_get_proxies_for_url(void *ctx, const pac_script_s *script, const char *url) {
     proxy_execute_wsh_s *proxy_execute_wsh = (proxy_execute_wsh_s *)ctx;
     bool is_ok = false;
 
@@ -249,7 +249,7 @@ bool proxy_execute_wsh_get_proxies_for_url(void *ctx, const char *script, const
         goto execute_wsh_cleanup;
     }
 
-    if (!script_engine_parse_text(proxy_execute_wsh, script)) {
+    if (!script_engine_parse_text(proxy_execute_wsh, script->text)) {
         log_error("Failed to parse PAC script");
         goto execute_wsh_cleanup;
     }
@@ -4,7 +4,7 @@
 extern "C" {
 #endif
 
-bool proxy_execute_wsh_get_proxies_for_url(void *ctx, const char *script, const char *url);
+bool proxy_execute_wsh_get_proxies_for_url(void *ctx, const pac_script_s *script, const char *url);
 const char *proxy_execute_wsh_get_list(void *ctx);
 int32_t proxy_execute_wsh_get_error(void *ctx);
 
@@ -0,0 +1,132 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef _WIN32
+#  define strncasecmp _strnicmp
+#else
+#  include <strings.h>
+#endif
+
+#include "fetch.h"
+#include "util.h"
+
+static fetch_timeouts_s g_fetch_timeouts = {FETCH_CONNECT_TIMEOUT_MS, FETCH_READ_TIMEOUT_MS, FETCH_TOTAL_TIMEOUT_MS};
+
+// Duplicate header value without surrounding whitespace
+static char *fetch_dup_header_value(const char *value, size_t value_len) {
+    while (value_len && isspace((unsigned char)*value)) {
+        value++;
+        value_len--;
+    }
+    while (value_len && isspace((unsigned char)value[value_len - 1]))
+        value_len--;
+    if (!value_len)
+        return NULL;
+    char *dup = (char *)calloc(value_len + 1, sizeof(char));
+    if (dup)
+        memcpy(dup, value, value_len);
+    return dup;
+}
+
+// Parse max-age directive from Cache-Control header value
+static int32_t fetch_parse_max_age(const char *value, size_t value_len) {
+    // Script must be revalidated before reuse, which the default refresh interval already does with a conditional
+    // request, so do not let it shorten the interval
+    if (str_find_len_case_str(value, value_len, "no-cache") || str_find_len_case_str(value, value_len, "no-store"))
+        return -1;
+
+    const char *max_age = str_find_len_case_str(value, value_len, "max-age=");
+    if (!max_age)
+        return -1;
+    max_age += 8;
+
+    int64_t seconds = 0;
+    const char *value_end = value + value_len;
+    if (max_age >= value_end || !isdigit((unsigned char)*max_age))
+        return -1;
+    while (max_age < value_end && isdigit((unsigned char)*max_age)) {
+        seconds = seconds * 10 + (*max_age - '0');
+        if (seconds > INT32_MAX)
+            return INT32_MAX;
+        max_age++;
+    }
+    return (int32_t)seconds;
+}
+
+// Parse HTTP cache state from a response header line
+bool fetch_cache_parse_header(fetch_cache_s *cache, const char *header, size_t header_len) {
+    static const struct {
+        const char *name;
+        size_t name_len;
+    } names[] = {{"ETag:", 5}, {"Last-Modified:", 14}, {"Cache-Control:", 14}};
+
+    if (!cache || !header)
+        return false;
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (header_len < names[i].name_len || strncasecmp(header, names[i].name, names[i].name_len) != 0)
+            continue;
+
+        const char *value = header + names[i].name_len;
+        const size_t value_len = header_len - names[i].name_len;
+
+        switch (i) {
+        case 0:
+            free(cache->etag);
+            cache->etag = fetch_dup_header_value(value, value_len);
+            break;
+        case 1:
+            free(cache->last_modified);
+            cache->last_modified = fetch_dup_header_value(value, value_len);
+            break;
+        case 2:
+            cache->max_age = fetch_parse_max_age(value, value_len);
+            break;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Replace HTTP cache state with state from a newer response
+void fetch_cache_update(fetch_cache_s *cache, fetch_cache_s *response) {
+    if (!cache || !response)
+        return;
+    if (response->etag) {
+        free(cache->etag);
+        cache->etag = response->etag;
+        response->etag = NULL;
+    }
+    if (response->last_modified) {
+        free(cache->last_modified);
+        cache->last_modified = response->last_modified;
+        response->last_modified = NULL;
+    }
+    cache->max_age = response->max_age;
+}
+
+// Free HTTP cache state
+void fetch_cache_free(fetch_cache_s *cache) {
+    if (!cache)
+        return;
+    free(cache->etag);
+    free(cache->last_modified);
+    memset(cache, 0, sizeof(fetch_cache_s));
+    cache->max_age = -1;
+}
+
+// Set timeouts used for requests, zero or less uses the default timeout
+void fetch_set_timeouts(int32_t connect_ms, int32_t read_ms, int32_t total_ms) {
+    g_fetch_timeouts.connect_ms = connect_ms > 0 ? connect_ms : FETCH_CONNECT_TIMEOUT_MS;
+    g_fetch_timeouts.read_ms = read_ms > 0 ? read_ms : FETCH_READ_TIMEOUT_MS;
+    g_fetch_timeouts.total_ms = total_ms > 0 ? total_ms : FETCH_TOTAL_TIMEOUT_MS;
+}
+
+// Get timeouts used for requests
+void fetch_get_timeouts(fetch_timeouts_s *timeouts) {
+    if (timeouts)
+        *timeouts = g_fetch_timeouts;
+}
@@ -4,9 +4,51 @@
 extern "C" {
 #endif
 
+typedef struct fetch_cache_s {
+    // Entity tag validator returned by the server
+    char *etag;
+    // Last modified validator returned by the server
+    char *last_modified;
+    // Seconds the response may be cached for or -1 to revalidate at the default interval
+    int32_t max_age;
+    // Server responded that the resource has not been modified
+    bool not_modified;
+} fetch_cache_s;
+
+#define FETCH_CONNECT_TIMEOUT_MS (5000)
+#define FETCH_READ_TIMEOUT_MS    (5000)
+#define FETCH_TOTAL_TIMEOUT_MS   (15000)
+
+typedef struct fetch_timeouts_s {
+    // Milliseconds to wait for a connection to be established
+    int32_t connect_ms;
+    // Milliseconds to wait for more data from the server
+    int32_t read_ms;
+    // Milliseconds the whole request may take
+    int32_t total_ms;
+} fetch_timeouts_s;
+
 // Downloads a PAC script
 char *fetch_get(const char *url, int32_t *error);
 
+// Downloads a PAC script only if it has been modified since it was last fetched
+char *fetch_get_ex(const char *url, fetch_cache_s *cache, int32_t *error);
+
+// Parse HTTP cache state from a response header line
+bool fetch_cache_parse_header(fetch_cache_s *cache, const char *header, size_t header_len);
+
+// Replace HTTP cache state with state from a newer response
+void fetch_cache_update(fetch_cache_s *cache, fetch_cache_s *response);
+
+// Free HTTP cache state
+void fetch_cache_free(fetch_cache_s *cache);
+
+// Set timeouts used for requests, zero or less uses the default timeout
+void fetch_set_timeouts(int32_t connect_ms, int32_t read_ms, int32_t total_ms);
+
+// Get timeouts used for requests
+void fetch_get_timeouts(fetch_timeouts_s *timeouts);
+
 // Initialize URL fetching
 bool fetch_global_init(void);
 
@@ -6,11 +6,29 @@
 #include <inttypes.h>
 #include <errno.h>
 
+#include "deadline.h"
+#include "fetch.h"
 #include "log.h"
+#include "mutex.h"
 #include "util.h"
 
 #include "curl/curl.h"
 
+#define FETCH_CURL_POOL_MAX (8)
+#define FETCH_MAX_REDIRECTS (5)
+
+typedef struct g_fetch_curl_s {
+    // Share DNS, connection and TLS session caches between handles
+    CURLSH *share;
+    void *share_locks[CURL_LOCK_DATA_LAST];
+    // Idle easy handles available for reuse
+    void *pool_mutex;
+    CURL *pool[FETCH_CURL_POOL_MAX];
+    int32_t pool_count;
+} g_fetch_curl_s;
+
+static g_fetch_curl_s g_fetch_curl;
+
 typedef struct script_s {
     char *buffer;
     size_t size;
@@ -40,13 +58,105 @@ static size_t fetch_write_script(void *contents, size_t size, size_t nscriptb, v
     return new_size;
 }
 
+static size_t fetch_write_header(char *buffer, size_t size, size_t nitems, void *userp) {
+    fetch_cache_s *response_cache = (fetch_cache_s *)userp;
+    size_t header_len = size * nitems;
+
+    // Reset cache state for each response when following redirects
+    if (header_len > 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        fetch_cache_free(response_cache);
+        return header_len;
+    }
+
+    // Strip line ending from header
+    size_t line_len = header_len;
+    while (line_len && (buffer[line_len - 1] == '\r' || buffer[line_len - 1] == '\n'))
+        line_len--;
+
+    fetch_cache_parse_header(response_cache, buffer, line_len);
+    return header_len;
+}
+
+static struct curl_slist *fetch_append_header(struct curl_slist *headers, const char *name, const char *value) {
+    const size_t header_len = strlen(name) + strlen(value) + 3;
+    char *header = (char *)calloc(header_len, sizeof(char));
+    if (!header)
+        return headers;
+    snprintf(header, header_len, "%s: %s", name, value);
+    struct curl_slist *new_headers = curl_slist_append(headers, header);
+    free(header);
+    return new_headers ? new_headers : headers;
+}
+
+static void fetch_share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userp) {
+    UNUSED(handle);
+    UNUSED(access);
+    UNUSED(userp);
+    if (data < CURL_LOCK_DATA_LAST && g_fetch_curl.share_locks[data])
+        mutex_lock(g_fetch_curl.share_locks[data]);
+}
+
+static void fetch_share_unlock(CURL *handle, curl_lock_data data, void *userp) {
+    UNUSED(handle);
+    UNUSED(userp);
+    if (data < CURL_LOCK_DATA_LAST && g_fetch_curl.share_locks[data])
+        mutex_unlock(g_fetch_curl.share_locks[data]);
+}
+
+// Take an idle handle from the pool or create a new one
+static CURL *fetch_acquire_handle(void) {
+    CURL *curl_handle = NULL;
+
+    if (g_fetch_curl.pool_mutex) {
+        mutex_lock(g_fetch_curl.pool_mutex);
+        if (g_fetch_curl.pool_count > 0)
+            curl_handle = g_fetch_curl.pool[--g_fetch_curl.pool_count];
+        mutex_unlock(g_fetch_curl.pool_mutex);
+    }
+
+    if (!curl_handle)
+        curl_handle = curl_easy_init();
+    if (curl_handle && g_fetch_curl.share)
+        curl_easy_setopt(curl_handle, CURLOPT_SHARE, g_fetch_curl.share);
+    return curl_handle;
+}
+
+// Return handle to the pool so the next fetch can reuse its state
+static void fetch_release_handle(CURL *curl_handle) {
+    // Reset options but keep live connections and caches
+    curl_easy_reset(curl_handle);
+
+    if (g_fetch_curl.pool_mutex) {
+        mutex_lock(g_fetch_curl.pool_mutex);
+        if (g_fetch_curl.pool_count < FETCH_CURL_POOL_MAX) {
+            g_fetch_curl.pool[g_fetch_curl.pool_count++] = curl_handle;
+            curl_handle = NULL;
+        }
+        mutex_unlock(g_fetch_curl.pool_mutex);
+    }
+
+    if (curl_handle)
+        curl_easy_cleanup(curl_handle);
+}
+
 // Fetch proxy auto configuration using CURL
 char *fetch_get(const char *url, int32_t *error) {
+    return fetch_get_ex(url, NULL, error);
+}
+
+// Fetch proxy auto configuration using CURL only if modified since last fetch
+char *fetch_get_ex(const char *url, fetch_cache_s *cache, int32_t *error) {
     script_s script = {(char *)calloc(1, sizeof(char)), 0};
+    fetch_cache_s response_cache = {NULL, NULL, -1, false};
+
+    // Only a response to this request may report the script as not modified
+    if (cache)
+        cache->not_modified = false;
 
-    CURL *curl_handle = curl_easy_init();
+    CURL *curl_handle = fetch_acquire_handle();
     if (!curl_handle) {
         log_error("Unable to initialize curl handle");
+        free(script.buffer);
         return NULL;
     }
 
@@ -56,17 +166,98 @@ char *fetch_get(const char *url, int32_t *error) {
     // Add Accept header with PAC mime-type
     struct curl_slist *headers = NULL;
     headers = curl_slist_append(headers, "Accept: application/x-ns-proxy-autoconfig");
-    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
+
+    // Add validators from previous fetch to make request conditional
+    struct curl_slist *conditional_headers = NULL;
+    conditional_headers = curl_slist_append(conditional_headers, "Accept: application/x-ns-proxy-autoconfig");
+    if (cache && cache->etag)
+        conditional_headers = fetch_append_header(conditional_headers, "If-None-Match", cache->etag);
+    if (cache && cache->last_modified)
+        conditional_headers = fetch_append_header(conditional_headers, "If-Modified-Since", cache->last_modified);
+    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, conditional_headers);
+
+    // Request compressed response using all encodings supported by curl, the
+    // write callback receives decoded data so the script size limit still applies
+    curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING, "");
+
+    // Parse cache validators from response headers
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, fetch_write_header);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void *)&response_cache);
+
+    // Give up on unresponsive servers
+    fetch_timeouts_s timeouts = {0};
+    fetch_get_timeouts(&timeouts);
+    curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT_MS, (long)timeouts.connect_ms);
+    // Transfer must also finish within the time left for the lookup, curl treats zero as no timeout
+    const int32_t total_ms = deadline_clamp_timeout(timeouts.total_ms);
+    curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT_MS, (long)(total_ms > 0 ? total_ms : 1));
+    curl_easy_setopt(curl_handle, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl_handle, CURLOPT_LOW_SPEED_TIME, (long)((timeouts.read_ms + 999) / 1000));
+    curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1L);
 
     // Setup url to fetch
     curl_easy_setopt(curl_handle, CURLOPT_URL, url);
-    curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1L);
 
     // Write to memory buffer callback
     curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, fetch_write_script);
     curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&script);
 
-    CURLcode res = curl_easy_perform(curl_handle);
+    CURLcode res = CURLE_OK;
+    long response_code = 0;
+    for (int32_t redirects = 0;; redirects++) {
+        res = curl_easy_perform(curl_handle);
+        response_code = 0;
+        if (res == CURLE_OK)
+            curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &response_code);
+
+        // Redirect url is only available for redirect responses when curl does not follow them itself
+        char *location = NULL;
+        if (res != CURLE_OK || curl_easy_getinfo(curl_handle, CURLINFO_REDIRECT_URL, &location) != CURLE_OK ||
+            !location)
+            break;
+
+        if (redirects == FETCH_MAX_REDIRECTS) {
+            res = CURLE_TOO_MANY_REDIRECTS;
+            log_error("Too many HTTP redirects (%d)", (int)res);
+            break;
+        }
+
+        location = strdup(location);
+        if (!location) {
+            res = CURLE_OUT_OF_MEMORY;
+            log_error("Unable to allocate memory for %s (%" PRId32 ")", "location", errno);
+            break;
+        }
+
+        // Validators belong to the original url, so only send them with the first request
+        curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(curl_handle, CURLOPT_URL, location);
+        free(location);
+
+        // Discard body of the redirect response
+        script.size = 0;
+        if (script.buffer)
+            script.buffer[0] = 0;
+    }
+
+    if (res == CURLE_OK && cache && response_code == 304) {
+        // Server indicates that cached script is still valid
+        free(script.buffer);
+        script.buffer = NULL;
+        cache->not_modified = true;
+        fetch_cache_update(cache, &response_cache);
+    } else if (res == CURLE_OK && (response_code < 200 || response_code >= 300)) {
+        // Error pages are not scripts, so keep the validators of the script we already have
+        res = CURLE_HTTP_RETURNED_ERROR;
+        log_error("Unexpected HTTP status code %ld (%d)", response_code, (int)res);
+    } else if (res == CURLE_OK && cache) {
+        // Replace cache validators with ones for the new script
+        free(cache->etag);
+        cache->etag = NULL;
+        free(cache->last_modified);
+        cache->last_modified = NULL;
+        fetch_cache_update(cache, &response_cache);
+    }
     if (res != CURLE_OK) {
         free(script.buffer);
         script.buffer = NULL;
@@ -75,8 +266,10 @@ char *fetch_get(const char *url, int32_t *error) {
     if (error)
         *error = res;
 
+    fetch_cache_free(&response_cache);
+    curl_slist_free_all(conditional_headers);
     curl_slist_free_all(headers);
-    curl_easy_cleanup(curl_handle);
+    fetch_release_handle(curl_handle);
     return script.buffer;
 }
 
@@ -86,10 +279,43 @@ bool fetch_global_init(void) {
         log_error("Unable to initialize curl");
         return false;
     }
+
+    memset(&g_fetch_curl, 0, sizeof(g_fetch_curl));
+    g_fetch_curl.pool_mutex = mutex_create();
+
+    // Share caches so that repeated fetches and concurrent probes reuse resolved
+    // addresses, connections and TLS sessions instead of starting from scratch
+    g_fetch_curl.share = curl_share_init();
+    if (g_fetch_curl.share) {
+        const curl_lock_data share_data[] = {CURL_LOCK_DATA_DNS, CURL_LOCK_DATA_SSL_SESSION, CURL_LOCK_DATA_CONNECT};
+        for (size_t i = 0; i < sizeof(share_data) / sizeof(share_data[0]); i++) {
+            g_fetch_curl.share_locks[share_data[i]] = mutex_create();
+            if (curl_share_setopt(g_fetch_curl.share, CURLSHOPT_SHARE, share_data[i]) != CURLSHE_OK)
+                log_debug("Unable to share curl data (%d)", (int)share_data[i]);
+        }
+        // Share lock for the share object itself is required before use
+        g_fetch_curl.share_locks[CURL_LOCK_DATA_SHARE] = mutex_create();
+        curl_share_setopt(g_fetch_curl.share, CURLSHOPT_LOCKFUNC, fetch_share_lock);
+        curl_share_setopt(g_fetch_curl.share, CURLSHOPT_UNLOCKFUNC, fetch_share_unlock);
+    }
     return true;
 }
 
 bool fetch_global_cleanup(void) {
+    for (int32_t i = 0; i < g_fetch_curl.pool_count; i++)
+        curl_easy_cleanup(g_fetch_curl.pool[i]);
+    g_fetch_curl.pool_count = 0;
+
+    if (g_fetch_curl.share)
+        curl_share_cleanup(g_fetch_curl.share);
+    for (int32_t i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        if (g_fetch_curl.share_locks[i])
+            mutex_delete(&g_fetch_curl.share_locks[i]);
+    }
+    if (g_fetch_curl.pool_mutex)
+        mutex_delete(&g_fetch_curl.pool_mutex);
+    memset(&g_fetch_curl, 0, sizeof(g_fetch_curl));
+
     curl_global_cleanup();
     return true;
 }
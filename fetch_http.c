@@ -0,0 +1,570 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <errno.h>
+
+#ifdef HAVE_ZLIB
+#  include <zlib.h>
+#endif
+#ifdef HAVE_BROTLI
+#  include <brotli/decode.h>
+#endif
+
+#ifdef _WIN32
+#  define strncasecmp _strnicmp
+#else
+#  include <strings.h>
+#endif
+
+#include "fetch.h"
+#include "fetch_http.h"
+#include "log.h"
+#include "util.h"
+
+#define FETCH_HTTP_DECODE_CHUNK (16384)
+
+static bool fetch_http_fail(fetch_http_s *http, int32_t error) {
+    http->state = FETCH_HTTP_STATE_ERROR;
+    http->error = error;
+    return false;
+}
+
+// Grow body buffer so that it can hold at least the requested length plus a terminator
+static bool fetch_http_reserve_body(fetch_http_s *http, size_t body_len) {
+    if (body_len > http->max_body_len) {
+        log_error("Response body exceeds maximum (%zu)", http->max_body_len);
+        return fetch_http_fail(http, EFBIG);
+    }
+    if (body_len < http->body_max)
+        return true;
+
+    size_t body_max = http->body_max ? http->body_max : 4096;
+    while (body_max <= body_len)
+        body_max *= 2;
+    if (body_max > http->max_body_len + 1)
+        body_max = http->max_body_len + 1;
+
+    char *body = (char *)realloc(http->body, body_max);
+    if (!body)
+        return fetch_http_fail(http, ENOMEM);
+    http->body = body;
+    http->body_max = body_max;
+    return true;
+}
+
+#if defined(HAVE_ZLIB) || defined(HAVE_BROTLI)
+// Reserve space for the next block of decoded output, limited to the maximum body length
+static bool fetch_http_reserve_decoded(fetch_http_s *http, size_t *avail_out) {
+    size_t reserve_len = http->body_len + FETCH_HTTP_DECODE_CHUNK;
+    if (reserve_len > http->max_body_len)
+        reserve_len = http->max_body_len;
+    if (!fetch_http_reserve_body(http, reserve_len))
+        return false;
+
+    *avail_out = reserve_len - http->body_len;
+    if (*avail_out == 0) {
+        log_error("Response body exceeds maximum (%zu)", http->max_body_len);
+        return fetch_http_fail(http, EFBIG);
+    }
+    return true;
+}
+#endif
+
+#ifdef HAVE_ZLIB
+static bool fetch_http_inflate(fetch_http_s *http, const char *data, size_t data_len) {
+    z_stream *zstream = (z_stream *)http->decoder;
+    if (!zstream) {
+        zstream = (z_stream *)calloc(1, sizeof(z_stream));
+        if (!zstream)
+            return fetch_http_fail(http, ENOMEM);
+        // Automatically detect gzip or zlib header
+        if (inflateInit2(zstream, 15 + 32) != Z_OK) {
+            free(zstream);
+            return fetch_http_fail(http, ENOMEM);
+        }
+        http->decoder = zstream;
+    }
+
+    zstream->next_in = (Bytef *)data;
+    zstream->avail_in = (uInt)data_len;
+
+    // Some servers send raw deflate data without the zlib header, which can only be retried from the start
+    bool can_retry_raw = http->content_encoding == FETCH_HTTP_ENCODING_DEFLATE && zstream->total_in == 0;
+
+    while (zstream->avail_in > 0) {
+        // Limit output to the maximum so the size cap applies to decompressed bytes
+        size_t avail_out = 0;
+        if (!fetch_http_reserve_decoded(http, &avail_out))
+            return false;
+
+        zstream->next_out = (Bytef *)http->body + http->body_len;
+        zstream->avail_out = (uInt)avail_out;
+
+        const int result = inflate(zstream, Z_NO_FLUSH);
+        http->body_len += avail_out - zstream->avail_out;
+
+        if (result == Z_STREAM_END)
+            break;
+        if (result == Z_DATA_ERROR && can_retry_raw && zstream->total_out == 0) {
+            can_retry_raw = false;
+            if (inflateReset2(zstream, -15) != Z_OK)
+                return fetch_http_fail(http, EIO);
+            zstream->next_in = (Bytef *)data;
+            zstream->avail_in = (uInt)data_len;
+            continue;
+        }
+        if (result != Z_OK && result != Z_BUF_ERROR) {
+            log_error("Unable to decompress response body (%d)", result);
+            return fetch_http_fail(http, EIO);
+        }
+    }
+    return true;
+}
+#endif
+
+#ifdef HAVE_BROTLI
+static bool fetch_http_brotli_decompress(fetch_http_s *http, const char *data, size_t data_len) {
+    BrotliDecoderState *state = (BrotliDecoderState *)http->decoder;
+    if (!state) {
+        state = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+        if (!state)
+            return fetch_http_fail(http, ENOMEM);
+        http->decoder = state;
+    }
+
+    const uint8_t *next_in = (const uint8_t *)data;
+    size_t avail_in = data_len;
+
+    while (avail_in > 0 || BrotliDecoderHasMoreOutput(state)) {
+        // Limit output to the maximum so the size cap applies to decompressed bytes
+        size_t avail_out = 0;
+        if (!fetch_http_reserve_decoded(http, &avail_out))
+            return false;
+
+        uint8_t *next_out = (uint8_t *)http->body + http->body_len;
+        const size_t max_out = avail_out;
+
+        const BrotliDecoderResult result =
+            BrotliDecoderDecompressStream(state, &avail_in, &next_in, &avail_out, &next_out, NULL);
+        http->body_len += max_out - avail_out;
+
+        if (result == BROTLI_DECODER_RESULT_SUCCESS || result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT)
+            break;
+        if (result == BROTLI_DECODER_RESULT_ERROR) {
+            log_error("Unable to decompress response body (%s)",
+                      BrotliDecoderErrorString(BrotliDecoderGetErrorCode(state)));
+            return fetch_http_fail(http, EIO);
+        }
+    }
+    return true;
+}
+#endif
+
+// Append received body bytes, decoding them if necessary
+static bool fetch_http_append_body(fetch_http_s *http, const char *data, size_t data_len) {
+    if (!data_len)
+        return true;
+    switch (http->content_encoding) {
+    case FETCH_HTTP_ENCODING_IDENTITY:
+        break;
+#ifdef HAVE_ZLIB
+    case FETCH_HTTP_ENCODING_GZIP:
+    case FETCH_HTTP_ENCODING_DEFLATE:
+        return fetch_http_inflate(http, data, data_len);
+#endif
+#ifdef HAVE_BROTLI
+    case FETCH_HTTP_ENCODING_BROTLI:
+        return fetch_http_brotli_decompress(http, data, data_len);
+#endif
+    default:
+        return fetch_http_fail(http, ENOTSUP);
+    }
+    if (!fetch_http_reserve_body(http, http->body_len + data_len))
+        return false;
+    memcpy(http->body + http->body_len, data, data_len);
+    http->body_len += data_len;
+    return true;
+}
+
+static bool fetch_http_is_encoding_supported(fetch_http_encoding_enum encoding) {
+    switch (encoding) {
+    case FETCH_HTTP_ENCODING_IDENTITY:
+        return true;
+#ifdef HAVE_ZLIB
+    case FETCH_HTTP_ENCODING_GZIP:
+    case FETCH_HTTP_ENCODING_DEFLATE:
+        return true;
+#endif
+#ifdef HAVE_BROTLI
+    case FETCH_HTTP_ENCODING_BROTLI:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+// Accumulate bytes until a complete line is available
+static bool fetch_http_read_line(fetch_http_s *http, const char **data, size_t *data_len, bool *complete) {
+    const char *line_end = str_find_len_char(*data, *data_len, '\n');
+    const size_t consume = line_end ? (size_t)(line_end - *data) + 1 : *data_len;
+
+    if (http->line_len + consume > FETCH_HTTP_LINE_MAX) {
+        log_error("HTTP response line exceeds maximum (%d)", FETCH_HTTP_LINE_MAX);
+        return fetch_http_fail(http, EMSGSIZE);
+    }
+    if (http->line_len + consume + 1 > http->line_max) {
+        size_t line_max = http->line_max ? http->line_max : 256;
+        while (line_max < http->line_len + consume + 1)
+            line_max *= 2;
+        char *line = (char *)realloc(http->line, line_max);
+        if (!line)
+            return fetch_http_fail(http, ENOMEM);
+        http->line = line;
+        http->line_max = line_max;
+    }
+
+    memcpy(http->line + http->line_len, *data, consume);
+    http->line_len += consume;
+    *data += consume;
+    *data_len -= consume;
+
+    *complete = line_end != NULL;
+    if (*complete) {
+        // Strip line ending
+        while (http->line_len && (http->line[http->line_len - 1] == '\n' || http->line[http->line_len - 1] == '\r'))
+            http->line_len--;
+        http->line[http->line_len] = 0;
+    }
+    return true;
+}
+
+static bool fetch_http_parse_status_line(fetch_http_s *http) {
+    const char *line = http->line;
+    if (http->line_len < 12 || strncmp(line, "HTTP/", 5) != 0) {
+        log_error("Invalid HTTP status line");
+        return fetch_http_fail(http, EIO);
+    }
+    const char *status = strchr(line, ' ');
+    if (!status || !isdigit((unsigned char)status[1])) {
+        log_error("Invalid HTTP status line");
+        return fetch_http_fail(http, EIO);
+    }
+    http->status_code = (int32_t)strtol(status + 1, NULL, 10);
+    http->state = FETCH_HTTP_STATE_HEADERS;
+    return true;
+}
+
+static bool fetch_http_parse_header(fetch_http_s *http) {
+    const char *line = http->line;
+    const size_t line_len = http->line_len;
+    const char *value = str_find_len_char(line, line_len, ':');
+    if (!value)
+        return true;
+    value++;
+    while (*value == ' ' || *value == '\t')
+        value++;
+
+    if (strncasecmp(line, "Content-Length:", 15) == 0) {
+        if (!isdigit((unsigned char)*value)) {
+            log_error("Invalid Content-Length header");
+            return fetch_http_fail(http, EIO);
+        }
+        http->content_length = strtoll(value, NULL, 10);
+    } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+        http->chunked = str_find_len_case_str(value, strlen(value), "chunked") != NULL;
+    } else if (strncasecmp(line, "Content-Encoding:", 17) == 0) {
+        if (strncasecmp(value, "gzip", 4) == 0 || strncasecmp(value, "x-gzip", 6) == 0) {
+            http->content_encoding = FETCH_HTTP_ENCODING_GZIP;
+        } else if (strncasecmp(value, "deflate", 7) == 0) {
+            http->content_encoding = FETCH_HTTP_ENCODING_DEFLATE;
+        } else if (strncasecmp(value, "br", 2) == 0) {
+            http->content_encoding = FETCH_HTTP_ENCODING_BROTLI;
+        } else if (*value && strncasecmp(value, "identity", 8) != 0) {
+            log_error("Unsupported Content-Encoding %s", value);
+            return fetch_http_fail(http, ENOTSUP);
+        }
+        if (!fetch_http_is_encoding_supported(http->content_encoding)) {
+            log_error("Unsupported Content-Encoding %s", value);
+            return fetch_http_fail(http, ENOTSUP);
+        }
+    } else if (strncasecmp(line, "Location:", 9) == 0) {
+        free(http->location);
+        http->location = *value ? strdup(value) : NULL;
+    } else {
+        fetch_cache_parse_header(&http->cache, line, line_len);
+    }
+    return true;
+}
+
+// Determine how the response body is delimited once all headers have been received
+static bool fetch_http_begin_body(fetch_http_s *http) {
+    // Skip interim responses
+    if (http->status_code >= 100 && http->status_code < 200) {
+        http->state = FETCH_HTTP_STATE_STATUS_LINE;
+        return true;
+    }
+
+    // Responses without a body
+    if (http->status_code == 204 || http->status_code == 304) {
+        http->state = FETCH_HTTP_STATE_DONE;
+        return true;
+    }
+
+    if (http->chunked) {
+        http->state = FETCH_HTTP_STATE_CHUNK_SIZE;
+        return true;
+    }
+
+    if (http->content_length >= 0) {
+        if ((uint64_t)http->content_length > http->max_body_len) {
+            log_error("Invalid Content-Length header (%" PRId64 ")", http->content_length);
+            return fetch_http_fail(http, EFBIG);
+        }
+        // Allocate uncompressed body at once so it is read in a single pass
+        if (http->content_encoding == FETCH_HTTP_ENCODING_IDENTITY &&
+            !fetch_http_reserve_body(http, (size_t)http->content_length))
+            return false;
+        http->remaining = (uint64_t)http->content_length;
+        http->state = http->remaining ? FETCH_HTTP_STATE_BODY : FETCH_HTTP_STATE_DONE;
+        return true;
+    }
+
+    // Body is delimited by the connection closing
+    http->state = FETCH_HTTP_STATE_BODY;
+    return true;
+}
+
+// Content codings the parser is able to decode, or NULL if none
+const char *fetch_http_accept_encoding(void) {
+#if defined(HAVE_ZLIB) && defined(HAVE_BROTLI)
+    return "gzip, deflate, br";
+#elif defined(HAVE_ZLIB)
+    return "gzip, deflate";
+#elif defined(HAVE_BROTLI)
+    return "br";
+#else
+    return NULL;
+#endif
+}
+
+// Initialize an incremental HTTP response parser
+void fetch_http_init(fetch_http_s *http, size_t max_body_len) {
+    memset(http, 0, sizeof(fetch_http_s));
+    http->state = FETCH_HTTP_STATE_STATUS_LINE;
+    http->content_length = -1;
+    http->cache.max_age = -1;
+    http->max_body_len = max_body_len;
+}
+
+// Parse the next part of an HTTP response as it is received
+bool fetch_http_parse(fetch_http_s *http, const char *data, size_t data_len) {
+    bool complete = false;
+
+    while (data_len > 0) {
+        switch (http->state) {
+        case FETCH_HTTP_STATE_STATUS_LINE:
+        case FETCH_HTTP_STATE_HEADERS:
+        case FETCH_HTTP_STATE_TRAILERS: {
+            const size_t start_len = data_len;
+            if (!fetch_http_read_line(http, &data, &data_len, &complete))
+                return false;
+            http->headers_len += start_len - data_len;
+            if (http->headers_len > FETCH_HTTP_HEADERS_MAX) {
+                log_error("HTTP response headers exceed maximum (%d)", FETCH_HTTP_HEADERS_MAX);
+                return fetch_http_fail(http, EMSGSIZE);
+            }
+            if (!complete)
+                break;
+
+            bool is_ok = true;
+            if (http->state == FETCH_HTTP_STATE_STATUS_LINE) {
+                is_ok = fetch_http_parse_status_line(http);
+            } else if (http->line_len == 0) {
+                // Empty line ends headers or trailers
+                if (http->state == FETCH_HTTP_STATE_HEADERS)
+                    is_ok = fetch_http_begin_body(http);
+                else
+                    http->state = FETCH_HTTP_STATE_DONE;
+            } else if (http->state == FETCH_HTTP_STATE_HEADERS) {
+                is_ok = fetch_http_parse_header(http);
+            }
+            http->line_len = 0;
+            if (!is_ok)
+                return false;
+            break;
+        }
+        case FETCH_HTTP_STATE_CHUNK_SIZE:
+        case FETCH_HTTP_STATE_CHUNK_DATA_END:
+            if (!fetch_http_read_line(http, &data, &data_len, &complete))
+                return false;
+            if (!complete)
+                break;
+
+            if (http->state == FETCH_HTTP_STATE_CHUNK_DATA_END) {
+                if (http->line_len != 0) {
+                    log_error("Invalid HTTP chunk terminator");
+                    return fetch_http_fail(http, EIO);
+                }
+                http->state = FETCH_HTTP_STATE_CHUNK_SIZE;
+            } else {
+                // Chunk size may be followed by extensions
+                if (!isxdigit((unsigned char)*http->line)) {
+                    log_error("Invalid HTTP chunk size");
+                    return fetch_http_fail(http, EIO);
+                }
+                http->remaining = strtoull(http->line, NULL, 16);
+                if (http->remaining > http->max_body_len) {
+                    log_error("Response body exceeds maximum (%zu)", http->max_body_len);
+                    return fetch_http_fail(http, EFBIG);
+                }
+                http->state = http->remaining ? FETCH_HTTP_STATE_CHUNK_DATA : FETCH_HTTP_STATE_TRAILERS;
+            }
+            http->line_len = 0;
+            break;
+        case FETCH_HTTP_STATE_BODY:
+        case FETCH_HTTP_STATE_CHUNK_DATA: {
+            // Body delimited by the connection closing consumes everything
+            size_t body_len = data_len;
+            if (http->chunked || http->content_length >= 0) {
+                if (body_len > http->remaining)
+                    body_len = (size_t)http->remaining;
+                http->remaining -= body_len;
+            }
+
+            if (!fetch_http_append_body(http, data, body_len))
+                return false;
+            data += body_len;
+            data_len -= body_len;
+
+            if ((http->chunked || http->content_length >= 0) && http->remaining == 0) {
+                if (http->state == FETCH_HTTP_STATE_CHUNK_DATA)
+                    http->state = FETCH_HTTP_STATE_CHUNK_DATA_END;
+                else
+                    http->state = FETCH_HTTP_STATE_DONE;
+            }
+            break;
+        }
+        case FETCH_HTTP_STATE_DONE:
+            // Ignore anything sent after the response
+            return true;
+        case FETCH_HTTP_STATE_ERROR:
+            return false;
+        }
+    }
+    return true;
+}
+
+// Notify parser that the connection was closed
+bool fetch_http_finish(fetch_http_s *http) {
+    if (http->state == FETCH_HTTP_STATE_BODY && !http->chunked && http->content_length < 0)
+        http->state = FETCH_HTTP_STATE_DONE;
+    if (http->state == FETCH_HTTP_STATE_DONE)
+        return true;
+    if (http->state != FETCH_HTTP_STATE_ERROR) {
+        log_error("HTTP response ended prematurely");
+        fetch_http_fail(http, EIO);
+    }
+    return false;
+}
+
+// Check whether the response has been completely parsed
+bool fetch_http_is_done(fetch_http_s *http) {
+    return http->state == FETCH_HTTP_STATE_DONE;
+}
+
+// Check whether the response is a redirect with a location
+bool fetch_http_is_redirect(fetch_http_s *http) {
+    switch (http->status_code) {
+    case 301:
+    case 302:
+    case 303:
+    case 307:
+    case 308:
+        return http->location != NULL;
+    }
+    return false;
+}
+
+// Take ownership of the decoded response body
+char *fetch_http_take_body(fetch_http_s *http) {
+    if (!fetch_http_reserve_body(http, http->body_len))
+        return NULL;
+    char *body = http->body;
+    body[http->body_len] = 0;
+    http->body = NULL;
+    http->body_len = 0;
+    http->body_max = 0;
+    return body;
+}
+
+// Free HTTP response parser state
+void fetch_http_free(fetch_http_s *http) {
+    if (http->decoder) {
+        switch (http->content_encoding) {
+#ifdef HAVE_ZLIB
+        case FETCH_HTTP_ENCODING_GZIP:
+        case FETCH_HTTP_ENCODING_DEFLATE:
+            inflateEnd((z_stream *)http->decoder);
+            free(http->decoder);
+            break;
+#endif
+#ifdef HAVE_BROTLI
+        case FETCH_HTTP_ENCODING_BROTLI:
+            BrotliDecoderDestroyInstance((BrotliDecoderState *)http->decoder);
+            break;
+#endif
+        default:
+            break;
+        }
+    }
+    fetch_cache_free(&http->cache);
+    free(http->location);
+    free(http->line);
+    free(http->body);
+    memset(http, 0, sizeof(fetch_http_s));
+}
+
+// Resolve redirect location against the url that was requested
+char *fetch_http_resolve_location(const char *url, const char *location) {
+    if (!url || !location)
+        return NULL;
+
+    // Absolute location
+    if (strstr(location, "://"))
+        return strdup(location);
+
+    char *scheme = get_url_scheme(url, "http");
+    char *host = get_url_host(url);
+    char *resolved = NULL;
+
+    if (scheme && host) {
+        if (location[0] == '/' && location[1] == '/') {
+            // Network-path reference
+            resolved = (char *)calloc(strlen(scheme) + strlen(location) + 2, sizeof(char));
+            if (resolved)
+                sprintf(resolved, "%s:%s", scheme, location);
+        } else if (location[0] == '/') {
+            // Absolute-path reference
+            resolved = (char *)calloc(strlen(scheme) + strlen(host) + strlen(location) + 4, sizeof(char));
+            if (resolved)
+                sprintf(resolved, "%s://%s%s", scheme, host, location);
+        } else {
+            // Relative-path reference replaces the last path segment
+            const char *path = get_url_path(url);
+            const char *path_end = path ? strrchr(path, '/') : NULL;
+            const size_t path_len = path_end ? (size_t)(path_end - path) : 0;
+            resolved = (char *)calloc(strlen(scheme) + strlen(host) + path_len + strlen(location) + 5, sizeof(char));
+            if (resolved)
+                sprintf(resolved, "%s://%s%.*s/%s", scheme, host, (int)path_len, path ? path : "", location);
+        }
+    }
+
+    free(scheme);
+    free(host);
+    return resolved;
+}
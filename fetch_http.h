@@ -0,0 +1,93 @@
+#pragma once
+
+#include "fetch.h"
+
+#define FETCH_HTTP_LINE_MAX    (8192)
+#define FETCH_HTTP_HEADERS_MAX (65536)
+
+typedef enum fetch_http_state_enum {
+    FETCH_HTTP_STATE_STATUS_LINE,
+    FETCH_HTTP_STATE_HEADERS,
+    FETCH_HTTP_STATE_BODY,
+    FETCH_HTTP_STATE_CHUNK_SIZE,
+    FETCH_HTTP_STATE_CHUNK_DATA,
+    FETCH_HTTP_STATE_CHUNK_DATA_END,
+    FETCH_HTTP_STATE_TRAILERS,
+    FETCH_HTTP_STATE_DONE,
+    FETCH_HTTP_STATE_ERROR
+} fetch_http_state_enum;
+
+typedef enum fetch_http_encoding_enum {
+    FETCH_HTTP_ENCODING_IDENTITY,
+    FETCH_HTTP_ENCODING_GZIP,
+    FETCH_HTTP_ENCODING_DEFLATE,
+    FETCH_HTTP_ENCODING_BROTLI
+} fetch_http_encoding_enum;
+
+typedef struct fetch_http_s {
+    fetch_http_state_enum state;
+    // Last error while parsing
+    int32_t error;
+    // Response status code
+    int32_t status_code;
+    // Partial line carried over between reads
+    char *line;
+    size_t line_len;
+    size_t line_max;
+    // Number of header bytes received
+    size_t headers_len;
+    // Response body is sent in chunks
+    bool chunked;
+    // Response body length or -1 if delimited by the connection closing
+    int64_t content_length;
+    // Bytes remaining in the body or current chunk
+    uint64_t remaining;
+    fetch_http_encoding_enum content_encoding;
+    // Redirect location
+    char *location;
+    // HTTP cache state of the response
+    fetch_cache_s cache;
+    // Decoded response body
+    char *body;
+    size_t body_len;
+    size_t body_max;
+    // Maximum decoded body length
+    size_t max_body_len;
+    // Decompression stream state
+    void *decoder;
+} fetch_http_s;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Content codings the parser is able to decode, or NULL if none
+const char *fetch_http_accept_encoding(void);
+
+// Initialize an incremental HTTP response parser
+void fetch_http_init(fetch_http_s *http, size_t max_body_len);
+
+// Parse the next part of an HTTP response as it is received
+bool fetch_http_parse(fetch_http_s *http, const char *data, size_t data_len);
+
+// Notify parser that the connection was closed
+bool fetch_http_finish(fetch_http_s *http);
+
+// Check whether the response has been completely parsed
+bool fetch_http_is_done(fetch_http_s *http);
+
+// Check whether the response is a redirect with a location
+bool fetch_http_is_redirect(fetch_http_s *http);
+
+// Take ownership of the decoded response body
+char *fetch_http_take_body(fetch_http_s *http);
+
+// Free HTTP response parser state
+void fetch_http_free(fetch_http_s *http);
+
+// Resolve redirect location against the url that was requested
+char *fetch_http_resolve_location(const char *url, const char *location);
+
+#ifdef __cplusplus
+}
+#endif
@@ -16,46 +16,241 @@
 #  include <winsock2.h>
 #  include <ws2tcpip.h>
 #else
+#  include <fcntl.h>
+#  include <poll.h>
 #  include <sys/types.h>
 #  include <sys/socket.h>
 #  include <unistd.h>
 #endif
 
 #ifdef _WIN32
-#  define socketerr WSAGetLastError()
-#  define ssize_t   int
+#  define socketerr          WSAGetLastError()
+#  define ssize_t            int
+#  define nfds_t             ULONG
+#  define poll               WSAPoll
+#  define SOCKET_EINPROGRESS WSAEWOULDBLOCK
+#  define SOCKET_EWOULDBLOCK WSAEWOULDBLOCK
 #else
-#  define socketerr   errno
-#  define SOCKET      int
-#  define closesocket close
+#  define socketerr          errno
+#  define SOCKET             int
+#  define closesocket        close
+#  define SOCKET_EINPROGRESS EINPROGRESS
+#  define SOCKET_EWOULDBLOCK EWOULDBLOCK
 #endif
 
+#include "deadline.h"
+#include "fetch.h"
+#include "fetch_http.h"
 #include "log.h"
 #include "util.h"
 
-// Fetch proxy auto configuration using HTTP only
-char *fetch_get(const char *url, int32_t *error) {
+#define HTTP_NOT_MODIFIED (304)
+
+// Delay before racing a connection to the next address (RFC 8305)
+#define FETCH_CONNECT_ATTEMPT_DELAY_MS (250)
+#define FETCH_MAX_CONNECT_ATTEMPTS     (16)
+#define FETCH_MAX_REDIRECTS            (5)
+
+static bool fetch_set_nonblocking(SOCKET sfd) {
+#ifdef _WIN32
+    u_long non_blocking = 1;
+    return ioctlsocket(sfd, FIONBIO, &non_blocking) == 0;
+#else
+    const int flags = fcntl(sfd, F_GETFL, 0);
+    return flags != -1 && fcntl(sfd, F_SETFL, flags | O_NONBLOCK) != -1;
+#endif
+}
+
+// Milliseconds until the earliest of two deadlines
+static int fetch_get_wait_ms(int64_t deadline, int64_t other_deadline) {
+    const int64_t now = get_monotonic_time_ms();
+    const int64_t until = deadline < other_deadline ? deadline : other_deadline;
+    return until > now ? (int)(until - now) : 0;
+}
+
+// Wait for socket to become ready for reading or writing
+static int32_t fetch_wait_socket(SOCKET sfd, short events, int64_t deadline, int64_t other_deadline) {
+    struct pollfd fd = {0};
+    fd.fd = sfd;
+    fd.events = events;
+
+    while (true) {
+        const int wait_ms = fetch_get_wait_ms(deadline, other_deadline);
+        if (wait_ms <= 0)
+            return ETIMEDOUT;
+        const int result = poll(&fd, 1, wait_ms);
+        if (result > 0)
+            return 0;
+        if (result == 0)
+            return ETIMEDOUT;
+        if (socketerr != EINTR)
+            return socketerr;
+    }
+}
+
+// Order addresses so that address families alternate, starting with the preferred family (RFC 8305)
+static int32_t fetch_sort_addresses(struct addrinfo *address_info, struct addrinfo **addresses, int32_t max_addresses) {
+    int32_t count = 0;
+
+    if (!address_info)
+        return 0;
+
+    const int preferred_family = address_info->ai_family;
+    struct addrinfo *preferred = address_info;
+    struct addrinfo *other = address_info;
+
+    while (count < max_addresses && (preferred || other)) {
+        while (preferred && preferred->ai_family != preferred_family)
+            preferred = preferred->ai_next;
+        if (preferred) {
+            addresses[count++] = preferred;
+            preferred = preferred->ai_next;
+        }
+        while (other && other->ai_family == preferred_family)
+            other = other->ai_next;
+        if (other && count < max_addresses) {
+            addresses[count++] = other;
+            other = other->ai_next;
+        }
+    }
+    return count;
+}
+
+// Connect to the first address that answers, starting a new attempt whenever the previous one is slow
+static SOCKET fetch_connect(struct addrinfo *address_info, int64_t deadline, int32_t *error) {
+    struct addrinfo *addresses[FETCH_MAX_CONNECT_ATTEMPTS];
+    struct pollfd fds[FETCH_MAX_CONNECT_ATTEMPTS];
+    SOCKET sfd = (SOCKET)-1;
+    int32_t num_addresses = fetch_sort_addresses(address_info, addresses, FETCH_MAX_CONNECT_ATTEMPTS);
+    int32_t next_address = 0;
+    int32_t num_fds = 0;
+    int64_t next_attempt = 0;
+
+    *error = ECONNREFUSED;
+
+    while (sfd == (SOCKET)-1) {
+        // Start next connection attempt if the previous attempts are taking too long or have all failed
+        if (next_address < num_addresses && (get_monotonic_time_ms() >= next_attempt || num_fds == 0)) {
+            struct addrinfo *address = addresses[next_address++];
+            SOCKET attempt = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if ((int)attempt == -1 || !fetch_set_nonblocking(attempt)) {
+                *error = socketerr;
+                if ((int)attempt != -1)
+                    closesocket(attempt);
+                continue;
+            }
+            if (connect(attempt, address->ai_addr, (int)address->ai_addrlen) != 0 && socketerr != SOCKET_EINPROGRESS) {
+                *error = socketerr;
+                closesocket(attempt);
+                continue;
+            }
+            fds[num_fds].fd = attempt;
+            fds[num_fds].events = POLLOUT;
+            fds[num_fds].revents = 0;
+            num_fds++;
+            next_attempt = get_monotonic_time_ms() + FETCH_CONNECT_ATTEMPT_DELAY_MS;
+        }
+
+        if (num_fds == 0)
+            break;
+
+        const int wait_ms = fetch_get_wait_ms(deadline, next_address < num_addresses ? next_attempt : deadline);
+        if (wait_ms <= 0 && get_monotonic_time_ms() >= deadline) {
+            *error = ETIMEDOUT;
+            break;
+        }
+
+        const int result = poll(fds, (nfds_t)num_fds, wait_ms);
+        if (result < 0 && socketerr != EINTR) {
+            *error = socketerr;
+            break;
+        }
+
+        for (int32_t i = num_fds - 1; result > 0 && i >= 0; i--) {
+            if (!fds[i].revents)
+                continue;
+
+            // Check whether the connection attempt succeeded
+            int so_error = 0;
+            socklen_t so_error_len = sizeof(so_error);
+            if (getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, (char *)&so_error, &so_error_len) != 0)
+                so_error = socketerr;
+
+            if (so_error == 0 && sfd == (SOCKET)-1) {
+                sfd = fds[i].fd;
+            } else {
+                if (so_error != 0)
+                    *error = so_error;
+                closesocket(fds[i].fd);
+            }
+            fds[i] = fds[--num_fds];
+        }
+    }
+
+    // Cancel connection attempts that lost the race
+    for (int32_t i = 0; i < num_fds; i++)
+        closesocket(fds[i].fd);
+
+    if (sfd != (SOCKET)-1)
+        *error = 0;
+    return sfd;
+}
+
+// Send all data before the deadline
+static int32_t fetch_send(SOCKET sfd, const char *data, size_t data_len, int64_t deadline) {
+    while (data_len > 0) {
+        const ssize_t count = send(sfd, data, (int)data_len, 0);
+        if (count < 0) {
+            const int32_t err = socketerr;
+            if (err != SOCKET_EWOULDBLOCK && err != EAGAIN && err != EINTR)
+                return err;
+            const int32_t wait_err = fetch_wait_socket(sfd, POLLOUT, deadline, deadline);
+            if (wait_err != 0)
+                return wait_err;
+            continue;
+        }
+        data += count;
+        data_len -= (size_t)count;
+    }
+    return 0;
+}
+
+// Receive available data waiting no longer than the read timeout and deadline, returns zero when the
+// connection is closed
+static ssize_t fetch_recv(SOCKET sfd, char *buffer, size_t buffer_len, int32_t read_ms, int64_t deadline,
+                          int32_t *error) {
+    while (true) {
+        const ssize_t count = recv(sfd, buffer, (int)buffer_len, 0);
+        if (count >= 0)
+            return count;
+        const int32_t err = socketerr;
+        if (err != SOCKET_EWOULDBLOCK && err != EAGAIN && err != EINTR) {
+            *error = err;
+            return -1;
+        }
+        *error = fetch_wait_socket(sfd, POLLIN, deadline, get_monotonic_time_ms() + read_ms);
+        if (*error != 0)
+            return -1;
+    }
+}
+
+// Send a single HTTP request and parse the response
+static int32_t fetch_request(const char *url, fetch_cache_s *cache, fetch_http_s *http,
+                             const fetch_timeouts_s *timeouts, int64_t deadline) {
     const int32_t socktype = SOCK_STREAM;
     const int32_t protocol = IPPROTO_TCP;
 
     struct addrinfo hints = {0};
     struct addrinfo *address_info = NULL;
-    struct sockaddr *addr = NULL;
-    socklen_t addrlen = 0;
     SOCKET sfd = -1;
-    char *body = NULL;
     char *host = NULL;
     int32_t err = 0;
-    ssize_t count = 0;
-
-    if (!url)
-        return NULL;
 
     // Check to make sure we are only using http:// urls
     if (strstr(url, "https://")) {
         err = ENOTSUP;
         log_error("HTTPS not supported (%" PRId32 ")", err);
-        goto download_cleanup;
+        goto request_cleanup;
     }
 
     // Parse host name from url
@@ -63,7 +258,7 @@ char *fetch_get(const char *url, int32_t *error) {
     if (!host) {
         err = EADDRNOTAVAIL;
         log_error("Unable to parse URL host (%" PRId32 ")", err);
-        goto download_cleanup;
+        goto request_cleanup;
     }
 
     // Parse port name from host
@@ -75,6 +270,13 @@ char *fetch_get(const char *url, int32_t *error) {
         port = "http";
     }
 
+    // Host name resolution can not be interrupted, so skip it when there is no time left
+    if (get_monotonic_time_ms() >= deadline) {
+        err = ETIMEDOUT;
+        log_debug("Timed out before resolving host %s", host);
+        goto request_cleanup;
+    }
+
     // Attempt to resolve the host name
     hints.ai_family = AF_UNSPEC;
     hints.ai_socktype = socktype;
@@ -84,116 +286,176 @@ char *fetch_get(const char *url, int32_t *error) {
     if (err != 0) {
         err = socketerr;
         log_debug("Unable to resolve host %s (%" PRId32 ")", host, err);
-        goto download_cleanup;
+        goto request_cleanup;
     }
 
-    addr = address_info->ai_addr;
-    addrlen = address_info->ai_addrlen;
-
-    // Create communication socket
-    sfd = socket(addr->sa_family, socktype, protocol);
+    // Connect to any of the remote addresses
+    const int64_t connect_deadline = get_monotonic_time_ms() + timeouts->connect_ms;
+    sfd = fetch_connect(address_info, connect_deadline < deadline ? connect_deadline : deadline, &err);
     if ((int)sfd == -1) {
-        err = socketerr;
-        log_error("Unable to create socket (%" PRId32 ")", err);
-        goto download_cleanup;
-    }
-
-    // Connect to remote address
-    err = connect(sfd, addr, addrlen);
-    if (err != 0) {
-        err = socketerr;
         log_debug("Unable to connect to host %s (%" PRId32 ")", host, err);
-        goto download_cleanup;
+        goto request_cleanup;
     }
 
-    // Create http request using bare-minimum headers
-    char request[512];
-    snprintf(request, sizeof(request),
-             "GET %s HTTP/1.0\r\n"
-             "Host: %s\r\n"
-             "Accept: application/x-ns-proxy-autoconfig\r\n"
-             "Connection: close\r\n"
-             "\r\n",
-             get_url_path(url), host);
+    // Create http request using bare-minimum headers and validators from previous fetch, asking
+    // for a compressed response when the parser is able to decode it
+    const char *accept_encoding = fetch_http_accept_encoding();
+    char request[1024];
+    int32_t request_len = snprintf(request, sizeof(request),
+                                   "GET %s HTTP/1.1\r\n"
+                                   "Host: %s\r\n"
+                                   "Accept: application/x-ns-proxy-autoconfig\r\n"
+                                   "%s%s%s"
+                                   "%s%s%s"
+                                   "%s%s%s"
+                                   "Connection: close\r\n"
+                                   "\r\n",
+                                   get_url_path(url), host, accept_encoding ? "Accept-Encoding: " : "",
+                                   accept_encoding ? accept_encoding : "", accept_encoding ? "\r\n" : "",
+                                   cache && cache->etag ? "If-None-Match: " : "",
+                                   cache && cache->etag ? cache->etag : "", cache && cache->etag ? "\r\n" : "",
+                                   cache && cache->last_modified ? "If-Modified-Since: " : "",
+                                   cache && cache->last_modified ? cache->last_modified : "",
+                                   cache && cache->last_modified ? "\r\n" : "");
+    if (request_len < 0 || request_len >= (int32_t)sizeof(request)) {
+        err = EMSGSIZE;
+        log_error("Unable to create HTTP request (%" PRId32 ")", err);
+        goto request_cleanup;
+    }
 
     // Send request
-    size_t written = send(sfd, request, (int)strlen(request), 0);
-    if (written != strlen(request)) {
-        err = socketerr;
+    err = fetch_send(sfd, request, (size_t)request_len, deadline);
+    if (err != 0) {
         log_error("Unable to send HTTP request (%" PRId32 ")", err);
-        goto download_cleanup;
+        goto request_cleanup;
     }
 
-    char response[1024];
-    int32_t response_len = 0;
-    do {
-        count = recv(sfd, response + response_len, sizeof(response) - response_len, 0);
-        if (count <= 0)
+    // Parse response as it arrives
+    char buffer[4096];
+    while (!fetch_http_is_done(http)) {
+        const ssize_t count = fetch_recv(sfd, buffer, sizeof(buffer), timeouts->read_ms, deadline, &err);
+        if (count < 0) {
+            log_error("Unable to read HTTP response (%" PRId32 ")", err);
+            goto request_cleanup;
+        }
+        if (count == 0) {
+            if (!fetch_http_finish(http))
+                err = http->error;
             break;
-        response_len += count;
-        if (response_len == sizeof(response))
+        }
+        if (!fetch_http_parse(http, buffer, (size_t)count)) {
+            err = http->error;
             break;
-    } while (true);
+        }
+    }
 
-    // Find the content length header
-    const char *content_length_header = str_find_len_case_str(response, response_len, "Content-Length: ");
-    if (!content_length_header) {
-        err = EIO;
-        log_error("Unable to find Content-Length header (%" PRId32 ")", err);
-        goto download_cleanup;
+request_cleanup:
+    if (address_info)
+        freeaddrinfo(address_info);
+    if (sfd != -1)
+        closesocket(sfd);
+
+    free(host);
+    return err;
+}
+
+// Fetch proxy auto configuration using HTTP only
+char *fetch_get(const char *url, int32_t *error) {
+    return fetch_get_ex(url, NULL, error);
+}
+
+// Fetch proxy auto configuration using HTTP only if modified since last fetch
+char *fetch_get_ex(const char *url, fetch_cache_s *cache, int32_t *error) {
+    fetch_timeouts_s timeouts = {0};
+    fetch_http_s http = {0};
+    char *request_url = NULL;
+    char *body = NULL;
+    int32_t err = 0;
+
+    // Only a response to this request may report the script as not modified
+    if (cache)
+        cache->not_modified = false;
+    if (!url)
+        return NULL;
+
+    fetch_get_timeouts(&timeouts);
+    // Download must also finish within the time left for the lookup
+    const int64_t deadline = deadline_clamp(get_monotonic_time_ms() + timeouts.total_ms);
+
+    request_url = strdup(url);
+    fetch_http_init(&http, SCRIPT_MAX);
+
+    for (int32_t redirects = 0; request_url; redirects++) {
+        // Validators belong to the original url, so only send them with the first request
+        err = fetch_request(request_url, redirects == 0 ? cache : NULL, &http, &timeouts, deadline);
+        if (err != 0 || !fetch_http_is_redirect(&http))
+            break;
+
+        if (redirects == FETCH_MAX_REDIRECTS) {
+            err = ELOOP;
+            log_error("Too many HTTP redirects (%" PRId32 ")", err);
+            goto download_cleanup;
+        }
+
+        // Follow redirect to the new location
+        char *location = fetch_http_resolve_location(request_url, http.location);
+        log_debug("Following HTTP redirect to %s", location ? location : "(null)");
+        free(request_url);
+        request_url = location;
+
+        fetch_http_free(&http);
+        fetch_http_init(&http, SCRIPT_MAX);
     }
 
-    // Parse the content length
-    const size_t content_length = strtoul(content_length_header + 16, NULL, 0);
-    if (content_length <= 0 || content_length >= SCRIPT_MAX) {
-        err = EIO;
-        log_error("Invalid Content-Length header (%" PRId64 "/%" PRId32 ")", content_length, err);
+    if (!request_url) {
+        err = ENOMEM;
+        log_error("Unable to allocate memory for %s (%" PRId32 ")", "url", err);
         goto download_cleanup;
     }
+    if (err != 0)
+        goto download_cleanup;
 
-    // Create a buffer to hold the response body
-    body = (char *)calloc(content_length + 1, sizeof(char));
-    if (!body) {
-        err = ENOMEM;
-        log_error("Unable to allocate memory for %s (%" PRId32 ")", "response body", err);
+    // Server indicates that cached script is still valid
+    if (http.status_code == HTTP_NOT_MODIFIED) {
+        if (cache) {
+            fetch_cache_update(cache, &http.cache);
+            cache->not_modified = true;
+        }
+        log_debug("Proxy auto config script not modified (%" PRId32 ")", http.status_code);
         goto download_cleanup;
     }
 
-    // Find the start of the response body
-    const char *body_start = str_find_len_str(response, response_len, "\r\n\r\n");
-    if (!body_start) {
+    if (http.status_code < 200 || http.status_code >= 300) {
         err = EIO;
-        log_error("Unable to find response body (%" PRId32 ")", err);
+        log_error("Unexpected HTTP status code %" PRId32 " (%" PRId32 ")", http.status_code, err);
         goto download_cleanup;
     }
-    body_start += 4;
 
-    // Copy the response body into the buffer
-    const size_t response_header_len = (size_t)(body_start - response);
-    size_t body_length = response_len - response_header_len;
-    memcpy(body, body_start, body_length);
+    if (http.body_len == 0) {
+        err = EIO;
+        log_error("Empty response body (%" PRId32 ")", err);
+        goto download_cleanup;
+    }
 
-    // Read the remaining body
-    if (content_length > body_length) {
-        do {
-            count = recv(sfd, body + body_length, (int)(content_length - body_length), 0);
-            if (count <= 0)
-                break;
-            body_length += count;
-            if (body_length == content_length)
-                break;
-        } while (1);
+    body = fetch_http_take_body(&http);
+    if (!body) {
+        err = http.error;
+        goto download_cleanup;
     }
 
-    body[body_length] = 0;
+    // Replace cache validators with ones for the new script
+    if (cache) {
+        free(cache->etag);
+        cache->etag = NULL;
+        free(cache->last_modified);
+        cache->last_modified = NULL;
+        fetch_cache_update(cache, &http.cache);
+        cache->not_modified = false;
+    }
 
 download_cleanup:
-    if (address_info)
-        freeaddrinfo(address_info);
-    if (sfd != -1)
-        closesocket(sfd);
-
-    free(host);
+    fetch_http_free(&http);
+    free(request_url);
 
     if (error)
         *error = err;
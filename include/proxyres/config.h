@@ -31,6 +31,9 @@ void proxy_config_set_bypass_list_override(const char *bypass_list);
 // Initialization function for reading user's proxy configuration.
 bool proxy_config_global_init(void);
 
+// Initialization function that defers loading the system configuration until it is first read.
+bool proxy_config_global_init_lazy(void);
+
 // Uninitialization function for reading user's proxy configuration.
 bool proxy_config_global_cleanup(void);
 
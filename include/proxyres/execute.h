@@ -25,6 +25,9 @@ bool proxy_execute_delete(void **ctx);
 // Initialization function for PAC script execution.
 bool proxy_execute_global_init(void);
 
+// Initialization function that defers loading the script engine until the first instance is created.
+bool proxy_execute_global_init_lazy(void);
+
 // Uninitialization function for PAC script execution.
 bool proxy_execute_global_cleanup(void);
 
@@ -1,19 +1,53 @@
-#pragma once
-
-#include <stdarg.h>
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-void proxy_log_set_error_cb(void (*func)(const char *fmt, va_list args));
-
-void proxy_log_set_warn_cb(void (*func)(const char *fmt, va_list args));
-
-void proxy_log_set_info_cb(void (*func)(const char *fmt, va_list args));
-
-void proxy_log_set_debug_cb(void (*func)(const char *fmt, va_list args));
-
-#ifdef __cplusplus
-}
-#endif
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum proxy_log_level_enum {
+    PROXY_LOG_LEVEL_NONE = 0,
+    PROXY_LOG_LEVEL_ERROR = 1,
+    PROXY_LOG_LEVEL_WARN = 2,
+    PROXY_LOG_LEVEL_INFO = 3,
+    PROXY_LOG_LEVEL_DEBUG = 4
+} proxy_log_level_enum;
+
+typedef enum proxy_log_event_enum {
+    // Message without an associated event
+    PROXY_LOG_EVENT_NONE = 0,
+    // Proxy lookup started for url
+    PROXY_LOG_EVENT_LOOKUP_START = 1,
+    // Proxy lookup attached to one already running for url
+    PROXY_LOG_EVENT_LOOKUP_JOIN = 2,
+    // Proxy lookup finished for url with list and error
+    PROXY_LOG_EVENT_LOOKUP_COMPLETE = 3
+} proxy_log_event_enum;
+
+typedef struct proxy_log_field_s {
+    const char *key;
+    const char *value;
+} proxy_log_field_s;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void proxy_log_set_error_cb(void (*func)(const char *fmt, va_list args));
+
+void proxy_log_set_warn_cb(void (*func)(const char *fmt, va_list args));
+
+void proxy_log_set_info_cb(void (*func)(const char *fmt, va_list args));
+
+void proxy_log_set_debug_cb(void (*func)(const char *fmt, va_list args));
+
+void proxy_log_set_structured_cb(void (*func)(int32_t level, const char *subsystem, int32_t event_id,
+                                              const proxy_log_field_s *fields, size_t fields_len,
+                                              const char *message));
+
+void proxy_log_set_level(int32_t level);
+
+int32_t proxy_log_get_level(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -7,6 +7,7 @@
 #include "resolver.h"
 #include "execute.h"
 #include "log.h"
+#include "trace.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -15,6 +16,9 @@ extern "C" {
 // Initialize proxy resolution library
 bool proxyres_global_init(void);
 
+// Initialize proxy resolution library, deferring each component's setup until it is first used
+bool proxyres_global_init_lazy(void);
+
 // Uninitialize proxy resolution library
 bool proxyres_global_cleanup(void);
 
@@ -3,9 +3,19 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #define MAX_PROXY_URL 256
 
+typedef enum proxy_resolver_fallback_enum {
+    // Lookups that run out of time fail with ETIMEDOUT
+    PROXY_RESOLVER_FALLBACK_NONE = 0,
+    // Lookups that run out of time connect directly
+    PROXY_RESOLVER_FALLBACK_DIRECT = 1,
+    // Lookups that run out of time use the last list resolved for the same host, otherwise connect directly
+    PROXY_RESOLVER_FALLBACK_LAST_KNOWN = 2
+} proxy_resolver_fallback_enum;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -34,9 +44,36 @@ void *proxy_resolver_create(void);
 // Deletes a proxy resolver instance.
 bool proxy_resolver_delete(void **ctx);
 
+// Releases the result of the last lookup so the instance can be reused for another url.
+bool proxy_resolver_reset(void *ctx);
+
+// Resolves the proxies for a given URL and copies the list into the buffer, returns zero or an error code.
+int32_t proxy_resolver_resolve_sync(const char *url, char *list, size_t list_len, int32_t timeout_ms);
+
+// Sets the file used to persist proxy auto-discovery state between processes.
+void proxy_resolver_set_cache_path(const char *path);
+
+// Sets the socket of a local resolver daemon to forward lookups to, lookups are resolved in process while it is not
+// running.
+void proxy_resolver_set_daemon_socket(const char *path);
+
+// Sets the time in milliseconds each proxy auto-config lookup may take and the answer used when it runs out.
+void proxy_resolver_set_lookup_timeout(int32_t timeout_ms, int32_t fallback);
+
+// Sets the CPUs that lookup worker threads are pinned to and whether workers are spread across NUMA nodes, keeping
+// each lookup on the node it was requested from. Only used on Linux, must be called before initialization and is
+// reset by global cleanup.
+void proxy_resolver_set_worker_cpus(const int32_t *cpus, int32_t cpu_count, bool numa_local);
+
+// Sets the timeouts in milliseconds used when downloading proxy auto-config scripts.
+void proxy_resolver_set_fetch_timeouts(int32_t connect_timeout_ms, int32_t read_timeout_ms, int32_t total_timeout_ms);
+
 // Initialization function for proxy resolution.
 bool proxy_resolver_global_init(void);
 
+// Initialization function that defers proxy auto-discovery and backend setup until the first instance is created.
+bool proxy_resolver_global_init_lazy(void);
+
 // Uninitialization function for proxy resolution.
 bool proxy_resolver_global_cleanup(void);
 
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Start recording resolver pipeline events into per-thread ring buffers holding the given number of events.
+bool proxy_trace_start(int32_t events_per_thread);
+
+// Stop recording events, recorded events are kept until tracing is started again.
+bool proxy_trace_stop(void);
+
+// Write recorded events to a file in Chrome trace event JSON format.
+bool proxy_trace_write_json(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,74 +1,128 @@
-#include "log.h"
-
-static void (*log_error_func)(const char *fmt, va_list args);
-static void (*log_warn_func)(const char *fmt, va_list args);
-static void (*log_info_func)(const char *fmt, va_list args);
-static void (*log_debug_func)(const char *fmt, va_list args);
-
-void proxy_log_set_error_cb(void (*func)(const char *fmt, va_list args)) {
-    log_error_func = func;
-}
-
-void proxy_log_set_warn_cb(void (*func)(const char *fmt, va_list args)) {
-    log_warn_func = func;
-}
-
-void proxy_log_set_info_cb(void (*func)(const char *fmt, va_list args)) {
-    log_info_func = func;
-}
-
-void proxy_log_set_debug_cb(void (*func)(const char *fmt, va_list args)) {
-    log_debug_func = func;
-}
-
-void log_error(const char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    if (log_error_func) {
-        log_error_func(fmt, args);
-    } else {
-        vprintf(fmt, args);
-        printf("\n");
-    }
-    va_end(args);
-}
-
-void log_warn(const char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    if (log_warn_func) {
-        log_warn_func(fmt, args);
-    } else {
-        vprintf(fmt, args);
-        printf("\n");
-    }
-    va_end(args);
-}
-
-void log_info(const char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    if (log_info_func)
-        log_info_func(fmt, args);
-#ifdef _DEBUG
-    else {
-        vprintf(fmt, args);
-        printf("\n");
-    }
-#endif
-    va_end(args);
-}
-
-void log_debug(const char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    if (log_debug_func)
-        log_debug_func(fmt, args);
-#ifdef _DEBUG
-    else {
-        vprintf(fmt, args);
-        printf("\n");
-    }
-#endif
-    va_end(args);
-}
+#include <stdint.h>
+
+#include "log.h"
+
+#define LOG_MESSAGE_MAX (1024)
+
+// Most verbose level printed when no callback is set
+#ifdef _DEBUG
+#  define LOG_PRINT_LEVEL PROXY_LOG_LEVEL_DEBUG
+#else
+#  define LOG_PRINT_LEVEL PROXY_LOG_LEVEL_WARN
+#endif
+
+static void (*log_error_func)(const char *fmt, va_list args);
+static void (*log_warn_func)(const char *fmt, va_list args);
+static void (*log_info_func)(const char *fmt, va_list args);
+static void (*log_debug_func)(const char *fmt, va_list args);
+static void (*log_structured_func)(int32_t level, const char *subsystem, int32_t event_id,
+                                   const proxy_log_field_s *fields, size_t fields_len, const char *message);
+
+// Most verbose level requested by the application
+static int32_t log_level = PROXY_LOG_LEVEL_DEBUG;
+
+int32_t g_log_level = LOG_PRINT_LEVEL;
+
+static void log_update_level(void) {
+    // Messages less severe than the print level are dropped unless a callback wants them
+    int32_t output_level = LOG_PRINT_LEVEL;
+    if (log_structured_func || log_debug_func)
+        output_level = PROXY_LOG_LEVEL_DEBUG;
+    else if (log_info_func && output_level < PROXY_LOG_LEVEL_INFO)
+        output_level = PROXY_LOG_LEVEL_INFO;
+    g_log_level = log_level < output_level ? log_level : output_level;
+}
+
+void proxy_log_set_error_cb(void (*func)(const char *fmt, va_list args)) {
+    log_error_func = func;
+    log_update_level();
+}
+
+void proxy_log_set_warn_cb(void (*func)(const char *fmt, va_list args)) {
+    log_warn_func = func;
+    log_update_level();
+}
+
+void proxy_log_set_info_cb(void (*func)(const char *fmt, va_list args)) {
+    log_info_func = func;
+    log_update_level();
+}
+
+void proxy_log_set_debug_cb(void (*func)(const char *fmt, va_list args)) {
+    log_debug_func = func;
+    log_update_level();
+}
+
+void proxy_log_set_structured_cb(void (*func)(int32_t level, const char *subsystem, int32_t event_id,
+                                              const proxy_log_field_s *fields, size_t fields_len,
+                                              const char *message)) {
+    log_structured_func = func;
+    log_update_level();
+}
+
+void proxy_log_set_level(int32_t level) {
+    if (level < PROXY_LOG_LEVEL_NONE)
+        level = PROXY_LOG_LEVEL_NONE;
+    if (level > PROXY_LOG_LEVEL_DEBUG)
+        level = PROXY_LOG_LEVEL_DEBUG;
+    log_level = level;
+    log_update_level();
+}
+
+int32_t proxy_log_get_level(void) {
+    return log_level;
+}
+
+static void log_vwrite(int32_t level, const char *subsystem, int32_t event_id, const proxy_log_field_s *fields,
+                       size_t fields_len, const char *fmt, va_list args) {
+    void (*log_func)(const char *fmt, va_list args) = NULL;
+
+    if (level > g_log_level)
+        return;
+
+    switch (level) {
+    case PROXY_LOG_LEVEL_ERROR:
+        log_func = log_error_func;
+        break;
+    case PROXY_LOG_LEVEL_WARN:
+        log_func = log_warn_func;
+        break;
+    case PROXY_LOG_LEVEL_INFO:
+        log_func = log_info_func;
+        break;
+    case PROXY_LOG_LEVEL_DEBUG:
+        log_func = log_debug_func;
+        break;
+    }
+
+    if (log_structured_func) {
+        char message[LOG_MESSAGE_MAX];
+        va_list message_args;
+        va_copy(message_args, args);
+        vsnprintf(message, sizeof(message), fmt, message_args);
+        va_end(message_args);
+        log_structured_func(level, subsystem, event_id, fields, fields_len, message);
+    }
+
+    if (log_func) {
+        log_func(fmt, args);
+    } else if (!log_structured_func && level <= LOG_PRINT_LEVEL) {
+        vprintf(fmt, args);
+        printf("\n");
+    }
+}
+
+void log_write(int32_t level, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    log_vwrite(level, NULL, PROXY_LOG_EVENT_NONE, NULL, 0, fmt, args);
+    va_end(args);
+}
+
+void log_write_event(int32_t level, const char *subsystem, int32_t event_id, const proxy_log_field_s *fields,
+                     size_t fields_len, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    log_vwrite(level, subsystem, event_id, fields, fields_len, fmt, args);
+    va_end(args);
+}
@@ -1,22 +1,60 @@
-#pragma once
-
-#include <stdarg.h>
-#include <stdio.h>
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-void proxy_log_set_error_cb(void (*func)(const char *fmt, va_list args));
-void proxy_log_set_warn_cb(void (*func)(const char *fmt, va_list args));
-void proxy_log_set_info_cb(void (*func)(const char *fmt, va_list args));
-void proxy_log_set_debug_cb(void (*func)(const char *fmt, va_list args));
-
-void log_error(const char *fmt, ...);
-void log_warn(const char *fmt, ...);
-void log_info(const char *fmt, ...);
-void log_debug(const char *fmt, ...);
-
-#ifdef __cplusplus
-}
-#endif
+#pragma once
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "proxyres/log.h"
+
+// Most verbose level compiled in, debug messages are stripped from release builds
+#ifndef PROXYRES_LOG_MAX_LEVEL
+#  ifdef _DEBUG
+#    define PROXYRES_LOG_MAX_LEVEL PROXY_LOG_LEVEL_DEBUG
+#  else
+#    define PROXYRES_LOG_MAX_LEVEL PROXY_LOG_LEVEL_INFO
+#  endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Most verbose level that has somewhere to go, checked before any message is formatted
+extern int32_t g_log_level;
+
+#define log_is_enabled(level) ((level) <= PROXYRES_LOG_MAX_LEVEL && (level) <= g_log_level)
+
+void log_write(int32_t level, const char *fmt, ...);
+void log_write_event(int32_t level, const char *subsystem, int32_t event_id, const proxy_log_field_s *fields,
+                     size_t fields_len, const char *fmt, ...);
+
+#define log_error(...)                                     \
+    do {                                                   \
+        if (log_is_enabled(PROXY_LOG_LEVEL_ERROR))         \
+            log_write(PROXY_LOG_LEVEL_ERROR, __VA_ARGS__); \
+    } while (0)
+#define log_warn(...)                                     \
+    do {                                                  \
+        if (log_is_enabled(PROXY_LOG_LEVEL_WARN))         \
+            log_write(PROXY_LOG_LEVEL_WARN, __VA_ARGS__); \
+    } while (0)
+#define log_info(...)                                     \
+    do {                                                  \
+        if (log_is_enabled(PROXY_LOG_LEVEL_INFO))         \
+            log_write(PROXY_LOG_LEVEL_INFO, __VA_ARGS__); \
+    } while (0)
+#define log_debug(...)                                     \
+    do {                                                   \
+        if (log_is_enabled(PROXY_LOG_LEVEL_DEBUG))         \
+            log_write(PROXY_LOG_LEVEL_DEBUG, __VA_ARGS__); \
+    } while (0)
+
+// Message with subsystem, event id and key/value fields for structured log callbacks
+#define log_event(level, subsystem, event_id, fields, fields_len, ...)                              \
+    do {                                                                                            \
+        if (log_is_enabled(level))                                                                  \
+            log_write_event((level), (subsystem), (event_id), (fields), (fields_len), __VA_ARGS__); \
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif
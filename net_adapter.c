@@ -1,6 +1,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 #ifdef _WIN32
 #  include <ws2tcpip.h>
@@ -9,6 +10,7 @@
 #endif
 
 #include "net_adapter.h"
+#include "util.h"
 
 static inline void print_ip(const char *name, uint8_t ip[4]) {
     char ip_str[INET_ADDRSTRLEN] = {0};
@@ -46,3 +48,40 @@ void net_adapter_print(net_adapter_s *adapter) {
     if (adapter->is_connected)
         printf("  connected\n");
 }
+
+static bool net_adapter_fingerprint_adapter(void *user_data, net_adapter_s *adapter) {
+    uint64_t *fingerprint = (uint64_t *)user_data;
+
+    if (!adapter->is_connected)
+        return true;
+
+    // Only hash fields that identify the network the adapter is attached to
+    struct {
+        char name[sizeof(adapter->name)];
+        uint8_t mac[sizeof(adapter->mac)];
+        uint8_t ip[sizeof(adapter->ip)];
+        uint8_t ipv6[sizeof(adapter->ipv6)];
+        uint8_t netmask[sizeof(adapter->netmask)];
+        uint8_t gateway[sizeof(adapter->gateway)];
+        uint8_t dhcp[sizeof(adapter->dhcp)];
+    } identity;
+
+    memset(&identity, 0, sizeof(identity));
+    strncpy(identity.name, adapter->name, sizeof(identity.name) - 1);
+    memcpy(identity.mac, adapter->mac, adapter->mac_length);
+    memcpy(identity.ip, adapter->ip, sizeof(identity.ip));
+    memcpy(identity.ipv6, adapter->ipv6, sizeof(identity.ipv6));
+    memcpy(identity.netmask, adapter->netmask, sizeof(identity.netmask));
+    memcpy(identity.gateway, adapter->gateway, sizeof(identity.gateway));
+    memcpy(identity.dhcp, adapter->dhcp, sizeof(identity.dhcp));
+
+    // Combine so that the result does not depend on enumeration order
+    *fingerprint ^= str_hash((const char *)&identity, sizeof(identity));
+    return true;
+}
+
+uint64_t net_adapter_get_fingerprint(void) {
+    uint64_t fingerprint = 0;
+    net_adapter_enum(&fingerprint, net_adapter_fingerprint_adapter);
+    return fingerprint;
+}
@@ -30,6 +30,8 @@ typedef bool (*net_adapter_cb)(void *user_data, net_adapter_s *adapter);
 bool net_adapter_enum(void *user_data, net_adapter_cb callback);
 // Print network adapter information
 void net_adapter_print(net_adapter_s *adapter);
+// Hash addresses of connected adapters to identify the current network
+uint64_t net_adapter_get_fingerprint(void);
 
 #ifdef __cplusplus
 }
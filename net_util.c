@@ -26,8 +26,10 @@
 #  include <unistd.h>
 #endif
 
+#include "deadline.h"
 #include "net_adapter.h"
 #include "net_util.h"
+#include "trace.h"
 #include "util.h"
 
 typedef struct address_list {
@@ -133,6 +135,13 @@ static char *dns_resolve_filter(const char *host, int32_t family, uint8_t max_ad
         return NULL;
     }
 
+    // Resolution can not be interrupted once started, so fail fast when the lookup has no time left
+    if (deadline_is_expired()) {
+        if (error)
+            *error = ETIMEDOUT;
+        return NULL;
+    }
+
     hints.ai_family = family;
     hints.ai_socktype = SOCK_STREAM;
 
@@ -204,12 +213,18 @@ dns_resolve_error:
 
 // Resolve a host name to it an IPv4 address
 char *dns_resolve(const char *host, int32_t *error) {
-    return dns_resolve_filter(host, AF_INET, 1, error);
+    trace_begin(TRACE_EVENT_DNS_RESOLVE);
+    char *addresses = dns_resolve_filter(host, AF_INET, 1, error);
+    trace_end(TRACE_EVENT_DNS_RESOLVE);
+    return addresses;
 }
 
 // Resolve a host name to its addresses
 char *dns_resolve_ex(const char *host, int32_t *error) {
-    return dns_resolve_filter(host, AF_UNSPEC, UINT8_MAX, error);
+    trace_begin(TRACE_EVENT_DNS_RESOLVE);
+    char *addresses = dns_resolve_filter(host, AF_UNSPEC, UINT8_MAX, error);
+    trace_end(TRACE_EVENT_DNS_RESOLVE);
+    return addresses;
 }
 
 #if _WIN32_WINNT < _WIN32_WINNT_VISTA
@@ -0,0 +1,44 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pac_script.h"
+#include "util.h"
+
+pac_script_s *pac_script_create(char *text) {
+    if (!text)
+        return NULL;
+    pac_script_s *script = (pac_script_s *)calloc(1, sizeof(pac_script_s));
+    if (!script) {
+        free(text);
+        return NULL;
+    }
+    pac_script_init(script, text);
+    script->ref_count = 1;
+    return script;
+}
+
+void pac_script_init(pac_script_s *script, const char *text) {
+    script->text = text;
+    script->len = strlen(text);
+    script->hash = str_hash(text, script->len);
+    script->ref_count = 0;
+}
+
+pac_script_s *pac_script_retain(pac_script_s *script) {
+    if (script)
+        ATOMIC_INCREMENT(&script->ref_count);
+    return script;
+}
+
+void pac_script_release(pac_script_s **script) {
+    if (!script || !*script)
+        return;
+    pac_script_s *released = *script;
+    *script = NULL;
+    if (ATOMIC_DECREMENT(&released->ref_count) > 0)
+        return;
+    free((char *)released->text);
+    free(released);
+}
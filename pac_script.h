@@ -0,0 +1,31 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Proxy auto config script shared between lookups, never modified once created
+typedef struct pac_script_s {
+    const char *text;
+    size_t len;
+    // Hash of the text, so compiled scripts can be looked up without hashing it again
+    uint64_t hash;
+    // References held, zero when the caller owns the text
+    int32_t ref_count;
+} pac_script_s;
+
+// Create a reference counted script that takes ownership of the text
+pac_script_s *pac_script_create(char *text);
+
+// Describe a script whose text stays owned by the caller
+void pac_script_init(pac_script_s *script, const char *text);
+
+// Add a reference to a script
+pac_script_s *pac_script_retain(pac_script_s *script);
+
+// Release a reference to a script, freeing it along with its text when it was the last one
+void pac_script_release(pac_script_s **script);
+
+#ifdef __cplusplus
+}
+#endif
@@ -12,12 +12,21 @@
 #endif
 
 #include "config.h"
+#include "deadline.h"
+#include "event.h"
 #if defined(__linux__) || defined(HAVE_DUKTAPE)
 #  include "execute.h"
 #endif
+#ifdef PROXYRES_EXECUTE
+#  include "fetch.h"
+#endif
 #include "log.h"
+#include "mutex.h"
 #include "resolver.h"
 #include "resolver_i.h"
+#ifdef PROXYRES_DAEMON
+#  include "resolver_daemon.h"
+#endif
 #if defined(__APPLE__)
 #  if defined(PROXYRES_EXECUTE) && defined(HAVE_DUKTAPE)
 #    include "resolver_posix.h"
@@ -40,39 +49,342 @@
 #  endif
 #endif
 #include "threadpool.h"
+#include "trace.h"
 #include "util.h"
 
 #ifdef __cplusplus
 #  define delete f_delete
 #endif
 
+#define PROXY_RESOLVER_POOL_MAX       (64)
+#define PROXY_RESOLVER_LAST_KNOWN_MAX (64)
+
+// Most recent proxy list resolved for a host
+typedef struct proxy_resolver_last_known_s {
+    char *host;
+    char *list;
+} proxy_resolver_last_known_s;
+
 typedef struct g_proxy_resolver_s {
     // Library reference count
     int32_t ref_count;
     // Proxy resolver interface
     const proxy_resolver_i_s *proxy_resolver_i;
+    // Local resolver daemon interface that lookups are forwarded to while it can be reached
+    const proxy_resolver_i_s *daemon_i;
+    // Set once the in-process resolver interface is initialized, read without the lock
+    int32_t is_local_init_done;
+    void *local_init_mutex;
     // Thread pool
     void *threadpool;
+    // Lookups running on the thread pool, guarded by mutex
+    struct proxy_resolver_flight_s *flights;
+    void *mutex;
+    // Deleted instances kept for reuse, guarded by mutex
+    struct proxy_resolver_s *pool;
+    int32_t pool_count;
+    // Answers kept for lookups that run out of time, guarded by mutex
+    proxy_resolver_last_known_s last_known[PROXY_RESOLVER_LAST_KNOWN_MAX];
+    int32_t last_known_next;
+    // Whether interface and its dependencies are initialized
+    bool is_initialized;
+    // Resolver interface is initialized on first use
+    bool is_lazy;
+    // Set once initialization on first use has finished, read without the lock
+    int32_t is_lazy_init_done;
+    void *lazy_init_mutex;
 } g_proxy_resolver_s;
 
 g_proxy_resolver_s g_proxy_resolver;
 
+static bool proxy_resolver_init_interface(void);
+static bool proxy_resolver_local_init(void);
+
+// Persistent cache file path, kept across global init and cleanup
+static char *proxy_resolver_cache_path;
+
+// Local resolver daemon socket path, kept across global init and cleanup
+static char *proxy_resolver_daemon_socket;
+
+// Time each lookup may take and the answer used when it runs out, kept across global init and cleanup
+static int32_t proxy_resolver_lookup_timeout_ms;
+static int32_t proxy_resolver_fallback;
+
+// CPUs and NUMA placement of thread pool workers, kept across global init and cleanup
+static int32_t *proxy_resolver_worker_cpus;
+static int32_t proxy_resolver_worker_cpu_count;
+static bool proxy_resolver_worker_numa_local;
+
+// Lookup shared by all instances that request the same url while it is running
+typedef struct proxy_resolver_flight_s {
+    // Base proxy resolver instance doing the lookup
+    void *base;
+    char *url;
+    // Thread pool job and each attached instance hold a reference
+    int32_t ref_count;
+    int32_t waiter_count;
+    // Ties together trace events recorded for the lookup
+    uint64_t trace_id;
+    // Monotonic time in milliseconds by which the lookup must finish, zero for none
+    int64_t deadline;
+    // Set once the lookup has finished, guarded by mutex
+    bool is_done;
+    // Attached instances whose completion events are set when the lookup finishes, guarded by mutex
+    struct proxy_resolver_s *waiters;
+    struct proxy_resolver_flight_s *next;
+} proxy_resolver_flight_s;
+
 typedef struct proxy_resolver_s {
     // Base proxy resolver instance
     void *base;
-    // Async job
-    char *url;
+    // Shared lookup when using the thread pool
+    proxy_resolver_flight_s *flight;
+    // Lookup forwarded to the resolver daemon, resolved in process instead if the daemon goes away
+    void *daemon;
+    char *daemon_url;
+    bool is_forwarded;
+    // Set when the shared lookup finishes, each instance has its own since Windows events wake a single waiter
+    void *complete;
+    // Next instance attached to the same shared lookup
+    struct proxy_resolver_s *next_waiter;
     // Proxy list from system config
     char *list;
     // Next proxy pointer
     const char *listp;
+    // Next instance in pool
+    struct proxy_resolver_s *next;
 } proxy_resolver_s;
 
+static void proxy_resolver_flight_release(proxy_resolver_flight_s *flight, proxy_resolver_s *waiter) {
+    mutex_lock(g_proxy_resolver.mutex);
+    if (waiter) {
+        proxy_resolver_s **link = &flight->waiters;
+        while (*link && *link != waiter)
+            link = &(*link)->next_waiter;
+        if (*link)
+            *link = waiter->next_waiter;
+        waiter->next_waiter = NULL;
+        flight->waiter_count--;
+    }
+    const int32_t ref_count = --flight->ref_count;
+    mutex_unlock(g_proxy_resolver.mutex);
+
+    if (ref_count > 0)
+        return;
+    g_proxy_resolver.proxy_resolver_i->delete(&flight->base);
+    free(flight->url);
+    free(flight);
+}
+
+// Remember the proxy list resolved for the url's host
+static void proxy_resolver_set_last_known(const char *url, const char *list) {
+    char *host = get_url_host(url);
+    if (!host)
+        return;
+
+    mutex_lock(g_proxy_resolver.mutex);
+    proxy_resolver_last_known_s *last_known = NULL;
+    for (int32_t i = 0; i < PROXY_RESOLVER_LAST_KNOWN_MAX && !last_known; i++) {
+        if (g_proxy_resolver.last_known[i].host && strcmp(g_proxy_resolver.last_known[i].host, host) == 0)
+            last_known = &g_proxy_resolver.last_known[i];
+    }
+    if (!last_known) {
+        // Replace the oldest host once all entries are used
+        last_known = &g_proxy_resolver.last_known[g_proxy_resolver.last_known_next];
+        g_proxy_resolver.last_known_next = (g_proxy_resolver.last_known_next + 1) % PROXY_RESOLVER_LAST_KNOWN_MAX;
+        free(last_known->host);
+        last_known->host = host;
+        host = NULL;
+    }
+    if (!last_known->list || strcmp(last_known->list, list) != 0) {
+        free(last_known->list);
+        last_known->list = strdup(list);
+    }
+    mutex_unlock(g_proxy_resolver.mutex);
+    free(host);
+}
+
+// Get the answer for a lookup that ran out of time, NULL if it should fail
+static char *proxy_resolver_get_fallback(const char *url) {
+    char *list = NULL;
+
+    if (proxy_resolver_fallback == PROXY_RESOLVER_FALLBACK_LAST_KNOWN) {
+        char *host = get_url_host(url);
+        if (host) {
+            mutex_lock(g_proxy_resolver.mutex);
+            for (int32_t i = 0; i < PROXY_RESOLVER_LAST_KNOWN_MAX && !list; i++) {
+                const proxy_resolver_last_known_s *last_known = &g_proxy_resolver.last_known[i];
+                if (last_known->host && last_known->list && strcmp(last_known->host, host) == 0)
+                    list = strdup(last_known->list);
+            }
+            mutex_unlock(g_proxy_resolver.mutex);
+            free(host);
+        }
+    }
+    if (!list && proxy_resolver_fallback != PROXY_RESOLVER_FALLBACK_NONE)
+        list = strdup("direct://");
+    if (list)
+        log_warn("Proxy lookup for %s timed out, using %s", url, list);
+    return list;
+}
+
 static void proxy_resolver_get_proxies_for_url_threadpool(void *arg) {
-    proxy_resolver_s *proxy_resolver = (proxy_resolver_s *)arg;
-    if (!proxy_resolver)
+    proxy_resolver_flight_s *flight = (proxy_resolver_flight_s *)arg;
+    if (!flight)
         return;
-    g_proxy_resolver.proxy_resolver_i->get_proxies_for_url(proxy_resolver->base, proxy_resolver->url);
+
+    trace_set_lookup(flight->trace_id);
+    trace_begin(TRACE_EVENT_LOOKUP);
+    // Each stage of the lookup shortens its own timeouts to the time that is left
+    deadline_set(flight->deadline);
+    g_proxy_resolver.proxy_resolver_i->get_proxies_for_url(flight->base, flight->url);
+    deadline_set(0);
+    trace_instant(TRACE_EVENT_LOOKUP_COMPLETE, (uint32_t)g_proxy_resolver.proxy_resolver_i->get_error(flight->base));
+    trace_end(TRACE_EVENT_LOOKUP);
+    trace_set_lookup(0);
+
+    if (proxy_resolver_fallback == PROXY_RESOLVER_FALLBACK_LAST_KNOWN) {
+        const char *list = g_proxy_resolver.proxy_resolver_i->get_list(flight->base);
+        if (list)
+            proxy_resolver_set_last_known(flight->url, list);
+    }
+
+    if (log_is_enabled(PROXY_LOG_LEVEL_DEBUG)) {
+        const char *list = g_proxy_resolver.proxy_resolver_i->get_list(flight->base);
+        char error[16];
+        snprintf(error, sizeof(error), "%" PRId32, g_proxy_resolver.proxy_resolver_i->get_error(flight->base));
+        const proxy_log_field_s fields[] = {{"url", flight->url}, {"list", list ? list : ""}, {"error", error}};
+        log_event(PROXY_LOG_LEVEL_DEBUG, "resolver", PROXY_LOG_EVENT_LOOKUP_COMPLETE, fields, 3,
+                  "Proxy lookup complete for %s (%s)", flight->url, list ? list : error);
+    }
+
+    // Lookups for the url that start from now on get a new evaluation
+    mutex_lock(g_proxy_resolver.mutex);
+    proxy_resolver_flight_s **link = &g_proxy_resolver.flights;
+    while (*link && *link != flight)
+        link = &(*link)->next;
+    if (*link)
+        *link = flight->next;
+
+    // Wake every attached instance
+    flight->is_done = true;
+    for (proxy_resolver_s *waiter = flight->waiters; waiter; waiter = waiter->next_waiter)
+        event_set(waiter->complete);
+    mutex_unlock(g_proxy_resolver.mutex);
+
+    proxy_resolver_flight_release(flight, NULL);
+}
+
+// Attach to a running lookup for the same url, otherwise start a new one on the thread pool
+static bool proxy_resolver_join_flight(proxy_resolver_s *proxy_resolver, const char *url) {
+    proxy_resolver_flight_s *flight = NULL;
+    bool is_ok = true;
+
+    if (!proxy_resolver->complete) {
+        proxy_resolver->complete = event_create();
+        if (!proxy_resolver->complete) {
+            log_error("Unable to create %s", "proxy lookup event");
+            return false;
+        }
+    }
+    event_reset(proxy_resolver->complete);
+
+    mutex_lock(g_proxy_resolver.mutex);
+    for (flight = g_proxy_resolver.flights; flight; flight = flight->next) {
+        if (strcmp(flight->url, url) == 0)
+            break;
+    }
+
+    const proxy_log_field_s fields[] = {{"url", url}};
+    if (flight) {
+        log_event(PROXY_LOG_LEVEL_DEBUG, "resolver", PROXY_LOG_EVENT_LOOKUP_JOIN, fields, 1,
+                  "Joining proxy lookup in progress for %s", url);
+    } else {
+        log_event(PROXY_LOG_LEVEL_DEBUG, "resolver", PROXY_LOG_EVENT_LOOKUP_START, fields, 1,
+                  "Starting proxy lookup for %s", url);
+        flight = (proxy_resolver_flight_s *)calloc(1, sizeof(proxy_resolver_flight_s));
+        if (flight) {
+            flight->url = strdup(url);
+            flight->base = g_proxy_resolver.proxy_resolver_i->create();
+        }
+        if (!flight || !flight->url || !flight->base) {
+            log_error("Unable to allocate memory for %s", "proxy lookup");
+            if (flight) {
+                if (flight->base)
+                    g_proxy_resolver.proxy_resolver_i->delete(&flight->base);
+                free(flight->url);
+                free(flight);
+            }
+            mutex_unlock(g_proxy_resolver.mutex);
+            return false;
+        }
+        // Reference held by thread pool job until the lookup completes
+        flight->ref_count = 1;
+        if (proxy_resolver_lookup_timeout_ms > 0)
+            flight->deadline = get_monotonic_time_ms() + proxy_resolver_lookup_timeout_ms;
+        if (g_trace_enabled) {
+            flight->trace_id = trace_next_lookup_id();
+            trace_write(TRACE_EVENT_LOOKUP_ENQUEUE, TRACE_PHASE_INSTANT, flight->trace_id, 0);
+        }
+        is_ok = threadpool_enqueue(g_proxy_resolver.threadpool, flight, proxy_resolver_get_proxies_for_url_threadpool);
+        if (is_ok) {
+            flight->next = g_proxy_resolver.flights;
+            g_proxy_resolver.flights = flight;
+        }
+    }
+
+    if (is_ok) {
+        flight->ref_count++;
+        flight->waiter_count++;
+        proxy_resolver->next_waiter = flight->waiters;
+        flight->waiters = proxy_resolver;
+        proxy_resolver->flight = flight;
+    }
+    mutex_unlock(g_proxy_resolver.mutex);
+
+    if (!is_ok) {
+        g_proxy_resolver.proxy_resolver_i->delete(&flight->base);
+        free(flight->url);
+        free(flight);
+    }
+    return is_ok;
+}
+
+// Base instance that holds the result of the most recent lookup
+static void *proxy_resolver_get_base(proxy_resolver_s *proxy_resolver) {
+    if (proxy_resolver->is_forwarded)
+        return proxy_resolver->daemon;
+    if (proxy_resolver->flight)
+        return proxy_resolver->flight->base;
+    return proxy_resolver->base;
+}
+
+// Interface that the most recent lookup was started with
+static const proxy_resolver_i_s *proxy_resolver_get_base_i(proxy_resolver_s *proxy_resolver) {
+    if (proxy_resolver->is_forwarded)
+        return g_proxy_resolver.daemon_i;
+    return g_proxy_resolver.proxy_resolver_i;
+}
+
+// Check whether lookups can be forwarded to the daemon or resolved in process
+static bool proxy_resolver_is_available(void) {
+    return g_proxy_resolver.daemon_i || g_proxy_resolver.proxy_resolver_i;
+}
+
+// Release result of the most recent lookup
+static void proxy_resolver_clear(proxy_resolver_s *proxy_resolver) {
+    proxy_resolver->listp = NULL;
+    free(proxy_resolver->list);
+    proxy_resolver->list = NULL;
+
+    if (proxy_resolver->flight) {
+        proxy_resolver_flight_release(proxy_resolver->flight, proxy_resolver);
+        proxy_resolver->flight = NULL;
+    }
+
+    free(proxy_resolver->daemon_url);
+    proxy_resolver->daemon_url = NULL;
+    proxy_resolver->is_forwarded = false;
 }
 
 static bool proxy_resolver_get_proxies_for_url_from_system_config(void *ctx, const char *url) {
@@ -127,137 +439,434 @@ config_done:
     return proxy_resolver->list != NULL;
 }
 
-bool proxy_resolver_get_proxies_for_url(void *ctx, const char *url) {
-    proxy_resolver_s *proxy_resolver = (proxy_resolver_s *)ctx;
-    if (!proxy_resolver || !g_proxy_resolver.proxy_resolver_i)
-        return false;
+// Start lookup using the resolver interface
+static bool proxy_resolver_start_lookup(proxy_resolver_s *proxy_resolver, const char *url) {
+    // Discover proxy auto-config asynchronously if supported, otherwise spool to thread pool
+    if (g_proxy_resolver.proxy_resolver_i->is_async) {
+        // Asynchronous implementations keep lookup state in their own instance
+        if (!proxy_resolver->base) {
+            proxy_resolver->base = g_proxy_resolver.proxy_resolver_i->create();
+            if (!proxy_resolver->base)
+                return false;
+        }
+        const proxy_log_field_s fields[] = {{"url", url}};
+        log_event(PROXY_LOG_LEVEL_DEBUG, "resolver", PROXY_LOG_EVENT_LOOKUP_START, fields, 1,
+                  "Starting proxy lookup for %s", url);
+        return g_proxy_resolver.proxy_resolver_i->get_proxies_for_url(proxy_resolver->base, url);
+    }
 
-    proxy_resolver->listp = NULL;
-    free(proxy_resolver->list);
-    proxy_resolver->list = NULL;
+    // Identical lookups that arrive while one is running share its evaluation
+    return proxy_resolver_join_flight(proxy_resolver, url);
+}
+
+// Copy proxy list into caller's buffer
+static int32_t proxy_resolver_copy_list(const char *source, char *list, size_t list_len) {
+    const size_t source_len = strlen(source);
+    if (source_len >= list_len)
+        return ENOBUFS;
+    memcpy(list, source, source_len + 1);
+    return 0;
+}
+
+// Resolve in process, using system configuration if the resolver interface does not take it into account
+static bool proxy_resolver_start_local_lookup(proxy_resolver_s *proxy_resolver, const char *url) {
+    if (!proxy_resolver_local_init())
+        return false;
 
     // Check if OS resolver already takes into account system configuration
     if (!g_proxy_resolver.proxy_resolver_i->uses_system_config) {
         // Check if auto-discovery is necessary
-        if (proxy_resolver_get_proxies_for_url_from_system_config(ctx, url)) {
+        if (proxy_resolver_get_proxies_for_url_from_system_config(proxy_resolver, url)) {
             // Use system proxy configuration if no auto-discovery mechanism is necessary
             return true;
         }
     }
 
-    // Discover proxy auto-config asynchronously if supported, otherwise spool to thread pool
-    if (g_proxy_resolver.proxy_resolver_i->is_async)
-        return g_proxy_resolver.proxy_resolver_i->get_proxies_for_url(proxy_resolver->base, url);
+    return proxy_resolver_start_lookup(proxy_resolver, url);
+}
 
-    free(proxy_resolver->url);
-    proxy_resolver->url = strdup(url);
+// Forward lookup to the resolver daemon, returns false if it can not be reached
+static bool proxy_resolver_forward_lookup(proxy_resolver_s *proxy_resolver, const char *url) {
+    if (!g_proxy_resolver.daemon_i)
+        return false;
+
+    if (!proxy_resolver->daemon) {
+        proxy_resolver->daemon = g_proxy_resolver.daemon_i->create();
+        if (!proxy_resolver->daemon)
+            return false;
+    }
+    proxy_resolver->daemon_url = strdup(url);
+    if (!proxy_resolver->daemon_url)
+        return false;
 
-    return threadpool_enqueue(g_proxy_resolver.threadpool, proxy_resolver,
-                              proxy_resolver_get_proxies_for_url_threadpool);
+    if (!g_proxy_resolver.daemon_i->get_proxies_for_url(proxy_resolver->daemon, url)) {
+        log_debug("Unable to forward proxy lookup to daemon (%" PRId32 "), resolving in process",
+                  g_proxy_resolver.daemon_i->get_error(proxy_resolver->daemon));
+        free(proxy_resolver->daemon_url);
+        proxy_resolver->daemon_url = NULL;
+        return false;
+    }
+    proxy_resolver->is_forwarded = true;
+    return true;
+}
+
+bool proxy_resolver_get_proxies_for_url(void *ctx, const char *url) {
+    proxy_resolver_s *proxy_resolver = (proxy_resolver_s *)ctx;
+    if (!proxy_resolver || !proxy_resolver_is_available())
+        return false;
+
+    proxy_resolver_clear(proxy_resolver);
+
+    // Daemon takes into account system configuration itself
+    if (proxy_resolver_forward_lookup(proxy_resolver, url))
+        return true;
+
+    return proxy_resolver_start_local_lookup(proxy_resolver, url);
 }
 
 const char *proxy_resolver_get_list(void *ctx) {
     proxy_resolver_s *proxy_resolver = (proxy_resolver_s *)ctx;
-    if (!proxy_resolver || !g_proxy_resolver.proxy_resolver_i)
+    if (!proxy_resolver || !proxy_resolver_is_available())
         return NULL;
     if (proxy_resolver->list)
         return proxy_resolver->list;
-    return g_proxy_resolver.proxy_resolver_i->get_list(proxy_resolver->base);
+    void *base = proxy_resolver_get_base(proxy_resolver);
+    if (!base)
+        return NULL;
+    return proxy_resolver_get_base_i(proxy_resolver)->get_list(base);
 }
 
 char *proxy_resolver_get_next_proxy(void *ctx) {
     proxy_resolver_s *proxy_resolver = (proxy_resolver_s *)ctx;
-    if (!proxy_resolver || !g_proxy_resolver.proxy_resolver_i)
+    if (!proxy_resolver || !proxy_resolver_is_available())
         return NULL;
     if (!proxy_resolver->listp)
         return NULL;
 
     // Get the next proxy to connect through
     char *proxy = str_sep_dup(&proxy_resolver->listp, ",");
-    if (!proxy) {
-        if (proxy_resolver->list)
-            proxy_resolver->listp = proxy_resolver->list;
-        else
-            proxy_resolver->listp = g_proxy_resolver.proxy_resolver_i->get_list(proxy_resolver->base);
-    }
+    if (!proxy)
+        proxy_resolver->listp = proxy_resolver_get_list(ctx);
     return proxy;
 }
 
 int32_t proxy_resolver_get_error(void *ctx) {
     proxy_resolver_s *proxy_resolver = (proxy_resolver_s *)ctx;
-    if (!proxy_resolver || !g_proxy_resolver.proxy_resolver_i)
+    if (!proxy_resolver || !proxy_resolver_is_available())
         return -1;
-    return g_proxy_resolver.proxy_resolver_i->get_error(proxy_resolver->base);
+    void *base = proxy_resolver_get_base(proxy_resolver);
+    if (!base)
+        return 0;
+    return proxy_resolver_get_base_i(proxy_resolver)->get_error(base);
+}
+
+// Resolve in process when the daemon went away before answering a forwarded lookup
+static void proxy_resolver_check_forwarded(proxy_resolver_s *proxy_resolver) {
+    const int32_t error = g_proxy_resolver.daemon_i->get_error(proxy_resolver->daemon);
+    if (g_proxy_resolver.daemon_i->get_list(proxy_resolver->daemon) || error != ECONNRESET)
+        return;
+
+    log_warn("Proxy resolver daemon disconnected (%" PRId32 "), resolving %s in process", error,
+             proxy_resolver->daemon_url);
+    proxy_resolver->is_forwarded = false;
+    if (!proxy_resolver_start_local_lookup(proxy_resolver, proxy_resolver->daemon_url)) {
+        // Report the daemon error when the lookup can not be resolved in process either
+        proxy_resolver->is_forwarded = true;
+    }
 }
 
 bool proxy_resolver_wait(void *ctx, int32_t timeout_ms) {
     proxy_resolver_s *proxy_resolver = (proxy_resolver_s *)ctx;
-    if (!proxy_resolver || !g_proxy_resolver.proxy_resolver_i)
+    if (!proxy_resolver || !proxy_resolver_is_available())
         return false;
+    if (proxy_resolver->is_forwarded) {
+        if (!g_proxy_resolver.daemon_i->wait(proxy_resolver->daemon, timeout_ms))
+            return false;
+        proxy_resolver_check_forwarded(proxy_resolver);
+        if (proxy_resolver->is_forwarded) {
+            proxy_resolver->listp = proxy_resolver_get_list(ctx);
+            return true;
+        }
+    }
     if (proxy_resolver->list) {
         proxy_resolver->listp = proxy_resolver->list;
         return true;
     }
-    if (g_proxy_resolver.proxy_resolver_i->wait(proxy_resolver->base, timeout_ms)) {
-        proxy_resolver->listp = g_proxy_resolver.proxy_resolver_i->get_list(proxy_resolver->base);
-        return true;
+    void *base = proxy_resolver_get_base(proxy_resolver);
+    if (!base)
+        return false;
+
+    proxy_resolver_flight_s *flight = proxy_resolver->flight;
+    if (flight) {
+        // Completion event is consumed by the first successful wait on Windows, so check the flag first
+        mutex_lock(g_proxy_resolver.mutex);
+        const bool is_done = flight->is_done;
+        mutex_unlock(g_proxy_resolver.mutex);
+        if (!is_done && !event_wait(proxy_resolver->complete, timeout_ms))
+            return false;
+    } else if (!g_proxy_resolver.proxy_resolver_i->wait(base, timeout_ms)) {
+        return false;
     }
-    return false;
+
+    // Use fallback answer when the shared lookup ran out of time
+    if (flight && flight->deadline && !g_proxy_resolver.proxy_resolver_i->get_list(base) &&
+        g_proxy_resolver.proxy_resolver_i->get_error(base) == ETIMEDOUT) {
+        proxy_resolver->list = proxy_resolver_get_fallback(flight->url);
+    }
+
+    proxy_resolver->listp = proxy_resolver_get_list(ctx);
+    return true;
 }
 
 bool proxy_resolver_cancel(void *ctx) {
     proxy_resolver_s *proxy_resolver = (proxy_resolver_s *)ctx;
-    if (!proxy_resolver || !g_proxy_resolver.proxy_resolver_i)
+    if (!proxy_resolver || !proxy_resolver_is_available())
         return false;
     if (proxy_resolver->list)
         return true;
-    return g_proxy_resolver.proxy_resolver_i->cancel(proxy_resolver->base);
+    if (proxy_resolver->flight) {
+        // Lookup can not be cancelled while other instances are waiting on it
+        mutex_lock(g_proxy_resolver.mutex);
+        const bool is_shared = proxy_resolver->flight->waiter_count > 1;
+        mutex_unlock(g_proxy_resolver.mutex);
+        if (is_shared)
+            return false;
+    }
+    void *base = proxy_resolver_get_base(proxy_resolver);
+    if (!base)
+        return false;
+    return proxy_resolver_get_base_i(proxy_resolver)->cancel(base);
+}
+
+// Initialize resolver interface once, on the first call that needs it
+static void proxy_resolver_lazy_init(void) {
+    if (!g_proxy_resolver.is_lazy || ATOMIC_LOAD_ACQUIRE(&g_proxy_resolver.is_lazy_init_done))
+        return;
+    mutex_lock(g_proxy_resolver.lazy_init_mutex);
+    if (!g_proxy_resolver.is_lazy_init_done) {
+        if (!proxy_resolver_init_interface())
+            log_warn("Failed to initialize proxy resolver");
+        ATOMIC_STORE_RELEASE(&g_proxy_resolver.is_lazy_init_done, 1);
+    }
+    mutex_unlock(g_proxy_resolver.lazy_init_mutex);
 }
 
 void *proxy_resolver_create(void) {
-    if (!g_proxy_resolver.proxy_resolver_i)
-        return NULL;
-    proxy_resolver_s *proxy_resolver = (proxy_resolver_s *)calloc(1, sizeof(proxy_resolver_s));
-    if (!proxy_resolver)
-        return NULL;
-    proxy_resolver->base = g_proxy_resolver.proxy_resolver_i->create();
-    if (!proxy_resolver->base) {
-        free(proxy_resolver);
+    proxy_resolver_lazy_init();
+    if (!proxy_resolver_is_available())
         return NULL;
+
+    // Reuse a deleted instance when available
+    mutex_lock(g_proxy_resolver.mutex);
+    proxy_resolver_s *proxy_resolver = g_proxy_resolver.pool;
+    if (proxy_resolver) {
+        g_proxy_resolver.pool = proxy_resolver->next;
+        g_proxy_resolver.pool_count--;
+        proxy_resolver->next = NULL;
     }
+    mutex_unlock(g_proxy_resolver.mutex);
+
+    // Asynchronous implementations create their own instance when the first lookup starts
+    if (!proxy_resolver)
+        proxy_resolver = (proxy_resolver_s *)calloc(1, sizeof(proxy_resolver_s));
     return proxy_resolver;
 }
 
+bool proxy_resolver_reset(void *ctx) {
+    proxy_resolver_s *proxy_resolver = (proxy_resolver_s *)ctx;
+    if (!proxy_resolver || !proxy_resolver_is_available())
+        return false;
+
+    proxy_resolver_clear(proxy_resolver);
+
+    // Asynchronous implementations keep lookup state in their own instance, which is created again on the next lookup
+    if (proxy_resolver->daemon)
+        g_proxy_resolver.daemon_i->delete(&proxy_resolver->daemon);
+    if (proxy_resolver->base)
+        g_proxy_resolver.proxy_resolver_i->delete(&proxy_resolver->base);
+    return true;
+}
+
 bool proxy_resolver_delete(void **ctx) {
-    if (!g_proxy_resolver.proxy_resolver_i)
+    if (!proxy_resolver_is_available())
         return true;
     if (!ctx || !*ctx)
         return false;
     proxy_resolver_s *proxy_resolver = (proxy_resolver_s *)*ctx;
-    free(proxy_resolver->url);
-    free(proxy_resolver->list);
-    g_proxy_resolver.proxy_resolver_i->delete(&proxy_resolver->base);
-    free(proxy_resolver);
     *ctx = NULL;
+
+    proxy_resolver_clear(proxy_resolver);
+    if (proxy_resolver->base)
+        g_proxy_resolver.proxy_resolver_i->delete(&proxy_resolver->base);
+    if (proxy_resolver->daemon)
+        g_proxy_resolver.daemon_i->delete(&proxy_resolver->daemon);
+
+    bool is_pooled = false;
+    if (mutex_lock(g_proxy_resolver.mutex)) {
+        if (g_proxy_resolver.pool_count < PROXY_RESOLVER_POOL_MAX) {
+            proxy_resolver->next = g_proxy_resolver.pool;
+            g_proxy_resolver.pool = proxy_resolver;
+            g_proxy_resolver.pool_count++;
+            is_pooled = true;
+        }
+        mutex_unlock(g_proxy_resolver.mutex);
+    }
+    if (!is_pooled) {
+        if (proxy_resolver->complete)
+            event_delete(&proxy_resolver->complete);
+        free(proxy_resolver);
+    }
     return true;
 }
 
-bool proxy_resolver_global_init(void) {
-    if (g_proxy_resolver.ref_count > 0) {
-        g_proxy_resolver.ref_count++;
-        return true;
+int32_t proxy_resolver_resolve_sync(const char *url, char *list, size_t list_len, int32_t timeout_ms) {
+    proxy_resolver_s system_config = {0};
+    int32_t error = 0;
+
+    if (!url || !list || !list_len)
+        return EINVAL;
+    *list = 0;
+
+    proxy_resolver_lazy_init();
+    if (!proxy_resolver_is_available())
+        return ENOTSUP;
+
+    // Answer manual and bypass configurations on the calling thread without a resolver instance
+    if (!g_proxy_resolver.daemon_i && !g_proxy_resolver.proxy_resolver_i->uses_system_config &&
+        proxy_resolver_get_proxies_for_url_from_system_config(&system_config, url)) {
+        error = proxy_resolver_copy_list(system_config.list, list, list_len);
+        free(system_config.list);
+        return error;
     }
-    memset(&g_proxy_resolver, 0, sizeof(g_proxy_resolver_s));
-#if defined(_WIN32) && (WINAPI_FAMILY == WINAPI_FAMILY_DESKTOP_APP)
-    WSADATA WsaData = {0};
-    if (WSAStartup(MAKEWORD(2, 2), &WsaData) != 0) {
-        log_error("Failed to initialize winsock %d", WSAGetLastError());
-        return false;
+
+    // Proxy auto-config evaluation is required
+    proxy_resolver_s *proxy_resolver = (proxy_resolver_s *)proxy_resolver_create();
+    if (!proxy_resolver)
+        return ENOMEM;
+
+    // Lookups forwarded to the daemon fall back to resolving in process when it can not be reached
+    const bool is_started = g_proxy_resolver.daemon_i ? proxy_resolver_get_proxies_for_url(proxy_resolver, url)
+                                                      : proxy_resolver_start_lookup(proxy_resolver, url);
+    if (!is_started) {
+        error = proxy_resolver_get_error(proxy_resolver);
+    } else if (!proxy_resolver_wait(proxy_resolver, timeout_ms)) {
+        proxy_resolver_cancel(proxy_resolver);
+        error = ETIMEDOUT;
+    } else {
+        const char *result = proxy_resolver_get_list(proxy_resolver);
+        if (result)
+            error = proxy_resolver_copy_list(result, list, list_len);
+        else
+            error = proxy_resolver_get_error(proxy_resolver);
+    }
+    if (!error && !*list)
+        error = EIO;
+
+    proxy_resolver_delete((void **)&proxy_resolver);
+    return error;
+}
+
+void proxy_resolver_set_cache_path(const char *path) {
+    free(proxy_resolver_cache_path);
+    proxy_resolver_cache_path = path ? strdup(path) : NULL;
+}
+
+void proxy_resolver_set_daemon_socket(const char *path) {
+    free(proxy_resolver_daemon_socket);
+    proxy_resolver_daemon_socket = path ? strdup(path) : NULL;
+}
+
+void proxy_resolver_set_lookup_timeout(int32_t timeout_ms, int32_t fallback) {
+    proxy_resolver_lookup_timeout_ms = timeout_ms;
+    proxy_resolver_fallback = fallback;
+}
+
+void proxy_resolver_set_worker_cpus(const int32_t *cpus, int32_t cpu_count, bool numa_local) {
+    free(proxy_resolver_worker_cpus);
+    proxy_resolver_worker_cpus = NULL;
+    proxy_resolver_worker_cpu_count = 0;
+    proxy_resolver_worker_numa_local = numa_local;
+
+    if (cpus && cpu_count > 0) {
+        proxy_resolver_worker_cpus = (int32_t *)malloc((size_t)cpu_count * sizeof(int32_t));
+        if (!proxy_resolver_worker_cpus) {
+            log_error("Unable to allocate memory for %s (%" PRId32 ")", "worker cpus", ENOMEM);
+            return;
+        }
+        memcpy(proxy_resolver_worker_cpus, cpus, (size_t)cpu_count * sizeof(int32_t));
+        proxy_resolver_worker_cpu_count = cpu_count;
     }
+}
+
+void proxy_resolver_set_fetch_timeouts(int32_t connect_timeout_ms, int32_t read_timeout_ms, int32_t total_timeout_ms) {
+#ifdef PROXYRES_EXECUTE
+    fetch_set_timeouts(connect_timeout_ms, read_timeout_ms, total_timeout_ms);
+#else
+    UNUSED(connect_timeout_ms);
+    UNUSED(read_timeout_ms);
+    UNUSED(total_timeout_ms);
 #endif
+}
 
-    if (!proxy_config_global_init())
-        return false;
+// Release the in-process resolver interface and the thread pool its lookups run on
+static void proxy_resolver_cleanup_local(void) {
+    if (g_proxy_resolver.threadpool)
+        threadpool_delete(&g_proxy_resolver.threadpool);
+    // Release lookups that were still queued when the thread pool stopped
+    while (g_proxy_resolver.flights) {
+        proxy_resolver_flight_s *flight = g_proxy_resolver.flights;
+        g_proxy_resolver.flights = flight->next;
+        proxy_resolver_flight_release(flight, NULL);
+    }
+
+    if (g_proxy_resolver.proxy_resolver_i)
+        g_proxy_resolver.proxy_resolver_i->global_cleanup();
+    g_proxy_resolver.proxy_resolver_i = NULL;
+}
+
+static bool proxy_resolver_cleanup_interface(void) {
+    bool is_ok = true;
+
+    proxy_resolver_cleanup_local();
+    while (g_proxy_resolver.pool) {
+        proxy_resolver_s *proxy_resolver = g_proxy_resolver.pool;
+        g_proxy_resolver.pool = proxy_resolver->next;
+        if (proxy_resolver->complete)
+            event_delete(&proxy_resolver->complete);
+        free(proxy_resolver);
+    }
+    g_proxy_resolver.pool_count = 0;
+    for (int32_t i = 0; i < PROXY_RESOLVER_LAST_KNOWN_MAX; i++) {
+        free(g_proxy_resolver.last_known[i].host);
+        free(g_proxy_resolver.last_known[i].list);
+    }
+    memset(g_proxy_resolver.last_known, 0, sizeof(g_proxy_resolver.last_known));
+    if (g_proxy_resolver.mutex)
+        mutex_delete(&g_proxy_resolver.mutex);
+
+    if (g_proxy_resolver.daemon_i)
+        g_proxy_resolver.daemon_i->global_cleanup();
+    g_proxy_resolver.daemon_i = NULL;
+    if (g_proxy_resolver.local_init_mutex)
+        mutex_delete(&g_proxy_resolver.local_init_mutex);
+    g_proxy_resolver.is_local_init_done = 0;
+
+    g_proxy_resolver.is_initialized = false;
+#ifdef HAVE_DUKTAPE
+    if (!proxy_execute_global_cleanup())
+        is_ok = false;
+#endif
+    if (!proxy_config_global_cleanup())
+        is_ok = false;
+
+#if defined(_WIN32) && (WINAPI_FAMILY == WINAPI_FAMILY_DESKTOP_APP)
+    WSACleanup();
+#endif
+    return is_ok;
+}
+
+// Initialize the in-process resolver interface and the thread pool its lookups run on
+static bool proxy_resolver_init_local(void) {
 #if defined(__APPLE__)
 #  if defined(PROXYRES_EXECUTE) && defined(HAVE_DUKTAPE)
     if (proxy_execute_global_init())
@@ -295,30 +904,120 @@ bool proxy_resolver_global_init(void) {
     }
 
     // No need to create thread pool since underlying implementation is already asynchronous
-    if (g_proxy_resolver.proxy_resolver_i->is_async) {
-        g_proxy_resolver.ref_count++;
+    if (g_proxy_resolver.proxy_resolver_i->is_async)
         return true;
-    }
 
-    // Create thread pool to handle proxy resolution requests asynchronously
-    g_proxy_resolver.threadpool = threadpool_create(THREADPOOL_DEFAULT_MIN_THREADS, THREADPOOL_DEFAULT_MAX_THREADS);
+    // Create thread pool to handle proxy resolution requests asynchronously, work stealing keeps lookups on workers
+    // of the submitting thread's NUMA node
+    threadpool_options_s options = {THREADPOOL_SCHEDULER_SHARED, proxy_resolver_worker_cpus,
+                                    proxy_resolver_worker_cpu_count, proxy_resolver_worker_numa_local};
+    if (proxy_resolver_worker_numa_local)
+        options.scheduler = THREADPOOL_SCHEDULER_WORK_STEALING;
+    g_proxy_resolver.threadpool =
+        threadpool_create_ex(THREADPOOL_DEFAULT_MIN_THREADS, THREADPOOL_DEFAULT_MAX_THREADS, &options);
     if (!g_proxy_resolver.threadpool) {
         log_error("Failed to create thread pool");
-        proxy_resolver_global_cleanup();
+        proxy_resolver_cleanup_local();
         return false;
     }
 
 #if defined(__linux__) && defined(PROXYRES_EXECUTE)
     // Pass threadpool to posix resolver to immediately start wpad discovery
     if (g_proxy_resolver.proxy_resolver_i == proxy_resolver_posix_get_interface()) {
-        if (!proxy_resolver_posix_init_ex(g_proxy_resolver.threadpool)) {
+        if (!proxy_resolver_posix_init_ex(g_proxy_resolver.threadpool, proxy_resolver_cache_path)) {
             log_error("Failed to initialize posix proxy resolver");
-            proxy_resolver_global_cleanup();
+            proxy_resolver_cleanup_local();
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+static bool proxy_resolver_init_interface(void) {
+#if defined(_WIN32) && (WINAPI_FAMILY == WINAPI_FAMILY_DESKTOP_APP)
+    WSADATA WsaData = {0};
+    if (WSAStartup(MAKEWORD(2, 2), &WsaData) != 0) {
+        log_error("Failed to initialize winsock %d", WSAGetLastError());
+        return false;
+    }
+#endif
+
+    if (!proxy_config_global_init()) {
+#if defined(_WIN32) && (WINAPI_FAMILY == WINAPI_FAMILY_DESKTOP_APP)
+        WSACleanup();
+#endif
+        return false;
+    }
+    g_proxy_resolver.is_initialized = true;
+
+    g_proxy_resolver.mutex = mutex_create();
+    if (!g_proxy_resolver.mutex) {
+        log_error("Failed to create proxy resolver mutex");
+        proxy_resolver_cleanup_interface();
+        return false;
+    }
+
+#ifdef PROXYRES_DAEMON
+    // Forward lookups to the local resolver daemon if it is running, the in-process resolver is only initialized
+    // once a lookup can not be forwarded
+    if (proxy_resolver_daemon_socket && proxy_resolver_daemon_init_ex(proxy_resolver_daemon_socket)) {
+        log_info("Using proxy resolver daemon %s", proxy_resolver_daemon_socket);
+        g_proxy_resolver.daemon_i = proxy_resolver_daemon_get_interface();
+        g_proxy_resolver.local_init_mutex = mutex_create();
+        if (!g_proxy_resolver.local_init_mutex) {
+            log_error("Failed to create proxy resolver mutex");
+            proxy_resolver_cleanup_interface();
             return false;
         }
+        return true;
     }
 #endif
 
+    if (!proxy_resolver_init_local()) {
+        proxy_resolver_cleanup_interface();
+        return false;
+    }
+    ATOMIC_STORE_RELEASE(&g_proxy_resolver.is_local_init_done, 1);
+    return true;
+}
+
+// Initialize the in-process resolver on the first lookup that can not be forwarded to the daemon
+static bool proxy_resolver_local_init(void) {
+    if (!ATOMIC_LOAD_ACQUIRE(&g_proxy_resolver.is_local_init_done)) {
+        mutex_lock(g_proxy_resolver.local_init_mutex);
+        if (!g_proxy_resolver.is_local_init_done) {
+            if (!proxy_resolver_init_local())
+                log_warn("Failed to initialize in-process proxy resolver");
+            ATOMIC_STORE_RELEASE(&g_proxy_resolver.is_local_init_done, 1);
+        }
+        mutex_unlock(g_proxy_resolver.local_init_mutex);
+    }
+    return g_proxy_resolver.proxy_resolver_i != NULL;
+}
+
+bool proxy_resolver_global_init(void) {
+    if (g_proxy_resolver.ref_count > 0) {
+        g_proxy_resolver.ref_count++;
+        return true;
+    }
+    memset(&g_proxy_resolver, 0, sizeof(g_proxy_resolver_s));
+    if (!proxy_resolver_init_interface())
+        return false;
+    g_proxy_resolver.ref_count++;
+    return true;
+}
+
+bool proxy_resolver_global_init_lazy(void) {
+    if (g_proxy_resolver.ref_count > 0) {
+        g_proxy_resolver.ref_count++;
+        return true;
+    }
+    memset(&g_proxy_resolver, 0, sizeof(g_proxy_resolver_s));
+    g_proxy_resolver.lazy_init_mutex = mutex_create();
+    if (!g_proxy_resolver.lazy_init_mutex)
+        return false;
+    g_proxy_resolver.is_lazy = true;
     g_proxy_resolver.ref_count++;
     return true;
 }
@@ -327,22 +1026,15 @@ bool proxy_resolver_global_cleanup(void) {
     if (--g_proxy_resolver.ref_count > 0)
         return true;
 
-    if (g_proxy_resolver.threadpool)
-        threadpool_delete(&g_proxy_resolver.threadpool);
+    bool is_ok = true;
+    if (g_proxy_resolver.is_initialized)
+        is_ok = proxy_resolver_cleanup_interface();
+    if (g_proxy_resolver.lazy_init_mutex)
+        mutex_delete(&g_proxy_resolver.lazy_init_mutex);
 
-    if (g_proxy_resolver.proxy_resolver_i)
-        g_proxy_resolver.proxy_resolver_i->global_cleanup();
+    // Worker placement only applies to the pool that was created with it
+    proxy_resolver_set_worker_cpus(NULL, 0, false);
 
     memset(&g_proxy_resolver, 0, sizeof(g_proxy_resolver));
-#ifdef HAVE_DUKTAPE
-    if (!proxy_execute_global_cleanup())
-        return false;
-#endif
-    if (!proxy_config_global_cleanup())
-        return false;
-
-#if defined(_WIN32) && (WINAPI_FAMILY == WINAPI_FAMILY_DESKTOP_APP)
-    WSACleanup();
-#endif
-    return true;
+    return is_ok;
 }
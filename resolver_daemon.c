@@ -0,0 +1,341 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <errno.h>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "daemon_proto.h"
+#include "event.h"
+#include "log.h"
+#include "mutex.h"
+#include "resolver.h"
+#include "resolver_i.h"
+#include "resolver_daemon.h"
+#include "util.h"
+
+typedef struct proxy_resolver_daemon_s {
+    // Last system error
+    int32_t error;
+    // Complete event
+    void *complete;
+    // Proxy list
+    char *list;
+    // Id of request waiting for a result
+    uint32_t id;
+    // Next request waiting for a result
+    struct proxy_resolver_daemon_s *next;
+    bool pending;
+} proxy_resolver_daemon_s;
+
+typedef struct g_proxy_resolver_daemon_s {
+    // Daemon socket path
+    char *socket_path;
+    // Connection and pending request lock
+    void *mutex;
+    // Connection to daemon or -1 if disconnected
+    int sfd;
+    // Thread that receives results from the daemon
+    pthread_t reader;
+    bool reader_started;
+    // Requests waiting for a result
+    proxy_resolver_daemon_s *pending;
+    uint32_t next_id;
+} g_proxy_resolver_daemon_s;
+
+g_proxy_resolver_daemon_s g_proxy_resolver_daemon;
+
+// Remove request from the list of requests waiting for a result, must be called with lock held
+static bool proxy_resolver_daemon_unlink(proxy_resolver_daemon_s *proxy_resolver) {
+    proxy_resolver_daemon_s **link = &g_proxy_resolver_daemon.pending;
+    while (*link) {
+        if (*link == proxy_resolver) {
+            *link = proxy_resolver->next;
+            proxy_resolver->next = NULL;
+            proxy_resolver->pending = false;
+            return true;
+        }
+        link = &(*link)->next;
+    }
+    return false;
+}
+
+// Complete request with a result or an error, must be called with lock held
+static void proxy_resolver_daemon_complete(proxy_resolver_daemon_s *proxy_resolver, int32_t error, const char *list,
+                                           size_t list_len) {
+    proxy_resolver_daemon_unlink(proxy_resolver);
+    proxy_resolver->error = error;
+    if (!error && list) {
+        proxy_resolver->list = (char *)calloc(list_len + 1, sizeof(char));
+        if (proxy_resolver->list)
+            memcpy(proxy_resolver->list, list, list_len);
+        else
+            proxy_resolver->error = ENOMEM;
+    }
+    event_set(proxy_resolver->complete);
+}
+
+static void *proxy_resolver_daemon_read_results(void *arg) {
+    daemon_proto_reader_s reader = {0};
+    daemon_proto_frame_s frame = {0};
+    const int sfd = (int)(intptr_t)arg;
+
+    // Results arrive in the order lookups finish, not the order they were requested
+    while (daemon_proto_reader_recv(&reader, sfd)) {
+        int32_t frame_len = 0;
+        while ((frame_len = daemon_proto_reader_next(&reader, &frame)) > 0) {
+            if (frame.type != DAEMON_PROTO_TYPE_RESULT)
+                continue;
+
+            mutex_lock(g_proxy_resolver_daemon.mutex);
+            proxy_resolver_daemon_s *proxy_resolver = g_proxy_resolver_daemon.pending;
+            while (proxy_resolver && proxy_resolver->id != frame.id)
+                proxy_resolver = proxy_resolver->next;
+            if (proxy_resolver)
+                proxy_resolver_daemon_complete(proxy_resolver, frame.error, frame.payload, frame.payload_len);
+            mutex_unlock(g_proxy_resolver_daemon.mutex);
+        }
+        if (frame_len < 0) {
+            log_error("Invalid response from proxy resolver daemon");
+            break;
+        }
+    }
+
+    daemon_proto_reader_free(&reader);
+
+    // Fail requests that will never get a result
+    mutex_lock(g_proxy_resolver_daemon.mutex);
+    log_debug("Disconnected from proxy resolver daemon");
+    while (g_proxy_resolver_daemon.pending)
+        proxy_resolver_daemon_complete(g_proxy_resolver_daemon.pending, ECONNRESET, NULL, 0);
+    close(sfd);
+    g_proxy_resolver_daemon.sfd = -1;
+    mutex_unlock(g_proxy_resolver_daemon.mutex);
+    return NULL;
+}
+
+// Connect to the daemon and start receiving results, must be called with lock held
+static bool proxy_resolver_daemon_connect(void) {
+    struct sockaddr_un address = {0};
+
+    if (g_proxy_resolver_daemon.sfd >= 0)
+        return true;
+    if (!g_proxy_resolver_daemon.socket_path)
+        return false;
+
+    // Collect thread that received results on the previous connection
+    if (g_proxy_resolver_daemon.reader_started) {
+        pthread_join(g_proxy_resolver_daemon.reader, NULL);
+        g_proxy_resolver_daemon.reader_started = false;
+    }
+
+    if (strlen(g_proxy_resolver_daemon.socket_path) >= sizeof(address.sun_path)) {
+        log_error("Proxy resolver daemon socket path too long");
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, g_proxy_resolver_daemon.socket_path, sizeof(address.sun_path) - 1);
+
+    int sfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sfd < 0) {
+        log_error("Unable to create socket (%" PRId32 ")", (int32_t)errno);
+        return false;
+    }
+    if (connect(sfd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        log_debug("Unable to connect to proxy resolver daemon %s (%" PRId32 ")", address.sun_path, (int32_t)errno);
+        close(sfd);
+        return false;
+    }
+
+    if (pthread_create(&g_proxy_resolver_daemon.reader, NULL, proxy_resolver_daemon_read_results,
+                       (void *)(intptr_t)sfd) != 0) {
+        log_error("Unable to create proxy resolver daemon thread");
+        close(sfd);
+        return false;
+    }
+    g_proxy_resolver_daemon.reader_started = true;
+    g_proxy_resolver_daemon.sfd = sfd;
+    log_debug("Connected to proxy resolver daemon %s", address.sun_path);
+    return true;
+}
+
+bool proxy_resolver_daemon_get_proxies_for_url(void *ctx, const char *url) {
+    proxy_resolver_daemon_s *proxy_resolver = (proxy_resolver_daemon_s *)ctx;
+    daemon_proto_frame_s frame = {0};
+    bool is_ok = false;
+
+    if (!proxy_resolver || !url)
+        return false;
+
+    const size_t url_len = strlen(url);
+    if (url_len > DAEMON_PROTO_PAYLOAD_MAX) {
+        proxy_resolver->error = EMSGSIZE;
+        log_error("Url too long for proxy resolver daemon");
+        event_set(proxy_resolver->complete);
+        return false;
+    }
+
+    mutex_lock(g_proxy_resolver_daemon.mutex);
+
+    free(proxy_resolver->list);
+    proxy_resolver->list = NULL;
+    proxy_resolver->error = 0;
+    event_reset(proxy_resolver->complete);
+
+    // Reconnect if the daemon was restarted since the last request
+    if (!proxy_resolver_daemon_connect()) {
+        proxy_resolver->error = ECONNREFUSED;
+        goto daemon_done;
+    }
+
+    // Many requests may be in flight on the same connection at once
+    proxy_resolver->id = ++g_proxy_resolver_daemon.next_id;
+    proxy_resolver->next = g_proxy_resolver_daemon.pending;
+    proxy_resolver->pending = true;
+    g_proxy_resolver_daemon.pending = proxy_resolver;
+
+    frame.id = proxy_resolver->id;
+    frame.type = DAEMON_PROTO_TYPE_RESOLVE;
+    frame.payload = url;
+    frame.payload_len = (uint32_t)url_len;
+
+    if (!daemon_proto_send(g_proxy_resolver_daemon.sfd, &frame)) {
+        proxy_resolver_daemon_unlink(proxy_resolver);
+        proxy_resolver->error = errno ? errno : EIO;
+        log_error("Unable to send request to proxy resolver daemon (%" PRId32 ")", proxy_resolver->error);
+        goto daemon_done;
+    }
+
+    is_ok = true;
+
+daemon_done:
+
+    if (!is_ok)
+        event_set(proxy_resolver->complete);
+
+    mutex_unlock(g_proxy_resolver_daemon.mutex);
+    return is_ok;
+}
+
+const char *proxy_resolver_daemon_get_list(void *ctx) {
+    proxy_resolver_daemon_s *proxy_resolver = (proxy_resolver_daemon_s *)ctx;
+    if (!proxy_resolver)
+        return NULL;
+    return proxy_resolver->list;
+}
+
+int32_t proxy_resolver_daemon_get_error(void *ctx) {
+    proxy_resolver_daemon_s *proxy_resolver = (proxy_resolver_daemon_s *)ctx;
+    return proxy_resolver->error;
+}
+
+bool proxy_resolver_daemon_wait(void *ctx, int32_t timeout_ms) {
+    proxy_resolver_daemon_s *proxy_resolver = (proxy_resolver_daemon_s *)ctx;
+    if (!proxy_resolver)
+        return false;
+    return event_wait(proxy_resolver->complete, timeout_ms);
+}
+
+bool proxy_resolver_daemon_cancel(void *ctx) {
+    proxy_resolver_daemon_s *proxy_resolver = (proxy_resolver_daemon_s *)ctx;
+    if (!proxy_resolver)
+        return false;
+
+    // Result for a cancelled request is ignored when it arrives
+    mutex_lock(g_proxy_resolver_daemon.mutex);
+    const bool cancelled = proxy_resolver->pending;
+    if (cancelled)
+        proxy_resolver_daemon_complete(proxy_resolver, ECANCELED, NULL, 0);
+    mutex_unlock(g_proxy_resolver_daemon.mutex);
+    return cancelled;
+}
+
+void *proxy_resolver_daemon_create(void) {
+    proxy_resolver_daemon_s *proxy_resolver = (proxy_resolver_daemon_s *)calloc(1, sizeof(proxy_resolver_daemon_s));
+    if (!proxy_resolver)
+        return NULL;
+    proxy_resolver->complete = event_create();
+    if (!proxy_resolver->complete) {
+        free(proxy_resolver);
+        return NULL;
+    }
+    return proxy_resolver;
+}
+
+bool proxy_resolver_daemon_delete(void **ctx) {
+    if (!ctx)
+        return false;
+    proxy_resolver_daemon_s *proxy_resolver = (proxy_resolver_daemon_s *)*ctx;
+    if (!proxy_resolver)
+        return false;
+    proxy_resolver_daemon_cancel(*ctx);
+    event_delete(&proxy_resolver->complete);
+    free(proxy_resolver->list);
+    free(proxy_resolver);
+    *ctx = NULL;
+    return true;
+}
+
+bool proxy_resolver_daemon_global_init(void) {
+    return false;
+}
+
+bool proxy_resolver_daemon_init_ex(const char *socket_path) {
+    if (!socket_path)
+        return false;
+
+    g_proxy_resolver_daemon.sfd = -1;
+    g_proxy_resolver_daemon.mutex = mutex_create();
+    g_proxy_resolver_daemon.socket_path = strdup(socket_path);
+    if (!g_proxy_resolver_daemon.mutex || !g_proxy_resolver_daemon.socket_path)
+        return !proxy_resolver_daemon_global_cleanup();
+
+    // Only use the daemon if it is running, otherwise resolve in process
+    mutex_lock(g_proxy_resolver_daemon.mutex);
+    const bool is_connected = proxy_resolver_daemon_connect();
+    mutex_unlock(g_proxy_resolver_daemon.mutex);
+    if (!is_connected)
+        return !proxy_resolver_daemon_global_cleanup();
+    return true;
+}
+
+bool proxy_resolver_daemon_global_cleanup(void) {
+    if (g_proxy_resolver_daemon.mutex) {
+        // Wake the receiving thread so that it closes the connection and exits
+        mutex_lock(g_proxy_resolver_daemon.mutex);
+        if (g_proxy_resolver_daemon.sfd >= 0)
+            shutdown(g_proxy_resolver_daemon.sfd, SHUT_RDWR);
+        mutex_unlock(g_proxy_resolver_daemon.mutex);
+    }
+    if (g_proxy_resolver_daemon.reader_started)
+        pthread_join(g_proxy_resolver_daemon.reader, NULL);
+
+    free(g_proxy_resolver_daemon.socket_path);
+    mutex_delete(&g_proxy_resolver_daemon.mutex);
+
+    memset(&g_proxy_resolver_daemon, 0, sizeof(g_proxy_resolver_daemon));
+    g_proxy_resolver_daemon.sfd = -1;
+    return true;
+}
+
+const proxy_resolver_i_s *proxy_resolver_daemon_get_interface(void) {
+    static const proxy_resolver_i_s proxy_resolver_daemon_i = {
+        proxy_resolver_daemon_get_proxies_for_url,
+        proxy_resolver_daemon_get_list,
+        proxy_resolver_daemon_get_error,
+        proxy_resolver_daemon_wait,
+        proxy_resolver_daemon_cancel,
+        proxy_resolver_daemon_create,
+        proxy_resolver_daemon_delete,
+        true,  // get_proxies_for_url is answered asynchronously by the daemon
+        true,  // get_proxies_for_url takes into account system config in the daemon
+        proxy_resolver_daemon_global_init,
+        proxy_resolver_daemon_global_cleanup};
+    return &proxy_resolver_daemon_i;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+bool proxy_resolver_daemon_get_proxies_for_url(void *ctx, const char *url);
+const char *proxy_resolver_daemon_get_list(void *ctx);
+int32_t proxy_resolver_daemon_get_error(void *ctx);
+bool proxy_resolver_daemon_wait(void *ctx, int32_t timeout_ms);
+bool proxy_resolver_daemon_cancel(void *ctx);
+
+void *proxy_resolver_daemon_create(void);
+bool proxy_resolver_daemon_delete(void **ctx);
+
+bool proxy_resolver_daemon_global_init(void);
+bool proxy_resolver_daemon_init_ex(const char *socket_path);
+bool proxy_resolver_daemon_global_cleanup(void);
+
+const proxy_resolver_i_s *proxy_resolver_daemon_get_interface(void);
@@ -15,6 +15,7 @@
 #include "resolver.h"
 #include "resolver_i.h"
 #include "resolver_gnome3.h"
+#include "util.h"
 
 typedef struct g_proxy_resolver_gnome3_s {
     // GIO module handle
@@ -206,6 +207,18 @@ bool proxy_resolver_gnome3_delete(void **ctx) {
 }
 
 bool proxy_resolver_gnome3_global_init(void) {
+    // Glib functions
+    const dl_symbol_s glib_symbols[] = {{"g_error_free", (void **)&g_proxy_resolver_gnome3.g_error_free},
+                                        {"g_strv_length", (void **)&g_proxy_resolver_gnome3.g_strv_length},
+                                        {"g_strfreev", (void **)&g_proxy_resolver_gnome3.g_strfreev}};
+    // GIO cancellable and GProxyResolver functions
+    const dl_symbol_s gio_symbols[] = {
+        {"g_object_unref", (void **)&g_proxy_resolver_gnome3.g_object_unref},
+        {"g_cancellable_new", (void **)&g_proxy_resolver_gnome3.g_cancellable_new},
+        {"g_cancellable_cancel", (void **)&g_proxy_resolver_gnome3.g_cancellable_cancel},
+        {"g_proxy_resolver_get_default", (void **)&g_proxy_resolver_gnome3.g_proxy_resolver_get_default},
+        {"g_proxy_resolver_lookup", (void **)&g_proxy_resolver_gnome3.g_proxy_resolver_lookup}};
+
     g_proxy_resolver_gnome3.gio_module = dlopen("libgio-2.0.so.0", RTLD_LAZY | RTLD_LOCAL);
     if (!g_proxy_resolver_gnome3.gio_module)
         goto gnome3_init_error;
@@ -213,42 +226,11 @@ bool proxy_resolver_gnome3_global_init(void) {
     if (!g_proxy_resolver_gnome3.glib_module)
         goto gnome3_init_error;
 
-    // Glib functions
-    g_proxy_resolver_gnome3.g_error_free =
-        (void (*)(GError *))dlsym(g_proxy_resolver_gnome3.glib_module, "g_error_free");
-    if (!g_proxy_resolver_gnome3.g_error_free)
-        goto gnome3_init_error;
-    g_proxy_resolver_gnome3.g_strv_length =
-        (guint(*)(gchar **))dlsym(g_proxy_resolver_gnome3.glib_module, "g_strv_length");
-    if (!g_proxy_resolver_gnome3.g_strv_length)
-        goto gnome3_init_error;
-    g_proxy_resolver_gnome3.g_strfreev = (void (*)(gchar **))dlsym(g_proxy_resolver_gnome3.glib_module, "g_strfreev");
-    if (!g_proxy_resolver_gnome3.g_strfreev)
-        goto gnome3_init_error;
-
-    // GIO cancellable functions
-    g_proxy_resolver_gnome3.g_object_unref =
-        (void (*)(gpointer))dlsym(g_proxy_resolver_gnome3.gio_module, "g_object_unref");
-    if (!g_proxy_resolver_gnome3.g_object_unref)
-        goto gnome3_init_error;
-    g_proxy_resolver_gnome3.g_cancellable_new =
-        (GCancellable * (*)()) dlsym(g_proxy_resolver_gnome3.gio_module, "g_cancellable_new");
-    if (!g_proxy_resolver_gnome3.g_cancellable_new)
-        goto gnome3_init_error;
-    g_proxy_resolver_gnome3.g_cancellable_cancel =
-        (void (*)(GCancellable *))dlsym(g_proxy_resolver_gnome3.gio_module, "g_cancellable_cancel");
-    if (!g_proxy_resolver_gnome3.g_cancellable_cancel)
-        goto gnome3_init_error;
-
-    // GProxyResolver functions
-    g_proxy_resolver_gnome3.g_proxy_resolver_get_default =
-        (GProxyResolver * (*)()) dlsym(g_proxy_resolver_gnome3.gio_module, "g_proxy_resolver_get_default");
-    if (!g_proxy_resolver_gnome3.g_proxy_resolver_get_default)
+    if (!dl_load_symbols(g_proxy_resolver_gnome3.glib_module, glib_symbols,
+                         sizeof(glib_symbols) / sizeof(glib_symbols[0])))
         goto gnome3_init_error;
-    g_proxy_resolver_gnome3.g_proxy_resolver_lookup =
-        (gchar * *(*)(GProxyResolver *, const gchar *, GCancellable *, GError **))
-            dlsym(g_proxy_resolver_gnome3.gio_module, "g_proxy_resolver_lookup");
-    if (!g_proxy_resolver_gnome3.g_proxy_resolver_lookup)
+    if (!dl_load_symbols(g_proxy_resolver_gnome3.gio_module, gio_symbols,
+                         sizeof(gio_symbols) / sizeof(gio_symbols[0])))
         goto gnome3_init_error;
 
     return true;
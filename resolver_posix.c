@@ -8,36 +8,95 @@
 #include <time.h>
 
 #include "config.h"
+#include "deadline.h"
 #include "event.h"
 #include "fetch.h"
 #include "log.h"
 #include "execute.h"
+#include "execute_i.h"
 #include "mutex.h"
 #include "net_adapter.h"
+#include "pac_script.h"
 #include "resolver.h"
 #include "resolver_i.h"
 #include "resolver_posix.h"
+#include "resolver_posix_p.h"
+#include "testing.h"
 #include "threadpool.h"
+#include "trace.h"
 #include "util.h"
+#include "wpad_cache.h"
 #include "wpad_dhcp.h"
 #include "wpad_dns.h"
 
-#define WPAD_DHCP_TIMEOUT   (3)
-#define WPAD_EXPIRE_SECONDS (300)
+#define WPAD_DHCP_TIMEOUT       (3)
+#define WPAD_DHCP_GRACE_MS      (250)
+#define WPAD_DISCOVER_THREADS   (2 + WPAD_DNS_MAX_PROBES)
+#define WPAD_EXPIRE_SECONDS     (300)
+#define PAC_EXPIRE_MIN_SECONDS  (30)
+#define PAC_EXPIRE_MAX_SECONDS  (86400)
+#define WPAD_RETRY_MAX_SECONDS  (1200)
+#define PAC_RETRY_MIN_SECONDS   (30)
+#define PAC_RETRY_MAX_SECONDS   (1800)
+#define WPAD_CACHE_LOCK_TIMEOUT_MS (20000)
+#define RESOLVER_POOL_MAX       (64)
+
+// Backs off from an endpoint that keeps failing so it is not retried by every lookup
+typedef struct proxy_resolver_posix_breaker_s {
+    // Consecutive failures, zero while the endpoint is healthy
+    int32_t failures;
+    // Error from the most recent failure
+    int32_t error;
+    // Time before which the endpoint is not tried again
+    time_t retry_time;
+} proxy_resolver_posix_breaker_s;
 
 typedef struct g_proxy_resolver_posix_s {
     // WPAD discovered url
     char *auto_config_url;
     // WPAD discovery lock
     void *mutex;
-    // PAC script
-    char *script;
+    // PAC script shared with the lookups executing it
+    pac_script_s *script;
+    // PAC script url
+    char *script_url;
+    // PAC script HTTP cache state
+    fetch_cache_s fetch_cache;
+    // Persistent cache file path
+    char *cache_path;
+    // Thread pool used to run DHCP and DNS discovery concurrently
+    void *discover_threadpool;
     time_t last_wpad_time;
     time_t last_fetch_time;
+    // Backoff for WPAD discovery that finds nothing and for PAC script urls that can not be fetched
+    proxy_resolver_posix_breaker_s wpad_breaker;
+    proxy_resolver_posix_breaker_s fetch_breaker;
+    // Deleted instances kept with their events for reuse
+    void *pool_mutex;
+    struct proxy_resolver_posix_s *pool;
+    int32_t pool_count;
 } g_proxy_resolver_posix_s;
 
 g_proxy_resolver_posix_s g_proxy_resolver_posix;
 
+typedef struct proxy_resolver_posix_wpad_s {
+    // Discovery state lock
+    void *mutex;
+    // Signalled when either discovery method finishes
+    void *any_complete;
+    void *dhcp_complete;
+    void *dns_complete;
+    // Url found using DHCP
+    char *dhcp_url;
+    // Script and url found using DNS
+    char *dns_script;
+    char *dns_url;
+    // Discovery jobs may outlive the caller that started them
+    int32_t ref_count;
+    // Lookup deadline of the caller that started discovery
+    int64_t deadline;
+} proxy_resolver_posix_wpad_s;
+
 typedef struct proxy_resolver_posix_s {
     // Last system error
     int32_t error;
@@ -45,95 +104,510 @@ typedef struct proxy_resolver_posix_s {
     void *complete;
     // Proxy list
     char *list;
+    // Next instance in pool
+    struct proxy_resolver_posix_s *next;
 } proxy_resolver_posix_s;
 
+// Replace the PAC script only if its contents have changed so anything derived from it remains valid
+static bool proxy_resolver_posix_set_script(char *text) {
+    pac_script_s *script = text ? pac_script_create(text) : NULL;
+    pac_script_s *current = g_proxy_resolver_posix.script;
+
+    if (script && current && current->len == script->len && current->hash == script->hash) {
+        log_debug("Proxy auto config script unchanged (%" PRIx64 ")", script->hash);
+        pac_script_release(&script);
+        return false;
+    }
+
+    pac_script_release(&g_proxy_resolver_posix.script);
+    g_proxy_resolver_posix.script = script;
+    return true;
+}
+
+// Use expiration from PAC server if specified, otherwise use default
+static int32_t proxy_resolver_posix_get_fetch_expire(int32_t max_age) {
+    if (max_age < 0)
+        return WPAD_EXPIRE_SECONDS;
+    if (max_age < PAC_EXPIRE_MIN_SECONDS)
+        return PAC_EXPIRE_MIN_SECONDS;
+    if (max_age > PAC_EXPIRE_MAX_SECONDS)
+        return PAC_EXPIRE_MAX_SECONDS;
+    return max_age;
+}
+
+// Check whether an endpoint failed recently and should not be tried yet
+static bool proxy_resolver_posix_breaker_is_open(const proxy_resolver_posix_breaker_s *breaker, time_t now) {
+    return breaker->failures > 0 && now < breaker->retry_time;
+}
+
+// Double the delay before the next attempt with each consecutive failure, lengthened by a random amount of up to half
+// without exceeding the maximum
+PROXYRES_TESTABLE int64_t proxy_resolver_posix_get_retry_delay(int32_t failures, int32_t min_seconds,
+                                                               int32_t max_seconds, uint64_t jitter) {
+    int64_t delay = min_seconds;
+    for (int32_t i = 1; i < failures && delay < max_seconds; i++)
+        delay *= 2;
+    if (delay > max_seconds)
+        delay = max_seconds;
+
+    // Only ever wait longer, so a script is not fetched again sooner than the backoff allows
+    delay += (int64_t)(jitter % (uint64_t)(delay / 2 + 1));
+    if (delay > max_seconds)
+        delay = max_seconds;
+    return delay;
+}
+
+static void proxy_resolver_posix_breaker_fail(proxy_resolver_posix_breaker_s *breaker, int32_t error,
+                                              int32_t min_seconds, int32_t max_seconds) {
+    if (breaker->failures < INT32_MAX)
+        breaker->failures++;
+    breaker->error = error;
+
+    // Low bits of the clock at the time of failure differ between processes that failed together,
+    // so they do not all retry together
+    const int64_t delay = proxy_resolver_posix_get_retry_delay(breaker->failures, min_seconds, max_seconds,
+                                                               (uint64_t)get_monotonic_time_us());
+    breaker->retry_time = time(NULL) + (time_t)delay;
+}
+
+static void proxy_resolver_posix_breaker_reset(proxy_resolver_posix_breaker_s *breaker) {
+    memset(breaker, 0, sizeof(proxy_resolver_posix_breaker_s));
+}
+
+// Check whether the WPAD discovery result can still be used, a miss is kept while discovery is backing off
+static bool proxy_resolver_posix_wpad_is_fresh(time_t now) {
+    if (g_proxy_resolver_posix.last_wpad_time <= 0)
+        return false;
+    if (!g_proxy_resolver_posix.auto_config_url && g_proxy_resolver_posix.wpad_breaker.failures > 0)
+        return proxy_resolver_posix_breaker_is_open(&g_proxy_resolver_posix.wpad_breaker, now);
+    return g_proxy_resolver_posix.last_wpad_time + WPAD_EXPIRE_SECONDS >= now;
+}
+
+// Record the result of WPAD discovery
+static void proxy_resolver_posix_wpad_set_result(char *auto_config_url) {
+    free(g_proxy_resolver_posix.auto_config_url);
+    g_proxy_resolver_posix.auto_config_url = auto_config_url;
+    g_proxy_resolver_posix.last_wpad_time = time(NULL);
+
+    if (auto_config_url) {
+        proxy_resolver_posix_breaker_reset(&g_proxy_resolver_posix.wpad_breaker);
+        return;
+    }
+    proxy_resolver_posix_breaker_fail(&g_proxy_resolver_posix.wpad_breaker, 0, WPAD_EXPIRE_SECONDS,
+                                      WPAD_RETRY_MAX_SECONDS);
+    log_info("No proxy auto config found using WPAD, retrying in %" PRId64 " seconds",
+             (int64_t)(g_proxy_resolver_posix.wpad_breaker.retry_time - g_proxy_resolver_posix.last_wpad_time));
+}
+
+// Check whether WPAD discovery or the PAC script need to be refreshed
+static bool proxy_resolver_posix_is_stale(void) {
+    const time_t now = time(NULL);
+    if (proxy_config_get_auto_discover()) {
+        if (!proxy_resolver_posix_wpad_is_fresh(now))
+            return true;
+        // Nothing to fetch when WPAD did not find a proxy auto config url
+        if (!g_proxy_resolver_posix.auto_config_url)
+            return false;
+    }
+    const int32_t fetch_expire = proxy_resolver_posix_get_fetch_expire(g_proxy_resolver_posix.fetch_cache.max_age);
+    if (g_proxy_resolver_posix.last_fetch_time + fetch_expire >= now)
+        return false;
+    return !proxy_resolver_posix_breaker_is_open(&g_proxy_resolver_posix.fetch_breaker, now);
+}
+
+// Persist the current WPAD discovery state so the next process can start with it
+static void proxy_resolver_posix_cache_save(void) {
+    if (!g_proxy_resolver_posix.cache_path || !g_proxy_resolver_posix.script)
+        return;
+
+    wpad_cache_s cache = {0};
+    cache.fingerprint = net_adapter_get_fingerprint();
+    cache.fetch_time = (int64_t)g_proxy_resolver_posix.last_fetch_time;
+    cache.auto_config_url = g_proxy_resolver_posix.auto_config_url;
+    cache.script_url = g_proxy_resolver_posix.script_url;
+    cache.script = (char *)g_proxy_resolver_posix.script->text;
+    cache.max_age = g_proxy_resolver_posix.fetch_cache.max_age;
+    cache.fetch_failures = g_proxy_resolver_posix.fetch_breaker.failures;
+    cache.fetch_retry_time = (int64_t)g_proxy_resolver_posix.fetch_breaker.retry_time;
+    cache.etag = g_proxy_resolver_posix.fetch_cache.etag;
+    cache.last_modified = g_proxy_resolver_posix.fetch_cache.last_modified;
+
+    if (!wpad_cache_write(g_proxy_resolver_posix.cache_path, &cache))
+        log_warn("Unable to write WPAD cache %s", g_proxy_resolver_posix.cache_path);
+}
+
+// Use the fetch backoff of another process sharing the cache if it retries later than this one
+static void proxy_resolver_posix_cache_load_breaker(const wpad_cache_s *cache) {
+    if ((time_t)cache->fetch_retry_time <= g_proxy_resolver_posix.fetch_breaker.retry_time)
+        return;
+    g_proxy_resolver_posix.fetch_breaker.failures = cache->fetch_failures;
+    g_proxy_resolver_posix.fetch_breaker.retry_time = (time_t)cache->fetch_retry_time;
+}
+
+// Restore WPAD discovery state persisted by another process on the same network if it is newer than ours.
+// Expired state is only used if allowed, and is then treated as fresh until it is revalidated.
+static bool proxy_resolver_posix_cache_load(bool allow_expired, bool *is_expired) {
+    wpad_cache_s cache = {0};
+
+    if (!g_proxy_resolver_posix.cache_path || !wpad_cache_read(g_proxy_resolver_posix.cache_path, &cache))
+        return false;
+
+    if (cache.fingerprint != net_adapter_get_fingerprint()) {
+        log_info("Ignoring WPAD cache from a different network");
+        wpad_cache_free(&cache);
+        return false;
+    }
+
+    // Back off from a failing PAC server for as long as any process sharing the cache does
+    if (cache.script_url && g_proxy_resolver_posix.script_url &&
+        strcmp(cache.script_url, g_proxy_resolver_posix.script_url) == 0)
+        proxy_resolver_posix_cache_load_breaker(&cache);
+
+    if (cache.fetch_time < (int64_t)g_proxy_resolver_posix.last_fetch_time) {
+        wpad_cache_free(&cache);
+        return false;
+    }
+
+    const time_t now = time(NULL);
+    const bool expired = cache.fetch_time + proxy_resolver_posix_get_fetch_expire(cache.max_age) < now;
+    if (is_expired)
+        *is_expired = expired;
+    if (expired && !allow_expired) {
+        wpad_cache_free(&cache);
+        return false;
+    }
+
+    log_info("Using cached proxy auto config script from %s", cache.script_url ? cache.script_url : "WPAD");
+
+    const time_t cache_time = expired ? now : (time_t)cache.fetch_time;
+
+    free(g_proxy_resolver_posix.auto_config_url);
+    g_proxy_resolver_posix.auto_config_url = cache.auto_config_url;
+    if (cache.auto_config_url)
+        g_proxy_resolver_posix.last_wpad_time = cache_time;
+    free(g_proxy_resolver_posix.script_url);
+    g_proxy_resolver_posix.script_url = cache.script_url;
+    proxy_resolver_posix_set_script(cache.script);
+    fetch_cache_free(&g_proxy_resolver_posix.fetch_cache);
+    g_proxy_resolver_posix.fetch_cache.etag = cache.etag;
+    g_proxy_resolver_posix.fetch_cache.last_modified = cache.last_modified;
+    g_proxy_resolver_posix.fetch_cache.max_age = cache.max_age;
+    g_proxy_resolver_posix.last_fetch_time = cache_time;
+    proxy_resolver_posix_breaker_reset(&g_proxy_resolver_posix.fetch_breaker);
+    proxy_resolver_posix_cache_load_breaker(&cache);
+    return true;
+}
+
+// Wait for any other process sharing the cache file to finish refreshing it, then use its result if it is
+// newer. The returned lock is held while this process refreshes and is released after it saves the result.
+static void *proxy_resolver_posix_cache_acquire(void) {
+    if (!g_proxy_resolver_posix.cache_path || !proxy_resolver_posix_is_stale())
+        return NULL;
+
+    void *cache_lock =
+        wpad_cache_lock(g_proxy_resolver_posix.cache_path, deadline_clamp_timeout(WPAD_CACHE_LOCK_TIMEOUT_MS));
+    proxy_resolver_posix_cache_load(false, NULL);
+    return cache_lock;
+}
+
+static void proxy_resolver_posix_wpad_release(proxy_resolver_posix_wpad_s *wpad) {
+    mutex_lock(wpad->mutex);
+    const int32_t ref_count = --wpad->ref_count;
+    mutex_unlock(wpad->mutex);
+    if (ref_count > 0)
+        return;
+
+    free(wpad->dhcp_url);
+    free(wpad->dns_script);
+    free(wpad->dns_url);
+    event_delete(&wpad->any_complete);
+    event_delete(&wpad->dhcp_complete);
+    event_delete(&wpad->dns_complete);
+    mutex_delete(&wpad->mutex);
+    free(wpad);
+}
+
+static void proxy_resolver_posix_wpad_dhcp(void *arg) {
+    proxy_resolver_posix_wpad_s *wpad = (proxy_resolver_posix_wpad_s *)arg;
+
+    deadline_set(wpad->deadline);
+    log_info("Discovering proxy auto config using WPAD (%s)", "DHCP");
+    char *auto_config_url = wpad_dhcp(WPAD_DHCP_TIMEOUT);
+    deadline_set(0);
+
+    mutex_lock(wpad->mutex);
+    wpad->dhcp_url = auto_config_url;
+    mutex_unlock(wpad->mutex);
+
+    event_set(wpad->dhcp_complete);
+    event_set(wpad->any_complete);
+    proxy_resolver_posix_wpad_release(wpad);
+}
+
+static void proxy_resolver_posix_wpad_dns(void *arg) {
+    proxy_resolver_posix_wpad_s *wpad = (proxy_resolver_posix_wpad_s *)arg;
+    char *url = NULL;
+
+    deadline_set(wpad->deadline);
+    log_info("Discovering proxy auto config using WPAD (%s)", "DNS");
+    char *script = wpad_dns_ex(NULL, &url);
+    deadline_set(0);
+
+    mutex_lock(wpad->mutex);
+    wpad->dns_script = script;
+    wpad->dns_url = url;
+    mutex_unlock(wpad->mutex);
+
+    event_set(wpad->dns_complete);
+    event_set(wpad->any_complete);
+    proxy_resolver_posix_wpad_release(wpad);
+}
+
+static proxy_resolver_posix_wpad_s *proxy_resolver_posix_wpad_create(void) {
+    proxy_resolver_posix_wpad_s *wpad = (proxy_resolver_posix_wpad_s *)calloc(1, sizeof(proxy_resolver_posix_wpad_s));
+    if (!wpad)
+        return NULL;
+    wpad->ref_count = 1;
+    wpad->deadline = deadline_get();
+    wpad->mutex = mutex_create();
+    wpad->any_complete = event_create();
+    wpad->dhcp_complete = event_create();
+    wpad->dns_complete = event_create();
+    if (!wpad->mutex || !wpad->any_complete || !wpad->dhcp_complete || !wpad->dns_complete) {
+        proxy_resolver_posix_wpad_release(wpad);
+        return NULL;
+    }
+    return wpad;
+}
+
+// Discover the proxy auto config url using DHCP and DNS at the same time. DHCP takes precedence if it answers
+// shortly after DNS, otherwise whichever method finds a proxy auto config first is used.
+static char *proxy_resolver_posix_wpad_find(char **script) {
+    void *threadpool = g_proxy_resolver_posix.discover_threadpool;
+    proxy_resolver_posix_wpad_s *wpad = threadpool ? proxy_resolver_posix_wpad_create() : NULL;
+    char *auto_config_url = NULL;
+
+    if (!wpad) {
+        // Discover sequentially when discovery jobs can not be started
+        log_info("Discovering proxy auto config using WPAD (%s)", "DHCP");
+        auto_config_url = wpad_dhcp(WPAD_DHCP_TIMEOUT);
+        if (!auto_config_url) {
+            log_info("Discovering proxy auto config using WPAD (%s)", "DNS");
+            *script = wpad_dns_ex(NULL, &auto_config_url);
+        }
+        return auto_config_url;
+    }
+
+    // Each job holds a reference that it releases when it finishes
+    wpad->ref_count += 2;
+    if (!threadpool_enqueue(threadpool, wpad, proxy_resolver_posix_wpad_dhcp)) {
+        event_set(wpad->dhcp_complete);
+        event_set(wpad->any_complete);
+        proxy_resolver_posix_wpad_release(wpad);
+    }
+    if (!threadpool_enqueue(threadpool, wpad, proxy_resolver_posix_wpad_dns)) {
+        event_set(wpad->dns_complete);
+        event_set(wpad->any_complete);
+        proxy_resolver_posix_wpad_release(wpad);
+    }
+
+    // Wait for the first method to finish
+    event_wait(wpad->any_complete, -1);
+
+    mutex_lock(wpad->mutex);
+    const bool dhcp_found = wpad->dhcp_url != NULL;
+    const bool dns_found = wpad->dns_script != NULL;
+    mutex_unlock(wpad->mutex);
+
+    if (!dhcp_found) {
+        if (dns_found) {
+            // Give DHCP a short time to answer before using the DNS result
+            event_wait(wpad->dhcp_complete, WPAD_DHCP_GRACE_MS);
+        } else {
+            // Neither method has found anything yet, so wait for both to finish
+            event_wait(wpad->dhcp_complete, -1);
+            event_wait(wpad->dns_complete, -1);
+        }
+    }
+
+    mutex_lock(wpad->mutex);
+    if (wpad->dhcp_url) {
+        auto_config_url = wpad->dhcp_url;
+        wpad->dhcp_url = NULL;
+    } else if (wpad->dns_script) {
+        auto_config_url = wpad->dns_url;
+        *script = wpad->dns_script;
+        wpad->dns_url = NULL;
+        wpad->dns_script = NULL;
+    }
+    mutex_unlock(wpad->mutex);
+
+    // Remaining discovery job finishes in the background
+    proxy_resolver_posix_wpad_release(wpad);
+    return auto_config_url;
+}
+
 static char *proxy_resolver_posix_wpad_discover(void) {
     char *auto_config_url = NULL;
     char *script = NULL;
 
     // Check if we need to re-discover the WPAD auto config url
-    if (g_proxy_resolver_posix.last_wpad_time > 0 &&
-        g_proxy_resolver_posix.last_wpad_time + WPAD_EXPIRE_SECONDS >= time(NULL)) {
+    if (proxy_resolver_posix_wpad_is_fresh(time(NULL))) {
         // Use cached version of WPAD auto config url
         auto_config_url = g_proxy_resolver_posix.auto_config_url;
+        trace_instant(TRACE_EVENT_WPAD_CACHE_HIT, 0);
     } else {
         free(g_proxy_resolver_posix.auto_config_url);
         g_proxy_resolver_posix.auto_config_url = NULL;
 
-        // Detect proxy auto configuration using DHCP
-        log_info("Discovering proxy auto config using WPAD (%s)", "DHCP");
-        auto_config_url = wpad_dhcp(WPAD_DHCP_TIMEOUT);
-
-        // Detect proxy auto configuration using DNS
-        if (!auto_config_url) {
-            log_info("Discovering proxy auto config using WPAD (%s)", "DNS");
-            script = wpad_dns(NULL);
-            if (script) {
-                g_proxy_resolver_posix.script = script;
-                g_proxy_resolver_posix.last_fetch_time = time(NULL);
-            }
+        trace_begin(TRACE_EVENT_WPAD_CACHE_MISS);
+        auto_config_url = proxy_resolver_posix_wpad_find(&script);
+        trace_end(TRACE_EVENT_WPAD_CACHE_MISS);
+        if (!auto_config_url && deadline_is_expired()) {
+            // Discovery was cut short, so try again on the next lookup instead of remembering the miss
+            free(script);
+            return NULL;
+        }
+        if (script) {
+            // Script found using DNS does not need to be fetched again
+            proxy_resolver_posix_set_script(script);
+            free(g_proxy_resolver_posix.script_url);
+            g_proxy_resolver_posix.script_url = auto_config_url ? strdup(auto_config_url) : NULL;
+            fetch_cache_free(&g_proxy_resolver_posix.fetch_cache);
+            g_proxy_resolver_posix.last_fetch_time = time(NULL);
+            proxy_resolver_posix_breaker_reset(&g_proxy_resolver_posix.fetch_breaker);
         }
 
-        g_proxy_resolver_posix.auto_config_url = auto_config_url;
-        g_proxy_resolver_posix.last_wpad_time = time(NULL);
+        proxy_resolver_posix_wpad_set_result(auto_config_url);
+
+        if (script)
+            proxy_resolver_posix_cache_save();
     }
 
     // Duplicate so it can be freed the same if proxy_config_get_auto_config_url() returns a string
     return auto_config_url ? strdup(auto_config_url) : NULL;
 }
 
-static char *proxy_resolver_posix_fetch_pac(const char *auto_config_url, int32_t *error) {
-    char *script = NULL;
+static pac_script_s *proxy_resolver_posix_fetch_pac(const char *auto_config_url, int32_t *error) {
+    pac_script_s *script = NULL;
 
     // Check if the auto config url has changed
     bool url_changed = false;
-    if (g_proxy_resolver_posix.auto_config_url)
-        url_changed = strcmp(g_proxy_resolver_posix.auto_config_url, auto_config_url) != 0;
+    if (g_proxy_resolver_posix.script_url)
+        url_changed = strcmp(g_proxy_resolver_posix.script_url, auto_config_url) != 0;
     else
         url_changed = true;
 
+    const time_t now = time(NULL);
+    proxy_resolver_posix_breaker_s *breaker = &g_proxy_resolver_posix.fetch_breaker;
+
     // Check if we need to re-fetch the PAC script
     if (g_proxy_resolver_posix.last_fetch_time > 0 &&
-        g_proxy_resolver_posix.last_fetch_time + WPAD_EXPIRE_SECONDS >= time(NULL) && !url_changed) {
+        g_proxy_resolver_posix.last_fetch_time +
+                proxy_resolver_posix_get_fetch_expire(g_proxy_resolver_posix.fetch_cache.max_age) >=
+            now &&
+        !url_changed) {
         // Use cached version of the PAC script
         script = g_proxy_resolver_posix.script;
+        trace_instant(TRACE_EVENT_PAC_CACHE_HIT, 0);
+    } else if (!url_changed && proxy_resolver_posix_breaker_is_open(breaker, now)) {
+        // Server is failing, so keep using the last good script until it is time to retry
+        script = g_proxy_resolver_posix.script;
+        if (!script)
+            *error = breaker->error;
+        trace_instant(TRACE_EVENT_PAC_CACHE_HIT, 0);
     } else {
         log_info("Fetching proxy auto config script from %s", auto_config_url);
 
-        script = fetch_get(auto_config_url, error);
-        if (!script)
-            log_error("Unable to fetch proxy auto config script %s (%" PRId32 ")", auto_config_url, *error);
+        // Only send validators when refreshing the script we already have
+        if (url_changed || !g_proxy_resolver_posix.script)
+            fetch_cache_free(&g_proxy_resolver_posix.fetch_cache);
+        if (url_changed)
+            proxy_resolver_posix_breaker_reset(breaker);
+
+        trace_begin(TRACE_EVENT_FETCH);
+        char *text = fetch_get_ex(auto_config_url, &g_proxy_resolver_posix.fetch_cache, error);
+        trace_end(TRACE_EVENT_FETCH);
+        if (!text && !g_proxy_resolver_posix.fetch_cache.not_modified && deadline_is_expired()) {
+            // Download was cut short, so keep the current script and try again on the next lookup
+            *error = ETIMEDOUT;
+            return NULL;
+        }
+        if (text || g_proxy_resolver_posix.fetch_cache.not_modified) {
+            if (text) {
+                // Servers without validators resend identical scripts, so compare contents
+                proxy_resolver_posix_set_script(text);
+                free(g_proxy_resolver_posix.script_url);
+                g_proxy_resolver_posix.script_url = strdup(auto_config_url);
+            } else {
+                // Keep existing script so anything derived from it remains valid
+                log_info("Proxy auto config script not modified");
+            }
+            proxy_resolver_posix_breaker_reset(breaker);
+            g_proxy_resolver_posix.last_fetch_time = now;
+        } else {
+            proxy_resolver_posix_breaker_fail(breaker, *error, PAC_RETRY_MIN_SECONDS, PAC_RETRY_MAX_SECONDS);
+            log_error("Unable to fetch proxy auto config script %s (%" PRId32 "), retrying in %" PRId64 " seconds",
+                      auto_config_url, *error, (int64_t)(breaker->retry_time - now));
+
+            if (url_changed || !g_proxy_resolver_posix.script) {
+                // No script to fall back to for this url
+                fetch_cache_free(&g_proxy_resolver_posix.fetch_cache);
+                proxy_resolver_posix_set_script(NULL);
+                free(g_proxy_resolver_posix.script_url);
+                g_proxy_resolver_posix.script_url = strdup(auto_config_url);
+            } else {
+                // Keep the last good script and its validators until the server recovers
+                log_warn("Using last good proxy auto config script from %s", auto_config_url);
+            }
+        }
+        script = g_proxy_resolver_posix.script;
 
-        free(g_proxy_resolver_posix.script);
-        g_proxy_resolver_posix.script = script;
-        g_proxy_resolver_posix.last_fetch_time = time(NULL);
+        proxy_resolver_posix_cache_save();
     }
 
-    return script;
+    // Hold a reference so the script remains valid after the lock is released
+    return script ? pac_script_retain(script) : NULL;
 }
 
 bool proxy_resolver_posix_get_proxies_for_url(void *ctx, const char *url) {
     proxy_resolver_posix_s *proxy_resolver = (proxy_resolver_posix_s *)ctx;
     void *proxy_execute = NULL;
     char *auto_config_url = NULL;
-    char *proxy = NULL;
-    char *script = NULL;
+    pac_script_s *script = NULL;
+    void *cache_lock = NULL;
     bool locked = false;
     bool is_ok = false;
 
-    if (proxy_config_get_auto_discover()) {
-        locked = mutex_lock(g_proxy_resolver_posix.mutex);
-        // Discover the proxy auto config url
-        auto_config_url = proxy_resolver_posix_wpad_discover();
+    locked = mutex_lock(g_proxy_resolver_posix.mutex);
+
+    // Lookup may have used up its time waiting in the queue or for another lookup
+    if (deadline_is_expired()) {
+        proxy_resolver->error = ETIMEDOUT;
+        goto posix_done;
     }
 
+    // Refresh at most once per host when the cache file is shared by other processes
+    cache_lock = proxy_resolver_posix_cache_acquire();
+
+    // Discover the proxy auto config url
+    if (proxy_config_get_auto_discover())
+        auto_config_url = proxy_resolver_posix_wpad_discover();
+
     // Use manually specified proxy auto configuration
     if (!auto_config_url)
         auto_config_url = proxy_config_get_auto_config_url();
 
+    // Discovery that ran out of time has not ruled out a proxy auto config
+    if (!auto_config_url && deadline_is_expired()) {
+        proxy_resolver->error = ETIMEDOUT;
+        goto posix_done;
+    }
+
     if (auto_config_url) {
         // Download proxy auto config script if available
         script = proxy_resolver_posix_fetch_pac(auto_config_url, &proxy_resolver->error);
+        wpad_cache_unlock(&cache_lock);
         locked = locked && !mutex_unlock(g_proxy_resolver_posix.mutex);
 
         if (!script)
@@ -147,7 +621,7 @@ bool proxy_resolver_posix_get_proxies_for_url(void *ctx, const char *url) {
             goto posix_done;
         }
 
-        if (!proxy_execute_get_proxies_for_url(proxy_execute, g_proxy_resolver_posix.script, url)) {
+        if (!proxy_execute_get_proxies_for_script(proxy_execute, script, url)) {
             proxy_resolver->error = proxy_execute_get_error(proxy_execute);
             log_error("Unable to get proxies for url (%" PRId32 ")", proxy_resolver->error);
             goto posix_done;
@@ -155,6 +629,13 @@ bool proxy_resolver_posix_get_proxies_for_url(void *ctx, const char *url) {
 
         // Get return value from FindProxyForURL and convert to uri list. We use default http
         // scheme if PROXY is returned.
+        // Host name lookups made by the script fail once the deadline passes, so the result can not be trusted
+        if (deadline_is_expired()) {
+            proxy_resolver->error = ETIMEDOUT;
+            log_warn("Timed out evaluating proxy auto config script for %s", url);
+            goto posix_done;
+        }
+
         const char *list = proxy_execute_get_list(proxy_execute);
         proxy_resolver->list = convert_proxy_list_to_uri_list(list, "http");
     } else {
@@ -166,13 +647,14 @@ posix_done:
 
     if (proxy_execute)
         proxy_execute_delete(&proxy_execute);
+    wpad_cache_unlock(&cache_lock);
     if (locked)
         mutex_unlock(g_proxy_resolver_posix.mutex);
 
     is_ok = proxy_resolver->list != NULL;
     event_set(proxy_resolver->complete);
 
-    free(proxy);
+    pac_script_release(&script);
     free(auto_config_url);
 
     return is_ok;
@@ -203,7 +685,22 @@ bool proxy_resolver_posix_cancel(void *ctx) {
 }
 
 void *proxy_resolver_posix_create(void) {
-    proxy_resolver_posix_s *proxy_resolver = (proxy_resolver_posix_s *)calloc(1, sizeof(proxy_resolver_posix_s));
+    proxy_resolver_posix_s *proxy_resolver = NULL;
+
+    // Reuse a deleted instance to avoid allocating and initializing another event
+    if (mutex_lock(g_proxy_resolver_posix.pool_mutex)) {
+        proxy_resolver = g_proxy_resolver_posix.pool;
+        if (proxy_resolver) {
+            g_proxy_resolver_posix.pool = proxy_resolver->next;
+            g_proxy_resolver_posix.pool_count--;
+            proxy_resolver->next = NULL;
+        }
+        mutex_unlock(g_proxy_resolver_posix.pool_mutex);
+    }
+    if (proxy_resolver)
+        return proxy_resolver;
+
+    proxy_resolver = (proxy_resolver_posix_s *)calloc(1, sizeof(proxy_resolver_posix_s));
     if (!proxy_resolver)
         return NULL;
     proxy_resolver->complete = event_create();
@@ -221,10 +718,26 @@ bool proxy_resolver_posix_delete(void **ctx) {
     if (!proxy_resolver)
         return false;
     proxy_resolver_posix_cancel(*ctx);
-    event_delete(&proxy_resolver->complete);
-    free(proxy_resolver->list);
-    free(proxy_resolver);
     *ctx = NULL;
+
+    free(proxy_resolver->list);
+    proxy_resolver->list = NULL;
+    proxy_resolver->error = 0;
+
+    bool is_pooled = false;
+    if (event_reset(proxy_resolver->complete) && mutex_lock(g_proxy_resolver_posix.pool_mutex)) {
+        if (g_proxy_resolver_posix.pool_count < RESOLVER_POOL_MAX) {
+            proxy_resolver->next = g_proxy_resolver_posix.pool;
+            g_proxy_resolver_posix.pool = proxy_resolver;
+            g_proxy_resolver_posix.pool_count++;
+            is_pooled = true;
+        }
+        mutex_unlock(g_proxy_resolver_posix.pool_mutex);
+    }
+    if (!is_pooled) {
+        event_delete(&proxy_resolver->complete);
+        free(proxy_resolver);
+    }
     return true;
 }
 
@@ -233,43 +746,175 @@ static void proxy_resolver_posix_wpad_startup(void *arg) {
 
     mutex_lock(g_proxy_resolver_posix.mutex);
 
+    // Another process sharing the cache file may already be discovering
+    void *cache_lock = proxy_resolver_posix_cache_acquire();
+
     // Discover the proxy auto config url
     char *auto_config_url = proxy_resolver_posix_wpad_discover();
     if (auto_config_url) {
         int32_t error = 0;
 
         // Download proxy auto config script if available
-        proxy_resolver_posix_fetch_pac(auto_config_url, &error);
+        pac_script_s *script = proxy_resolver_posix_fetch_pac(auto_config_url, &error);
+        pac_script_release(&script);
         free(auto_config_url);
     }
 
+    wpad_cache_unlock(&cache_lock);
+    mutex_unlock(g_proxy_resolver_posix.mutex);
+}
+
+static void proxy_resolver_posix_cache_revalidate(void *arg) {
+    fetch_cache_s fetch_cache = {NULL, NULL, -1, false};
+    char *auto_config_url = NULL;
+    char *script_url = NULL;
+    char *script = NULL;
+    int32_t error = 0;
+
+    UNUSED(arg);
+
+    // Another process sharing the cache file may have revalidated it already
+    void *cache_lock = wpad_cache_lock(g_proxy_resolver_posix.cache_path, WPAD_CACHE_LOCK_TIMEOUT_MS);
+    mutex_lock(g_proxy_resolver_posix.mutex);
+    const bool revalidated = proxy_resolver_posix_cache_load(false, NULL);
+    // Another process found the server failing and is backing off from it
+    const bool is_backing_off = proxy_resolver_posix_breaker_is_open(&g_proxy_resolver_posix.fetch_breaker, time(NULL));
+    mutex_unlock(g_proxy_resolver_posix.mutex);
+    if (revalidated || is_backing_off) {
+        wpad_cache_unlock(&cache_lock);
+        return;
+    }
+
+    // Discover and fetch without holding the lock so lookups continue to be served from the cache
+    const bool auto_discover = proxy_config_get_auto_discover();
+    if (auto_discover)
+        auto_config_url = proxy_resolver_posix_wpad_find(&script);
+
+    script_url = auto_config_url ? strdup(auto_config_url) : proxy_config_get_auto_config_url();
+    if (script_url && !script) {
+        // Use validators of cached script to make the request conditional
+        mutex_lock(g_proxy_resolver_posix.mutex);
+        if (g_proxy_resolver_posix.script && g_proxy_resolver_posix.script_url &&
+            strcmp(g_proxy_resolver_posix.script_url, script_url) == 0) {
+            fetch_cache_s *cached = &g_proxy_resolver_posix.fetch_cache;
+            fetch_cache.etag = cached->etag ? strdup(cached->etag) : NULL;
+            fetch_cache.last_modified = cached->last_modified ? strdup(cached->last_modified) : NULL;
+        }
+        mutex_unlock(g_proxy_resolver_posix.mutex);
+
+        log_info("Revalidating proxy auto config script from %s", script_url);
+        script = fetch_get_ex(script_url, &fetch_cache, &error);
+        if (!script && !fetch_cache.not_modified)
+            log_warn("Unable to revalidate proxy auto config script %s (%" PRId32 ")", script_url, error);
+    }
+
+    mutex_lock(g_proxy_resolver_posix.mutex);
+
+    if (auto_discover) {
+        proxy_resolver_posix_wpad_set_result(auto_config_url);
+        auto_config_url = NULL;
+    }
+
+    if (script) {
+        proxy_resolver_posix_set_script(script);
+        free(g_proxy_resolver_posix.script_url);
+        g_proxy_resolver_posix.script_url = script_url;
+        fetch_cache_free(&g_proxy_resolver_posix.fetch_cache);
+        g_proxy_resolver_posix.fetch_cache = fetch_cache;
+        g_proxy_resolver_posix.last_fetch_time = time(NULL);
+        proxy_resolver_posix_breaker_reset(&g_proxy_resolver_posix.fetch_breaker);
+        memset(&fetch_cache, 0, sizeof(fetch_cache));
+        script = NULL;
+        script_url = NULL;
+
+        proxy_resolver_posix_cache_save();
+    } else if (fetch_cache.not_modified && g_proxy_resolver_posix.script_url &&
+               strcmp(g_proxy_resolver_posix.script_url, script_url) == 0) {
+        // Cached script is still valid
+        fetch_cache_update(&g_proxy_resolver_posix.fetch_cache, &fetch_cache);
+        g_proxy_resolver_posix.last_fetch_time = time(NULL);
+        proxy_resolver_posix_breaker_reset(&g_proxy_resolver_posix.fetch_breaker);
+
+        proxy_resolver_posix_cache_save();
+    } else if (script_url && g_proxy_resolver_posix.script_url &&
+               strcmp(g_proxy_resolver_posix.script_url, script_url) == 0) {
+        // Lookups keep using the cached script while the server is failing
+        proxy_resolver_posix_breaker_fail(&g_proxy_resolver_posix.fetch_breaker, error, PAC_RETRY_MIN_SECONDS,
+                                          PAC_RETRY_MAX_SECONDS);
+        proxy_resolver_posix_cache_save();
+    }
+
     mutex_unlock(g_proxy_resolver_posix.mutex);
+    wpad_cache_unlock(&cache_lock);
+
+    fetch_cache_free(&fetch_cache);
+    free(script);
+    free(script_url);
+    free(auto_config_url);
 }
 
 bool proxy_resolver_posix_global_init(void) {
-    return proxy_resolver_posix_init_ex(NULL);
+    return proxy_resolver_posix_init_ex(NULL, NULL);
 }
 
-bool proxy_resolver_posix_init_ex(void *threadpool) {
+bool proxy_resolver_posix_init_ex(void *threadpool, const char *cache_path) {
     g_proxy_resolver_posix.mutex = mutex_create();
     if (!g_proxy_resolver_posix.mutex)
         return false;
+    g_proxy_resolver_posix.pool_mutex = mutex_create();
+
+    fetch_cache_free(&g_proxy_resolver_posix.fetch_cache);
 
     if (!fetch_global_init())
         return proxy_resolver_posix_global_cleanup();
 
-    // Start WPAD discovery process immediately
+    // Keep enough threads that DHCP and DNS discovery and the DNS probes never queue behind each other
+    g_proxy_resolver_posix.discover_threadpool = threadpool_create(WPAD_DISCOVER_THREADS, WPAD_DISCOVER_THREADS);
+    wpad_dns_set_threadpool(g_proxy_resolver_posix.discover_threadpool);
+
+    // Serve lookups from the state persisted by a previous process while it is revalidated
+    if (cache_path) {
+        g_proxy_resolver_posix.cache_path = strdup(cache_path);
+        bool is_expired = false;
+        if (proxy_resolver_posix_cache_load(true, &is_expired)) {
+            // State refreshed recently by another process is used as is until it expires
+            if (is_expired && threadpool)
+                threadpool_enqueue_ex(threadpool, THREADPOOL_PRIORITY_BACKGROUND, NULL,
+                                      proxy_resolver_posix_cache_revalidate);
+            return true;
+        }
+    }
+
+    // Start WPAD discovery process immediately, without taking threads that lookups need
     if (threadpool && proxy_config_get_auto_discover())
-        threadpool_enqueue(threadpool, NULL, proxy_resolver_posix_wpad_startup);
+        threadpool_enqueue_ex(threadpool, THREADPOOL_PRIORITY_BACKGROUND, NULL, proxy_resolver_posix_wpad_startup);
 
     return true;
 }
 
 bool proxy_resolver_posix_global_cleanup(void) {
-    free(g_proxy_resolver_posix.script);
+    // Wait for discovery jobs that were no longer needed when their result arrived
+    if (g_proxy_resolver_posix.discover_threadpool) {
+        wpad_dns_set_threadpool(NULL);
+        threadpool_wait(g_proxy_resolver_posix.discover_threadpool);
+        threadpool_delete(&g_proxy_resolver_posix.discover_threadpool);
+    }
+
+    pac_script_release(&g_proxy_resolver_posix.script);
+    free(g_proxy_resolver_posix.script_url);
+    fetch_cache_free(&g_proxy_resolver_posix.fetch_cache);
     free(g_proxy_resolver_posix.auto_config_url);
+    free(g_proxy_resolver_posix.cache_path);
     mutex_delete(&g_proxy_resolver_posix.mutex);
 
+    while (g_proxy_resolver_posix.pool) {
+        proxy_resolver_posix_s *proxy_resolver = g_proxy_resolver_posix.pool;
+        g_proxy_resolver_posix.pool = proxy_resolver->next;
+        event_delete(&proxy_resolver->complete);
+        free(proxy_resolver);
+    }
+    mutex_delete(&g_proxy_resolver_posix.pool_mutex);
+
     fetch_global_cleanup();
 
     memset(&g_proxy_resolver_posix, 0, sizeof(g_proxy_resolver_posix));
@@ -11,7 +11,7 @@ void *proxy_resolver_posix_create(void);
 bool proxy_resolver_posix_delete(void **ctx);
 
 bool proxy_resolver_posix_global_init(void);
-bool proxy_resolver_posix_init_ex(void *threadpool);
+bool proxy_resolver_posix_init_ex(void *threadpool, const char *cache_path);
 bool proxy_resolver_posix_global_cleanup(void);
 
 const proxy_resolver_i_s *proxy_resolver_posix_get_interface(void);
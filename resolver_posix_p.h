@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef PROXYRES_TESTING
+int64_t proxy_resolver_posix_get_retry_delay(int32_t failures, int32_t min_seconds, int32_t max_seconds,
+                                             uint64_t jitter);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,65 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <signal.h>
+
+#include "proxyres/proxyres.h"
+
+#include "daemon_server.h"
+
+static void *g_daemon_server = NULL;
+
+static void handle_signal(int sig) {
+    (void)sig;
+    daemon_server_stop(g_daemon_server);
+}
+
+static int print_help(void) {
+    printf("proxyresd [--help] [--cache-path path] socket_path\n");
+    printf(" answers proxy lookups from clients that call proxy_resolver_set_daemon_socket\n");
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *socket_path = NULL;
+    int exit_code = 0;
+
+    for (int32_t argi = 1; argi < argc; argi++) {
+        if (strcmp(argv[argi], "--help") == 0) {
+            print_help();
+            return 0;
+        } else if (strcmp(argv[argi], "--cache-path") == 0 && argi + 1 < argc) {
+            proxy_resolver_set_cache_path(argv[++argi]);
+        } else if (!socket_path) {
+            socket_path = argv[argi];
+        } else {
+            return print_help();
+        }
+    }
+    if (!socket_path)
+        return print_help();
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!proxyres_global_init())
+        return 1;
+
+    g_daemon_server = daemon_server_create(socket_path);
+    if (!g_daemon_server) {
+        proxyres_global_cleanup();
+        return 1;
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    if (!daemon_server_run(g_daemon_server))
+        exit_code = 1;
+
+    daemon_server_delete(&g_daemon_server);
+    proxyres_global_cleanup();
+    return exit_code;
+}
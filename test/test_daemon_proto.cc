@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "daemon_proto.h"
+
+TEST(daemon_proto, encode_decode) {
+    const char *url = "https://example.com/";
+    daemon_proto_frame_s frame = {0};
+    frame.id = 0x01020304;
+    frame.type = DAEMON_PROTO_TYPE_RESOLVE;
+    frame.error = -2;
+    frame.payload = url;
+    frame.payload_len = (uint32_t)strlen(url);
+
+    uint8_t buffer[128];
+    const size_t frame_len = daemon_proto_encode(&frame, buffer, sizeof(buffer));
+    EXPECT_EQ(frame_len, DAEMON_PROTO_HEADER_LEN + strlen(url));
+
+    daemon_proto_frame_s decoded = {0};
+    EXPECT_EQ(daemon_proto_decode(buffer, frame_len, &decoded), (int32_t)frame_len);
+    EXPECT_EQ(decoded.id, frame.id);
+    EXPECT_EQ(decoded.type, frame.type);
+    EXPECT_EQ(decoded.error, frame.error);
+    EXPECT_EQ(decoded.payload_len, frame.payload_len);
+    EXPECT_EQ(memcmp(decoded.payload, url, decoded.payload_len), 0);
+}
+
+TEST(daemon_proto, decode_incomplete) {
+    daemon_proto_frame_s frame = {0};
+    frame.id = 1;
+    frame.type = DAEMON_PROTO_TYPE_RESULT;
+    frame.payload = "DIRECT";
+    frame.payload_len = 6;
+
+    uint8_t buffer[64];
+    const size_t frame_len = daemon_proto_encode(&frame, buffer, sizeof(buffer));
+    EXPECT_GT(frame_len, 0);
+
+    daemon_proto_frame_s decoded = {0};
+    EXPECT_EQ(daemon_proto_decode(buffer, DAEMON_PROTO_HEADER_LEN - 1, &decoded), 0);
+    EXPECT_EQ(daemon_proto_decode(buffer, frame_len - 1, &decoded), 0);
+    EXPECT_EQ(daemon_proto_decode(buffer, frame_len, &decoded), (int32_t)frame_len);
+}
+
+TEST(daemon_proto, decode_invalid) {
+    uint8_t buffer[DAEMON_PROTO_HEADER_LEN] = {0};
+    daemon_proto_frame_s decoded = {0};
+
+    // Unknown frame type
+    buffer[8] = 0xff;
+    EXPECT_EQ(daemon_proto_decode(buffer, sizeof(buffer), &decoded), -1);
+
+    // Payload larger than allowed
+    buffer[8] = DAEMON_PROTO_TYPE_RESOLVE;
+    buffer[0] = 0xff;
+    buffer[1] = 0xff;
+    buffer[2] = 0xff;
+    EXPECT_EQ(daemon_proto_decode(buffer, sizeof(buffer), &decoded), -1);
+}
+
+TEST(daemon_proto, encode_too_small) {
+    daemon_proto_frame_s frame = {0};
+    frame.type = DAEMON_PROTO_TYPE_RESOLVE;
+    frame.payload = "https://example.com/";
+    frame.payload_len = 20;
+
+    uint8_t buffer[DAEMON_PROTO_HEADER_LEN + 4];
+    EXPECT_EQ(daemon_proto_encode(&frame, buffer, sizeof(buffer)), 0);
+}
+
+TEST(daemon_proto, reader_pipelined) {
+    int sfds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sfds), 0);
+
+    // Send several frames back to back as a pipelining client would
+    for (uint32_t id = 1; id <= 3; id++) {
+        daemon_proto_frame_s frame = {0};
+        frame.id = id;
+        frame.type = DAEMON_PROTO_TYPE_RESOLVE;
+        frame.payload = "http://example.com/";
+        frame.payload_len = 19;
+        EXPECT_TRUE(daemon_proto_send(sfds[0], &frame));
+    }
+    close(sfds[0]);
+
+    daemon_proto_reader_s reader = {0};
+    daemon_proto_frame_s frame = {0};
+    uint32_t next_id = 1;
+    while (daemon_proto_reader_recv(&reader, sfds[1])) {
+        while (daemon_proto_reader_next(&reader, &frame) > 0)
+            EXPECT_EQ(frame.id, next_id++);
+    }
+    EXPECT_EQ(next_id, 4);
+
+    daemon_proto_reader_free(&reader);
+    close(sfds[1]);
+}
@@ -0,0 +1,61 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "deadline.h"
+#include "net_util.h"
+#include "util.h"
+
+class deadline : public ::testing::Test {
+   protected:
+    void TearDown() override {
+        deadline_set(0);
+    }
+};
+
+TEST_F(deadline, none) {
+    EXPECT_EQ(deadline_get(), 0);
+    EXPECT_FALSE(deadline_is_expired());
+    EXPECT_EQ(deadline_clamp(1234), 1234);
+    EXPECT_EQ(deadline_clamp_timeout(100), 100);
+    EXPECT_EQ(deadline_clamp_timeout(-1), -1);
+}
+
+TEST_F(deadline, clamp) {
+    const int64_t now = get_monotonic_time_ms();
+    deadline_set(now + 50);
+    EXPECT_FALSE(deadline_is_expired());
+    EXPECT_EQ(deadline_clamp(now + 1000), now + 50);
+    EXPECT_EQ(deadline_clamp(now + 10), now + 10);
+    EXPECT_EQ(deadline_clamp_timeout(10), 10);
+    EXPECT_LE(deadline_clamp_timeout(1000), 50);
+    EXPECT_GE(deadline_clamp_timeout(1000), 0);
+    EXPECT_LE(deadline_clamp_timeout(-1), 50);
+    EXPECT_GE(deadline_clamp_timeout(-1), 0);
+}
+
+TEST_F(deadline, expired) {
+    deadline_set(get_monotonic_time_ms() - 1);
+    EXPECT_TRUE(deadline_is_expired());
+    EXPECT_EQ(deadline_clamp_timeout(1000), 0);
+    EXPECT_EQ(deadline_clamp_timeout(-1), 0);
+
+    // Host names are not resolved once the deadline has passed
+    int32_t error = 0;
+    char *address = dns_resolve("localhost", &error);
+    EXPECT_EQ(address, nullptr);
+    EXPECT_EQ(error, ETIMEDOUT);
+    free(address);
+}
+
+TEST_F(deadline, per_thread) {
+    deadline_set(get_monotonic_time_ms() - 1);
+    std::thread worker([] { EXPECT_FALSE(deadline_is_expired()); });
+    worker.join();
+    EXPECT_TRUE(deadline_is_expired());
+}
@@ -0,0 +1,72 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <chrono>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "event.h"
+
+using namespace std::chrono;
+
+TEST(event, wait_zero_timeout) {
+    void *event = event_create();
+    ASSERT_NE(event, nullptr);
+    auto start = steady_clock::now();
+    EXPECT_FALSE(event_wait(event, 0));
+    EXPECT_LT(steady_clock::now() - start, milliseconds(50));
+    EXPECT_TRUE(event_set(event));
+    EXPECT_TRUE(event_wait(event, 0));
+    EXPECT_TRUE(event_delete(&event));
+    ASSERT_EQ(event, nullptr);
+}
+
+TEST(event, reset) {
+    void *event = event_create();
+    ASSERT_NE(event, nullptr);
+    EXPECT_TRUE(event_set(event));
+    EXPECT_TRUE(event_reset(event));
+    EXPECT_FALSE(event_wait(event, 0));
+    EXPECT_TRUE(event_delete(&event));
+}
+
+TEST(event, wait_timeout_latency) {
+    const int32_t timeout_ms = 200;
+    void *event = event_create();
+    ASSERT_NE(event, nullptr);
+
+    // Wait must block for the whole timeout without spinning on the processor
+    const clock_t cpu_start = clock();
+    auto start = steady_clock::now();
+    EXPECT_FALSE(event_wait(event, timeout_ms));
+    auto elapsed = duration_cast<milliseconds>(steady_clock::now() - start);
+    auto cpu_elapsed_ms = (clock() - cpu_start) * 1000 / CLOCKS_PER_SEC;
+
+    // Allow for timer resolution on either side of the deadline
+    EXPECT_GE(elapsed.count(), timeout_ms - 20);
+    EXPECT_LT(elapsed.count(), timeout_ms + 500);
+    EXPECT_LT(cpu_elapsed_ms, timeout_ms / 4);
+    EXPECT_TRUE(event_delete(&event));
+}
+
+TEST(event, wait_signalled_latency) {
+    void *event = event_create();
+    ASSERT_NE(event, nullptr);
+
+    std::thread setter([event] {
+        std::this_thread::sleep_for(milliseconds(50));
+        event_set(event);
+    });
+
+    // Wait returns as soon as the event is signalled rather than at the timeout
+    auto start = steady_clock::now();
+    EXPECT_TRUE(event_wait(event, 10000));
+    auto elapsed = duration_cast<milliseconds>(steady_clock::now() - start);
+    setter.join();
+
+    EXPECT_GE(elapsed.count(), 30);
+    EXPECT_LT(elapsed.count(), 2000);
+    EXPECT_TRUE(event_delete(&event));
+}
@@ -1,11 +1,29 @@
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#  include <arpa/inet.h>
+#  include <netinet/in.h>
+#  include <sys/socket.h>
+#  include <unistd.h>
+#endif
+
 #include <gtest/gtest.h>
 
+#ifdef HAVE_ZLIB
+#  include <zlib.h>
+#endif
+
 #include "fetch.h"
+#include "fetch_http.h"
+#include "util.h"
 
 TEST(fetch, get) {
     int32_t error = 0;
@@ -14,7 +32,7 @@ TEST(fetch, get) {
     const char *expected_string = "world's information";
 #else
     const char *url = "http://google.com/";
-    const char *expected_string = "document has moved";
+    const char *expected_string = "google";
 #endif
     char *body = fetch_get(url, &error);
     EXPECT_EQ(error, 0);
@@ -24,3 +42,447 @@ TEST(fetch, get) {
         free(body);
     }
 }
+
+TEST(fetch, cache_parse_header) {
+    fetch_cache_s cache = {nullptr, nullptr, -1, false};
+    const char *etag = "ETag:  \"33a64df551425fcc55e4d42a148795d9f25f89d4\" ";
+    const char *last_modified = "last-modified: Wed, 21 Oct 2015 07:28:00 GMT";
+    const char *content_type = "Content-Type: application/x-ns-proxy-autoconfig";
+
+    EXPECT_TRUE(fetch_cache_parse_header(&cache, etag, strlen(etag)));
+    EXPECT_TRUE(fetch_cache_parse_header(&cache, last_modified, strlen(last_modified)));
+    EXPECT_FALSE(fetch_cache_parse_header(&cache, content_type, strlen(content_type)));
+
+    EXPECT_STREQ(cache.etag, "\"33a64df551425fcc55e4d42a148795d9f25f89d4\"");
+    EXPECT_STREQ(cache.last_modified, "Wed, 21 Oct 2015 07:28:00 GMT");
+    EXPECT_EQ(cache.max_age, -1);
+
+    fetch_cache_free(&cache);
+    EXPECT_EQ(cache.etag, nullptr);
+    EXPECT_EQ(cache.last_modified, nullptr);
+}
+
+struct fetch_max_age_param {
+    const char *header;
+    int32_t expected;
+
+    friend std::ostream &operator<<(std::ostream &os, const fetch_max_age_param &param) {
+        return os << "header: " << param.header;
+    }
+};
+
+constexpr fetch_max_age_param fetch_max_age_tests[] = {
+    {"Cache-Control: max-age=600", 600},
+    {"Cache-Control: public, max-age=3600, must-revalidate", 3600},
+    {"cache-control: MAX-AGE=10", 10},
+    // Revalidated at the default interval instead of expiring straight away
+    {"Cache-Control: no-cache", -1},
+    {"Cache-Control: private, NO-CACHE", -1},
+    {"Cache-Control: no-store, max-age=600", -1},
+    {"Cache-Control: public", -1},
+    {"Cache-Control: max-age=", -1},
+    {"Cache-Control: max-age=99999999999", INT32_MAX},
+};
+
+class fetch_max_age : public ::testing::TestWithParam<fetch_max_age_param> {};
+
+INSTANTIATE_TEST_SUITE_P(fetch, fetch_max_age, testing::ValuesIn(fetch_max_age_tests));
+
+TEST_P(fetch_max_age, parse_header) {
+    const auto &param = GetParam();
+    fetch_cache_s cache = {nullptr, nullptr, -1, false};
+    EXPECT_TRUE(fetch_cache_parse_header(&cache, param.header, strlen(param.header)));
+    EXPECT_EQ(cache.max_age, param.expected);
+    fetch_cache_free(&cache);
+}
+
+TEST(fetch, cache_update) {
+    fetch_cache_s cache = {strdup("\"old\""), strdup("Wed, 21 Oct 2015 07:28:00 GMT"), 60, false};
+    fetch_cache_s response = {strdup("\"new\""), nullptr, 120, false};
+
+    fetch_cache_update(&cache, &response);
+    EXPECT_STREQ(cache.etag, "\"new\"");
+    EXPECT_STREQ(cache.last_modified, "Wed, 21 Oct 2015 07:28:00 GMT");
+    EXPECT_EQ(cache.max_age, 120);
+    EXPECT_EQ(response.etag, nullptr);
+
+    fetch_cache_free(&response);
+    fetch_cache_free(&cache);
+}
+
+#ifndef _WIN32
+// Listen on a loopback port and return the url prefix requests to it start with
+static int fetch_test_listen(std::string *base_url) {
+    struct sockaddr_in address = {0};
+    socklen_t address_len = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int sfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sfd == -1)
+        return -1;
+    if (bind(sfd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(sfd, 1) != 0 ||
+        getsockname(sfd, (struct sockaddr *)&address, &address_len) != 0) {
+        close(sfd);
+        return -1;
+    }
+    *base_url = "http://127.0.0.1:" + std::to_string(ntohs(address.sin_port));
+    return sfd;
+}
+
+// Answer one connection per response, keeping the requests that were received
+static std::thread fetch_test_serve(int sfd, std::vector<std::string> responses, std::vector<std::string> *requests) {
+    return std::thread([sfd, responses, requests]() {
+        for (const std::string &response : responses) {
+            char request[4096];
+            int cfd = accept(sfd, NULL, NULL);
+            if (cfd == -1)
+                return;
+            const ssize_t request_len = recv(cfd, request, sizeof(request), 0);
+            EXPECT_GT(request_len, 0);
+            if (requests && request_len > 0)
+                requests->push_back(std::string(request, (size_t)request_len));
+            EXPECT_EQ(send(cfd, response.c_str(), response.size(), 0), (ssize_t)response.size());
+            close(cfd);
+        }
+    });
+}
+
+TEST(fetch, not_modified_then_failure) {
+    std::string base_url;
+    int sfd = fetch_test_listen(&base_url);
+    ASSERT_NE(sfd, -1);
+    const std::string url = base_url + "/proxy.pac";
+
+    // Answer a single request with not modified
+    std::thread server =
+        fetch_test_serve(sfd, {"HTTP/1.1 304 Not Modified\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"}, nullptr);
+
+    fetch_cache_s cache = {strdup("\"etag\""), nullptr, -1, false};
+    int32_t error = 0;
+    EXPECT_EQ(fetch_get_ex(url.c_str(), &cache, &error), nullptr);
+    EXPECT_EQ(error, 0);
+    EXPECT_TRUE(cache.not_modified);
+    server.join();
+    close(sfd);
+
+    // Failed fetch must not look like the script was not modified
+    EXPECT_EQ(fetch_get_ex(url.c_str(), &cache, &error), nullptr);
+    EXPECT_NE(error, 0);
+    EXPECT_FALSE(cache.not_modified);
+    fetch_cache_free(&cache);
+}
+
+TEST(fetch, error_status_keeps_validators) {
+    std::string base_url;
+    int sfd = fetch_test_listen(&base_url);
+    ASSERT_NE(sfd, -1);
+    const std::string url = base_url + "/proxy.pac";
+
+    // Error page with its own validators is not a script
+    std::thread server = fetch_test_serve(sfd,
+                                          {"HTTP/1.1 404 Not Found\r\nETag: \"error\"\r\nContent-Length: 9\r\n"
+                                           "Connection: close\r\n\r\nNot Found"},
+                                          nullptr);
+
+    fetch_cache_s cache = {strdup("\"etag\""), nullptr, -1, false};
+    int32_t error = 0;
+    EXPECT_EQ(fetch_get_ex(url.c_str(), &cache, &error), nullptr);
+    EXPECT_NE(error, 0);
+    EXPECT_FALSE(cache.not_modified);
+    EXPECT_STREQ(cache.etag, "\"etag\"");
+    server.join();
+    close(sfd);
+    fetch_cache_free(&cache);
+}
+
+TEST(fetch, redirect_without_validators) {
+    std::string base_url;
+    int sfd = fetch_test_listen(&base_url);
+    ASSERT_NE(sfd, -1);
+    const std::string url = base_url + "/proxy.pac";
+
+    // Redirect to another location that does not know about our validators
+    std::vector<std::string> requests;
+    std::thread server = fetch_test_serve(sfd,
+                                          {"HTTP/1.1 302 Found\r\nLocation: /other.pac\r\nContent-Length: 0\r\n"
+                                           "Connection: close\r\n\r\n",
+                                           "HTTP/1.1 200 OK\r\nContent-Length: 6\r\nConnection: close\r\n\r\nDIRECT"},
+                                          &requests);
+
+    fetch_cache_s cache = {strdup("\"etag\""), strdup("Wed, 21 Oct 2015 07:28:00 GMT"), -1, false};
+    int32_t error = 0;
+    char *script = fetch_get_ex(url.c_str(), &cache, &error);
+    EXPECT_STREQ(script, "DIRECT");
+    EXPECT_EQ(error, 0);
+    server.join();
+    close(sfd);
+
+    ASSERT_EQ(requests.size(), 2u);
+    EXPECT_NE(requests[0].find("If-None-Match: \"etag\""), std::string::npos);
+    EXPECT_NE(requests[0].find("If-Modified-Since: "), std::string::npos);
+    EXPECT_EQ(requests[1].find("If-None-Match: "), std::string::npos);
+    EXPECT_EQ(requests[1].find("If-Modified-Since: "), std::string::npos);
+    free(script);
+    fetch_cache_free(&cache);
+}
+#endif
+
+// Feed response to parser one byte at a time to exercise state carried between reads
+static bool fetch_http_parse_bytewise(fetch_http_s *http, const char *response, size_t response_len) {
+    for (size_t i = 0; i < response_len; i++) {
+        if (!fetch_http_parse(http, response + i, 1))
+            return false;
+    }
+    return true;
+}
+
+TEST(fetch_http, content_length) {
+    const char *response =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/x-ns-proxy-autoconfig\r\n"
+        "ETag: \"abc\"\r\n"
+        "Content-Length: 6\r\n"
+        "\r\n"
+        "DIRECTtrailing";
+    fetch_http_s http;
+    fetch_http_init(&http, SCRIPT_MAX);
+
+    EXPECT_TRUE(fetch_http_parse_bytewise(&http, response, strlen(response)));
+    EXPECT_TRUE(fetch_http_is_done(&http));
+    EXPECT_EQ(http.status_code, 200);
+    EXPECT_STREQ(http.cache.etag, "\"abc\"");
+
+    char *body = fetch_http_take_body(&http);
+    EXPECT_STREQ(body, "DIRECT");
+    free(body);
+    fetch_http_free(&http);
+}
+
+TEST(fetch_http, chunked) {
+    const char *response =
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "3;ext=1\r\n"
+        "DIR\r\n"
+        "a\r\n"
+        "ECT; PROXY\r\n"
+        "0\r\n"
+        "Trailer: value\r\n"
+        "\r\n";
+    fetch_http_s http;
+    fetch_http_init(&http, SCRIPT_MAX);
+
+    EXPECT_TRUE(fetch_http_parse_bytewise(&http, response, strlen(response)));
+    EXPECT_TRUE(fetch_http_is_done(&http));
+
+    char *body = fetch_http_take_body(&http);
+    EXPECT_STREQ(body, "DIRECT; PROXY");
+    free(body);
+    fetch_http_free(&http);
+}
+
+TEST(fetch_http, close_delimited) {
+    const char *response = "HTTP/1.0 200 OK\r\n\r\nDIRECT";
+    fetch_http_s http;
+    fetch_http_init(&http, SCRIPT_MAX);
+
+    EXPECT_TRUE(fetch_http_parse(&http, response, strlen(response)));
+    EXPECT_FALSE(fetch_http_is_done(&http));
+    EXPECT_TRUE(fetch_http_finish(&http));
+
+    char *body = fetch_http_take_body(&http);
+    EXPECT_STREQ(body, "DIRECT");
+    free(body);
+    fetch_http_free(&http);
+}
+
+TEST(fetch_http, large_headers) {
+    std::string response = "HTTP/1.1 200 OK\r\nSet-Cookie: ";
+    response.append(4000, 'x');
+    response += "\r\nContent-Length: 6\r\n\r\nDIRECT";
+    fetch_http_s http;
+    fetch_http_init(&http, SCRIPT_MAX);
+
+    EXPECT_TRUE(fetch_http_parse(&http, response.c_str(), response.size()));
+    EXPECT_TRUE(fetch_http_is_done(&http));
+    EXPECT_EQ(http.body_len, 6u);
+    fetch_http_free(&http);
+}
+
+TEST(fetch_http, not_modified) {
+    const char *response = "HTTP/1.1 304 Not Modified\r\nCache-Control: max-age=60\r\n\r\n";
+    fetch_http_s http;
+    fetch_http_init(&http, SCRIPT_MAX);
+
+    EXPECT_TRUE(fetch_http_parse(&http, response, strlen(response)));
+    EXPECT_TRUE(fetch_http_is_done(&http));
+    EXPECT_EQ(http.status_code, 304);
+    EXPECT_EQ(http.cache.max_age, 60);
+    fetch_http_free(&http);
+}
+
+TEST(fetch_http, body_too_large) {
+    const char *response = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n10\r\n0123456789abcdef\r\n0\r\n\r\n";
+    fetch_http_s http;
+    fetch_http_init(&http, 8);
+
+    EXPECT_FALSE(fetch_http_parse(&http, response, strlen(response)));
+    EXPECT_EQ(http.error, EFBIG);
+    fetch_http_free(&http);
+}
+
+TEST(fetch_http, truncated) {
+    const char *response = "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nDIRECT";
+    fetch_http_s http;
+    fetch_http_init(&http, SCRIPT_MAX);
+
+    EXPECT_TRUE(fetch_http_parse(&http, response, strlen(response)));
+    EXPECT_FALSE(fetch_http_finish(&http));
+    fetch_http_free(&http);
+}
+
+#ifdef HAVE_ZLIB
+TEST(fetch_http, gzip) {
+    const uint8_t gzip_body[] = {
+        0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x4b, 0x2b, 0xcd, 0x4b, 0x2e, 0xc9,
+        0xcc, 0xcf, 0x53, 0x70, 0xcb, 0xcc, 0x4b, 0x09, 0x28, 0xca, 0xaf, 0xa8, 0x74, 0xcb, 0x2f, 0x0a,
+        0x0d, 0xf2, 0xd1, 0x28, 0x2d, 0xca, 0xd1, 0x51, 0xc8, 0xc8, 0x2f, 0x2e, 0xd1, 0x54, 0xa8, 0x56,
+        0x28, 0x4a, 0x2d, 0x29, 0x2d, 0xca, 0x53, 0x50, 0x72, 0xf1, 0x0c, 0x72, 0x75, 0x0e, 0x51, 0xb2,
+        0x56, 0xa8, 0x05, 0x00, 0x12, 0x05, 0x55, 0x99, 0x38, 0x00, 0x00, 0x00};
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nContent-Length: " +
+                           std::to_string(sizeof(gzip_body)) + "\r\n\r\n";
+    response.append((const char *)gzip_body, sizeof(gzip_body));
+    fetch_http_s http;
+    fetch_http_init(&http, SCRIPT_MAX);
+
+    EXPECT_TRUE(fetch_http_parse_bytewise(&http, response.c_str(), response.size()));
+    EXPECT_TRUE(fetch_http_is_done(&http));
+
+    char *body = fetch_http_take_body(&http);
+    EXPECT_STREQ(body, "function FindProxyForURL(url, host) { return \"DIRECT\"; }");
+    free(body);
+    fetch_http_free(&http);
+}
+
+TEST(fetch_http, raw_deflate) {
+    // Deflate data without the zlib header as sent by some servers
+    const char *script = "function FindProxyForURL(url, host) { return \"DIRECT\"; }";
+    z_stream zstream = {0};
+    ASSERT_EQ(deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY), Z_OK);
+    std::string compressed(deflateBound(&zstream, (uLong)strlen(script)), '\0');
+    zstream.next_in = (Bytef *)script;
+    zstream.avail_in = (uInt)strlen(script);
+    zstream.next_out = (Bytef *)&compressed[0];
+    zstream.avail_out = (uInt)compressed.size();
+    ASSERT_EQ(deflate(&zstream, Z_FINISH), Z_STREAM_END);
+    compressed.resize(zstream.total_out);
+    deflateEnd(&zstream);
+
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Encoding: deflate\r\nContent-Length: " +
+                           std::to_string(compressed.size()) + "\r\n\r\n" + compressed;
+    fetch_http_s http;
+    fetch_http_init(&http, SCRIPT_MAX);
+
+    EXPECT_TRUE(fetch_http_parse(&http, response.c_str(), response.size()));
+    EXPECT_TRUE(fetch_http_is_done(&http));
+
+    char *body = fetch_http_take_body(&http);
+    EXPECT_STREQ(body, script);
+    free(body);
+    fetch_http_free(&http);
+}
+
+TEST(fetch_http, decompressed_body_too_large) {
+    // Highly compressible body that expands well beyond the maximum body length
+    std::string script(65536, ' ');
+    uLongf compressed_len = compressBound((uLong)script.size());
+    std::string compressed(compressed_len, '\0');
+    ASSERT_EQ(compress((Bytef *)&compressed[0], &compressed_len, (const Bytef *)script.data(), (uLong)script.size()),
+              Z_OK);
+    compressed.resize(compressed_len);
+
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Encoding: deflate\r\nContent-Length: " +
+                           std::to_string(compressed.size()) + "\r\n\r\n" + compressed;
+    fetch_http_s http;
+    fetch_http_init(&http, 1024);
+
+    EXPECT_FALSE(fetch_http_parse(&http, response.c_str(), response.size()));
+    EXPECT_EQ(http.error, EFBIG);
+    EXPECT_LE(http.body_len, 1024u);
+    fetch_http_free(&http);
+}
+#endif
+
+#ifdef HAVE_BROTLI
+TEST(fetch_http, brotli) {
+    const uint8_t brotli_body[] = {
+        0x8b, 0x1b, 0x80, 0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x46, 0x69, 0x6e, 0x64,
+        0x50, 0x72, 0x6f, 0x78, 0x79, 0x46, 0x6f, 0x72, 0x55, 0x52, 0x4c, 0x28, 0x75, 0x72, 0x6c, 0x2c,
+        0x20, 0x68, 0x6f, 0x73, 0x74, 0x29, 0x20, 0x7b, 0x20, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20,
+        0x22, 0x44, 0x49, 0x52, 0x45, 0x43, 0x54, 0x22, 0x3b, 0x20, 0x7d, 0x03};
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Encoding: br\r\nContent-Length: " +
+                           std::to_string(sizeof(brotli_body)) + "\r\n\r\n";
+    response.append((const char *)brotli_body, sizeof(brotli_body));
+    fetch_http_s http;
+    fetch_http_init(&http, SCRIPT_MAX);
+
+    EXPECT_TRUE(fetch_http_parse_bytewise(&http, response.c_str(), response.size()));
+    EXPECT_TRUE(fetch_http_is_done(&http));
+
+    char *body = fetch_http_take_body(&http);
+    EXPECT_STREQ(body, "function FindProxyForURL(url, host) { return \"DIRECT\"; }");
+    free(body);
+    fetch_http_free(&http);
+}
+#endif
+
+TEST(fetch_http, unsupported_encoding) {
+    const char *response = "HTTP/1.1 200 OK\r\nContent-Encoding: compress\r\nContent-Length: 6\r\n\r\nDIRECT";
+    fetch_http_s http;
+    fetch_http_init(&http, SCRIPT_MAX);
+
+    EXPECT_FALSE(fetch_http_parse(&http, response, strlen(response)));
+    EXPECT_EQ(http.error, ENOTSUP);
+    fetch_http_free(&http);
+}
+
+TEST(fetch_http, redirect) {
+    const char *response = "HTTP/1.1 302 Found\r\nLocation: /proxy.pac\r\nContent-Length: 0\r\n\r\n";
+    fetch_http_s http;
+    fetch_http_init(&http, SCRIPT_MAX);
+
+    EXPECT_TRUE(fetch_http_parse(&http, response, strlen(response)));
+    EXPECT_TRUE(fetch_http_is_done(&http));
+    EXPECT_TRUE(fetch_http_is_redirect(&http));
+    EXPECT_STREQ(http.location, "/proxy.pac");
+    fetch_http_free(&http);
+}
+
+struct fetch_location_param {
+    const char *url;
+    const char *location;
+    const char *expected;
+
+    friend std::ostream &operator<<(std::ostream &os, const fetch_location_param &param) {
+        return os << "location: " << param.location;
+    }
+};
+
+constexpr fetch_location_param fetch_location_tests[] = {
+    {"http://wpad.example.com/wpad.dat", "http://pac.example.com/proxy.pac", "http://pac.example.com/proxy.pac"},
+    {"http://wpad.example.com:8080/wpad.dat", "/proxy.pac", "http://wpad.example.com:8080/proxy.pac"},
+    {"http://wpad.example.com/pac/wpad.dat", "proxy.pac", "http://wpad.example.com/pac/proxy.pac"},
+    {"http://wpad.example.com/wpad.dat", "//pac.example.com/proxy.pac", "http://pac.example.com/proxy.pac"},
+};
+
+class fetch_location : public ::testing::TestWithParam<fetch_location_param> {};
+
+INSTANTIATE_TEST_SUITE_P(fetch_http, fetch_location, testing::ValuesIn(fetch_location_tests));
+
+TEST_P(fetch_location, resolve) {
+    const auto &param = GetParam();
+    char *resolved = fetch_http_resolve_location(param.url, param.location);
+    EXPECT_STREQ(resolved, param.expected);
+    free(resolved);
+}
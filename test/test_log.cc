@@ -0,0 +1,83 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "log.h"
+
+struct log_entry {
+    int32_t level;
+    std::string subsystem;
+    int32_t event_id;
+    std::vector<std::pair<std::string, std::string>> fields;
+    std::string message;
+};
+
+static std::vector<log_entry> log_entries;
+
+static void log_structured(int32_t level, const char *subsystem, int32_t event_id, const proxy_log_field_s *fields,
+                           size_t fields_len, const char *message) {
+    log_entry entry = {level, subsystem ? subsystem : "", event_id, {}, message};
+    for (size_t i = 0; i < fields_len; i++)
+        entry.fields.emplace_back(fields[i].key, fields[i].value);
+    log_entries.push_back(entry);
+}
+
+class proxy_log : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        log_entries.clear();
+        proxy_log_set_structured_cb(log_structured);
+    }
+    void TearDown() override {
+        proxy_log_set_structured_cb(NULL);
+        proxy_log_set_level(PROXY_LOG_LEVEL_DEBUG);
+    }
+};
+
+TEST_F(proxy_log, level) {
+    proxy_log_set_level(PROXY_LOG_LEVEL_WARN);
+    EXPECT_EQ(proxy_log_get_level(), PROXY_LOG_LEVEL_WARN);
+    log_info("info %d", 1);
+    log_warn("warn %d", 2);
+    log_error("error %d", 3);
+    ASSERT_EQ(log_entries.size(), 2);
+    EXPECT_EQ(log_entries[0].level, PROXY_LOG_LEVEL_WARN);
+    EXPECT_EQ(log_entries[0].message, "warn 2");
+    EXPECT_EQ(log_entries[0].event_id, PROXY_LOG_EVENT_NONE);
+    EXPECT_EQ(log_entries[1].level, PROXY_LOG_LEVEL_ERROR);
+    EXPECT_EQ(log_entries[1].message, "error 3");
+}
+
+TEST_F(proxy_log, level_none) {
+    proxy_log_set_level(PROXY_LOG_LEVEL_NONE);
+    EXPECT_FALSE(log_is_enabled(PROXY_LOG_LEVEL_ERROR));
+    log_error("error");
+    EXPECT_TRUE(log_entries.empty());
+}
+
+TEST_F(proxy_log, level_clamped) {
+    proxy_log_set_level(100);
+    EXPECT_EQ(proxy_log_get_level(), PROXY_LOG_LEVEL_DEBUG);
+    proxy_log_set_level(-1);
+    EXPECT_EQ(proxy_log_get_level(), PROXY_LOG_LEVEL_NONE);
+}
+
+TEST_F(proxy_log, structured_event) {
+    const proxy_log_field_s fields[] = {{"url", "http://example.com/"}, {"list", "direct://"}};
+    log_event(PROXY_LOG_LEVEL_INFO, "resolver", PROXY_LOG_EVENT_LOOKUP_COMPLETE, fields, 2, "Lookup for %s",
+              "http://example.com/");
+    ASSERT_EQ(log_entries.size(), 1);
+    EXPECT_EQ(log_entries[0].level, PROXY_LOG_LEVEL_INFO);
+    EXPECT_EQ(log_entries[0].subsystem, "resolver");
+    EXPECT_EQ(log_entries[0].event_id, PROXY_LOG_EVENT_LOOKUP_COMPLETE);
+    ASSERT_EQ(log_entries[0].fields.size(), 2);
+    EXPECT_EQ(log_entries[0].fields[0].first, "url");
+    EXPECT_EQ(log_entries[0].fields[0].second, "http://example.com/");
+    EXPECT_EQ(log_entries[0].fields[1].first, "list");
+    EXPECT_EQ(log_entries[0].fields[1].second, "direct://");
+    EXPECT_EQ(log_entries[0].message, "Lookup for http://example.com/");
+}
@@ -15,3 +15,7 @@ static inline bool print_adapter(void *user_data, net_adapter_s *adapter) {
 TEST(net_adapter, enum) {
     net_adapter_enum(NULL, print_adapter);
 }
+
+TEST(net_adapter, fingerprint) {
+    EXPECT_EQ(net_adapter_get_fingerprint(), net_adapter_get_fingerprint());
+}
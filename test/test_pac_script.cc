@@ -0,0 +1,46 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <gtest/gtest.h>
+
+#include "pac_script.h"
+#include "util.h"
+
+static const char *pac_script_text = "function FindProxyForURL(url, host) { return \"DIRECT\"; }";
+
+TEST(pac_script, create) {
+    pac_script_s *script = pac_script_create(strdup(pac_script_text));
+    ASSERT_NE(script, nullptr);
+    EXPECT_STREQ(script->text, pac_script_text);
+    EXPECT_EQ(script->len, strlen(pac_script_text));
+    EXPECT_EQ(script->hash, str_hash(pac_script_text, strlen(pac_script_text)));
+    pac_script_release(&script);
+    EXPECT_EQ(script, nullptr);
+}
+
+TEST(pac_script, create_null) {
+    EXPECT_EQ(pac_script_create(NULL), nullptr);
+}
+
+TEST(pac_script, retain_release) {
+    pac_script_s *script = pac_script_create(strdup(pac_script_text));
+    ASSERT_NE(script, nullptr);
+    pac_script_s *shared = pac_script_retain(script);
+    EXPECT_EQ(shared, script);
+    pac_script_release(&script);
+    EXPECT_EQ(script, nullptr);
+    // Text remains valid while another reference is held
+    EXPECT_STREQ(shared->text, pac_script_text);
+    pac_script_release(&shared);
+    EXPECT_EQ(shared, nullptr);
+}
+
+TEST(pac_script, init) {
+    pac_script_s script;
+    pac_script_init(&script, pac_script_text);
+    EXPECT_EQ(script.text, pac_script_text);
+    EXPECT_EQ(script.len, strlen(pac_script_text));
+    EXPECT_EQ(script.hash, str_hash(pac_script_text, strlen(pac_script_text)));
+}
@@ -0,0 +1,228 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#if defined(__linux__) && defined(PROXYRES_EXECUTE)
+#  include <arpa/inet.h>
+#  include <netinet/in.h>
+#  include <sys/socket.h>
+#  include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(PROXYRES_DAEMON)
+#  include <sys/un.h>
+#endif
+
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "proxyres.h"
+#include "util.h"
+
+class resolver : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        proxy_config_set_auto_config_url_override(NULL);
+    }
+    void TearDown() override {
+        proxy_config_set_proxy_override(NULL);
+        proxy_config_set_bypass_list_override(NULL);
+        proxy_config_set_auto_config_url_override(NULL);
+        proxy_resolver_set_lookup_timeout(0, PROXY_RESOLVER_FALLBACK_NONE);
+    }
+};
+
+TEST_F(resolver, resolve_sync_proxy_override) {
+    char list[MAX_PROXY_URL];
+    proxy_config_set_proxy_override("127.0.0.1:8000");
+    proxy_config_set_bypass_list_override("");
+    EXPECT_EQ(proxy_resolver_resolve_sync("http://example.com/", list, sizeof(list), 1000), 0);
+    EXPECT_STREQ(list, "http://127.0.0.1:8000");
+}
+
+TEST_F(resolver, resolve_sync_bypass) {
+    char list[MAX_PROXY_URL];
+    proxy_config_set_proxy_override("127.0.0.1:8000");
+    proxy_config_set_bypass_list_override("*.example.com");
+    EXPECT_EQ(proxy_resolver_resolve_sync("http://www.example.com/", list, sizeof(list), 1000), 0);
+    EXPECT_STREQ(list, "direct://");
+}
+
+TEST_F(resolver, resolve_sync_buffer_too_small) {
+    char list[8];
+    proxy_config_set_proxy_override("127.0.0.1:8000");
+    proxy_config_set_bypass_list_override("");
+    EXPECT_EQ(proxy_resolver_resolve_sync("http://example.com/", list, sizeof(list), 1000), ENOBUFS);
+    EXPECT_STREQ(list, "");
+}
+
+TEST_F(resolver, resolve_sync_invalid) {
+    char list[MAX_PROXY_URL];
+    EXPECT_EQ(proxy_resolver_resolve_sync(NULL, list, sizeof(list), 1000), EINVAL);
+    EXPECT_EQ(proxy_resolver_resolve_sync("http://example.com/", list, 0, 1000), EINVAL);
+}
+
+TEST_F(resolver, reset_reuse) {
+    proxy_config_set_proxy_override("127.0.0.1:8000");
+    proxy_config_set_bypass_list_override("*.example.com");
+    void *proxy_resolver = proxy_resolver_create();
+    ASSERT_NE(proxy_resolver, nullptr);
+    EXPECT_TRUE(proxy_resolver_get_proxies_for_url(proxy_resolver, "http://example.org/"));
+    EXPECT_TRUE(proxy_resolver_wait(proxy_resolver, 1000));
+    EXPECT_STREQ(proxy_resolver_get_list(proxy_resolver), "http://127.0.0.1:8000");
+    EXPECT_TRUE(proxy_resolver_reset(proxy_resolver));
+    EXPECT_EQ(proxy_resolver_get_list(proxy_resolver), nullptr);
+    EXPECT_TRUE(proxy_resolver_get_proxies_for_url(proxy_resolver, "http://www.example.com/"));
+    EXPECT_TRUE(proxy_resolver_wait(proxy_resolver, 1000));
+    EXPECT_STREQ(proxy_resolver_get_list(proxy_resolver), "direct://");
+    EXPECT_TRUE(proxy_resolver_delete(&proxy_resolver));
+
+    // Deleted instance is handed out again
+    void *reused = proxy_resolver_create();
+    EXPECT_NE(reused, nullptr);
+    EXPECT_EQ(proxy_resolver_get_list(reused), nullptr);
+    EXPECT_TRUE(proxy_resolver_delete(&reused));
+}
+
+#if defined(__linux__) && defined(PROXYRES_EXECUTE)
+// Server that accepts connections but never answers
+class resolver_unresponsive : public resolver {
+   protected:
+    void SetUp() override {
+        resolver::SetUp();
+        struct sockaddr_in address = {0};
+        socklen_t address_len = sizeof(address);
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sfd = socket(AF_INET, SOCK_STREAM, 0);
+        ASSERT_NE(sfd, -1);
+        ASSERT_EQ(bind(sfd, (struct sockaddr *)&address, sizeof(address)), 0);
+        ASSERT_EQ(listen(sfd, 16), 0);
+        ASSERT_EQ(getsockname(sfd, (struct sockaddr *)&address, &address_len), 0);
+        auto_config_url = "http://127.0.0.1:" + std::to_string(ntohs(address.sin_port)) + "/proxy.pac";
+        proxy_config_set_auto_config_url_override(auto_config_url.c_str());
+    }
+    void TearDown() override {
+        resolver::TearDown();
+        if (sfd != -1)
+            close(sfd);
+    }
+    int sfd = -1;
+    std::string auto_config_url;
+};
+
+TEST_F(resolver_unresponsive, lookup_timeout_fallback_direct) {
+    char list[MAX_PROXY_URL];
+    proxy_resolver_set_lookup_timeout(200, PROXY_RESOLVER_FALLBACK_DIRECT);
+    const int64_t start = get_monotonic_time_ms();
+    EXPECT_EQ(proxy_resolver_resolve_sync("http://example.com/", list, sizeof(list), 10000), 0);
+    EXPECT_LT(get_monotonic_time_ms() - start, 2000);
+    EXPECT_STREQ(list, "direct://");
+}
+
+TEST_F(resolver_unresponsive, lookup_timeout_fallback_none) {
+    char list[MAX_PROXY_URL];
+    proxy_resolver_set_lookup_timeout(200, PROXY_RESOLVER_FALLBACK_NONE);
+    const int64_t start = get_monotonic_time_ms();
+    EXPECT_EQ(proxy_resolver_resolve_sync("http://example.com/", list, sizeof(list), 10000), ETIMEDOUT);
+    EXPECT_LT(get_monotonic_time_ms() - start, 2000);
+}
+
+TEST_F(resolver_unresponsive, shared_lookup_wakes_every_waiter) {
+    void *proxy_resolvers[4] = {NULL};
+    proxy_resolver_set_lookup_timeout(200, PROXY_RESOLVER_FALLBACK_DIRECT);
+    const int64_t start = get_monotonic_time_ms();
+    for (int32_t i = 0; i < 4; i++) {
+        proxy_resolvers[i] = proxy_resolver_create();
+        ASSERT_NE(proxy_resolvers[i], nullptr);
+        EXPECT_TRUE(proxy_resolver_get_proxies_for_url(proxy_resolvers[i], "http://example.com/"));
+    }
+    // Every instance attached to the lookup wakes when it finishes, including repeated waits
+    for (int32_t i = 0; i < 4; i++) {
+        EXPECT_TRUE(proxy_resolver_wait(proxy_resolvers[i], 5000));
+        EXPECT_TRUE(proxy_resolver_wait(proxy_resolvers[i], 0));
+        EXPECT_STREQ(proxy_resolver_get_list(proxy_resolvers[i]), "direct://");
+    }
+    EXPECT_LT(get_monotonic_time_ms() - start, 2000);
+    for (int32_t i = 0; i < 4; i++)
+        EXPECT_TRUE(proxy_resolver_delete(&proxy_resolvers[i]));
+}
+#endif
+
+#if defined(__linux__) && defined(PROXYRES_DAEMON)
+// Resolver that forwards lookups to a daemon which goes away after initialization
+class resolver_daemon_gone : public resolver {
+   protected:
+    void SetUp() override {
+        resolver::SetUp();
+        struct sockaddr_un address = {0};
+        address.sun_family = AF_UNIX;
+        socket_path = "/tmp/proxyres_test_" + std::to_string(getpid()) + ".sock";
+        strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+        unlink(socket_path.c_str());
+        sfd = socket(AF_UNIX, SOCK_STREAM, 0);
+        ASSERT_NE(sfd, -1);
+        ASSERT_EQ(bind(sfd, (struct sockaddr *)&address, sizeof(address)), 0);
+        ASSERT_EQ(listen(sfd, 4), 0);
+
+        // Lookups resolved in process use the manually configured proxy
+        proxy_config_set_proxy_override("127.0.0.1:8000");
+        proxy_config_set_bypass_list_override("");
+
+        proxy_resolver_global_cleanup();
+        proxy_resolver_set_daemon_socket(socket_path.c_str());
+        ASSERT_TRUE(proxy_resolver_global_init());
+        cfd = accept(sfd, NULL, NULL);
+        ASSERT_NE(cfd, -1);
+    }
+    void TearDown() override {
+        proxy_resolver_global_cleanup();
+        proxy_resolver_set_daemon_socket(NULL);
+        proxy_resolver_global_init();
+        if (cfd != -1)
+            close(cfd);
+        if (sfd != -1)
+            close(sfd);
+        unlink(socket_path.c_str());
+        resolver::TearDown();
+    }
+    std::string socket_path;
+    int sfd = -1;
+    int cfd = -1;
+};
+
+TEST_F(resolver_daemon_gone, stopped_before_lookup) {
+    char list[MAX_PROXY_URL];
+    close(cfd);
+    cfd = -1;
+    close(sfd);
+    sfd = -1;
+    unlink(socket_path.c_str());
+
+    EXPECT_EQ(proxy_resolver_resolve_sync("http://example.com/", list, sizeof(list), 5000), 0);
+    EXPECT_STREQ(list, "http://127.0.0.1:8000");
+}
+
+TEST_F(resolver_daemon_gone, stopped_during_lookup) {
+    // Daemon receives the lookup and exits without answering it
+    std::thread daemon([this]() {
+        char request[1024];
+        EXPECT_GT(recv(cfd, request, sizeof(request), 0), 0);
+        close(cfd);
+        cfd = -1;
+    });
+
+    void *proxy_resolver = proxy_resolver_create();
+    ASSERT_NE(proxy_resolver, nullptr);
+    EXPECT_TRUE(proxy_resolver_get_proxies_for_url(proxy_resolver, "http://example.com/"));
+    EXPECT_TRUE(proxy_resolver_wait(proxy_resolver, 5000));
+    EXPECT_STREQ(proxy_resolver_get_list(proxy_resolver), "http://127.0.0.1:8000");
+    EXPECT_EQ(proxy_resolver_get_error(proxy_resolver), 0);
+    EXPECT_TRUE(proxy_resolver_delete(&proxy_resolver));
+    daemon.join();
+}
+#endif
@@ -0,0 +1,29 @@
+#include <stdint.h>
+
+#include <gtest/gtest.h>
+
+#include "resolver_posix_p.h"
+
+TEST(resolver_posix_retry, backoff) {
+    // No jitter waits exactly the backoff
+    EXPECT_EQ(proxy_resolver_posix_get_retry_delay(1, 30, 1800, 0), 30);
+    EXPECT_EQ(proxy_resolver_posix_get_retry_delay(2, 30, 1800, 0), 60);
+    EXPECT_EQ(proxy_resolver_posix_get_retry_delay(3, 30, 1800, 0), 120);
+    EXPECT_EQ(proxy_resolver_posix_get_retry_delay(7, 30, 1800, 0), 1800);
+    EXPECT_EQ(proxy_resolver_posix_get_retry_delay(1000, 30, 1800, 0), 1800);
+}
+
+TEST(resolver_posix_retry, jitter) {
+    // Delay is never less than the backoff and at most half again as long
+    EXPECT_EQ(proxy_resolver_posix_get_retry_delay(1, 300, 1200, 150), 450);
+    EXPECT_EQ(proxy_resolver_posix_get_retry_delay(2, 300, 1200, 151), 751);
+    EXPECT_EQ(proxy_resolver_posix_get_retry_delay(6, 30, 1800, 900), 1379);
+    // Jitter never takes the delay past the maximum
+    EXPECT_EQ(proxy_resolver_posix_get_retry_delay(3, 300, 1200, 300), 1200);
+    EXPECT_EQ(proxy_resolver_posix_get_retry_delay(7, 30, 1800, 900), 1800);
+    for (uint64_t jitter = 0; jitter < 5000; jitter += 7) {
+        const int64_t delay = proxy_resolver_posix_get_retry_delay(2, 300, 1200, jitter);
+        EXPECT_GE(delay, 600);
+        EXPECT_LE(delay, 900);
+    }
+}
@@ -3,8 +3,15 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include <atomic>
+
+#ifdef __linux__
+#  include <sched.h>
+#endif
+
 #include <gtest/gtest.h>
 
+#include "event.h"
 #include "threadpool.h"
 
 TEST(threadpool, create) {
@@ -35,9 +42,9 @@ static void threadpool_run_many_worker(void *arg) {
     *job_was_run = true;
 }
 
-TEST(threadpool, run_many) {
+static void threadpool_check_run_many(const threadpool_options_s *options) {
     bool job_was_run[100] = {false};
-    void *pool = threadpool_create(1, 4);
+    void *pool = threadpool_create_ex(1, 4, options);
     ASSERT_NE(pool, nullptr);
     for (int32_t i = 0; i < sizeof(job_was_run); i++)
         EXPECT_TRUE(threadpool_enqueue(pool, &job_was_run[i], threadpool_run_many_worker));
@@ -47,3 +54,201 @@ TEST(threadpool, run_many) {
     EXPECT_TRUE(threadpool_delete(&pool));
     ASSERT_EQ(pool, nullptr);
 }
+
+TEST(threadpool, run_many) {
+    threadpool_check_run_many(nullptr);
+}
+
+typedef struct threadpool_priority_job_s {
+    void *started;
+    void *release;
+    std::atomic<int32_t> *running;
+    std::atomic<int32_t> *max_running;
+    std::atomic<int32_t> *order;
+    int32_t ran_at;
+} threadpool_priority_job_s;
+
+static void threadpool_priority_worker(void *arg) {
+    threadpool_priority_job_s *job = (threadpool_priority_job_s *)arg;
+    if (job->running) {
+        const int32_t running = ++*job->running;
+        int32_t max_running = job->max_running->load();
+        while (running > max_running && !job->max_running->compare_exchange_weak(max_running, running)) {
+        }
+    }
+    if (job->order)
+        job->ran_at = ++*job->order;
+    if (job->started)
+        event_set(job->started);
+    if (job->release)
+        event_wait(job->release, 5000);
+    if (job->running)
+        --*job->running;
+}
+
+static void threadpool_check_background_reserves_thread(const threadpool_options_s *options) {
+    std::atomic<int32_t> running(0), max_running(0);
+    void *release = event_create();
+    void *started = event_create();
+    void *done = event_create();
+    threadpool_priority_job_s background = {started, release, &running, &max_running, nullptr, 0};
+    threadpool_priority_job_s foreground = {done, nullptr, nullptr, nullptr, nullptr, 0};
+
+    void *pool = threadpool_create_ex(1, 2, options);
+    ASSERT_NE(pool, nullptr);
+    EXPECT_TRUE(threadpool_enqueue_ex(pool, THREADPOOL_PRIORITY_BACKGROUND, &background, threadpool_priority_worker));
+    EXPECT_TRUE(threadpool_enqueue_ex(pool, THREADPOOL_PRIORITY_BACKGROUND, &background, threadpool_priority_worker));
+    EXPECT_TRUE(event_wait(started, 5000));
+
+    // Foreground job runs while background jobs are blocked
+    EXPECT_TRUE(threadpool_enqueue(pool, &foreground, threadpool_priority_worker));
+    EXPECT_TRUE(event_wait(done, 5000));
+
+    event_set(release);
+    threadpool_wait(pool);
+    EXPECT_EQ(max_running.load(), 1);
+    EXPECT_TRUE(threadpool_delete(&pool));
+    event_delete(&done);
+    event_delete(&started);
+    event_delete(&release);
+}
+
+TEST(threadpool, background_reserves_thread) {
+    threadpool_check_background_reserves_thread(nullptr);
+}
+
+TEST(threadpool, background_single_thread) {
+    void *release = event_create();
+    void *started = event_create();
+    void *done = event_create();
+    threadpool_priority_job_s background = {started, release, nullptr, nullptr, nullptr, 0};
+    threadpool_priority_job_s foreground = {done, nullptr, nullptr, nullptr, nullptr, 0};
+
+    void *pool = threadpool_create(1, 1);
+    ASSERT_NE(pool, nullptr);
+    EXPECT_TRUE(threadpool_enqueue_ex(pool, THREADPOOL_PRIORITY_BACKGROUND, &background, threadpool_priority_worker));
+    EXPECT_TRUE(event_wait(started, 5000));
+
+    // Pool adds a thread rather than queue the foreground job behind the background job
+    EXPECT_TRUE(threadpool_enqueue(pool, &foreground, threadpool_priority_worker));
+    EXPECT_TRUE(event_wait(done, 5000));
+
+    event_set(release);
+    threadpool_wait(pool);
+    EXPECT_TRUE(threadpool_delete(&pool));
+    event_delete(&done);
+    event_delete(&started);
+    event_delete(&release);
+}
+
+TEST(threadpool, foreground_first) {
+    std::atomic<int32_t> order(0);
+    void *release = event_create();
+    void *started = event_create();
+    threadpool_priority_job_s blocker = {started, release, nullptr, nullptr, nullptr, 0};
+    threadpool_priority_job_s background = {nullptr, nullptr, nullptr, nullptr, &order, 0};
+    threadpool_priority_job_s foreground = {nullptr, nullptr, nullptr, nullptr, &order, 0};
+
+    void *pool = threadpool_create(1, 1);
+    ASSERT_NE(pool, nullptr);
+    EXPECT_TRUE(threadpool_enqueue(pool, &blocker, threadpool_priority_worker));
+    EXPECT_TRUE(event_wait(started, 5000));
+
+    // Queued foreground job runs before a background job queued earlier
+    EXPECT_TRUE(threadpool_enqueue_ex(pool, THREADPOOL_PRIORITY_BACKGROUND, &background, threadpool_priority_worker));
+    EXPECT_TRUE(threadpool_enqueue(pool, &foreground, threadpool_priority_worker));
+    event_set(release);
+    threadpool_wait(pool);
+    EXPECT_EQ(foreground.ran_at, 1);
+    EXPECT_EQ(background.ran_at, 2);
+
+    EXPECT_FALSE(threadpool_enqueue_ex(pool, -1, &background, threadpool_priority_worker));
+    EXPECT_FALSE(threadpool_enqueue_ex(pool, 2, &background, threadpool_priority_worker));
+    EXPECT_TRUE(threadpool_delete(&pool));
+    event_delete(&started);
+    event_delete(&release);
+}
+
+TEST(threadpool, work_stealing_run_many) {
+    threadpool_options_s options = {THREADPOOL_SCHEDULER_WORK_STEALING};
+    threadpool_check_run_many(&options);
+}
+
+typedef struct threadpool_fan_out_s {
+    void *pool;
+    std::atomic<int32_t> children;
+} threadpool_fan_out_s;
+
+static void threadpool_fan_out_child(void *arg) {
+    threadpool_fan_out_s *fan_out = (threadpool_fan_out_s *)arg;
+    fan_out->children++;
+}
+
+static void threadpool_fan_out_parent(void *arg) {
+    threadpool_fan_out_s *fan_out = (threadpool_fan_out_s *)arg;
+    for (int32_t i = 0; i < 50; i++)
+        threadpool_enqueue(fan_out->pool, fan_out, threadpool_fan_out_child);
+}
+
+TEST(threadpool, work_stealing_fan_out) {
+    threadpool_options_s options = {THREADPOOL_SCHEDULER_WORK_STEALING};
+    threadpool_fan_out_s fan_out;
+    fan_out.pool = threadpool_create_ex(4, 4, &options);
+    fan_out.children = 0;
+    ASSERT_NE(fan_out.pool, nullptr);
+
+    // Jobs submitted from workers are waited for along with the jobs that submitted them
+    for (int32_t i = 0; i < 20; i++)
+        EXPECT_TRUE(threadpool_enqueue(fan_out.pool, &fan_out, threadpool_fan_out_parent));
+    threadpool_wait(fan_out.pool);
+    EXPECT_EQ(fan_out.children.load(), 20 * 50);
+    EXPECT_TRUE(threadpool_delete(&fan_out.pool));
+}
+
+TEST(threadpool, work_stealing_background_reserves_thread) {
+    threadpool_options_s options = {THREADPOOL_SCHEDULER_WORK_STEALING};
+    threadpool_check_background_reserves_thread(&options);
+}
+
+TEST(threadpool, numa_local_run_many) {
+    threadpool_options_s options = {THREADPOOL_SCHEDULER_WORK_STEALING, nullptr, 0, true};
+    threadpool_check_run_many(&options);
+}
+
+#ifdef __linux__
+typedef struct threadpool_pinned_s {
+    int32_t cpu;
+    std::atomic<int32_t> wrong_cpu;
+} threadpool_pinned_s;
+
+static void threadpool_pinned_worker(void *arg) {
+    threadpool_pinned_s *pinned = (threadpool_pinned_s *)arg;
+    if (sched_getcpu() != pinned->cpu)
+        pinned->wrong_cpu++;
+}
+
+TEST(threadpool, pinned_to_cpus) {
+    // Pin to a cpu the process is allowed to run on, which is not always cpu 0 in containers
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+    threadpool_pinned_s pinned;
+    pinned.cpu = -1;
+    pinned.wrong_cpu = 0;
+    for (int32_t i = 0; i < CPU_SETSIZE && pinned.cpu < 0; i++) {
+        if (CPU_ISSET(i, &allowed))
+            pinned.cpu = i;
+    }
+    ASSERT_GE(pinned.cpu, 0);
+
+    const int32_t cpus[] = {pinned.cpu};
+    threadpool_options_s options = {THREADPOOL_SCHEDULER_SHARED, cpus, 1, false};
+    void *pool = threadpool_create_ex(2, 2, &options);
+    ASSERT_NE(pool, nullptr);
+    for (int32_t i = 0; i < 20; i++)
+        EXPECT_TRUE(threadpool_enqueue(pool, &pinned, threadpool_pinned_worker));
+    threadpool_wait(pool);
+    EXPECT_EQ(pinned.wrong_cpu.load(), 0);
+    EXPECT_TRUE(threadpool_delete(&pool));
+}
+#endif
@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "proxyres/trace.h"
+#include "trace.h"
+
+static std::string trace_read_json(const char *path) {
+    std::ifstream file(path);
+    std::stringstream json;
+    json << file.rdbuf();
+    return json.str();
+}
+
+static size_t trace_count(const std::string &json, const std::string &text) {
+    size_t count = 0;
+    for (size_t pos = json.find(text); pos != std::string::npos; pos = json.find(text, pos + text.size()))
+        count++;
+    return count;
+}
+
+class trace : public ::testing::Test {
+   protected:
+    void TearDown() override {
+        trace_global_cleanup();
+        remove(path);
+    }
+    const char *path = "test_trace.json";
+};
+
+TEST_F(trace, disabled) {
+    trace_instant(TRACE_EVENT_PAC_CACHE_HIT, 0);
+    EXPECT_FALSE(proxy_trace_write_json(path));
+}
+
+TEST_F(trace, write_json) {
+    ASSERT_TRUE(proxy_trace_start(0));
+    const uint64_t lookup_id = trace_next_lookup_id();
+    trace_write(TRACE_EVENT_LOOKUP_ENQUEUE, TRACE_PHASE_INSTANT, lookup_id, 0);
+
+    // Events from another thread are recorded in its own ring buffer
+    std::thread worker([lookup_id] {
+        trace_set_lookup(lookup_id);
+        trace_begin(TRACE_EVENT_LOOKUP);
+        trace_begin(TRACE_EVENT_DNS_RESOLVE);
+        trace_end(TRACE_EVENT_DNS_RESOLVE);
+        trace_instant(TRACE_EVENT_LOOKUP_COMPLETE, 0);
+        trace_end(TRACE_EVENT_LOOKUP);
+        trace_set_lookup(0);
+    });
+    worker.join();
+    EXPECT_TRUE(proxy_trace_stop());
+
+    // Nothing is recorded once stopped
+    trace_instant(TRACE_EVENT_PAC_CACHE_HIT, 0);
+
+    ASSERT_TRUE(proxy_trace_write_json(path));
+    std::string json = trace_read_json(path);
+    EXPECT_EQ(json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["), 0);
+    EXPECT_EQ(trace_count(json, "\"ph\":\"M\""), 3);
+    EXPECT_EQ(trace_count(json, "\"name\":\"enqueue\""), 1);
+    EXPECT_EQ(trace_count(json, "\"name\":\"dns resolve\""), 1);
+    EXPECT_EQ(trace_count(json, "\"name\":\"complete\""), 1);
+    EXPECT_EQ(trace_count(json, "\"name\":\"pac cache hit\""), 0);
+    EXPECT_EQ(trace_count(json, "\"ph\":\"B\""), 2);
+    EXPECT_EQ(trace_count(json, "\"ph\":\"E\""), 2);
+    EXPECT_EQ(trace_count(json, "\"ph\":\"s\""), 1);
+    EXPECT_EQ(trace_count(json, "\"ph\":\"f\""), 1);
+    EXPECT_EQ(trace_count(json, "\"lookup\":" + std::to_string(lookup_id)), 4);
+}
+
+TEST_F(trace, ring_overwrite) {
+    ASSERT_TRUE(proxy_trace_start(64));
+    for (int32_t i = 0; i < 1000; i++)
+        trace_instant(TRACE_EVENT_PAC_CACHE_HIT, (uint32_t)i);
+    ASSERT_TRUE(proxy_trace_write_json(path));
+
+    // Only the most recent events are kept
+    std::string json = trace_read_json(path);
+    EXPECT_EQ(trace_count(json, "\"name\":\"pac cache hit\""), 64);
+    EXPECT_EQ(trace_count(json, "\"arg\":999}"), 1);
+    EXPECT_EQ(trace_count(json, "\"arg\":935}"), 0);
+}
+
+TEST_F(trace, restart_discards_events) {
+    ASSERT_TRUE(proxy_trace_start(0));
+    trace_instant(TRACE_EVENT_PAC_CACHE_HIT, 0);
+    ASSERT_TRUE(proxy_trace_start(0));
+    trace_instant(TRACE_EVENT_WPAD_CACHE_HIT, 0);
+    ASSERT_TRUE(proxy_trace_write_json(path));
+
+    std::string json = trace_read_json(path);
+    EXPECT_EQ(trace_count(json, "\"name\":\"pac cache hit\""), 0);
+    EXPECT_EQ(trace_count(json, "\"name\":\"wpad cache hit\""), 1);
+}
@@ -3,6 +3,10 @@
 #include <string.h>
 #include <stdlib.h>
 
+#ifndef _WIN32
+#  include <dlfcn.h>
+#endif
+
 #include <gtest/gtest.h>
 
 #include "util.h"
@@ -257,4 +261,34 @@ TEST(util, str_sep_dup) {
     EXPECT_EQ(*tokenp, nullptr);
     char *third_token = str_sep_dup(tokenp, ";");
     EXPECT_EQ(third_token, nullptr);
-}
\ No newline at end of file
+}
+
+TEST(util, str_hash) {
+    const char *script = "function FindProxyForURL(url, host) { return \"DIRECT\"; }";
+    const size_t script_len = strlen(script);
+
+    EXPECT_EQ(str_hash(script, script_len), str_hash(script, script_len));
+    EXPECT_NE(str_hash(script, script_len), str_hash(script, script_len - 1));
+    EXPECT_NE(str_hash("DIRECT", 6), str_hash("DIRECU", 6));
+    EXPECT_NE(str_hash("", 0), str_hash("a", 1));
+}
+
+#ifndef _WIN32
+TEST(util, dl_load_symbols) {
+    void *module = dlopen(NULL, RTLD_LAZY);
+    ASSERT_NE(module, nullptr);
+
+    void *(*malloc_fn)(size_t) = NULL;
+    void (*free_fn)(void *) = NULL;
+    const dl_symbol_s symbols[] = {{"malloc", (void **)&malloc_fn}, {"free", (void **)&free_fn}};
+    EXPECT_TRUE(dl_load_symbols(module, symbols, sizeof(symbols) / sizeof(symbols[0])));
+    EXPECT_NE(malloc_fn, nullptr);
+    EXPECT_NE(free_fn, nullptr);
+
+    void *missing_fn = NULL;
+    const dl_symbol_s missing_symbols[] = {{"free", (void **)&free_fn}, {"proxyres_missing_symbol", &missing_fn}};
+    EXPECT_FALSE(dl_load_symbols(module, missing_symbols, sizeof(missing_symbols) / sizeof(missing_symbols[0])));
+
+    dlclose(module);
+}
+#endif
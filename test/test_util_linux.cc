@@ -59,4 +59,26 @@ TEST_P(util_config, get_value) {
     } else {
         EXPECT_EQ(value, param.expected);
     }
-}
\ No newline at end of file
+}
+
+TEST(util, parse_cpu_list) {
+    int32_t cpus[8] = {0};
+    EXPECT_EQ(parse_cpu_list("0-3,8\n", cpus, 8), 5);
+    EXPECT_EQ(cpus[0], 0);
+    EXPECT_EQ(cpus[3], 3);
+    EXPECT_EQ(cpus[4], 8);
+    // Stops when the buffer is full
+    EXPECT_EQ(parse_cpu_list("0-15", cpus, 8), 8);
+    EXPECT_EQ(cpus[7], 7);
+    // Stops at the first malformed entry
+    EXPECT_EQ(parse_cpu_list("2,x,4", cpus, 8), 1);
+    EXPECT_EQ(cpus[0], 2);
+    EXPECT_EQ(parse_cpu_list("5-1", cpus, 8), 0);
+    EXPECT_EQ(parse_cpu_list("", cpus, 8), 0);
+}
+
+TEST(util, numa_node) {
+    EXPECT_GE(get_numa_node_count(), 1);
+    EXPECT_GE(get_current_numa_node(), 0);
+    EXPECT_LT(get_current_numa_node(), get_numa_node_count());
+}
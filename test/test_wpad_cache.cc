@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "wpad_cache.h"
+
+class wpad_cache : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        path = testing::TempDir() + "proxyres_wpad_cache.bin";
+        remove(path.c_str());
+    }
+    void TearDown() override {
+        remove(path.c_str());
+    }
+
+    std::string path;
+};
+
+TEST_F(wpad_cache, write_read) {
+    wpad_cache_s cache = {0};
+    cache.fingerprint = 0x1234567890abcdefULL;
+    cache.fetch_time = 1700000000;
+    cache.max_age = 600;
+    cache.fetch_retry_time = 1700000120;
+    cache.fetch_failures = 2;
+    cache.auto_config_url = (char *)"http://wpad.example.com/wpad.dat";
+    cache.script_url = (char *)"http://wpad.example.com/wpad.dat";
+    cache.script = (char *)"function FindProxyForURL(url, host) { return \"DIRECT\"; }";
+    cache.etag = (char *)"\"5d8c72a5edda8\"";
+    cache.last_modified = (char *)"Wed, 21 Oct 2015 07:28:00 GMT";
+
+    ASSERT_TRUE(wpad_cache_write(path.c_str(), &cache));
+
+    wpad_cache_s read = {0};
+    ASSERT_TRUE(wpad_cache_read(path.c_str(), &read));
+    EXPECT_EQ(read.fingerprint, cache.fingerprint);
+    EXPECT_EQ(read.fetch_time, cache.fetch_time);
+    EXPECT_EQ(read.max_age, cache.max_age);
+    EXPECT_EQ(read.fetch_retry_time, cache.fetch_retry_time);
+    EXPECT_EQ(read.fetch_failures, cache.fetch_failures);
+    EXPECT_STREQ(read.etag, cache.etag);
+    EXPECT_STREQ(read.last_modified, cache.last_modified);
+    EXPECT_STREQ(read.auto_config_url, cache.auto_config_url);
+    EXPECT_STREQ(read.script_url, cache.script_url);
+    EXPECT_STREQ(read.script, cache.script);
+    wpad_cache_free(&read);
+    EXPECT_EQ(read.script, nullptr);
+}
+
+TEST_F(wpad_cache, write_read_no_auto_config_url) {
+    wpad_cache_s cache = {0};
+    cache.script_url = (char *)"http://pac.example.com/proxy.pac";
+    cache.script = (char *)"function FindProxyForURL(url, host) { return \"DIRECT\"; }";
+
+    ASSERT_TRUE(wpad_cache_write(path.c_str(), &cache));
+
+    wpad_cache_s read = {0};
+    ASSERT_TRUE(wpad_cache_read(path.c_str(), &read));
+    EXPECT_EQ(read.auto_config_url, nullptr);
+    EXPECT_STREQ(read.script_url, cache.script_url);
+    wpad_cache_free(&read);
+}
+
+TEST_F(wpad_cache, read_missing) {
+    wpad_cache_s read = {0};
+    EXPECT_FALSE(wpad_cache_read(path.c_str(), &read));
+    EXPECT_EQ(read.script, nullptr);
+}
+
+TEST_F(wpad_cache, read_invalid) {
+    FILE *file = fopen(path.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    fputs("not a wpad cache file", file);
+    fclose(file);
+
+    wpad_cache_s read = {0};
+    EXPECT_FALSE(wpad_cache_read(path.c_str(), &read));
+    EXPECT_EQ(read.script, nullptr);
+}
+
+TEST_F(wpad_cache, concurrent_writers) {
+    const std::string scripts[2] = {std::string(4096, 'a'), std::string(8192, 'b')};
+
+    // Writers never share a temporary file, so the cache always holds one writer's complete state
+    auto writer = [&](int32_t index) {
+        wpad_cache_s cache = {0};
+        cache.fingerprint = (uint64_t)index;
+        cache.script = (char *)scripts[index].c_str();
+        for (int32_t i = 0; i < 100; i++)
+            EXPECT_TRUE(wpad_cache_write(path.c_str(), &cache));
+    };
+    std::thread first(writer, 0);
+    std::thread second(writer, 1);
+    for (int32_t i = 0; i < 100; i++) {
+        wpad_cache_s read = {0};
+        if (!wpad_cache_read(path.c_str(), &read))
+            continue;
+        ASSERT_LT(read.fingerprint, 2u);
+        EXPECT_STREQ(read.script, scripts[read.fingerprint].c_str());
+        wpad_cache_free(&read);
+    }
+    first.join();
+    second.join();
+}
+
+TEST_F(wpad_cache, lock_exclusive) {
+    void *lock = wpad_cache_lock(path.c_str(), 100);
+    ASSERT_NE(lock, nullptr);
+
+    // Lock is held so the next attempt times out
+    void *other_lock = wpad_cache_lock(path.c_str(), 100);
+    EXPECT_EQ(other_lock, nullptr);
+
+    wpad_cache_unlock(&lock);
+    EXPECT_EQ(lock, nullptr);
+
+    other_lock = wpad_cache_lock(path.c_str(), 100);
+    EXPECT_NE(other_lock, nullptr);
+    wpad_cache_unlock(&other_lock);
+
+    remove((path + ".lock").c_str());
+}
@@ -238,3 +238,44 @@ TEST(dhcp_parse, full_ack_with_wpad) {
     EXPECT_STREQ((char *)opt, url);
     free(opt);
 }
+
+TEST(dhcp_parse, get_wpad_url) {
+    const char *url = "http://wpad.corp.example.com/wpad.dat";
+    uint8_t url_len = (uint8_t)strlen(url);
+
+    uint8_t opts[256];
+    size_t pos = 0;
+    opts[pos++] = DHCP_OPT_MSGTYPE;
+    opts[pos++] = 1;
+    opts[pos++] = DHCP_ACK;
+    opts[pos++] = DHCP_OPT_WPAD;
+    opts[pos++] = url_len;
+    memcpy(opts + pos, url, url_len);
+    pos += url_len;
+    opts[pos++] = DHCP_OPT_END;
+
+    dhcp_msg msg;
+    build_dhcp_reply(&msg, opts, pos);
+
+    char *wpad = dhcp_get_wpad_url(&msg);
+    ASSERT_NE(wpad, nullptr);
+    EXPECT_STREQ(wpad, url);
+    free(wpad);
+
+    // ACK from a DHCP server that does not know a WPAD url
+    const uint8_t ack_opts[] = {DHCP_OPT_MSGTYPE, 1, DHCP_ACK, DHCP_OPT_END};
+    build_dhcp_reply(&msg, ack_opts, sizeof(ack_opts));
+    EXPECT_EQ(dhcp_get_wpad_url(&msg), nullptr);
+
+    // Reply without message type
+    build_dhcp_reply(&msg, opts + 3, pos - 3);
+    EXPECT_EQ(dhcp_get_wpad_url(&msg), nullptr);
+}
+
+TEST(dhcp_retransmit, backoff) {
+    EXPECT_EQ(dhcp_get_retransmit_delay(0), 500);
+    EXPECT_EQ(dhcp_get_retransmit_delay(1), 1000);
+    EXPECT_EQ(dhcp_get_retransmit_delay(2), 2000);
+    EXPECT_EQ(dhcp_get_retransmit_delay(3), 4000);
+    EXPECT_EQ(dhcp_get_retransmit_delay(10), 4000);
+}
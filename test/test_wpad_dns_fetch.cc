@@ -2,8 +2,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <atomic>
+#include <chrono>
+#include <thread>
+
 #include <gtest/gtest.h>
 
+#include "threadpool.h"
 #include "wpad_dns.h"
 
 static const char *mock_target_url = nullptr;
@@ -24,29 +29,54 @@ static char *mock_fetch_all_fail(const char *url, int32_t *error) {
     return nullptr;
 }
 
-static int mock_fetch_call_count = 0;
+static std::atomic<int> mock_fetch_call_count(0);
+
+static char *mock_fetch_most_specific_slowest(const char *url, int32_t *error) {
+    (void)error;
+    mock_fetch_call_count++;
+    // Most specific candidate answers last
+    if (strcmp(url, "http://wpad.host.sub.example.com/wpad.dat") == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    return strdup(url);
+}
 
-static char *mock_fetch_first_succeeds(const char *url, int32_t *error) {
+static char *mock_fetch_slow_fail(const char *url, int32_t *error) {
     (void)url;
     mock_fetch_call_count++;
-    if (mock_fetch_call_count == 1)
-        return strdup("function FindProxyForURL() { return \"DIRECT\"; }");
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
     if (error)
         *error = -1;
     return nullptr;
 }
 
+static char *mock_fetch_less_specific_slow(const char *url, int32_t *error) {
+    (void)error;
+    mock_fetch_call_count++;
+    // Most specific candidate answers straight away
+    if (strcmp(url, "http://wpad.host.sub.example.com/wpad.dat") != 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    return strdup(url);
+}
+
 class wpad_dns_fetch : public ::testing::Test {
    protected:
     void SetUp() override {
         mock_fetch_call_count = 0;
+        threadpool = threadpool_create(WPAD_DNS_MAX_PROBES, WPAD_DNS_MAX_PROBES);
+        ASSERT_NE(threadpool, nullptr);
+        wpad_dns_set_threadpool(threadpool);
     }
     void TearDown() override {
+        // Wait for probes that were still running when the race was decided
+        wpad_dns_set_threadpool(nullptr);
+        threadpool_wait(threadpool);
+        threadpool_delete(&threadpool);
         wpad_dns_set_fetch_func(nullptr);
 
         mock_target_url = nullptr;
         mock_pac_script = nullptr;
     }
+    void *threadpool = nullptr;
 };
 
 TEST_F(wpad_dns_fetch, mock_returns_script) {
@@ -67,11 +97,49 @@ TEST_F(wpad_dns_fetch, mock_all_fail) {
     EXPECT_EQ(result, nullptr);
 }
 
-TEST_F(wpad_dns_fetch, mock_first_url_succeeds) {
-    wpad_dns_set_fetch_func(mock_fetch_first_succeeds);
+TEST_F(wpad_dns_fetch, mock_most_specific_wins) {
+    wpad_dns_set_fetch_func(mock_fetch_most_specific_slowest);
+
+    char *result = wpad_dns("host.sub.example.com");
+    ASSERT_NE(result, nullptr);
+    EXPECT_STREQ(result, "http://wpad.host.sub.example.com/wpad.dat");
+    EXPECT_EQ(mock_fetch_call_count, 3);
+    free(result);
+}
+
+TEST_F(wpad_dns_fetch, mock_probes_concurrently) {
+    wpad_dns_set_fetch_func(mock_fetch_slow_fail);
+
+    const auto start = std::chrono::steady_clock::now();
+    char *result = wpad_dns("host.sub.example.com");
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(result, nullptr);
+    EXPECT_EQ(mock_fetch_call_count, 3);
+    EXPECT_LT(elapsed, std::chrono::milliseconds(500));
+}
+
+TEST_F(wpad_dns_fetch, mock_winner_does_not_wait_for_others) {
+    wpad_dns_set_fetch_func(mock_fetch_less_specific_slow);
+
+    const auto start = std::chrono::steady_clock::now();
+    char *result = wpad_dns("host.sub.example.com");
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    ASSERT_NE(result, nullptr);
+    EXPECT_STREQ(result, "http://wpad.host.sub.example.com/wpad.dat");
+    EXPECT_LT(elapsed, std::chrono::milliseconds(500));
+    free(result);
+}
+
+TEST_F(wpad_dns_fetch, mock_without_threadpool) {
+    wpad_dns_set_threadpool(nullptr);
+    wpad_dns_set_fetch_func(mock_fetch_most_specific_slowest);
 
+    // Candidates are probed one at a time and probing stops at the first answer
     char *result = wpad_dns("host.sub.example.com");
     ASSERT_NE(result, nullptr);
+    EXPECT_STREQ(result, "http://wpad.host.sub.example.com/wpad.dat");
     EXPECT_EQ(mock_fetch_call_count, 1);
     free(result);
 }
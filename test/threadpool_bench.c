@@ -0,0 +1,99 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "proxyres/log.h"
+
+#include "threadpool.h"
+#include "util.h"
+
+#define FAN_OUT_CHILDREN (64)
+
+typedef struct bench_s {
+    void *pool;
+    int32_t work;
+    volatile uint64_t sink;
+} bench_s;
+
+static int print_help(void) {
+    printf("threadpool_bench [--help] [--jobs count] [--work iterations] [--threads count]\n");
+    printf(" compares job throughput of the shared queue and work stealing schedulers\n");
+    return 1;
+}
+
+static void bench_job(void *user_data) {
+    bench_s *bench = (bench_s *)user_data;
+    uint64_t value = (uint64_t)(uintptr_t)&value;
+    for (int32_t i = 0; i < bench->work; i++)
+        value = value * 6364136223846793005ULL + 1442695040888963407ULL;
+    bench->sink = value;
+}
+
+static void bench_fan_out_job(void *user_data) {
+    bench_s *bench = (bench_s *)user_data;
+    for (int32_t i = 0; i < FAN_OUT_CHILDREN; i++)
+        threadpool_enqueue(bench->pool, bench, bench_job);
+}
+
+// Run jobs and return the number completed per second
+static double bench_run(int32_t scheduler, int32_t threads, int32_t jobs, int32_t work, bool fan_out) {
+    threadpool_options_s options = {scheduler};
+    bench_s bench = {NULL, work, 0};
+
+    bench.pool = threadpool_create_ex(threads, threads, &options);
+    if (!bench.pool)
+        return 0;
+
+    const int64_t start_us = get_monotonic_time_us();
+    if (fan_out) {
+        for (int32_t i = 0; i < jobs / FAN_OUT_CHILDREN; i++)
+            threadpool_enqueue(bench.pool, &bench, bench_fan_out_job);
+    } else {
+        for (int32_t i = 0; i < jobs; i++)
+            threadpool_enqueue(bench.pool, &bench, bench_job);
+    }
+    threadpool_wait(bench.pool);
+    const int64_t elapsed_us = get_monotonic_time_us() - start_us;
+
+    threadpool_delete(&bench.pool);
+    return elapsed_us > 0 ? (double)jobs * 1000000.0 / (double)elapsed_us : 0;
+}
+
+int main(int argc, char *argv[]) {
+    int32_t jobs = 200000;
+    int32_t work = 100;
+    int32_t max_threads = 8;
+
+    for (int32_t argi = 1; argi < argc; argi++) {
+        if (strcmp(argv[argi], "--help") == 0) {
+            print_help();
+            return 0;
+        } else if (strcmp(argv[argi], "--jobs") == 0 && argi + 1 < argc) {
+            jobs = atoi(argv[++argi]);
+        } else if (strcmp(argv[argi], "--work") == 0 && argi + 1 < argc) {
+            work = atoi(argv[++argi]);
+        } else if (strcmp(argv[argi], "--threads") == 0 && argi + 1 < argc) {
+            max_threads = atoi(argv[++argi]);
+        } else {
+            return print_help();
+        }
+    }
+    if (jobs < FAN_OUT_CHILDREN || work < 0 || max_threads < 1)
+        return print_help();
+
+    // Debug builds would otherwise measure logging of every job
+    proxy_log_set_level(PROXY_LOG_LEVEL_WARN);
+
+    printf("%-8s %-8s %16s %16s\n", "test", "threads", "shared jobs/s", "stealing jobs/s");
+    for (int32_t fan_out = 0; fan_out <= 1; fan_out++) {
+        for (int32_t threads = 1; threads <= max_threads; threads *= 2) {
+            const double shared = bench_run(THREADPOOL_SCHEDULER_SHARED, threads, jobs, work, fan_out);
+            const double stealing = bench_run(THREADPOOL_SCHEDULER_WORK_STEALING, threads, jobs, work, fan_out);
+            printf("%-8s %-8" PRId32 " %16.0f %16.0f\n", fan_out ? "fan out" : "submit", threads, shared, stealing);
+        }
+    }
+    return 0;
+}
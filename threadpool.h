@@ -7,15 +7,45 @@ extern "C" {
 #define THREADPOOL_DEFAULT_MIN_THREADS 1
 #define THREADPOOL_DEFAULT_MAX_THREADS 3
 
+typedef enum threadpool_priority_enum {
+    // Jobs that callers are waiting on, such as proxy lookups
+    THREADPOOL_PRIORITY_FOREGROUND = 0,
+    // Maintenance jobs, run after queued foreground jobs and never on every thread
+    THREADPOOL_PRIORITY_BACKGROUND = 1
+} threadpool_priority_enum;
+
+typedef enum threadpool_scheduler_enum {
+    // All workers take jobs from one queue
+    THREADPOOL_SCHEDULER_SHARED = 0,
+    // Each worker has its own queue and takes jobs from the others when it runs out, only used with pthreads
+    THREADPOOL_SCHEDULER_WORK_STEALING = 1
+} threadpool_scheduler_enum;
+
+typedef struct threadpool_options_s {
+    // Scheduler from threadpool_scheduler_enum
+    int32_t scheduler;
+    // CPUs that workers are pinned to, NULL for any, only used on Linux
+    const int32_t *cpus;
+    int32_t cpu_count;
+    // Spread workers across NUMA nodes pinned to the CPUs of their node, and with work stealing queue jobs to workers
+    // on the node of the submitting thread, only used on Linux
+    bool numa_local;
+} threadpool_options_s;
+
 typedef void (*threadpool_job_cb)(void *user_data);
 
-// Add a job to the thread pool.
+// Add a foreground job to the thread pool.
 bool threadpool_enqueue(void *ctx, void *user_data, threadpool_job_cb callback);
+// Add a job with the given priority to the thread pool. Background jobs run on at most max_threads - 1 threads so
+// one is always left for foreground jobs, a pool of one thread adds a second for foreground jobs when needed.
+bool threadpool_enqueue_ex(void *ctx, int32_t priority, void *user_data, threadpool_job_cb callback);
 // Wait for thread pool to finish all jobs.
 void threadpool_wait(void *ctx);
 
 // Create a thread pool instance.
 void *threadpool_create(int32_t min_threads, int32_t max_threads);
+// Create a thread pool instance with options, NULL options uses the defaults.
+void *threadpool_create_ex(int32_t min_threads, int32_t max_threads, const threadpool_options_s *options);
 
 // Deletes a thread pool instance.
 bool threadpool_delete(void **ctx);
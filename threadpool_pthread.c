@@ -9,45 +9,101 @@
 
 #include "log.h"
 #include "threadpool.h"
+#include "util.h"
+
+#ifdef __linux__
+#  include <sched.h>
+#  include "util_linux.h"
+#endif
 
 #ifdef __APPLE__
 #  include <objc/message.h>
 #endif
 
+#define THREADPOOL_PRIORITY_COUNT (2)
+
+// Counters shared between workers without holding the queue mutex
+#define THREADPOOL_LOAD(ptr)             __atomic_load_n((ptr), __ATOMIC_SEQ_CST)
+#define THREADPOOL_STORE(ptr, value)     __atomic_store_n((ptr), (value), __ATOMIC_SEQ_CST)
+#define THREADPOOL_FETCH_ADD(ptr, value) __atomic_fetch_add((ptr), (value), __ATOMIC_SEQ_CST)
+
 typedef struct threadpool_job_s {
     void *user_data;
     threadpool_job_cb callback;
+    int32_t priority;
     struct threadpool_job_s *next;
+    // Newer job in a work stealing deque, where next is the older job
+    struct threadpool_job_s *prev;
 } threadpool_job_s;
 
+// Jobs queued to one worker, the worker takes the newest job and other workers steal the oldest
+typedef struct threadpool_deque_s {
+    pthread_mutex_t mutex;
+    int32_t count;
+    threadpool_job_s *newest;
+    threadpool_job_s *oldest;
+} threadpool_deque_s;
+
 struct threadpool_s;
 
 typedef struct threadpool_thread_s {
     pthread_t handle;
+    struct threadpool_s *pool;
+    // Index of the worker's deque when work stealing
+    int32_t index;
+    // NUMA node the worker is pinned to
+    int32_t node;
+    // State for picking which worker to steal from
+    uint32_t random;
     struct threadpool_thread_s *next;
 } threadpool_thread_s;
 
 typedef struct threadpool_s {
     bool stop;
+    int32_t scheduler;
     int32_t min_threads;
     int32_t num_threads;
     int32_t max_threads;
     int32_t busy_threads;
+    // Threads running background jobs, limited so foreground jobs always have a thread
+    int32_t busy_background_threads;
+    int32_t max_background_threads;
     pthread_cond_t wakeup_cond;
     pthread_cond_t lazy_cond;
     int32_t queue_count;
     pthread_mutex_t queue_mutex;
-    threadpool_job_s *queue_first;
-    threadpool_job_s *queue_last;
+    // Job queues indexed by priority
+    threadpool_job_s *queue_first[THREADPOOL_PRIORITY_COUNT];
+    threadpool_job_s *queue_last[THREADPOOL_PRIORITY_COUNT];
     threadpool_thread_s *threads;
+    // Work stealing deques, one for each thread the pool can create, background jobs still use the queue
+    threadpool_deque_s **deques;
+    int32_t deque_count;
+    // Jobs in deques, and jobs queued or running that threadpool_wait waits for
+    int32_t stealable_count;
+    int32_t pending_count;
+    // Threads waiting on wakeup_cond for jobs
+    int32_t sleeping_threads;
+    // Deque that the next job submitted from outside the pool goes to
+    uint32_t next_deque;
+    // CPUs that workers are pinned to
+    int32_t *cpus;
+    int32_t cpu_count;
+    // NUMA nodes with any of the CPUs, worker at each index is on node index % node_count
+    int32_t *nodes;
+    int32_t node_count;
 } threadpool_s;
 
-static threadpool_job_s *threadpool_job_create(void *user_data, threadpool_job_cb callback) {
+// Worker running on the calling thread, so jobs it submits go to its own deque
+static THREAD_LOCAL threadpool_thread_s *threadpool_current_thread;
+
+static threadpool_job_s *threadpool_job_create(int32_t priority, void *user_data, threadpool_job_cb callback) {
     threadpool_job_s *job = (threadpool_job_s *)calloc(1, sizeof(threadpool_job_s));
     if (!job)
         return NULL;
     job->user_data = user_data;
     job->callback = callback;
+    job->priority = priority;
     job->next = NULL;
     return job;
 }
@@ -63,44 +119,251 @@ static bool threadpool_job_delete(threadpool_job_s **job) {
 static bool threadpool_enqueue_job(threadpool_s *threadpool, threadpool_job_s *job) {
     log_debug("threadpool - job 0x%" PRIxPTR " - enqueue", (intptr_t)job);
 
-    // Add job to the end of the queue
-    if (!threadpool->queue_last) {
-        threadpool->queue_first = job;
-        threadpool->queue_last = job;
+    // Add job to the end of the queue for its priority
+    const int32_t priority = job->priority;
+    if (!threadpool->queue_last[priority]) {
+        threadpool->queue_first[priority] = job;
+        threadpool->queue_last[priority] = job;
     } else {
-        threadpool->queue_last->next = job;
-        threadpool->queue_last = job;
+        threadpool->queue_last[priority]->next = job;
+        threadpool->queue_last[priority] = job;
     }
     threadpool->queue_count++;
     return true;
 }
 
 static threadpool_job_s *threadpool_dequeue_job(threadpool_s *threadpool) {
-    if (!threadpool->queue_first)
+    // Foreground jobs go first, background jobs only while there are threads left for foreground jobs
+    int32_t priority = THREADPOOL_PRIORITY_FOREGROUND;
+    if (!threadpool->queue_first[priority]) {
+        if (threadpool->busy_background_threads >= threadpool->max_background_threads)
+            return NULL;
+        priority = THREADPOOL_PRIORITY_BACKGROUND;
+    }
+    if (!threadpool->queue_first[priority])
         return NULL;
 
     // Remove the first job from the queue
-    threadpool_job_s *job = threadpool->queue_first;
-    threadpool->queue_first = threadpool->queue_first->next;
-    if (!threadpool->queue_first)
-        threadpool->queue_last = NULL;
+    threadpool_job_s *job = threadpool->queue_first[priority];
+    threadpool->queue_first[priority] = job->next;
+    if (!threadpool->queue_first[priority])
+        threadpool->queue_last[priority] = NULL;
     threadpool->queue_count--;
 
     log_debug("threadpool - job 0x%" PRIxPTR " - dequeue", (intptr_t)job);
     return job;
 }
 
+static void threadpool_deque_push(threadpool_s *threadpool, threadpool_deque_s *deque, threadpool_job_s *job) {
+    log_debug("threadpool - job 0x%" PRIxPTR " - push", (intptr_t)job);
+
+    pthread_mutex_lock(&deque->mutex);
+    job->prev = NULL;
+    job->next = deque->newest;
+    if (deque->newest)
+        deque->newest->prev = job;
+    else
+        deque->oldest = job;
+    deque->newest = job;
+    THREADPOOL_STORE(&deque->count, deque->count + 1);
+    THREADPOOL_FETCH_ADD(&threadpool->stealable_count, 1);
+    pthread_mutex_unlock(&deque->mutex);
+}
+
+// Take the newest job, or the oldest job when stealing from another worker
+static threadpool_job_s *threadpool_deque_take(threadpool_s *threadpool, threadpool_deque_s *deque, bool steal) {
+    if (!THREADPOOL_LOAD(&deque->count))
+        return NULL;
+
+    pthread_mutex_lock(&deque->mutex);
+    threadpool_job_s *job = steal ? deque->oldest : deque->newest;
+    if (job) {
+        if (steal) {
+            deque->oldest = job->prev;
+            if (deque->oldest)
+                deque->oldest->next = NULL;
+            else
+                deque->newest = NULL;
+        } else {
+            deque->newest = job->next;
+            if (deque->newest)
+                deque->newest->prev = NULL;
+            else
+                deque->oldest = NULL;
+        }
+        job->next = job->prev = NULL;
+        THREADPOOL_STORE(&deque->count, deque->count - 1);
+        THREADPOOL_FETCH_ADD(&threadpool->stealable_count, -1);
+    }
+    pthread_mutex_unlock(&deque->mutex);
+
+    if (job)
+        log_debug("threadpool - job 0x%" PRIxPTR " - %s", (intptr_t)job, steal ? "steal" : "pop");
+    return job;
+}
+
+// Steal the oldest job from another worker, starting at a random one so thieves spread out
+static threadpool_job_s *threadpool_steal_job(threadpool_s *threadpool, threadpool_thread_s *thread) {
+    const int32_t count = THREADPOOL_LOAD(&threadpool->num_threads);
+    if (count <= 1)
+        return NULL;
+
+    thread->random ^= thread->random << 13;
+    thread->random ^= thread->random >> 17;
+    thread->random ^= thread->random << 5;
+
+    // Workers on the same NUMA node are tried first so the job's memory stays local
+    const int32_t node_count = threadpool->node_count;
+    const int32_t passes = node_count > 1 ? 2 : 1;
+    const int32_t start = (int32_t)(thread->random % (uint32_t)count);
+    for (int32_t pass = 0; pass < passes; pass++) {
+        for (int32_t i = 0; i < count; i++) {
+            const int32_t index = (start + i) % count;
+            if (index == thread->index)
+                continue;
+            if (passes > 1 && (index % node_count == thread->index % node_count) != (pass == 0))
+                continue;
+            threadpool_job_s *job = threadpool_deque_take(threadpool, threadpool->deques[index], true);
+            if (job)
+                return job;
+        }
+    }
+    return NULL;
+}
+
+// Pin the calling worker to the pool's CPUs that are on its NUMA node
+static void threadpool_thread_set_affinity(threadpool_thread_s *thread) {
+#ifdef __linux__
+    threadpool_s *threadpool = thread->pool;
+    if (!threadpool->cpu_count)
+        return;
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int32_t i = 0; i < threadpool->cpu_count; i++) {
+        const int32_t cpu = threadpool->cpus[i];
+        if (threadpool->node_count > 1 && get_numa_node_of_cpu(cpu) != thread->node)
+            continue;
+        CPU_SET(cpu, &cpu_set);
+    }
+
+    const int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (error)
+        log_warn("threadpool - worker 0x%" PRIx64 " - unable to set affinity (%d)", (uint64_t)pthread_self(), error);
+#else
+    UNUSED(thread);
+#endif
+}
+
+static void threadpool_run_job(threadpool_job_s *job) {
+#ifdef __APPLE__
+    // The implicit thread autorelease pool on macOS doesn’t drain until the thread terminates, and long-lived
+    // threads can run out of memory. Thus, create and drain the autorelease pool for every job callback.
+    typedef id (*init)(id, SEL);
+    static Class autorelease_pool_class = NULL;
+
+    if (autorelease_pool_class == NULL)
+        autorelease_pool_class = objc_getClass("NSAutoreleasePool");
+    id autorelease_pool = class_createInstance(autorelease_pool_class, 0);
+    ((init)objc_msgSend)(autorelease_pool, sel_getUid("init"));
+#endif
+
+    log_debug("threadpool - worker 0x%" PRIx64 " - processing job 0x%" PRIxPTR, (uint64_t)pthread_self(),
+              (intptr_t)job);
+    job->callback(job->user_data);
+    log_debug("threadpool - worker 0x%" PRIx64 " - job complete 0x%" PRIxPTR, (uint64_t)pthread_self(),
+              (intptr_t)job);
+
+#ifdef __APPLE__
+    typedef void (*drain)(id, SEL);
+    ((drain)objc_msgSend)(autorelease_pool, sel_getUid("drain"));
+#endif
+
+    threadpool_job_delete(&job);
+}
+
+static void *threadpool_do_work_stealing(threadpool_thread_s *thread) {
+    threadpool_s *threadpool = thread->pool;
+    threadpool_deque_s *deque = threadpool->deques[thread->index];
+
+    threadpool_current_thread = thread;
+
+    while (!THREADPOOL_LOAD(&threadpool->stop)) {
+        // Own newest job first since its data is most likely still in the cache, then other workers' oldest jobs
+        threadpool_job_s *job = threadpool_deque_take(threadpool, deque, false);
+        if (!job)
+            job = threadpool_steal_job(threadpool, thread);
+
+        bool is_background = false;
+        if (!job) {
+            pthread_mutex_lock(&threadpool->queue_mutex);
+            log_debug("threadpool - worker 0x%" PRIx64 " - waiting for job", (uint64_t)pthread_self());
+
+            // Submitters check for sleeping threads after pushing a job, and sleeping threads check for pushed jobs
+            // after saying they are sleeping, so a job is never left without a thread being woken for it
+            THREADPOOL_FETCH_ADD(&threadpool->sleeping_threads, 1);
+            while (!threadpool->stop && !THREADPOOL_LOAD(&threadpool->stealable_count)) {
+                // Background jobs have a limited number of threads so they stay in the shared queue
+                job = threadpool_dequeue_job(threadpool);
+                if (job)
+                    break;
+                pthread_cond_wait(&threadpool->wakeup_cond, &threadpool->queue_mutex);
+            }
+            THREADPOOL_FETCH_ADD(&threadpool->sleeping_threads, -1);
+
+            if (job) {
+                is_background = true;
+                threadpool->busy_background_threads++;
+            }
+            pthread_mutex_unlock(&threadpool->queue_mutex);
+            if (!job)
+                continue;
+        }
+
+        THREADPOOL_FETCH_ADD(&threadpool->busy_threads, 1);
+        threadpool_run_job(job);
+        THREADPOOL_FETCH_ADD(&threadpool->busy_threads, -1);
+
+        if (is_background) {
+            pthread_mutex_lock(&threadpool->queue_mutex);
+            threadpool->busy_background_threads--;
+            pthread_mutex_unlock(&threadpool->queue_mutex);
+        }
+
+        // If no more jobs then signal threadpool_wait that we are lazy
+        if (THREADPOOL_FETCH_ADD(&threadpool->pending_count, -1) == 1) {
+            pthread_mutex_lock(&threadpool->queue_mutex);
+            pthread_cond_signal(&threadpool->lazy_cond);
+            pthread_mutex_unlock(&threadpool->queue_mutex);
+        }
+    }
+
+    log_debug("threadpool - worker 0x%" PRIx64 " - stopped", (uint64_t)pthread_self());
+
+    pthread_mutex_lock(&threadpool->queue_mutex);
+    pthread_cond_signal(&threadpool->lazy_cond);
+    pthread_mutex_unlock(&threadpool->queue_mutex);
+    return NULL;
+}
+
 static void *threadpool_do_work(void *arg) {
-    threadpool_s *threadpool = (threadpool_s *)arg;
+    threadpool_thread_s *thread = (threadpool_thread_s *)arg;
+    threadpool_s *threadpool = thread->pool;
 
     log_debug("threadpool - worker 0x%" PRIx64 " - started", (uint64_t)pthread_self());
 
+    threadpool_thread_set_affinity(thread);
+
+    if (threadpool->scheduler == THREADPOOL_SCHEDULER_WORK_STEALING)
+        return threadpool_do_work_stealing(thread);
+
     while (true) {
         pthread_mutex_lock(&threadpool->queue_mutex);
         log_debug("threadpool - worker 0x%" PRIx64 " - waiting for job", (uint64_t)pthread_self());
 
-        // Sleep until there is work to do
-        while (!threadpool->stop && !threadpool->queue_first) {
+        // Sleep until there is a job this thread is allowed to do
+        threadpool_job_s *job = NULL;
+        while (!threadpool->stop && !(job = threadpool_dequeue_job(threadpool))) {
             // Queue_mutex will be unlocked during sleep and locked during awake
             pthread_cond_wait(&threadpool->wakeup_cond, &threadpool->queue_mutex);
         }
@@ -108,48 +371,26 @@ static void *threadpool_do_work(void *arg) {
         if (threadpool->stop)
             break;
 
-        // Get the next job to do
-        threadpool_job_s *job = threadpool_dequeue_job(threadpool);
-
         // Increment count of busy threads
+        const bool is_background = job->priority == THREADPOOL_PRIORITY_BACKGROUND;
         threadpool->busy_threads++;
+        if (is_background)
+            threadpool->busy_background_threads++;
         pthread_mutex_unlock(&threadpool->queue_mutex);
 
         // Do the job
-        if (job) {
-#ifdef __APPLE__
-            // The implicit thread autorelease pool on macOS doesn’t drain until the thread terminates, and long-lived
-            // threads can run out of memory. Thus, create and drain the autorelease pool for every job callback.
-            typedef id (*init)(id, SEL);
-            static Class autorelease_pool_class = NULL;
-
-            if (autorelease_pool_class == NULL)
-                autorelease_pool_class = objc_getClass("NSAutoreleasePool");
-            id autorelease_pool = class_createInstance(autorelease_pool_class, 0);
-            ((init)objc_msgSend)(autorelease_pool, sel_getUid("init"));
-#endif
-
-            log_debug("threadpool - worker 0x%" PRIx64 " - processing job 0x%" PRIxPTR, (uint64_t)pthread_self(),
-                      (intptr_t)job);
-            job->callback(job->user_data);
-            log_debug("threadpool - worker 0x%" PRIx64 " - job complete 0x%" PRIxPTR, (uint64_t)pthread_self(),
-                      (intptr_t)job);
-
-#ifdef __APPLE__
-            typedef void (*drain)(id, SEL);
-            ((drain)objc_msgSend)(autorelease_pool, sel_getUid("drain"));
-#endif
-
-            threadpool_job_delete(&job);
-        }
+        if (job)
+            threadpool_run_job(job);
 
         pthread_mutex_lock(&threadpool->queue_mutex);
 
         // Decrement count of busy threads
         threadpool->busy_threads--;
+        if (is_background)
+            threadpool->busy_background_threads--;
 
         // If no busy threads then signal threadpool_wait that we are lazy
-        if (threadpool->busy_threads == 0 && !threadpool->queue_first)
+        if (threadpool->busy_threads == 0 && !threadpool->queue_count)
             pthread_cond_signal(&threadpool->lazy_cond);
 
         pthread_mutex_unlock(&threadpool->queue_mutex);
@@ -163,42 +404,121 @@ static void *threadpool_do_work(void *arg) {
 }
 
 static bool threadpool_create_thread_on_demand(threadpool_s *threadpool) {
+    threadpool_thread_s *thread = (threadpool_thread_s *)calloc(1, sizeof(threadpool_thread_s));
+    if (!thread)
+        return false;
+    thread->pool = threadpool;
+    thread->index = threadpool->num_threads;
+    thread->random = (uint32_t)thread->index * 2654435761u + 1;
+    if (threadpool->node_count > 0)
+        thread->node = threadpool->nodes[thread->index % threadpool->node_count];
+
     // Create new thread and add it to the list of threads
-    pthread_t handle = 0;
-    if (pthread_create(&handle, NULL, threadpool_do_work, threadpool))
+    if (pthread_create(&thread->handle, NULL, threadpool_do_work, thread)) {
+        free(thread);
         return false;
+    }
 
-    threadpool_thread_s *thread = (threadpool_thread_s *)calloc(1, sizeof(threadpool_thread_s));
-    thread->handle = handle;
     thread->next = threadpool->threads;
-
     threadpool->threads = thread;
-    threadpool->num_threads++;
+    THREADPOOL_FETCH_ADD(&threadpool->num_threads, 1);
     return true;
 }
 
-bool threadpool_enqueue(void *ctx, void *user_data, threadpool_job_cb callback) {
+// Create threads while there are fewer than the minimum or when all are busy, must hold the queue mutex
+static void threadpool_create_threads(threadpool_s *threadpool, int32_t priority) {
+    // Create min amount of threads
+    while (threadpool->num_threads < threadpool->min_threads) {
+        if (!threadpool_create_thread_on_demand(threadpool))
+            break;
+    }
+
+    // Create new thread if all threads are busy, with one extra for foreground jobs when background jobs fill the pool
+    int32_t max_threads = threadpool->max_threads;
+    if (priority == THREADPOOL_PRIORITY_FOREGROUND && threadpool->busy_background_threads >= max_threads)
+        max_threads++;
+    if (THREADPOOL_LOAD(&threadpool->busy_threads) == threadpool->num_threads &&
+        threadpool->num_threads < max_threads)
+        threadpool_create_thread_on_demand(threadpool);
+}
+
+// Get the position of the calling thread's NUMA node in the pool's nodes, negative if not spread across nodes
+static int32_t threadpool_get_node_index(threadpool_s *threadpool) {
+#ifdef __linux__
+    if (threadpool->node_count > 1) {
+        const int32_t node = get_current_numa_node();
+        for (int32_t i = 0; i < threadpool->node_count; i++) {
+            if (threadpool->nodes[i] == node)
+                return i;
+        }
+    }
+#else
+    UNUSED(threadpool);
+#endif
+    return -1;
+}
+
+static void threadpool_enqueue_stealing(threadpool_s *threadpool, threadpool_job_s *job) {
+    // Only take the queue mutex when there may be a thread to create
+    const int32_t num_threads = THREADPOOL_LOAD(&threadpool->num_threads);
+    if (num_threads < threadpool->min_threads || THREADPOOL_LOAD(&threadpool->busy_threads) >= num_threads) {
+        pthread_mutex_lock(&threadpool->queue_mutex);
+        threadpool_create_threads(threadpool, job->priority);
+        pthread_mutex_unlock(&threadpool->queue_mutex);
+    }
+
+    // Jobs submitted by a worker, such as fan out, stay on its deque until it or an idle worker takes them.
+    // Other jobs go to each worker in turn.
+    threadpool_thread_s *thread = threadpool_current_thread;
+    int32_t index = 0;
+    if (thread && thread->pool == threadpool) {
+        index = thread->index;
+    } else {
+        const int32_t count = THREADPOOL_LOAD(&threadpool->num_threads);
+        const uint32_t next = THREADPOOL_FETCH_ADD(&threadpool->next_deque, 1);
+        const int32_t node_index = threadpool_get_node_index(threadpool);
+        if (node_index >= 0 && node_index < count) {
+            // Workers on the submitting thread's node are at every node_count index starting at its node index
+            const int32_t node_workers = (count - 1 - node_index) / threadpool->node_count + 1;
+            index = node_index + (int32_t)(next % (uint32_t)node_workers) * threadpool->node_count;
+        } else if (count > 0) {
+            index = (int32_t)(next % (uint32_t)count);
+        }
+    }
+    threadpool_deque_push(threadpool, threadpool->deques[index], job);
+
+    // Wake up a waiting thread
+    if (THREADPOOL_LOAD(&threadpool->sleeping_threads) > 0) {
+        pthread_mutex_lock(&threadpool->queue_mutex);
+        pthread_cond_signal(&threadpool->wakeup_cond);
+        pthread_mutex_unlock(&threadpool->queue_mutex);
+    }
+}
+
+bool threadpool_enqueue_ex(void *ctx, int32_t priority, void *user_data, threadpool_job_cb callback) {
     threadpool_s *threadpool = (threadpool_s *)ctx;
 
+    if (priority < 0 || priority >= THREADPOOL_PRIORITY_COUNT)
+        return false;
+
     // Create new job
-    threadpool_job_s *job = threadpool_job_create(user_data, callback);
+    threadpool_job_s *job = threadpool_job_create(priority, user_data, callback);
     if (!job)
         return false;
 
+    if (threadpool->scheduler == THREADPOOL_SCHEDULER_WORK_STEALING) {
+        THREADPOOL_FETCH_ADD(&threadpool->pending_count, 1);
+        if (priority == THREADPOOL_PRIORITY_FOREGROUND) {
+            threadpool_enqueue_stealing(threadpool, job);
+            return true;
+        }
+    }
+
     pthread_mutex_lock(&threadpool->queue_mutex);
 
     // Add job to the job queue
     threadpool_enqueue_job(threadpool, job);
-
-    // Create min amount of threads
-    while (threadpool->num_threads < threadpool->min_threads) {
-        if (!threadpool_create_thread_on_demand(threadpool))
-            break;
-    }
-
-    // Create new thread if all threads are busy
-    if (threadpool->busy_threads == threadpool->num_threads && threadpool->num_threads < threadpool->max_threads)
-        threadpool_create_thread_on_demand(threadpool);
+    threadpool_create_threads(threadpool, priority);
 
     pthread_mutex_unlock(&threadpool->queue_mutex);
 
@@ -207,6 +527,10 @@ bool threadpool_enqueue(void *ctx, void *user_data, threadpool_job_cb callback)
     return true;
 }
 
+bool threadpool_enqueue(void *ctx, void *user_data, threadpool_job_cb callback) {
+    return threadpool_enqueue_ex(ctx, THREADPOOL_PRIORITY_FOREGROUND, user_data, callback);
+}
+
 static void threadpool_delete_threads(threadpool_s *threadpool) {
     threadpool_thread_s *thread = NULL;
 
@@ -219,30 +543,121 @@ static void threadpool_delete_threads(threadpool_s *threadpool) {
 
         free(thread);
     }
-    threadpool->num_threads = 0;
+    THREADPOOL_STORE(&threadpool->num_threads, 0);
 }
 
 static void threadpool_delete_jobs(threadpool_s *threadpool) {
     threadpool_job_s *job = NULL;
 
-    // Delete job from the queue
-    while (threadpool->queue_first) {
-        job = threadpool->queue_first;
-        threadpool->queue_first = threadpool->queue_first->next;
-        threadpool_job_delete(&job);
+    // Delete jobs from the queues
+    for (int32_t priority = 0; priority < THREADPOOL_PRIORITY_COUNT; priority++) {
+        while (threadpool->queue_first[priority]) {
+            job = threadpool->queue_first[priority];
+            threadpool->queue_first[priority] = job->next;
+            threadpool_job_delete(&job);
+        }
+        threadpool->queue_last[priority] = NULL;
+    }
+    threadpool->queue_count = 0;
+
+    for (int32_t i = 0; i < threadpool->deque_count; i++) {
+        while ((job = threadpool_deque_take(threadpool, threadpool->deques[i], false)))
+            threadpool_job_delete(&job);
+    }
+}
+
+static void threadpool_delete_deques(threadpool_s *threadpool) {
+    for (int32_t i = 0; i < threadpool->deque_count; i++) {
+        if (!threadpool->deques[i])
+            continue;
+        pthread_mutex_destroy(&threadpool->deques[i]->mutex);
+        free(threadpool->deques[i]);
     }
+    free(threadpool->deques);
+    threadpool->deques = NULL;
+    threadpool->deque_count = 0;
+}
+
+static void threadpool_delete_placement(threadpool_s *threadpool) {
+    free(threadpool->cpus);
+    threadpool->cpus = NULL;
+    threadpool->cpu_count = 0;
+    free(threadpool->nodes);
+    threadpool->nodes = NULL;
+    threadpool->node_count = 0;
+}
+
+// Copy the CPUs workers are pinned to and find the NUMA nodes they are on
+static bool threadpool_create_placement(threadpool_s *threadpool, const threadpool_options_s *options) {
+#ifdef __linux__
+    if (!options->cpus && !options->numa_local)
+        return true;
+
+    // Without a list of CPUs, workers are spread across the nodes the process is allowed to run on
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    int32_t cpu_count = options->cpu_count;
+    if (!options->cpus) {
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            return true;
+        cpu_count = CPU_COUNT(&allowed);
+    }
+    if (cpu_count <= 0)
+        return true;
+
+    threadpool->cpus = (int32_t *)calloc((size_t)cpu_count, sizeof(int32_t));
+    threadpool->nodes = (int32_t *)calloc((size_t)cpu_count, sizeof(int32_t));
+    if (!threadpool->cpus || !threadpool->nodes)
+        return false;
+
+    for (int32_t i = 0, cpu = 0; i < cpu_count; i++, cpu++) {
+        if (options->cpus) {
+            cpu = options->cpus[i];
+            if (cpu < 0 || cpu >= CPU_SETSIZE)
+                continue;
+        } else {
+            while (!CPU_ISSET(cpu, &allowed))
+                cpu++;
+        }
+        threadpool->cpus[threadpool->cpu_count++] = cpu;
+
+        if (!options->numa_local)
+            continue;
+        const int32_t node = get_numa_node_of_cpu(cpu);
+        int32_t n = 0;
+        while (n < threadpool->node_count && threadpool->nodes[n] != node)
+            n++;
+        if (n == threadpool->node_count)
+            threadpool->nodes[threadpool->node_count++] = node;
+    }
+
+    // Nothing to pin to when all allowed CPUs are on one node
+    if (!options->cpus && threadpool->node_count <= 1)
+        threadpool_delete_placement(threadpool);
+#else
+    UNUSED(threadpool);
+    UNUSED(options);
+#endif
+    return true;
 }
 
 static void threadpool_stop_threads(threadpool_s *threadpool) {
     // Stop threads from doing anymore work
     pthread_mutex_lock(&threadpool->queue_mutex);
-    threadpool->stop = true;
+    THREADPOOL_STORE(&threadpool->stop, true);
     pthread_mutex_unlock(&threadpool->queue_mutex);
 
     // Wake up all threads to check stop flag
     pthread_cond_broadcast(&threadpool->wakeup_cond);
 }
 
+// Check whether any jobs are queued or running, must hold the queue mutex
+static bool threadpool_has_jobs(threadpool_s *threadpool) {
+    if (threadpool->scheduler == THREADPOOL_SCHEDULER_WORK_STEALING)
+        return THREADPOOL_LOAD(&threadpool->pending_count) != 0;
+    return threadpool->busy_threads != 0 || threadpool->queue_count != 0;
+}
+
 void threadpool_wait(void *ctx) {
     threadpool_s *threadpool = (threadpool_s *)ctx;
     if (!threadpool)
@@ -250,7 +665,7 @@ void threadpool_wait(void *ctx) {
 
     pthread_mutex_lock(&threadpool->queue_mutex);
     while (true) {
-        if ((!threadpool->stop && (threadpool->busy_threads != 0 || threadpool->queue_count != 0)) ||
+        if ((!threadpool->stop && threadpool_has_jobs(threadpool)) ||
             (threadpool->stop && threadpool->num_threads != 0)) {
             // Wait for signal that indicates there is no more work to do
             pthread_cond_wait(&threadpool->lazy_cond, &threadpool->queue_mutex);
@@ -261,13 +676,43 @@ void threadpool_wait(void *ctx) {
     pthread_mutex_unlock(&threadpool->queue_mutex);
 }
 
-void *threadpool_create(int32_t min_threads, int32_t max_threads) {
+void *threadpool_create_ex(int32_t min_threads, int32_t max_threads, const threadpool_options_s *options) {
     threadpool_s *threadpool = (threadpool_s *)calloc(1, sizeof(threadpool_s));
     if (!threadpool)
         return NULL;
 
     threadpool->min_threads = min_threads;
     threadpool->max_threads = max_threads;
+    threadpool->max_background_threads = max_threads > 1 ? max_threads - 1 : 1;
+
+    if (options && !threadpool_create_placement(threadpool, options)) {
+        threadpool_delete_placement(threadpool);
+        free(threadpool);
+        return NULL;
+    }
+
+    if (options && options->scheduler == THREADPOOL_SCHEDULER_WORK_STEALING) {
+        threadpool->scheduler = THREADPOOL_SCHEDULER_WORK_STEALING;
+
+        // Threads are never more than the maximum plus one for foreground jobs
+        threadpool->deques = (threadpool_deque_s **)calloc((size_t)max_threads + 1, sizeof(threadpool_deque_s *));
+        if (!threadpool->deques) {
+            threadpool_delete_placement(threadpool);
+            free(threadpool);
+            return NULL;
+        }
+        for (; threadpool->deque_count < max_threads + 1; threadpool->deque_count++) {
+            threadpool_deque_s *deque = (threadpool_deque_s *)calloc(1, sizeof(threadpool_deque_s));
+            if (!deque) {
+                threadpool_delete_deques(threadpool);
+                threadpool_delete_placement(threadpool);
+                free(threadpool);
+                return NULL;
+            }
+            pthread_mutex_init(&deque->mutex, NULL);
+            threadpool->deques[threadpool->deque_count] = deque;
+        }
+    }
 
     pthread_mutex_init(&threadpool->queue_mutex, NULL);
     pthread_cond_init(&threadpool->wakeup_cond, NULL);
@@ -276,6 +721,10 @@ void *threadpool_create(int32_t min_threads, int32_t max_threads) {
     return threadpool;
 }
 
+void *threadpool_create(int32_t min_threads, int32_t max_threads) {
+    return threadpool_create_ex(min_threads, max_threads, NULL);
+}
+
 bool threadpool_delete(void **ctx) {
     if (!ctx)
         return false;
@@ -286,6 +735,8 @@ bool threadpool_delete(void **ctx) {
     threadpool_stop_threads(threadpool);
     threadpool_delete_threads(threadpool);
     threadpool_delete_jobs(threadpool);
+    threadpool_delete_deques(threadpool);
+    threadpool_delete_placement(threadpool);
 
     pthread_mutex_destroy(&threadpool->queue_mutex);
     pthread_cond_destroy(&threadpool->wakeup_cond);
@@ -15,6 +15,7 @@ typedef struct threadpool_job_s {
     PTP_WORK handle;
     void *user_data;
     threadpool_job_cb callback;
+    int32_t priority;
     struct threadpool_s *pool;
     struct threadpool_job_s *next;
     struct threadpool_job_s *prev;
@@ -27,14 +28,21 @@ typedef struct threadpool_s {
     int32_t queue_count;
     threadpool_job_s *queue_first;
     threadpool_job_s *queue_last;
+    // Background jobs submitted to the system pool, limited so foreground jobs always have a thread
+    int32_t background_count;
+    int32_t max_background_count;
+    // Background jobs held back until a submitted one completes
+    threadpool_job_s *pending_first;
+    threadpool_job_s *pending_last;
 } threadpool_s;
 
-static threadpool_job_s *threadpool_job_create(void *user_data, threadpool_job_cb callback) {
+static threadpool_job_s *threadpool_job_create(int32_t priority, void *user_data, threadpool_job_cb callback) {
     threadpool_job_s *job = (threadpool_job_s *)calloc(1, sizeof(threadpool_job_s));
     if (!job)
         return NULL;
     job->user_data = user_data;
     job->callback = callback;
+    job->priority = priority;
     job->next = NULL;
     return job;
 }
@@ -81,6 +89,14 @@ static void threadpool_remove_job(threadpool_s *threadpool, threadpool_job_s *jo
     log_debug("threadpool - job 0x%" PRIxPTR " - remove", (intptr_t)job);
 }
 
+// Add a job to the queue and hand it to the system pool
+static void threadpool_submit_job(threadpool_s *threadpool, threadpool_job_s *job) {
+    if (job->priority == THREADPOOL_PRIORITY_BACKGROUND)
+        threadpool->background_count++;
+    threadpool_add_job(threadpool, job);
+    SubmitThreadpoolWork(job->handle);
+}
+
 VOID CALLBACK threadpool_job_callback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work) {
     UNUSED(instance);
 
@@ -96,14 +112,30 @@ VOID CALLBACK threadpool_job_callback(PTP_CALLBACK_INSTANCE instance, PVOID cont
     // Remove job from job queue
     threadpool_s *threadpool = job->pool;
     mutex_lock(threadpool->queue_lock);
+    if (job->priority == THREADPOOL_PRIORITY_BACKGROUND) {
+        threadpool->background_count--;
+
+        // Submit the next held back background job before this one leaves the queue, so threadpool_wait sees it
+        threadpool_job_s *pending = threadpool->pending_first;
+        if (pending) {
+            threadpool->pending_first = pending->next;
+            if (!threadpool->pending_first)
+                threadpool->pending_last = NULL;
+            pending->next = NULL;
+            threadpool_submit_job(threadpool, pending);
+        }
+    }
     threadpool_remove_job(threadpool, job);
     mutex_unlock(threadpool->queue_lock);
 }
 
-bool threadpool_enqueue(void *ctx, void *user_data, threadpool_job_cb callback) {
+bool threadpool_enqueue_ex(void *ctx, int32_t priority, void *user_data, threadpool_job_cb callback) {
     threadpool_s *threadpool = (threadpool_s *)ctx;
 
-    threadpool_job_s *job = threadpool_job_create(user_data, callback);
+    if (priority != THREADPOOL_PRIORITY_FOREGROUND && priority != THREADPOOL_PRIORITY_BACKGROUND)
+        return false;
+
+    threadpool_job_s *job = threadpool_job_create(priority, user_data, callback);
     if (!job)
         return false;
 
@@ -115,13 +147,26 @@ bool threadpool_enqueue(void *ctx, void *user_data, threadpool_job_cb callback)
     }
 
     mutex_lock(threadpool->queue_lock);
-    threadpool_add_job(threadpool, job);
+    const bool hold_back = priority == THREADPOOL_PRIORITY_BACKGROUND &&
+                           threadpool->background_count >= threadpool->max_background_count;
+    if (hold_back) {
+        // System pool runs work in order, so hold back background jobs that would take the last thread
+        if (!threadpool->pending_last)
+            threadpool->pending_first = job;
+        else
+            threadpool->pending_last->next = job;
+        threadpool->pending_last = job;
+    } else {
+        threadpool_submit_job(threadpool, job);
+    }
     mutex_unlock(threadpool->queue_lock);
-
-    SubmitThreadpoolWork(job->handle);
     return true;
 }
 
+bool threadpool_enqueue(void *ctx, void *user_data, threadpool_job_cb callback) {
+    return threadpool_enqueue_ex(ctx, THREADPOOL_PRIORITY_FOREGROUND, user_data, callback);
+}
+
 void threadpool_wait(void *ctx) {
     threadpool_s *threadpool = (threadpool_s *)ctx;
     threadpool_job_s *job = NULL;
@@ -164,6 +209,11 @@ void *threadpool_create(int32_t min_threads, int32_t max_threads) {
         return NULL;
     }
 
+    // Pool of one thread gets a second so foreground jobs are not stuck behind a background job
+    threadpool->max_background_count = max_threads > 1 ? max_threads - 1 : 1;
+    if (max_threads < threadpool->max_background_count + 1)
+        max_threads = threadpool->max_background_count + 1;
+
     SetThreadpoolThreadMinimum(threadpool->handle, min_threads);
     SetThreadpoolThreadMaximum(threadpool->handle, max_threads);
 
@@ -171,6 +221,12 @@ void *threadpool_create(int32_t min_threads, int32_t max_threads) {
     return threadpool;
 }
 
+void *threadpool_create_ex(int32_t min_threads, int32_t max_threads, const threadpool_options_s *options) {
+    // Workers always share one queue
+    UNUSED(options);
+    return threadpool_create(min_threads, max_threads);
+}
+
 bool threadpool_delete(void **ctx) {
     if (!ctx)
         return false;
@@ -179,6 +235,13 @@ bool threadpool_delete(void **ctx) {
         return false;
     if (threadpool->handle)
         CloseThreadpool(threadpool->handle);
+    // Background jobs still held back were never submitted
+    while (threadpool->pending_first) {
+        threadpool_job_s *job = threadpool->pending_first;
+        threadpool->pending_first = job->next;
+        CloseThreadpoolWork(job->handle);
+        threadpool_job_delete(&job);
+    }
     mutex_delete(&threadpool->queue_lock);
     DestroyThreadpoolEnvironment(&threadpool->cb_environ);
     free(threadpool);
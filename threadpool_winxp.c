@@ -13,10 +13,14 @@
 #include "log.h"
 #include "mutex.h"
 #include "threadpool.h"
+#include "util.h"
+
+#define THREADPOOL_PRIORITY_COUNT (2)
 
 typedef struct threadpool_job_s {
     void *user_data;
     threadpool_job_cb callback;
+    int32_t priority;
     struct threadpool_job_s *next;
 } threadpool_job_s;
 
@@ -33,21 +37,26 @@ typedef struct threadpool_s {
     int32_t num_threads;
     int32_t max_threads;
     int32_t busy_threads;
+    // Threads running background jobs, limited so foreground jobs always have a thread
+    int32_t busy_background_threads;
+    int32_t max_background_threads;
     void *wakeup_cond;
     void *lazy_cond;
     int32_t queue_count;
     void *queue_lock;
-    threadpool_job_s *queue_first;
-    threadpool_job_s *queue_last;
+    // Job queues indexed by priority
+    threadpool_job_s *queue_first[THREADPOOL_PRIORITY_COUNT];
+    threadpool_job_s *queue_last[THREADPOOL_PRIORITY_COUNT];
     threadpool_thread_s *threads;
 } threadpool_s;
 
-static threadpool_job_s *threadpool_job_create(void *user_data, threadpool_job_cb callback) {
+static threadpool_job_s *threadpool_job_create(int32_t priority, void *user_data, threadpool_job_cb callback) {
     threadpool_job_s *job = (threadpool_job_s *)calloc(1, sizeof(threadpool_job_s));
     if (!job)
         return NULL;
     job->user_data = user_data;
     job->callback = callback;
+    job->priority = priority;
     job->next = NULL;
     return job;
 }
@@ -63,26 +72,34 @@ static bool threadpool_job_delete(threadpool_job_s **job) {
 static void threadpool_enqueue_job(threadpool_s *threadpool, threadpool_job_s *job) {
     log_debug("threadpool - job 0x%" PRIxPTR " - enqueue", (intptr_t)job);
 
-    // Add job to the end of the queue
-    if (!threadpool->queue_last) {
-        threadpool->queue_first = job;
-        threadpool->queue_last = job;
+    // Add job to the end of the queue for its priority
+    const int32_t priority = job->priority;
+    if (!threadpool->queue_last[priority]) {
+        threadpool->queue_first[priority] = job;
+        threadpool->queue_last[priority] = job;
     } else {
-        threadpool->queue_last->next = job;
-        threadpool->queue_last = job;
+        threadpool->queue_last[priority]->next = job;
+        threadpool->queue_last[priority] = job;
     }
     threadpool->queue_count++;
 }
 
 static threadpool_job_s *threadpool_dequeue_job(threadpool_s *threadpool) {
-    if (!threadpool->queue_first)
+    // Foreground jobs go first, background jobs only while there are threads left for foreground jobs
+    int32_t priority = THREADPOOL_PRIORITY_FOREGROUND;
+    if (!threadpool->queue_first[priority]) {
+        if (threadpool->busy_background_threads >= threadpool->max_background_threads)
+            return NULL;
+        priority = THREADPOOL_PRIORITY_BACKGROUND;
+    }
+    if (!threadpool->queue_first[priority])
         return NULL;
 
     // Remove the first job from the queue
-    threadpool_job_s *job = threadpool->queue_first;
-    threadpool->queue_first = threadpool->queue_first->next;
-    if (!threadpool->queue_first)
-        threadpool->queue_last = NULL;
+    threadpool_job_s *job = threadpool->queue_first[priority];
+    threadpool->queue_first[priority] = job->next;
+    if (!threadpool->queue_first[priority])
+        threadpool->queue_last[priority] = NULL;
     threadpool->queue_count--;
 
     log_debug("threadpool - job 0x%" PRIxPTR " - dequeue", (intptr_t)job);
@@ -98,8 +115,9 @@ static void __cdecl threadpool_do_work(void *arg) {
         mutex_lock(threadpool->queue_lock);
         log_debug("threadpool - worker 0x%" PRIx32 " - waiting for job", GetCurrentThreadId());
 
-        // Sleep until there is work to do
-        while (!threadpool->stop && !threadpool->queue_first) {
+        // Sleep until there is a job this thread is allowed to do
+        threadpool_job_s *job = NULL;
+        while (!threadpool->stop && !(job = threadpool_dequeue_job(threadpool))) {
             mutex_unlock(threadpool->queue_lock);
             // queue_lock will be unlocked during sleep and locked during awake
             bool wakeup = event_wait(threadpool->wakeup_cond, 250);
@@ -111,11 +129,11 @@ static void __cdecl threadpool_do_work(void *arg) {
         if (threadpool->stop)
             break;
 
-        // Get the next job to do
-        threadpool_job_s *job = threadpool_dequeue_job(threadpool);
-
         // Increment count of busy threads
+        const bool is_background = job->priority == THREADPOOL_PRIORITY_BACKGROUND;
         threadpool->busy_threads++;
+        if (is_background)
+            threadpool->busy_background_threads++;
         mutex_unlock(threadpool->queue_lock);
 
         // Do the job
@@ -132,9 +150,11 @@ static void __cdecl threadpool_do_work(void *arg) {
 
         // Decrement count of busy threads
         threadpool->busy_threads--;
+        if (is_background)
+            threadpool->busy_background_threads--;
 
         // If no busy threads then signal threadpool_wait that we are lazy
-        if (threadpool->busy_threads == 0 && !threadpool->queue_first)
+        if (threadpool->busy_threads == 0 && !threadpool->queue_count)
             event_set(threadpool->lazy_cond);
 
         mutex_unlock(threadpool->queue_lock);
@@ -161,11 +181,14 @@ static bool threadpool_create_thread_on_demand(threadpool_s *threadpool) {
     return true;
 }
 
-bool threadpool_enqueue(void *ctx, void *user_data, threadpool_job_cb callback) {
+bool threadpool_enqueue_ex(void *ctx, int32_t priority, void *user_data, threadpool_job_cb callback) {
     threadpool_s *threadpool = (threadpool_s *)ctx;
 
+    if (priority < 0 || priority >= THREADPOOL_PRIORITY_COUNT)
+        return false;
+
     // Create new job
-    threadpool_job_s *job = threadpool_job_create(user_data, callback);
+    threadpool_job_s *job = threadpool_job_create(priority, user_data, callback);
     if (!job)
         return false;
 
@@ -180,8 +203,11 @@ bool threadpool_enqueue(void *ctx, void *user_data, threadpool_job_cb callback)
             break;
     }
 
-    // Create new thread if all threads are busy
-    if (threadpool->busy_threads == threadpool->num_threads && threadpool->num_threads < threadpool->max_threads)
+    // Create new thread if all threads are busy, with one extra for foreground jobs when background jobs fill the pool
+    int32_t max_threads = threadpool->max_threads;
+    if (priority == THREADPOOL_PRIORITY_FOREGROUND && threadpool->busy_background_threads >= max_threads)
+        max_threads++;
+    if (threadpool->busy_threads == threadpool->num_threads && threadpool->num_threads < max_threads)
         threadpool_create_thread_on_demand(threadpool);
 
     mutex_unlock(threadpool->queue_lock);
@@ -191,6 +217,10 @@ bool threadpool_enqueue(void *ctx, void *user_data, threadpool_job_cb callback)
     return true;
 }
 
+bool threadpool_enqueue(void *ctx, void *user_data, threadpool_job_cb callback) {
+    return threadpool_enqueue_ex(ctx, THREADPOOL_PRIORITY_FOREGROUND, user_data, callback);
+}
+
 static void threadpool_stop_threads(threadpool_s *threadpool) {
     mutex_lock(threadpool->queue_lock);
     // Stop threads from doing anymore work
@@ -226,12 +256,16 @@ static void threadpool_delete_threads(threadpool_s *threadpool) {
 static void threadpool_delete_jobs(threadpool_s *threadpool) {
     threadpool_job_s *job = NULL;
 
-    // Delete job from the queue
-    while (threadpool->queue_first) {
-        job = threadpool->queue_first;
-        threadpool->queue_first = threadpool->queue_first->next;
-        threadpool_job_delete(&job);
+    // Delete jobs from the queues
+    for (int32_t priority = 0; priority < THREADPOOL_PRIORITY_COUNT; priority++) {
+        while (threadpool->queue_first[priority]) {
+            job = threadpool->queue_first[priority];
+            threadpool->queue_first[priority] = job->next;
+            threadpool_job_delete(&job);
+        }
+        threadpool->queue_last[priority] = NULL;
     }
+    threadpool->queue_count = 0;
 }
 
 void threadpool_wait(void *ctx) {
@@ -282,10 +316,17 @@ void *threadpool_create(int32_t min_threads, int32_t max_threads) {
 
     threadpool->min_threads = min_threads;
     threadpool->max_threads = max_threads;
+    threadpool->max_background_threads = max_threads > 1 ? max_threads - 1 : 1;
 
     return threadpool;
 }
 
+void *threadpool_create_ex(int32_t min_threads, int32_t max_threads, const threadpool_options_s *options) {
+    // Workers always share one queue
+    UNUSED(options);
+    return threadpool_create(min_threads, max_threads);
+}
+
 bool threadpool_delete(void **ctx) {
     if (!ctx)
         return false;
@@ -0,0 +1,274 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#endif
+
+#include "log.h"
+#include "mutex.h"
+#include "trace.h"
+#include "util.h"
+
+#include "proxyres/trace.h"
+
+#define TRACE_DEFAULT_EVENTS_PER_THREAD (4096)
+#define TRACE_MIN_EVENTS_PER_THREAD     (64)
+#define TRACE_MAX_EVENTS_PER_THREAD     (1048576)
+
+// Ring buffer writes are published with release stores, so readers never block writers
+#if defined(_MSC_VER)
+#  define TRACE_LOAD(ptr)             ((uint64_t)ReadAcquire64((volatile LONG64 *)(ptr)))
+#  define TRACE_STORE(ptr, value)     WriteRelease64((volatile LONG64 *)(ptr), (LONG64)(value))
+#  define TRACE_FENCE_RELEASE()       MemoryBarrier()
+#  define TRACE_FENCE_ACQUIRE()       MemoryBarrier()
+#  define TRACE_FETCH_ADD(ptr, value) ((uint64_t)InterlockedExchangeAdd64((volatile LONG64 *)(ptr), (LONG64)(value)))
+#else
+#  define TRACE_LOAD(ptr)             __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#  define TRACE_STORE(ptr, value)     __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#  define TRACE_FENCE_RELEASE()       __atomic_thread_fence(__ATOMIC_RELEASE)
+#  define TRACE_FENCE_ACQUIRE()       __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#  define TRACE_FETCH_ADD(ptr, value) __atomic_fetch_add((ptr), (value), __ATOMIC_RELAXED)
+#endif
+
+typedef struct trace_record_s {
+    // Index of the record plus one once it is completely written, zero while being written
+    uint64_t seq;
+    int64_t time_us;
+    uint64_t lookup_id;
+    uint32_t arg;
+    uint16_t type;
+    uint16_t phase;
+} trace_record_s;
+
+typedef struct trace_ring_s {
+    // Next index to write, only advanced by the owning thread
+    uint64_t head;
+    // First index recorded since tracing was last started
+    uint64_t start;
+    uint64_t mask;
+    int32_t tid;
+    trace_record_s *records;
+    struct trace_ring_s *next;
+} trace_ring_s;
+
+typedef struct g_trace_s {
+    // Guards registration of rings, never taken when writing events
+    void *mutex;
+    trace_ring_s *rings;
+    int32_t ring_count;
+    uint64_t events_per_thread;
+    uint64_t lookup_id;
+    // Changes when rings are freed, so threads know to register new ones
+    uint32_t generation;
+} g_trace_s;
+
+g_trace_s g_trace;
+
+volatile int32_t g_trace_enabled;
+
+static THREAD_LOCAL trace_ring_s *trace_ring;
+static THREAD_LOCAL uint32_t trace_ring_generation;
+static THREAD_LOCAL uint64_t trace_lookup_id;
+
+// Names indexed by trace_event_enum
+static const char *trace_event_names[] = {"unknown",       "enqueue", "lookup",  "wpad cache hit", "wpad cache miss",
+                                          "pac cache hit", "fetch",   "compile", "execute",        "dns resolve",
+                                          "complete"};
+#define TRACE_EVENT_NAMES_COUNT (sizeof(trace_event_names) / sizeof(trace_event_names[0]))
+
+static void trace_ring_register(void) {
+    trace_ring = NULL;
+    if (!mutex_lock(g_trace.mutex))
+        return;
+    trace_ring_generation = g_trace.generation;
+
+    trace_ring_s *ring = (trace_ring_s *)calloc(1, sizeof(trace_ring_s));
+    if (ring) {
+        ring->records = (trace_record_s *)calloc((size_t)g_trace.events_per_thread, sizeof(trace_record_s));
+        if (!ring->records) {
+            free(ring);
+            ring = NULL;
+        }
+    }
+    if (ring) {
+        ring->mask = g_trace.events_per_thread - 1;
+        ring->tid = ++g_trace.ring_count;
+        ring->next = g_trace.rings;
+        g_trace.rings = ring;
+        trace_ring = ring;
+    } else {
+        log_error("Unable to allocate memory for %s", "trace buffer");
+    }
+    mutex_unlock(g_trace.mutex);
+}
+
+void trace_write(int32_t type, int32_t phase, uint64_t lookup_id, uint32_t arg) {
+    if (trace_ring_generation != g_trace.generation)
+        trace_ring_register();
+    trace_ring_s *ring = trace_ring;
+    if (!ring)
+        return;
+
+    // Oldest record is overwritten once the ring is full
+    const uint64_t index = ring->head;
+    trace_record_s *record = &ring->records[index & ring->mask];
+    TRACE_STORE(&record->seq, 0);
+    TRACE_FENCE_RELEASE();
+    record->time_us = get_monotonic_time_us();
+    record->lookup_id = lookup_id ? lookup_id : trace_lookup_id;
+    record->arg = arg;
+    record->type = (uint16_t)type;
+    record->phase = (uint16_t)phase;
+    TRACE_STORE(&record->seq, index + 1);
+    TRACE_STORE(&ring->head, index + 1);
+}
+
+uint64_t trace_next_lookup_id(void) {
+    return TRACE_FETCH_ADD(&g_trace.lookup_id, 1) + 1;
+}
+
+void trace_set_lookup(uint64_t lookup_id) {
+    trace_lookup_id = lookup_id;
+}
+
+// Copy a record, fails if the owning thread overwrote it during the copy
+static bool trace_read_record(const trace_ring_s *ring, uint64_t index, trace_record_s *copy) {
+    const trace_record_s *record = &ring->records[index & ring->mask];
+    if (TRACE_LOAD(&record->seq) != index + 1)
+        return false;
+    memcpy(copy, record, sizeof(trace_record_s));
+    TRACE_FENCE_ACQUIRE();
+    return TRACE_LOAD(&record->seq) == index + 1;
+}
+
+static void trace_print_record(FILE *file, uint32_t pid, int32_t tid, const trace_record_s *record) {
+    const char *name = trace_event_names[record->type < TRACE_EVENT_NAMES_COUNT ? record->type : 0];
+    const int64_t ts = record->time_us;
+
+    if (record->phase == TRACE_PHASE_BEGIN) {
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"proxyres\",\"ph\":\"B\",\"ts\":%" PRId64 ",\"pid\":%" PRIu32
+                      ",\"tid\":%" PRId32 ",\"args\":{\"lookup\":%" PRIu64 "}}",
+                name, ts, pid, tid, record->lookup_id);
+    } else if (record->phase == TRACE_PHASE_END) {
+        fprintf(file, ",\n{\"ph\":\"E\",\"ts\":%" PRId64 ",\"pid\":%" PRIu32 ",\"tid\":%" PRId32 "}", ts, pid, tid);
+    } else {
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"proxyres\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%" PRId64
+                      ",\"pid\":%" PRIu32 ",\"tid\":%" PRId32 ",\"args\":{\"lookup\":%" PRIu64 ",\"arg\":%" PRIu32 "}}",
+                name, ts, pid, tid, record->lookup_id, record->arg);
+    }
+
+    // Connect the thread that queued a lookup with the worker thread that ran it
+    const bool is_flow_start = record->type == TRACE_EVENT_LOOKUP_ENQUEUE;
+    const bool is_flow_end = record->type == TRACE_EVENT_LOOKUP && record->phase == TRACE_PHASE_BEGIN;
+    if (is_flow_start || is_flow_end) {
+        fprintf(file,
+                ",\n{\"name\":\"lookup\",\"cat\":\"proxyres\",\"ph\":\"%s\",%s\"id\":%" PRIu64 ",\"ts\":%" PRId64
+                ",\"pid\":%" PRIu32 ",\"tid\":%" PRId32 "}",
+                is_flow_start ? "s" : "f", is_flow_start ? "" : "\"bp\":\"e\",", record->lookup_id, ts, pid, tid);
+    }
+}
+
+bool proxy_trace_start(int32_t events_per_thread) {
+    uint64_t count = TRACE_DEFAULT_EVENTS_PER_THREAD;
+    if (events_per_thread > 0) {
+        // Ring size is a power of two so indexes wrap with a mask
+        count = TRACE_MIN_EVENTS_PER_THREAD;
+        while (count < (uint64_t)events_per_thread && count < TRACE_MAX_EVENTS_PER_THREAD)
+            count <<= 1;
+    }
+
+    if (!g_trace.mutex) {
+        g_trace.mutex = mutex_create();
+        if (!g_trace.mutex)
+            return false;
+        g_trace.generation++;
+    }
+
+    mutex_lock(g_trace.mutex);
+    // New size only applies to threads that have not recorded anything yet
+    g_trace.events_per_thread = count;
+    for (trace_ring_s *ring = g_trace.rings; ring; ring = ring->next)
+        ring->start = TRACE_LOAD(&ring->head);
+    mutex_unlock(g_trace.mutex);
+
+    g_trace_enabled = true;
+    return true;
+}
+
+bool proxy_trace_stop(void) {
+    g_trace_enabled = false;
+    return true;
+}
+
+bool proxy_trace_write_json(const char *path) {
+#ifdef _WIN32
+    const uint32_t pid = (uint32_t)GetCurrentProcessId();
+#else
+    const uint32_t pid = (uint32_t)getpid();
+#endif
+
+    if (!path || !g_trace.mutex)
+        return false;
+
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        log_error("Unable to open trace file %s", path);
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%" PRIu32 ",\"args\":{\"name\":\"proxyres\"}}",
+            pid);
+
+    mutex_lock(g_trace.mutex);
+    for (trace_ring_s *ring = g_trace.rings; ring; ring = ring->next) {
+        fprintf(file,
+                ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%" PRIu32 ",\"tid\":%" PRId32
+                ",\"args\":{\"name\":\"proxyres %" PRId32 "\"}}",
+                pid, ring->tid, ring->tid);
+
+        // Records older than the ring size have already been overwritten
+        const uint64_t head = TRACE_LOAD(&ring->head);
+        uint64_t index = ring->start;
+        if (head - index > ring->mask + 1)
+            index = head - (ring->mask + 1);
+
+        for (; index < head; index++) {
+            trace_record_s record;
+            if (trace_read_record(ring, index, &record))
+                trace_print_record(file, pid, ring->tid, &record);
+        }
+    }
+    mutex_unlock(g_trace.mutex);
+
+    fprintf(file, "\n]}\n");
+    const bool is_ok = !ferror(file);
+    fclose(file);
+    return is_ok;
+}
+
+bool trace_global_cleanup(void) {
+    g_trace_enabled = false;
+    if (!g_trace.mutex)
+        return true;
+
+    // Threads that recorded events register a new ring the next time tracing is started
+    mutex_lock(g_trace.mutex);
+    while (g_trace.rings) {
+        trace_ring_s *ring = g_trace.rings;
+        g_trace.rings = ring->next;
+        free(ring->records);
+        free(ring);
+    }
+    g_trace.ring_count = 0;
+    mutex_unlock(g_trace.mutex);
+    mutex_delete(&g_trace.mutex);
+    return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+typedef enum trace_event_enum {
+    // Lookup queued on the thread pool
+    TRACE_EVENT_LOOKUP_ENQUEUE = 1,
+    // Lookup running on a worker thread, from dequeue until complete
+    TRACE_EVENT_LOOKUP = 2,
+    // Auto config url taken from the WPAD cache
+    TRACE_EVENT_WPAD_CACHE_HIT = 3,
+    // Auto config url discovered with WPAD
+    TRACE_EVENT_WPAD_CACHE_MISS = 4,
+    // PAC script taken from the cache
+    TRACE_EVENT_PAC_CACHE_HIT = 5,
+    // PAC script downloaded
+    TRACE_EVENT_FETCH = 6,
+    // PAC script parsed or compiled by the JavaScript engine
+    TRACE_EVENT_COMPILE = 7,
+    // PAC script evaluated for a url
+    TRACE_EVENT_EXECUTE = 8,
+    // Host name resolved for the PAC script
+    TRACE_EVENT_DNS_RESOLVE = 9,
+    // Lookup finished, argument is the error code
+    TRACE_EVENT_LOOKUP_COMPLETE = 10
+} trace_event_enum;
+
+typedef enum trace_phase_enum {
+    TRACE_PHASE_INSTANT = 0,
+    TRACE_PHASE_BEGIN = 1,
+    TRACE_PHASE_END = 2
+} trace_phase_enum;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Whether events are being recorded, checked before any event is written
+extern volatile int32_t g_trace_enabled;
+
+#define trace_instant(type, arg)                                \
+    do {                                                        \
+        if (g_trace_enabled)                                    \
+            trace_write((type), TRACE_PHASE_INSTANT, 0, (arg)); \
+    } while (0)
+#define trace_begin(type)                                 \
+    do {                                                  \
+        if (g_trace_enabled)                              \
+            trace_write((type), TRACE_PHASE_BEGIN, 0, 0); \
+    } while (0)
+#define trace_end(type)                                 \
+    do {                                                \
+        if (g_trace_enabled)                            \
+            trace_write((type), TRACE_PHASE_END, 0, 0); \
+    } while (0)
+
+// Record an event in the calling thread's ring buffer, zero lookup id uses the thread's current lookup
+void trace_write(int32_t type, int32_t phase, uint64_t lookup_id, uint32_t arg);
+
+// Allocate an id that ties together events for one lookup
+uint64_t trace_next_lookup_id(void);
+
+// Set the lookup that events recorded on the calling thread belong to
+void trace_set_lookup(uint64_t lookup_id);
+
+// Stop recording and free ring buffers
+bool trace_global_cleanup(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -5,10 +5,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 
 #ifdef _WIN32
+#  include <windows.h>
 #  define strcasecmp  _stricmp
 #  define strncasecmp _strnicmp
+#else
+#  include <dlfcn.h>
 #endif
 
 #include "net_util.h"
@@ -192,6 +196,40 @@ bool str_wildcard_match(const char *str, const char *pattern, bool ignore_case)
     return true;
 }
 
+// Compute non-cryptographic 64-bit hash of exactly str_len bytes of a string
+uint64_t str_hash(const char *str, size_t str_len) {
+    const uint64_t prime = 0x9e3779b97f4a7c15ULL;
+    uint64_t hash = 0xcbf29ce484222325ULL ^ ((uint64_t)str_len * prime);
+    uint64_t word = 0;
+
+    // Mix in eight bytes at a time
+    while (str_len >= sizeof(word)) {
+        memcpy(&word, str, sizeof(word));
+        word *= prime;
+        word ^= word >> 32;
+        hash = (hash ^ word) * prime;
+        str += sizeof(word);
+        str_len -= sizeof(word);
+    }
+
+    // Mix in remaining bytes
+    if (str_len) {
+        word = 0;
+        memcpy(&word, str, str_len);
+        word *= prime;
+        word ^= word >> 32;
+        hash = (hash ^ word) * prime;
+    }
+
+    // Final avalanche
+    hash ^= hash >> 31;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
 // Find host for a given url
 char *get_url_host(const char *url) {
     // Find the start of the host after the scheme
@@ -597,3 +635,44 @@ bool should_bypass_proxy(const char *url, const char *bypass_list) {
 
     return should_bypass;
 }
+
+// Get milliseconds elapsed on a clock that is not affected by system time changes
+int64_t get_monotonic_time_ms(void) {
+#ifdef _WIN32
+    return (int64_t)GetTickCount64();
+#else
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+// Get microseconds elapsed on a high resolution clock that is not affected by system time changes
+int64_t get_monotonic_time_us(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency = {0};
+    LARGE_INTEGER counter = {0};
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (int64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+           (int64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+#ifndef _WIN32
+// Look up a table of symbols in a loaded shared library, fails if any are missing
+bool dl_load_symbols(void *module, const dl_symbol_s *symbols, size_t symbols_len) {
+    if (!module || !symbols)
+        return false;
+    for (size_t i = 0; i < symbols_len; i++) {
+        *symbols[i].address = dlsym(module, symbols[i].name);
+        if (!*symbols[i].address)
+            return false;
+    }
+    return true;
+}
+#endif
@@ -1,9 +1,39 @@
 #pragma once
 
 #define HOST_MAX   (260)
-#define SCRIPT_MAX (256 * 1024)
+#define SCRIPT_MAX (2 * 1024 * 1024)
 #define UNUSED(x)  ((void)x)
 
+#if defined(_MSC_VER)
+#  define THREAD_LOCAL __declspec(thread)
+#elif defined(__cplusplus)
+#  define THREAD_LOCAL thread_local
+#else
+#  define THREAD_LOCAL _Thread_local
+#endif
+
+// Load, store and count 32-bit values shared between threads without holding a lock, counts return the new value
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#  define ATOMIC_LOAD_ACQUIRE(ptr)         _InterlockedOr((volatile long *)(ptr), 0)
+#  define ATOMIC_STORE_RELEASE(ptr, value) _InterlockedExchange((volatile long *)(ptr), (long)(value))
+#  define ATOMIC_INCREMENT(ptr)            _InterlockedIncrement((volatile long *)(ptr))
+#  define ATOMIC_DECREMENT(ptr)            _InterlockedDecrement((volatile long *)(ptr))
+#else
+#  define ATOMIC_LOAD_ACQUIRE(ptr)         __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#  define ATOMIC_STORE_RELEASE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#  define ATOMIC_INCREMENT(ptr)            __atomic_add_fetch((ptr), 1, __ATOMIC_ACQ_REL)
+#  define ATOMIC_DECREMENT(ptr)            __atomic_sub_fetch((ptr), 1, __ATOMIC_ACQ_REL)
+#endif
+
+#ifndef _WIN32
+// Shared library symbol and where to store its address
+typedef struct dl_symbol_s {
+    const char *name;
+    void **address;
+} dl_symbol_s;
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -38,6 +68,9 @@ char *str_sep_dup(const char **strp, const char *delim);
 // Compare a string using wildcard pattern
 bool str_wildcard_match(const char *str, const char *pattern, bool ignore_case);
 
+// Compute non-cryptographic 64-bit hash of exactly str_len bytes of a string
+uint64_t str_hash(const char *str, size_t str_len);
+
 // Find host for a given url
 char *get_url_host(const char *url);
 
@@ -71,6 +104,17 @@ char *convert_proxy_list_to_uri_list(const char *proxy_list, const char *default
 // Evaluates whether or not the proxy should be bypassed for a given url
 bool should_bypass_proxy(const char *url, const char *bypass_list);
 
+// Get milliseconds elapsed on a clock that is not affected by system time changes
+int64_t get_monotonic_time_ms(void);
+
+// Get microseconds elapsed on a high resolution clock that is not affected by system time changes
+int64_t get_monotonic_time_us(void);
+
+#ifndef _WIN32
+// Look up a table of symbols in a loaded shared library, fails if any are missing
+bool dl_load_symbols(void *module, const dl_symbol_s *symbols, size_t symbols_len);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
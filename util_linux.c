@@ -2,11 +2,26 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
 
+#include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 
 #include "util_linux.h"
 
+#define NUMA_MAX_NODES (64)
+#define NUMA_MAX_CPUS  (1024)
+
+typedef struct g_numa_s {
+    pthread_once_t once;
+    int32_t node_count;
+    // Node of each CPU
+    uint8_t cpu_nodes[NUMA_MAX_CPUS];
+} g_numa_s;
+
+static g_numa_s g_numa = {PTHREAD_ONCE_INIT, 1, {0}};
+
 int32_t get_desktop_env(void) {
     const char *current_desktop = getenv("XDG_CURRENT_DESKTOP");  // Since 2012
     if (current_desktop) {
@@ -97,3 +112,71 @@ char *get_config_value(const char *config, const char *section, const char *key)
 
     return NULL;
 }
+
+int32_t parse_cpu_list(const char *list, int32_t *cpus, int32_t max_cpus) {
+    int32_t count = 0;
+    const char *next = list;
+
+    // Comma separated CPU numbers and inclusive ranges
+    while (next && *next && count < max_cpus) {
+        char *end = NULL;
+        const long first = strtol(next, &end, 10);
+        if (end == next || first < 0)
+            break;
+        long last = first;
+        if (*end == '-') {
+            next = end + 1;
+            last = strtol(next, &end, 10);
+            if (end == next || last < first)
+                break;
+        }
+        for (long cpu = first; cpu <= last && count < max_cpus; cpu++)
+            cpus[count++] = (int32_t)cpu;
+        next = *end == ',' ? end + 1 : NULL;
+    }
+    return count;
+}
+
+// Read which CPUs belong to each NUMA node from sysfs
+static void numa_read_topology(void) {
+    int32_t *cpus = (int32_t *)calloc(NUMA_MAX_CPUS, sizeof(int32_t));
+    if (!cpus)
+        return;
+
+    for (int32_t node = 0; node < NUMA_MAX_NODES; node++) {
+        char path[128];
+        char list[4096];
+
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *file = fopen(path, "r");
+        if (!file)
+            continue;
+        const bool is_read = fgets(list, sizeof(list), file) != NULL;
+        fclose(file);
+        if (!is_read)
+            continue;
+
+        const int32_t count = parse_cpu_list(list, cpus, NUMA_MAX_CPUS);
+        for (int32_t i = 0; i < count; i++)
+            g_numa.cpu_nodes[cpus[i]] = (uint8_t)node;
+        if (count > 0 && node >= g_numa.node_count)
+            g_numa.node_count = node + 1;
+    }
+    free(cpus);
+}
+
+int32_t get_numa_node_count(void) {
+    pthread_once(&g_numa.once, numa_read_topology);
+    return g_numa.node_count;
+}
+
+int32_t get_numa_node_of_cpu(int32_t cpu) {
+    pthread_once(&g_numa.once, numa_read_topology);
+    if (cpu < 0 || cpu >= NUMA_MAX_CPUS)
+        return 0;
+    return g_numa.cpu_nodes[cpu];
+}
+
+int32_t get_current_numa_node(void) {
+    return get_numa_node_of_cpu(sched_getcpu());
+}
@@ -19,6 +19,18 @@ int32_t get_desktop_env(void);
 // Retrieve the value for a setting stored in an INI configuration file
 char *get_config_value(const char *config, const char *section, const char *key);
 
+// Parse a sysfs CPU list such as "0-3,8" into CPU numbers, returns the number of CPUs stored
+int32_t parse_cpu_list(const char *list, int32_t *cpus, int32_t max_cpus);
+
+// Get the number of NUMA nodes, one when the topology is unknown
+int32_t get_numa_node_count(void);
+
+// Get the NUMA node a CPU belongs to, zero when unknown
+int32_t get_numa_node_of_cpu(int32_t cpu);
+
+// Get the NUMA node of the CPU the calling thread is running on
+int32_t get_current_numa_node(void);
+
 #ifdef __cplusplus
 }
 #endif
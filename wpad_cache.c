@@ -0,0 +1,292 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/file.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#include "log.h"
+#include "util.h"
+#include "wpad_cache.h"
+
+#define WPAD_CACHE_MAGIC   "PRXYWPAD"
+#define WPAD_CACHE_VERSION (3)
+#define WPAD_CACHE_URL_MAX (4096)
+
+#define WPAD_CACHE_LOCK_RETRY_MS (50)
+
+typedef struct wpad_cache_header_s {
+    char magic[8];
+    uint32_t version;
+    int32_t max_age;
+    uint64_t fingerprint;
+    int64_t fetch_time;
+    int64_t fetch_retry_time;
+    int32_t fetch_failures;
+} wpad_cache_header_s;
+
+static bool wpad_cache_write_str(FILE *file, const char *str) {
+    const uint32_t str_len = str ? (uint32_t)strlen(str) : 0;
+    if (fwrite(&str_len, sizeof(str_len), 1, file) != 1)
+        return false;
+    if (str_len && fwrite(str, str_len, 1, file) != 1)
+        return false;
+    return true;
+}
+
+static bool wpad_cache_read_str(FILE *file, uint32_t max_len, char **str) {
+    uint32_t str_len = 0;
+
+    *str = NULL;
+    if (fread(&str_len, sizeof(str_len), 1, file) != 1)
+        return false;
+    if (str_len == 0)
+        return true;
+    if (str_len > max_len)
+        return false;
+
+    *str = (char *)calloc(str_len + 1, sizeof(char));
+    if (!*str)
+        return false;
+    if (fread(*str, str_len, 1, file) != 1) {
+        free(*str);
+        *str = NULL;
+        return false;
+    }
+    return true;
+}
+
+// Read WPAD discovery state from a cache file
+bool wpad_cache_read(const char *path, wpad_cache_s *cache) {
+    wpad_cache_header_s header;
+    bool is_ok = false;
+
+    memset(&header, 0, sizeof(header));
+
+    if (!path || !cache)
+        return false;
+
+    memset(cache, 0, sizeof(wpad_cache_s));
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        log_debug("Unable to open WPAD cache %s (%" PRId32 ")", path, (int32_t)errno);
+        return false;
+    }
+
+    if (fread(&header, sizeof(header), 1, file) != 1)
+        goto read_done;
+    if (memcmp(header.magic, WPAD_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != WPAD_CACHE_VERSION) {
+        log_debug("Ignoring incompatible WPAD cache %s", path);
+        goto read_done;
+    }
+
+    cache->fingerprint = header.fingerprint;
+    cache->fetch_time = header.fetch_time;
+    cache->max_age = header.max_age;
+    cache->fetch_retry_time = header.fetch_retry_time;
+    cache->fetch_failures = header.fetch_failures;
+
+    if (!wpad_cache_read_str(file, WPAD_CACHE_URL_MAX, &cache->auto_config_url))
+        goto read_done;
+    if (!wpad_cache_read_str(file, WPAD_CACHE_URL_MAX, &cache->script_url))
+        goto read_done;
+    if (!wpad_cache_read_str(file, SCRIPT_MAX, &cache->script))
+        goto read_done;
+    if (!wpad_cache_read_str(file, WPAD_CACHE_URL_MAX, &cache->etag))
+        goto read_done;
+    if (!wpad_cache_read_str(file, WPAD_CACHE_URL_MAX, &cache->last_modified))
+        goto read_done;
+
+    is_ok = cache->script != NULL;
+
+read_done:
+    fclose(file);
+
+    if (!is_ok) {
+        log_debug("Unable to read WPAD cache %s", path);
+        wpad_cache_free(cache);
+    }
+    return is_ok;
+}
+
+// Write WPAD discovery state to a cache file
+bool wpad_cache_write(const char *path, const wpad_cache_s *cache) {
+    wpad_cache_header_s header;
+    bool is_ok = false;
+
+    memset(&header, 0, sizeof(header));
+
+    if (!path || !cache || !cache->script)
+        return false;
+
+    // Write to a temporary file first so readers never see a partially written cache. Each writer gets its own
+    // temporary file, since processes sharing the cache may write it at the same time.
+    const size_t temp_path_len = strlen(path) + 32;
+    char *temp_path = (char *)calloc(temp_path_len, sizeof(char));
+    if (!temp_path)
+        return false;
+#ifdef _WIN32
+    snprintf(temp_path, temp_path_len, "%s.%lu.%lu.tmp", path, (unsigned long)GetCurrentProcessId(),
+             (unsigned long)GetCurrentThreadId());
+    FILE *file = fopen(temp_path, "wb");
+#else
+    snprintf(temp_path, temp_path_len, "%s.XXXXXX", path);
+    FILE *file = NULL;
+    const int fd = mkstemp(temp_path);
+    if (fd != -1) {
+        // Temporary files are only readable by the owner, keep the permissions of a regular cache file
+        fchmod(fd, 0644);
+        file = fdopen(fd, "wb");
+        if (!file) {
+            close(fd);
+            remove(temp_path);
+        }
+    }
+#endif
+    if (!file) {
+        log_debug("Unable to create WPAD cache %s (%" PRId32 ")", temp_path, (int32_t)errno);
+        free(temp_path);
+        return false;
+    }
+
+    memcpy(header.magic, WPAD_CACHE_MAGIC, sizeof(header.magic));
+    header.version = WPAD_CACHE_VERSION;
+    header.fingerprint = cache->fingerprint;
+    header.fetch_time = cache->fetch_time;
+    header.max_age = cache->max_age;
+    header.fetch_retry_time = cache->fetch_retry_time;
+    header.fetch_failures = cache->fetch_failures;
+
+    is_ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    is_ok = is_ok && wpad_cache_write_str(file, cache->auto_config_url);
+    is_ok = is_ok && wpad_cache_write_str(file, cache->script_url);
+    is_ok = is_ok && wpad_cache_write_str(file, cache->script);
+    is_ok = is_ok && wpad_cache_write_str(file, cache->etag);
+    is_ok = is_ok && wpad_cache_write_str(file, cache->last_modified);
+
+    if (fclose(file) != 0)
+        is_ok = false;
+
+    if (is_ok) {
+#ifdef _WIN32
+        // Rename does not replace existing files on Windows
+        is_ok = MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        is_ok = rename(temp_path, path) == 0;
+#endif
+    }
+
+    if (!is_ok) {
+        log_debug("Unable to write WPAD cache %s (%" PRId32 ")", path, (int32_t)errno);
+        remove(temp_path);
+    }
+    free(temp_path);
+    return is_ok;
+}
+
+// Free strings held by WPAD discovery state
+void wpad_cache_free(wpad_cache_s *cache) {
+    if (!cache)
+        return;
+    free(cache->auto_config_url);
+    free(cache->script_url);
+    free(cache->script);
+    free(cache->etag);
+    free(cache->last_modified);
+    memset(cache, 0, sizeof(wpad_cache_s));
+}
+
+// Lock file next to the cache file so that only one process refreshes it at a time
+void *wpad_cache_lock(const char *path, int32_t timeout_ms) {
+    if (!path)
+        return NULL;
+
+    const size_t lock_path_len = strlen(path) + 6;
+    char *lock_path = (char *)calloc(lock_path_len, sizeof(char));
+    if (!lock_path)
+        return NULL;
+    snprintf(lock_path, lock_path_len, "%s.lock", path);
+
+#ifdef _WIN32
+    HANDLE lock_file = CreateFileA(lock_path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                   NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (lock_file == INVALID_HANDLE_VALUE) {
+        log_debug("Unable to open WPAD cache lock %s (%lu)", lock_path, GetLastError());
+        free(lock_path);
+        return NULL;
+    }
+#else
+    int lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd < 0) {
+        log_debug("Unable to open WPAD cache lock %s (%" PRId32 ")", lock_path, (int32_t)errno);
+        free(lock_path);
+        return NULL;
+    }
+#endif
+
+    // Poll for the lock so a stuck process can not block others forever
+    const int64_t deadline = get_monotonic_time_ms() + (timeout_ms > 0 ? timeout_ms : 0);
+    bool is_locked = false;
+    for (;;) {
+#ifdef _WIN32
+        OVERLAPPED overlapped = {0};
+        is_locked = LockFileEx(lock_file, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &overlapped);
+#else
+        is_locked = flock(lock_fd, LOCK_EX | LOCK_NB) == 0;
+#endif
+        if (is_locked || get_monotonic_time_ms() >= deadline)
+            break;
+#ifdef _WIN32
+        Sleep(WPAD_CACHE_LOCK_RETRY_MS);
+#else
+        usleep(WPAD_CACHE_LOCK_RETRY_MS * 1000);
+#endif
+    }
+
+    if (!is_locked) {
+        log_debug("Timed out waiting for WPAD cache lock %s", lock_path);
+#ifdef _WIN32
+        CloseHandle(lock_file);
+#else
+        close(lock_fd);
+#endif
+        free(lock_path);
+        return NULL;
+    }
+
+    free(lock_path);
+#ifdef _WIN32
+    return (void *)lock_file;
+#else
+    // Offset descriptor so that zero is never returned as a valid lock
+    return (void *)(intptr_t)(lock_fd + 1);
+#endif
+}
+
+// Release lock previously acquired on a cache file
+void wpad_cache_unlock(void **lock) {
+    if (!lock || !*lock)
+        return;
+#ifdef _WIN32
+    HANDLE lock_file = (HANDLE)*lock;
+    OVERLAPPED overlapped = {0};
+    UnlockFileEx(lock_file, 0, 1, 0, &overlapped);
+    CloseHandle(lock_file);
+#else
+    const int lock_fd = (int)((intptr_t)*lock - 1);
+    flock(lock_fd, LOCK_UN);
+    close(lock_fd);
+#endif
+    *lock = NULL;
+}
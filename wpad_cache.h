@@ -0,0 +1,47 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct wpad_cache_s {
+    // Fingerprint of the network the state was discovered on
+    uint64_t fingerprint;
+    // Time the PAC script was fetched
+    int64_t fetch_time;
+    // Seconds the PAC script may be cached for or -1 if not specified
+    int32_t max_age;
+    // Consecutive failures to fetch the PAC script
+    int32_t fetch_failures;
+    // Time before which the PAC script url is not fetched again
+    int64_t fetch_retry_time;
+    // WPAD discovered url
+    char *auto_config_url;
+    // PAC script url
+    char *script_url;
+    // PAC script
+    char *script;
+    // PAC script entity tag validator
+    char *etag;
+    // PAC script last modified validator
+    char *last_modified;
+} wpad_cache_s;
+
+// Read WPAD discovery state from a cache file
+bool wpad_cache_read(const char *path, wpad_cache_s *cache);
+
+// Write WPAD discovery state to a cache file
+bool wpad_cache_write(const char *path, const wpad_cache_s *cache);
+
+// Free strings held by WPAD discovery state
+void wpad_cache_free(wpad_cache_s *cache);
+
+// Lock cache file against other processes, waiting up to the timeout
+void *wpad_cache_lock(const char *path, int32_t timeout_ms);
+
+// Release lock previously acquired on a cache file
+void wpad_cache_unlock(void **lock);
+
+#ifdef __cplusplus
+}
+#endif
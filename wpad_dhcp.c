@@ -23,12 +23,13 @@ char *wpad_dhcp_adapter(uint8_t bind_ip[4], net_adapter_s *adapter, int32_t time
 #endif
     if (!wpad)
         return wpad_dhcp_adapter_posix(bind_ip, adapter, timeout_sec);
-    return NULL;
+    return wpad;
 }
 
 typedef struct wpad_dhcp_adapter_enum_s {
-    char *url;
-    int32_t timeout_sec;
+    net_adapter_s *adapters;
+    int32_t count;
+    int32_t max_count;
 } wpad_dhcp_adapter_enum_s;
 
 static bool wpad_dhcp_enum_adapter(void *user_data, net_adapter_s *adapter) {
@@ -46,19 +47,43 @@ static bool wpad_dhcp_enum_adapter(void *user_data, net_adapter_s *adapter) {
     if (!*adapter->ip)
         return true;
 
-    // Get WPAD from adapter's DHCP server
-    adapter_enum->url = wpad_dhcp_adapter(adapter->ip, adapter, adapter_enum->timeout_sec);
-    if (adapter_enum->url)
-        return false;
-
+    // Collect adapter so that all adapters can be queried at once
+    if (adapter_enum->count == adapter_enum->max_count) {
+        const int32_t max_count = adapter_enum->max_count ? adapter_enum->max_count * 2 : 4;
+        net_adapter_s *adapters =
+            (net_adapter_s *)realloc(adapter_enum->adapters, max_count * sizeof(net_adapter_s));
+        if (!adapters)
+            return false;
+        adapter_enum->adapters = adapters;
+        adapter_enum->max_count = max_count;
+    }
+    adapter_enum->adapters[adapter_enum->count++] = *adapter;
     return true;
 }
 
 char *wpad_dhcp(int32_t timeout_sec) {
-    wpad_dhcp_adapter_enum_s adapter_enum = {NULL, timeout_sec};
+    wpad_dhcp_adapter_enum_s adapter_enum = {NULL, 0, 0};
+    char *url = NULL;
 
-    // Enumerate each network adapter and send DHCP request for WPAD
+    // Enumerate each network adapter that can send a DHCP request for WPAD
     net_adapter_enum(&adapter_enum, wpad_dhcp_enum_adapter);
 
-    return adapter_enum.url;
-}
\ No newline at end of file
+#if defined(_WIN32) || defined(__APPLE__)
+    // Ask the operating system for the WPAD url it has already received
+    for (int32_t i = 0; !url && i < adapter_enum.count; i++) {
+        net_adapter_s *adapter = &adapter_enum.adapters[i];
+#  if defined(_WIN32)
+        url = wpad_dhcp_adapter_win(adapter->ip, adapter, timeout_sec);
+#  else
+        url = wpad_dhcp_adapter_mac(adapter->ip, adapter, timeout_sec);
+#  endif
+    }
+#endif
+
+    // Send DHCP request on all adapters at once and use the first reply with a WPAD url
+    if (!url)
+        url = wpad_dhcp_posix(adapter_enum.adapters, adapter_enum.count, timeout_sec);
+
+    free(adapter_enum.adapters);
+    return url;
+}
@@ -23,11 +23,13 @@
 #  include <windows.h>
 #else
 #  include <arpa/inet.h>
+#  include <poll.h>
 #  include <sys/types.h>
 #  include <sys/socket.h>
 #  include <unistd.h>
 #endif
 
+#include "deadline.h"
 #include "log.h"
 #include "net_adapter.h"
 #include "testing.h"
@@ -38,12 +40,26 @@
 #ifdef _WIN32
 #  define socketerr WSAGetLastError()
 #  define ssize_t   int
+#  define nfds_t    ULONG
+#  define poll      WSAPoll
 #else
 #  define socketerr   errno
 #  define SOCKET      int
 #  define closesocket close
 #endif
 
+#define DHCP_RETRANSMIT_MIN_MS (500)
+#define DHCP_RETRANSMIT_MAX_MS (4000)
+
+typedef struct dhcp_request_s {
+    // Address of adapter to send request from
+    uint8_t bind_ip[4];
+    net_adapter_s *adapter;
+    // Transaction id of request
+    uint32_t xid;
+    SOCKET sfd;
+} dhcp_request_s;
+
 PROXYRES_TESTABLE bool dhcp_check_magic(uint8_t *options) {
     return memcmp(options, DHCP_MAGIC, DHCP_MAGIC_LEN) == 0;
 }
@@ -172,19 +188,48 @@ static bool dhcp_read_reply(SOCKET sfd, uint32_t request_xid, dhcp_msg *reply) {
     return true;
 }
 
-char *wpad_dhcp_adapter_posix(uint8_t bind_ip[4], net_adapter_s *adapter, int32_t timeout_sec) {
+PROXYRES_TESTABLE char *dhcp_get_wpad_url(dhcp_msg *reply) {
+    uint8_t opt_length = 0;
+    uint8_t *opt = NULL;
+
+    // Parse options in DHCP reply
+    opt = dhcp_get_option(reply, DHCP_OPT_MSGTYPE, &opt_length);
+    if (!opt || opt_length != 1 || *opt != DHCP_ACK) {
+        log_error("Invalid DHCP reply (msgtype=%d)", opt ? *opt : -1);
+        free(opt);
+        return NULL;
+    }
+    free(opt);
+
+    opt = dhcp_get_option(reply, DHCP_OPT_WPAD, &opt_length);
+    if (!opt || opt_length == 0) {
+        log_error("Invalid DHCP reply (optlen=%d)", opt_length);
+        free(opt);
+        return NULL;
+    }
+
+    return (char *)opt;
+}
+
+// Exponential backoff between DHCPINFORM retransmissions
+PROXYRES_TESTABLE int32_t dhcp_get_retransmit_delay(int32_t attempt) {
+    int32_t delay_ms = DHCP_RETRANSMIT_MIN_MS;
+    while (attempt-- > 0 && delay_ms < DHCP_RETRANSMIT_MAX_MS)
+        delay_ms *= 2;
+    return delay_ms < DHCP_RETRANSMIT_MAX_MS ? delay_ms : DHCP_RETRANSMIT_MAX_MS;
+}
+
+static SOCKET dhcp_open_socket(uint8_t bind_ip[4]) {
     SOCKET sfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
     if ((int)sfd == -1) {
         log_error("Unable to create udp socket");
-        return NULL;
+        return sfd;
     }
 
     int broadcast = 1;
     setsockopt(sfd, SOL_SOCKET, SO_BROADCAST, (const char *)&broadcast, sizeof(broadcast));
     int reuseaddr = 1;
     setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuseaddr, sizeof(reuseaddr));
-    struct timeval tv = {timeout_sec, 0};
-    setsockopt(sfd, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof(tv));
 
     struct sockaddr_in address = {0};
 
@@ -202,44 +247,141 @@ char *wpad_dhcp_adapter_posix(uint8_t bind_ip[4], net_adapter_s *adapter, int32_
         if (err == -1) {
             log_debug("Unable to bind udp socket (%d)", socketerr);
             closesocket(sfd);
-            return NULL;
+            return (SOCKET)-1;
         }
     }
+    return sfd;
+}
 
-    // Generate random transaction id
+// Send DHCPINFORM on all requests at once and wait for the first reply containing a WPAD url
+static char *dhcp_request_wpad(dhcp_request_s *requests, int32_t count, int32_t timeout_sec) {
+    struct pollfd *fds = NULL;
+    int32_t active = 0;
+    char *url = NULL;
+
+    fds = (struct pollfd *)calloc(count, sizeof(struct pollfd));
+    if (!fds) {
+        log_error("Unable to allocate memory for %s", "DHCP poll");
+        goto request_done;
+    }
+
+    // Generate random transaction ids
     srand((int)time(NULL));
-    uint32_t request_xid = rand();
 
-    // Send DHCPINFORM request to DHCP server
-    if (!dhcp_send_inform(sfd, request_xid, adapter)) {
-        log_error("Unable to send DHCP inform");
-        closesocket(sfd);
-        return NULL;
+    for (int32_t i = 0; i < count; i++) {
+        requests[i].sfd = dhcp_open_socket(requests[i].bind_ip);
+        requests[i].xid = rand();
+        if ((int)requests[i].sfd != -1)
+            active++;
     }
 
-    // Read reply from DHCP server
-    dhcp_msg reply = {0};
-    bool is_ok = dhcp_read_reply(sfd, request_xid, &reply);
-    closesocket(sfd);
-    if (!is_ok)
-        return NULL;
+    const int64_t deadline = deadline_clamp(get_monotonic_time_ms() + (int64_t)timeout_sec * 1000);
+    int64_t next_send = 0;
+    int32_t attempt = 0;
 
-    // Parse options in DHCP reply
-    uint8_t opt_length = 0;
-    uint8_t *opt = NULL;
+    while (active > 0) {
+        int64_t now = get_monotonic_time_ms();
+        if (now >= deadline) {
+            log_debug("Timed out waiting for DHCP reply");
+            break;
+        }
 
-    opt = dhcp_get_option(&reply, DHCP_OPT_MSGTYPE, &opt_length);
-    if (opt_length != 1 || *opt != DHCP_ACK) {
-        log_error("Invalid DHCP reply (msgtype=%d)", *opt);
-        return NULL;
+        // Send or retransmit DHCPINFORM to DHCP servers that have not replied
+        if (now >= next_send) {
+            for (int32_t i = 0; i < count; i++) {
+                if ((int)requests[i].sfd == -1)
+                    continue;
+                if (!dhcp_send_inform(requests[i].sfd, requests[i].xid, requests[i].adapter)) {
+                    log_error("Unable to send DHCP inform (%d)", socketerr);
+                    closesocket(requests[i].sfd);
+                    requests[i].sfd = (SOCKET)-1;
+                    active--;
+                }
+            }
+            next_send = now + dhcp_get_retransmit_delay(attempt++);
+        }
+
+        nfds_t num_fds = 0;
+        for (int32_t i = 0; i < count; i++) {
+            if ((int)requests[i].sfd == -1)
+                continue;
+            fds[num_fds].fd = requests[i].sfd;
+            fds[num_fds].events = POLLIN;
+            fds[num_fds].revents = 0;
+            num_fds++;
+        }
+        if (!num_fds)
+            break;
+
+        const int64_t wait_until = next_send < deadline ? next_send : deadline;
+        const int result = poll(fds, num_fds, (int)(wait_until - now));
+        if (result < 0) {
+            if (socketerr == EINTR)
+                continue;
+            log_error("Unable to wait for DHCP reply (%d)", socketerr);
+            break;
+        }
+        if (result == 0)
+            continue;
+
+        for (nfds_t f = 0; f < num_fds; f++) {
+            if (!(fds[f].revents & (POLLIN | POLLERR)))
+                continue;
+
+            for (int32_t i = 0; i < count; i++) {
+                if (requests[i].sfd != fds[f].fd)
+                    continue;
+
+                dhcp_msg reply = {0};
+                if (!dhcp_read_reply(requests[i].sfd, requests[i].xid, &reply))
+                    break;
+
+                // DHCP server has answered this adapter, whether or not it knows a WPAD url
+                closesocket(requests[i].sfd);
+                requests[i].sfd = (SOCKET)-1;
+                active--;
+
+                url = dhcp_get_wpad_url(&reply);
+                if (url)
+                    goto request_done;
+                break;
+            }
+        }
     }
-    free(opt);
 
-    opt = dhcp_get_option(&reply, DHCP_OPT_WPAD, &opt_length);
-    if (opt_length <= 0) {
-        log_error("Invalid DHCP reply (optlen=%d)", opt_length);
+request_done:
+    for (int32_t i = 0; i < count; i++) {
+        if ((int)requests[i].sfd != -1)
+            closesocket(requests[i].sfd);
+        requests[i].sfd = (SOCKET)-1;
+    }
+    free(fds);
+    return url;
+}
+
+char *wpad_dhcp_adapter_posix(uint8_t bind_ip[4], net_adapter_s *adapter, int32_t timeout_sec) {
+    dhcp_request_s request = {0};
+
+    memcpy(request.bind_ip, bind_ip, sizeof(request.bind_ip));
+    request.adapter = adapter;
+
+    return dhcp_request_wpad(&request, 1, timeout_sec);
+}
+
+char *wpad_dhcp_posix(net_adapter_s *adapters, int32_t count, int32_t timeout_sec) {
+    if (!adapters || count <= 0)
         return NULL;
+
+    dhcp_request_s *requests = (dhcp_request_s *)calloc(count, sizeof(dhcp_request_s));
+    if (!requests)
+        return NULL;
+
+    for (int32_t i = 0; i < count; i++) {
+        memcpy(requests[i].bind_ip, adapters[i].ip, sizeof(requests[i].bind_ip));
+        requests[i].adapter = &adapters[i];
     }
 
-    return (char *)opt;
+    char *url = dhcp_request_wpad(requests, count, timeout_sec);
+    free(requests);
+    return url;
 }
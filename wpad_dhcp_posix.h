@@ -7,6 +7,9 @@ extern "C" {
 // Request WPAD url using DHCP with a particular network adapter
 char *wpad_dhcp_adapter_posix(uint8_t bind_ip[4], net_adapter_s *adapter, int32_t timeout_sec);
 
+// Request WPAD url using DHCP with all network adapters at once
+char *wpad_dhcp_posix(net_adapter_s *adapters, int32_t count, int32_t timeout_sec);
+
 #ifdef __cplusplus
 }
 #endif
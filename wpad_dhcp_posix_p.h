@@ -60,6 +60,8 @@ bool dhcp_check_magic(uint8_t *options);
 uint8_t *dhcp_copy_magic(uint8_t *options);
 uint8_t *dhcp_copy_option(uint8_t *options, dhcp_option *option);
 uint8_t *dhcp_get_option(dhcp_msg *reply, uint8_t type, uint8_t *length);
+char *dhcp_get_wpad_url(dhcp_msg *reply);
+int32_t dhcp_get_retransmit_delay(int32_t attempt);
 #endif
 
 #ifdef __cplusplus
@@ -22,9 +22,13 @@
 #  include <unistd.h>
 #endif
 
+#include "deadline.h"
+#include "event.h"
 #include "fetch.h"
 #include "log.h"
+#include "mutex.h"
 #include "net_util.h"
+#include "threadpool.h"
 #include "util.h"
 #include "wpad_dns.h"
 
@@ -38,6 +42,189 @@
 static wpad_dns_fetch_func wpad_dns_fetch = fetch_get;
 #endif
 
+// Thread pool that candidates are probed on, probed one at a time on the calling thread when not set
+static void *wpad_dns_threadpool;
+
+struct wpad_dns_race_s;
+
+typedef struct wpad_dns_probe_s {
+    // Race the probe belongs to
+    struct wpad_dns_race_s *race;
+    // Candidate index, lower index is a more specific domain
+    int32_t index;
+    // WPAD url to probe
+    char *url;
+    // Script returned by the WPAD url
+    char *script;
+    // Probe has finished
+    bool done;
+} wpad_dns_probe_s;
+
+typedef struct wpad_dns_race_s {
+    // Race state lock
+    void *mutex;
+    // Signalled once a winner is known or all probes have finished
+    void *complete;
+    // Thread that started the race and each queued probe hold a reference
+    int32_t ref_count;
+    // Index of the winning probe or -1
+    int32_t winner;
+    int32_t count;
+    wpad_dns_probe_s *probes;
+    // Lookup deadline of the thread that started the race
+    int64_t deadline;
+} wpad_dns_race_s;
+
+static void wpad_dns_race_release(wpad_dns_race_s *race) {
+    mutex_lock(race->mutex);
+    const int32_t ref_count = --race->ref_count;
+    mutex_unlock(race->mutex);
+    if (ref_count > 0)
+        return;
+
+    for (int32_t i = 0; i < race->count; i++) {
+        free(race->probes[i].url);
+        free(race->probes[i].script);
+    }
+    free(race->probes);
+    event_delete(&race->complete);
+    mutex_delete(&race->mutex);
+    free(race);
+}
+
+static wpad_dns_race_s *wpad_dns_race_create(char **urls, int32_t count) {
+    wpad_dns_race_s *race = (wpad_dns_race_s *)calloc(1, sizeof(wpad_dns_race_s));
+    if (!race)
+        return NULL;
+    race->ref_count = 1;
+    race->winner = -1;
+    race->deadline = deadline_get();
+    race->mutex = mutex_create();
+    race->complete = event_create();
+    race->probes = (wpad_dns_probe_s *)calloc(count, sizeof(wpad_dns_probe_s));
+    if (!race->mutex || !race->complete || !race->probes) {
+        wpad_dns_race_release(race);
+        return NULL;
+    }
+
+    // Probes that are still running after the race is decided outlive the caller's urls
+    race->count = count;
+    for (int32_t i = 0; i < count; i++) {
+        race->probes[i].race = race;
+        race->probes[i].index = i;
+        race->probes[i].url = strdup(urls[i]);
+        if (!race->probes[i].url) {
+            wpad_dns_race_release(race);
+            return NULL;
+        }
+    }
+    return race;
+}
+
+// Pick the most specific candidate that answered once all more specific candidates have failed
+static bool wpad_dns_race_decide(wpad_dns_race_s *race) {
+    for (int32_t i = 0; i < race->count; i++) {
+        if (!race->probes[i].done)
+            return false;
+        if (race->probes[i].script) {
+            race->winner = i;
+            return true;
+        }
+    }
+    return true;
+}
+
+// Record the result of a probe, must hold the race mutex
+static void wpad_dns_race_finish_probe(wpad_dns_race_s *race, wpad_dns_probe_s *probe, char *script) {
+    probe->script = script;
+    probe->done = true;
+    if (race->winner < 0 && wpad_dns_race_decide(race))
+        event_set(race->complete);
+}
+
+static char *wpad_dns_probe_fetch(wpad_dns_probe_s *probe) {
+    char *script = NULL;
+    int32_t error = 0;
+
+    log_info("Checking WPAD URL: %s", probe->url);
+#ifdef PROXYRES_TESTING
+    script = wpad_dns_fetch(probe->url, &error);
+#else
+    script = fetch_get(probe->url, &error);
+#endif
+    if (!script)
+        log_info("No server found at %s (%d)", probe->url, error);
+    return script;
+}
+
+static void wpad_dns_probe(void *arg) {
+    wpad_dns_probe_s *probe = (wpad_dns_probe_s *)arg;
+    wpad_dns_race_s *race = probe->race;
+    char *script = NULL;
+
+    // Skip candidate if a more specific candidate has already won
+    mutex_lock(race->mutex);
+    const bool cancelled = race->winner >= 0 && race->winner < probe->index;
+    mutex_unlock(race->mutex);
+
+    if (!cancelled) {
+        deadline_set(race->deadline);
+        script = wpad_dns_probe_fetch(probe);
+        deadline_set(0);
+    }
+
+    mutex_lock(race->mutex);
+    wpad_dns_race_finish_probe(race, probe, script);
+    mutex_unlock(race->mutex);
+
+    wpad_dns_race_release(race);
+}
+
+// Probe all WPAD urls concurrently and return script from the most specific one that answers
+static char *wpad_dns_race(char **urls, int32_t count, char **url) {
+    char *script = NULL;
+
+    wpad_dns_race_s *race = wpad_dns_race_create(urls, count);
+    if (!race) {
+        log_error("Unable to allocate memory for %s", "WPAD probes");
+        return NULL;
+    }
+
+    for (int32_t i = 0; i < count; i++) {
+        wpad_dns_probe_s *probe = &race->probes[i];
+
+        mutex_lock(race->mutex);
+        const bool is_decided = race->winner >= 0;
+        race->ref_count++;
+        mutex_unlock(race->mutex);
+
+        if (wpad_dns_threadpool && threadpool_enqueue(wpad_dns_threadpool, probe, wpad_dns_probe))
+            continue;
+
+        // Probe on the calling thread when it can not be queued, stopping once a candidate has won
+        char *probe_script = is_decided ? NULL : wpad_dns_probe_fetch(probe);
+        mutex_lock(race->mutex);
+        wpad_dns_race_finish_probe(race, probe, probe_script);
+        race->ref_count--;
+        mutex_unlock(race->mutex);
+    }
+
+    // Less specific candidates still in flight finish on their own and release the race
+    event_wait(race->complete, -1);
+
+    mutex_lock(race->mutex);
+    if (race->winner >= 0) {
+        script = race->probes[race->winner].script;
+        race->probes[race->winner].script = NULL;
+        if (url)
+            *url = strdup(urls[race->winner]);
+    }
+    mutex_unlock(race->mutex);
+
+    wpad_dns_race_release(race);
+    return script;
+}
+
 // Generate NULL-terminated array of WPAD URLs from an FQDN
 char **wpad_dns_get_urls(const char *fqdn, int32_t *count) {
     if (!fqdn || !*fqdn)
@@ -113,10 +300,12 @@ void wpad_dns_free_urls(char **urls) {
     free(urls);
 }
 
-// Request WPAD script using DNS
-char *wpad_dns(const char *fqdn) {
+// Request WPAD script and the url it was found at using DNS
+char *wpad_dns_ex(const char *fqdn, char **url) {
     char hostname[HOST_MAX] = {0};
-    int32_t error = 0;
+
+    if (url)
+        *url = NULL;
 
     if (!fqdn) {
         // Get local hostname
@@ -143,27 +332,26 @@ char *wpad_dns(const char *fqdn) {
         }
     }
 
-    char **urls = wpad_dns_get_urls(fqdn, NULL);
+    int32_t count = 0;
+    char **urls = wpad_dns_get_urls(fqdn, &count);
     if (!urls)
         return NULL;
 
-    char *script = NULL;
-    for (int32_t i = 0; urls[i]; i++) {
-        log_info("Checking next WPAD URL: %s", urls[i]);
-#ifdef PROXYRES_TESTING
-        script = wpad_dns_fetch(urls[i], &error);
-#else
-        script = fetch_get(urls[i], &error);
-#endif
-        if (script)
-            break;
-        log_info("No server found at %s (%d)", urls[i], error);
-    }
+    char *script = wpad_dns_race(urls, count, url);
 
     wpad_dns_free_urls(urls);
     return script;
 }
 
+// Request WPAD script using DNS
+char *wpad_dns(const char *fqdn) {
+    return wpad_dns_ex(fqdn, NULL);
+}
+
+void wpad_dns_set_threadpool(void *threadpool) {
+    wpad_dns_threadpool = threadpool;
+}
+
 #ifdef PROXYRES_TESTING
 void wpad_dns_set_fetch_func(wpad_dns_fetch_func func) {
     wpad_dns_fetch = func ? func : fetch_get;
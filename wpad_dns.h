@@ -4,6 +4,9 @@
 extern "C" {
 #endif
 
+// Most WPAD urls probed at the same time
+#define WPAD_DNS_MAX_PROBES (8)
+
 // Generate NULL-terminated array of WPAD URLs from an FQDN
 char **wpad_dns_get_urls(const char *fqdn, int32_t *count);
 
@@ -13,6 +16,12 @@ void wpad_dns_free_urls(char **urls);
 // Request WPAD script using DNS
 char *wpad_dns(const char *fqdn);
 
+// Request WPAD script and the url it was found at using DNS
+char *wpad_dns_ex(const char *fqdn, char **url);
+
+// Set the thread pool that WPAD urls are probed on concurrently, NULL to probe them one at a time
+void wpad_dns_set_threadpool(void *threadpool);
+
 #ifdef PROXYRES_TESTING
 typedef char *(*wpad_dns_fetch_func)(const char *url, int32_t *error);
 void wpad_dns_set_fetch_func(wpad_dns_fetch_func func);